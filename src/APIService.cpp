@@ -6,6 +6,8 @@ Main function goes here to start vectorDB service
 #include "DataTypes.h"
 #include "Utils.h"
 #include "DB.h"
+#include "Distance.h"
+#include "TaskExecutor.h"
 #include <nlohmann/json.hpp>
 #include <iostream>
 #include <unordered_map>
@@ -29,6 +31,16 @@ int main() {
 // Get the singleton instance as a reference
 vectordb::DB& vec_db = vectordb::DB::getInstance();
 
+//build the distance kernel dispatch table once at startup (cpuid), not on the first query
+std::cout << "[SIMD] distance kernels: " << vectordb::to_string(vectordb::distance_kernels().level) << "\n";
+//same for the worker threads, start the query/index/io lanes now instead of on the first request
+vectordb::TaskExecutor::getInstance().printInfo();
+//collections of the last run come back before the first request, with their WAL replayed
+auto recovered = vec_db.recoverCollections();
+if (!recovered.ok) {
+    std::cerr << "[RECOVERY] " << recovered.message << "\n";
+}
+
 httplib::Server svr;
 svr.Get("/", [&](const httplib::Request& req, httplib::Response& res){
     res.set_content(R"({"Welcome": "Jerry's VectorDB", "status":"ok"})", "application/json");
@@ -164,9 +176,35 @@ svr.Post(R"(/collections/(.+)/query)", [&](const httplib::Request& req, httplib:
             }
         }
 
+        //optional per request recall/latency knobs
+        vectordb::SearchParams search_params;
+        if (json_body.contains("ef_search")) {
+            if (!json_body["ef_search"].is_number_integer() || json_body["ef_search"].get<long long>() <= 0) {
+                vectordb::api_send_error(res, 400, "'ef_search' must be a positive integer", vectordb::APIErrorType::UserInput);
+                return;
+            }
+            search_params.ef_search = json_body["ef_search"];
+        }
+
+        if (json_body.contains("nprobe")) {
+            if (!json_body["nprobe"].is_number_integer() || json_body["nprobe"].get<long long>() <= 0) {
+                vectordb::api_send_error(res, 400, "'nprobe' must be a positive integer", vectordb::APIErrorType::UserInput);
+                return;
+            }
+            search_params.nprobe = json_body["nprobe"];
+        }
+
+        if (json_body.contains("exact")) {
+            if (!json_body["exact"].is_boolean()) {
+                vectordb::api_send_error(res, 400, "'exact' must be a boolean", vectordb::APIErrorType::UserInput);
+                return;
+            }
+            search_params.exact = json_body["exact"];
+        }
+
         std::cout << "=============> Entering query" << std::endl;
 
-        auto result_json = vec_db.queryCollection(collection_name, json_body, using_index, top_k);
+        auto result_json = vec_db.queryCollection(collection_name, json_body, using_index, top_k, search_params);
         
         // Send results
         res.set_content(result_json.dump(), "application/json");
@@ -185,6 +223,44 @@ svr.Post(R"(/collections/(.+)/query)", [&](const httplib::Request& req, httplib:
 });
 
 
+// Delete Points
+//registered before the collection route below, whose (.+) would swallow ".../points" too
+svr.Delete(R"(/collections/([^/]+)/points)", [&](const httplib::Request& req, httplib::Response& res) {
+    try {
+        auto json_body = vectordb::json::parse(req.body);
+        if (!json_body.is_object() || !json_body.contains("points")) {
+            vectordb::api_send_error(res, 400, "Missing 'points' (array of point ids)", vectordb::APIErrorType::UserInput);
+            return;
+        }
+        if (json_body["points"].is_array() && json_body["points"].size() > vectordb::MAX_POINTS_PER_REQUEST) {
+            vectordb::api_send_error(res, 413,
+                "Too many points. Maximum: " + std::to_string(vectordb::MAX_POINTS_PER_REQUEST),
+                vectordb::APIErrorType::UserInput);
+            return;
+        }
+
+        std::string collection_name = req.matches[1];
+        auto deleted = vec_db.deletePointsFromCollection(collection_name, json_body["points"]);
+        if (!deleted.ok()) {
+            vectordb::api_send_error(res, 400, deleted.status().message, vectordb::APIErrorType::UserInput);
+            return;
+        }
+
+        vectordb::json response = {{"status", "ok"}, {"deleted", deleted.value()}};
+        res.set_content(response.dump(), "application/json");
+
+    } catch (const vectordb::json::parse_error &e) {
+        vectordb::api_send_error(res, 400,
+            std::string("Invalid JSON: ") + e.what(),
+            vectordb::APIErrorType::UserInput);
+    } catch (const std::exception &e) {
+        vectordb::api_send_error(res, 500, std::string("Internal server error: ") + e.what(), vectordb::APIErrorType::Server);
+    } catch (...) {
+        vectordb::api_send_error(res, 500, "Unknown error", vectordb::APIErrorType::Connection);
+    }
+});
+
+
 // Delete Collection
 svr.Delete(R"(/collections/(.+))", [&](const httplib::Request& req, httplib::Response& res) {
     try {
@@ -2,34 +2,59 @@
 
 #include "DataTypes.h"
 #include "Status.h"
-#include "Point.h"
 #include "WAL.h"
-#include "PointMemoryPool.h"
+#include "VectorArena.h"
 #include "CollectionInfo.h"
 #include "ImmutableSegment.h"
 #include "QueryResult.h"
+#include "PayloadFilter.h"
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
 #include <functional>
 #include <map>
 
 namespace vectordb {
 
+/**
+ * @brief Appendable segment, the one upserts write into.
+ *
+ * Concurrent ingestion: a writer reserves a slot with the atomic cursor m_next_slot and copies its
+ * row in without any lock (slots are disjoint, every buffer is preallocated to capacity). After
+ * commitSlot() the rows up to the first one still being written become visible, so searches only
+ * ever look at rows [0, m_committed) and never wait on writers. m_mutex is only for deletes, seal
+ * and the final trim before the build, searches take it shared.
+ */
 class ActiveSegment {
 public:
+    //(name, vector) pairs of one point, borrowed for the duration of the call
+    using VectorRefs = std::vector<std::pair<VectorName, const DenseVector*>>;
+
     ActiveSegment(size_t max_capacity, const CollectionInfo& info)
-        : m_pool{std::make_unique<PointMemoryPool>(max_capacity)}
-        , m_info{info}
+        : m_info{info}
         , m_index_spec{info.index_specs}
         , m_max_capacity{max_capacity}
+        , m_segment_id{generateSegmentId()}
     {
-        // // Initialize WAL
-        // m_wal = std::make_unique<WAL>(m_wal_base_path, generateSegmentId());
-        // auto status = m_wal->open();
-        // if (!status.ok()) {
-        //     std::cerr << "Warning: Failed to open WAL: " << status.message() << std::endl;
-        // }
+        initArenas();
+
+        // Initialize WAL, the upserts into this segment log to it (see WAL.h)
+        if (m_info.wal.durability != WalDurability::None) {
+            auto wal = std::make_shared<WAL>("./vectordb/" + m_info.name + "/wal", m_segment_id,
+                                             m_info.wal.durability,
+                                             std::chrono::milliseconds(m_info.wal.commit_window_ms),
+                                             m_info.wal.file_size_mb << 20);
+            auto status = wal->open();
+            if (!status.ok) {
+                std::cerr << "Warning: Failed to open WAL: " << status.message << std::endl;
+            } else {
+                m_wal = std::move(wal);
+            }
+        }
     }
 
     ~ActiveSegment() = default;
@@ -38,99 +63,170 @@ public:
     ActiveSegment(const ActiveSegment&) = delete;
     ActiveSegment& operator=(const ActiveSegment&) = delete;
 
-    //do allow moves though
-    ActiveSegment(ActiveSegment&&) noexcept = default;
-    ActiveSegment& operator=(ActiveSegment&&) noexcept = default;
-
-    //insert single unnamed vector
-    Status insertPoint(PointIdType point_id, const DenseVector& vector) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        // std::cout << "Hello from activeSegment inserting 1 vector\n";
-        auto* point = m_pool->allocatePoint(point_id);
-        if (!point) {
-            return Status::Error("Active segment is full");
-        }
-
-        if (!point->addVector("default", vector)) {
-            m_pool->deallocatePoint(point);
-            return Status::Error("Failed to add vector to point");
+    //no moves, the atomics and the mutex pin it (it lives behind a shared_ptr anyway)
+    ActiveSegment(ActiveSegment&&) = delete;
+    ActiveSegment& operator=(ActiveSegment&&) = delete;
+
+    //Names and dimensions against the collection's vector specs. Only reads m_info, no lock,
+    //so the SegmentHolder checks a point once before it goes looking for a slot.
+    Status validatePoint(const VectorRefs& vectors) const {
+        for (const auto& [name, vec] : vectors) {
+            auto it = m_info.vec_specs.find(name);
+            if (it == m_info.vec_specs.end()) {
+                return Status::Error("Vector name '" + name + "' not found in collection");
+            }
+            if (vec->size() != it->second.dim) {
+                return Status::Error("Vector '" + name + "' has dimension " + std::to_string(vec->size()) +
+                                     ", expected " + std::to_string(it->second.dim));
+            }
         }
-
         return Status::OK();
     }
 
-    //insert multiple named vectors
-    Status insertPoint(PointIdType point_id,
-                       const std::map<VectorName, DenseVector>& named_vectors) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        // std::cout << "Hello from activeSegment inserting multi namedvectors\n";
-        auto* point = m_pool->allocatePoint(point_id);
-        if (!point) {
-            return Status::Error("Active segment is full");
+    //Reserve a slot and write an already validated point into it, no lock taken. `version` is the
+    //SegmentHolder's write counter for this upsert. Returns the slot, or nullopt once the segment is
+    //full or sealed (the caller moves on to the next active segment). The row stays invisible to
+    //searches until commitSlot(slot).
+    std::optional<size_t> appendPoint(const PointIdType& point_id, const VectorRefs& vectors,
+                                      const Payload& payload, uint64_t version) {
+        const size_t slot = m_next_slot.fetch_add(1);
+        if (slot >= m_max_capacity) {
+            return std::nullopt;
         }
 
-        for (const auto& [name, vec] : named_vectors) {
-            if (!point->addVector(name, vec)) {
-                m_pool->deallocatePoint(point);
-                return Status::Error("Too many named vectors for TinyMap capacity");
-            }
+        //cosine rows are stored normalized, so the immutable build can use the arena as-is
+        for (const auto& [name, vec] : vectors) {
+            const bool normalize = m_info.vec_specs.at(name).metric == DistanceMetric::COSINE;
+            m_data.arenas.at(name).write(slot, vec->data(), normalize);
         }
+        m_data.point_ids[slot] = point_id;
+        m_data.payloads[slot] = projectIndexedFields(payload, m_info.payload_index);
+        m_data.versions[slot] = version;
+        return slot;
+    }
 
-        return Status::OK();
+    //Mark a slot written and move the visible watermark over every finished slot in a row. Whoever
+    //finishes the slot the watermark is stuck on carries it past the ones finished after it.
+    void commitSlot(size_t slot) {
+        m_slot_ready[slot].store(1);
+        size_t committed = m_committed.load();
+        while (committed < m_max_capacity && m_slot_ready[committed].load()) {
+            if (m_committed.compare_exchange_weak(committed, committed + 1)) ++committed;
+        }
     }
 
-    //Check if indexing threshold is reached
+    //Check if indexing threshold is reached (counting slots still being written)
     bool shouldIndex() const {
-        return getPointCount() >= m_index_spec.index_threshold;
+        return getReservedCount() >= m_index_spec.index_threshold;
     }
 
     //Check if segment is full
     bool isFull() const {
-        return getPointCount() >= m_max_capacity;
+        return getReservedCount() >= m_max_capacity;
     }
 
-    //Get a copy of the data from this activeSegment obj and put them in immutableSegment for index building, then clearPool 
-    //for the next incoming vector data. I choose to copy to keep it safe and simple...i will optimize in future.
-    StatusOr<std::unique_ptr<ImmutableSegment>> convertToImmutable() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        //Extract data safely by copying
-        SegPointData point_data;
-        // Lock only as long as needed for extracting data, then unlock before doing heavier stuff
-        auto points = m_pool->getAllPoints();
-        if (points.empty()) {
-            return Status::Error("No points to convert");
-        }
+    //Stop taking inserts. The SegmentHolder seals a full segment and swaps in a fresh one,
+    //the sealed one stays searchable (brute force) until its immutableSegment is published.
+    //Moving the cursor to the end turns every later appendPoint() away; writers that already
+    //hold a slot finish normally and convertToImmutable() waits for them.
+    void seal() {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_sealed) return;
+        m_sealed = true;
+        m_sealed_rows = std::min(m_next_slot.exchange(m_max_capacity), m_max_capacity);
+    }
 
-        point_data.reserve(points.size());
-        for (const auto* point : points) {
-            point_data.emplace_back(point->getId(), point->getAllVectors());
+    bool isSealed() const {
+        return m_sealed;
+    }
+
+    //Tombstone these slots (the SegmentHolder knows where each point id lives), returns how many
+    //were newly deleted. Before sealing the rows also drop out of the arenas, so the later index
+    //build never sees them. Once sealed the arenas belong to the build (it reads them unlocked), so
+    //only the tombstone is set and the SegmentHolder re-applies deletedSlots() to the immutableSegment
+    //when it is published.
+    //A writer can tombstone its own slot before committing it (it lost to a newer upsert of the same id).
+    size_t deleteSlots(const std::vector<size_t>& slots) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        size_t removed = 0;
+        for (size_t slot : slots) {
+            if (slot >= m_max_capacity || m_deleted[slot]) continue;
+            m_deleted[slot] = 1;
+            ++m_num_deleted;
+            ++removed;
+            if (!m_sealed) {
+                for (auto& [_, arena] : m_data.arenas) arena.erase(slot);
+                m_data.payloads[slot] = Payload{};
+            }
         }
+        return removed;
+    }
 
-        try {
-            SegmentIdType seg_id = generateSegmentId();
-            auto immutable_segment = std::make_unique<ImmutableSegment>(point_data, m_info, seg_id);
-            
-            //CLEAR THE POOL AFTER SUCCESSFUL CONVERSION
-            m_pool->clearPool();
+    //slots that were tombstoned, the immutableSegment built from this segment uses the same slots
+    std::vector<size_t> deletedSlots() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        std::vector<size_t> slots;
+        slots.reserve(m_num_deleted);
+        for (size_t slot = 0; slot < m_deleted.size(); ++slot) {
+            if (m_deleted[slot]) slots.push_back(slot);
+        }
+        return slots;
+    }
 
-            return immutable_segment;
+    //Build an immutableSegment from this sealed segment. First wait for writers that reserved a slot
+    //before the seal, then trim the preallocated buffers to the rows actually written. From there the
+    //arenas never change, so the build reads them without holding m_mutex and searches on this
+    //segment keep going meanwhile. The vectors are not copied, the FAISS build and k-means read the
+    //arena buffers directly.
+    StatusOr<std::unique_ptr<ImmutableSegment>> convertToImmutable() {
+        size_t rows = 0;
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            if (!m_sealed) {
+                return Status::Error("Active segment must be sealed before conversion");
+            }
+            rows = m_sealed_rows;
+        }
+        while (m_committed.load() < rows) {
+            std::this_thread::yield(); //a row copy, the writer is microseconds away
+        }
+        //every writer logged before committing its slot, nothing goes into this WAL any more
+        if (m_wal) m_wal->close();
+        {
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            if (rows == 0) {
+                return Status::Error("No points to convert");
+            }
+            m_data.point_ids.resize(rows);
+            m_data.payloads.resize(rows);
+            m_data.versions.resize(rows);
+        }
 
+        try {
+            return std::make_unique<ImmutableSegment>(m_data, m_info, m_segment_id);
         } catch (const std::exception& e) {
             return Status::Error(std::string("ImmutableSegment creation failed: ") + e.what());
         }
     }
 
+    const SegmentIdType& getSegmentId() const {
+        return m_segment_id;
+    }
 
-    // Get all points for conversion to immutable segment
-    std::vector<Point*> getAllPoints() const {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        return m_pool->getAllPoints();
+    //null when the collection runs without a WAL (or it failed to open)
+    const std::shared_ptr<WAL>& getWal() const {
+        return m_wal;
     }
 
     // Get statistics about the segment
+    //points visible to searches
     size_t getPointCount() const {
-        return m_pool->getTotalAllocated();
+        return m_committed.load();
+    }
+
+    //slots handed out so far, including ones still being written
+    size_t getReservedCount() const {
+        return std::min(m_next_slot.load(), m_max_capacity);
     }
 
     size_t getMaxCapacity() const {
@@ -146,9 +242,11 @@ public:
     // }
     QueryResult searchTopK(const std::string& vector_name,
                            const std::vector<DenseVector>& query_vectors,
-                           size_t k) const 
+                           size_t k,
+                           const SegmentFilter& filter = {}) const 
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        const size_t num_rows = m_committed.load(); //rows past this may still be half written
         // std::cout << "In ActiveSeg searchTopK\n";
         // std::cout << "[DEBUG] searchTopK k=" << k << "\n";
         // std::cout << "[DEBUG] searchTopK got " << query_vectors.size() << " query vectors\n";
@@ -187,10 +285,8 @@ public:
                 }
             }
 
-            // Get all points from the pool
-            auto points = m_pool->getAllPoints();
-            
-            if (points.empty() || query_vectors.empty()) {
+            auto arena_it = m_data.arenas.find(vector_name);
+            if (arena_it == m_data.arenas.end() || num_rows == 0 || query_vectors.empty()) {
                 query_result.status = Status::OK();
                 // Add empty results for each query
                 for (size_t i = 0; i < query_vectors.size(); ++i) {
@@ -199,114 +295,42 @@ public:
                 return query_result;
             }
 
-            // Pre-filter points that have the target vector name and cache their data
-            std::vector<PointIdType> valid_point_ids;
-            std::vector<DenseVector> valid_vectors;
-
-            for (const Point* point : points) {
-                auto vec_opt = point->getVector(vector_name);
-                if (!vec_opt.has_value()) {
-                    std::cout << "[WARN] point " << point->getId() << " missing vector " << vector_name << "\n";
-                    continue;
-                }
-
-                const DenseVector& v = vec_opt.value();
-                if (v.empty()) {
-                    std::cout << "[WARN] point " << point->getId() << " vector empty\n";
-                    continue;
-                }
-
-                valid_vectors.push_back(v); 
-                valid_point_ids.push_back(point->getId());
-
-            }
-
-            // -----------------------After collecting points and valid_vectors:
-            std::cout << "[DEBUG] ActiveSegment: total points in pool=" << points.size()
-                    << ", valid_vectors=" << valid_vectors.size() << "\n";
-            //---------------------------------------------------------
+            //the arena is already one contiguous row-major block with cached norms,
+            //so we can score straight out of it, no per point copies.
+            const VectorArena& arena = arena_it->second;
 
-            if (valid_vectors.empty()) {
-                query_result.status = Status::OK(); // No matching points is not an error
-                // Return empty results for each query
-                for (size_t i = 0; i < query_vectors.size(); ++i) {
-                    query_result.results.push_back(QueryBatchResult{});
-                }
-                return query_result;
+            const size_t nq = query_vectors.size();
+            std::vector<float> flat_queries;
+            flat_queries.reserve(nq * expected_dim);
+            for (const auto& qvec : query_vectors) {
+                flat_queries.insert(flat_queries.end(), qvec.begin(), qvec.end());
             }
 
-            std::cout << "hello\n";
-            // Process each query vector
-            for (const auto& query_vector : query_vectors) {
-                std::cout << "[DEBUG] new query start\n";
-                QueryBatchResult batch_result;
-                std::vector<ScoredId> scored_points;
-                scored_points.reserve(valid_vectors.size());
-                std::cout << "[DEBUG] valid_vectors.size()=" << valid_vectors.size() << "\n";
-                
-                //-------------------
-                for (size_t i = 0; i < valid_vectors.size(); ++i) {
-                    try {
-                        float score = compute_distance(metric, query_vector, valid_vectors[i]);
-                        // Unify metric convention: higher = better
-                        if (metric == DistanceMetric::L2)
-                            score = -score;
-                        score = std::round(score * 10000.0f) / 10000.0f; //just round to 4 digits
-                        // if (i < 3) std::cout << "[DEBUG] i=" << i << " score=" << score << "\n";
-                        scored_points.emplace_back(ScoredId{valid_point_ids[i], score});
-                    } catch (const std::exception& e) {
-                        std::cerr << "[ERROR] compute_distance threw: " << e.what()
-                                << " for i=" << i << " qsize=" << query_vector.size()
-                                << " stored.size=" << (valid_vectors[i]).size()
-                                << "\n";
-                        // skip this point and continue — don't abort whole query
-                        continue;
-                    }
-                }
-                //--------------------
-                std::cout << "[DEBUG] scored_points.size()=" << scored_points.size() << "\n";
-                // Sort based on metric type and take top K
-                if (metric == DistanceMetric::L2) {
-                    // For L2, lower distance is better, but since i negate the score, so higher the better
-                    if (scored_points.size() > k) {
-                        std::partial_sort(
-                            scored_points.begin(),
-                            scored_points.begin() + k,
-                            scored_points.end(),
-                            [](const ScoredId& a, const ScoredId& b) {
-                                return a.score > b.score;
-                            }
-                        );
-                        batch_result.hits.assign(scored_points.begin(), scored_points.begin() + k);
-                    } else {
-                        std::sort(scored_points.begin(), scored_points.end(),
-                                [](const ScoredId& a, const ScoredId& b) {
-                                    return a.score > b.score;
-                                });
-                        batch_result.hits = std::move(scored_points);
-                    }
-                } else {
-                    // For DOT and COSINE, higher score is better
-                    if (scored_points.size() > k) {
-                        std::partial_sort(
-                            scored_points.begin(),
-                            scored_points.begin() + k,
-                            scored_points.end(),
-                            [](const ScoredId& a, const ScoredId& b) {
-                                return a.score > b.score;
-                            }
-                        );
-                        batch_result.hits.assign(scored_points.begin(), scored_points.begin() + k);
-                    } else {
-                        std::sort(scored_points.begin(), scored_points.end(),
-                                [](const ScoredId& a, const ScoredId& b) {
-                                    return a.score > b.score;
-                                });
-                        batch_result.hits = std::move(scored_points);
+            //filtered: fold the filter into the presence mask, blockTopK already skips those rows.
+            //If every condition is on an indexed field the projected payloads we keep answer it,
+            //otherwise ask the payload store. Tombstones of a sealed segment go into the same mask.
+            const uint8_t* row_mask = arena.present();
+            std::vector<uint8_t> filter_mask;
+            if (filter || (m_sealed && m_num_deleted > 0)) {
+                const bool in_memory = filter && filter.filter->coveredBy(m_info.payload_index);
+                filter_mask.assign(num_rows, 0);
+                for (size_t row = 0; row < num_rows; ++row) {
+                    if (!row_mask[row] || m_deleted[row]) continue;
+                    bool pass = true;
+                    if (filter) {
+                        pass = in_memory ? filter.filter->matchesProjected(m_data.payloads[row])
+                                         : (filter.fallback && filter.fallback(m_data.point_ids[row]));
                     }
+                    filter_mask[row] = pass ? 1 : 0;
                 }
+                row_mask = filter_mask.data();
+            }
 
-                query_result.results.push_back(std::move(batch_result));
+            auto top_hits = blockTopK(metric, flat_queries.data(), nq,
+                                      arena.data(), arena.norms(), row_mask, m_data.point_ids,
+                                      m_data.versions, num_rows, expected_dim, k);
+            for (auto& hits : top_hits) {
+                query_result.results.push_back(QueryBatchResult{std::move(hits)});
             }
 
             query_result.status = Status::OK();
@@ -325,16 +349,8 @@ public:
         return query_result;
     }
 
-private:
-    SegmentType seg_type{SegmentType::Appendable};
-    std::unique_ptr<PointMemoryPool> m_pool;
-    CollectionInfo m_info;
-    IndexSpec m_index_spec;
-    size_t m_max_capacity;
-    mutable std::mutex m_mutex;
-    std::unique_ptr<WAL> m_wal;
-
     //generate UUID-based segment ID, not sure if i should make it static, but for now sure.
+    //public so compaction can name the segments it merges into the same way.
     static std::string generateSegmentId() {
         uuid_t uuid;
         uuid_generate(uuid);
@@ -344,6 +360,93 @@ private:
         
         return "Segment_" + std::string(uuid_str);
     }
+
+private:
+    //Score all queries against a contiguous block of stored vectors with compute_distance_matrix()
+    //and keep the best k per query. The base is consumed in chunks so the score scratch stays
+    //small (nq x SCORE_CHUNK_ROWS floats) no matter how many points are in the segment.
+    //Rows with present[j] == 0 are scored anyway (cheaper than gathering) but never kept.
+    static std::vector<std::vector<ScoredId>> blockTopK(DistanceMetric metric,
+                                                        const float* queries, size_t nq,
+                                                        const float* base, const float* base_norms,
+                                                        const uint8_t* present,
+                                                        const std::vector<PointIdType>& ids,
+                                                        const std::vector<uint64_t>& versions,
+                                                        size_t nb, size_t dim, size_t k)
+    {
+        static constexpr size_t SCORE_CHUNK_ROWS = 1024;
+
+        //min-heap per query on score, the top is the worst of the current best k
+        auto worse = [](const ScoredId& a, const ScoredId& b) { return a.score > b.score; };
+        std::vector<std::vector<ScoredId>> heaps(nq);
+        for (auto& h : heaps) h.reserve(k + 1);
+
+        std::vector<float> scores;
+        for (size_t begin = 0; begin < nb; begin += SCORE_CHUNK_ROWS) {
+            const size_t rows = std::min(SCORE_CHUNK_ROWS, nb - begin);
+            scores.resize(nq * rows);
+            compute_distance_matrix(metric, queries, nq, base + begin * dim, rows, dim, scores.data(),
+                                    base_norms ? base_norms + begin : nullptr);
+
+            for (size_t qi = 0; qi < nq; ++qi) {
+                auto& heap = heaps[qi];
+                const float* row = scores.data() + qi * rows;
+                for (size_t j = 0; j < rows; ++j) {
+                    if (present && !present[begin + j]) continue;
+                    //unify metric convention: higher = better, so negate the L2 distance
+                    float score = (metric == DistanceMetric::L2) ? -row[j] : row[j];
+                    if (heap.size() < k) {
+                        heap.push_back(ScoredId{ids[begin + j], score, versions[begin + j]});
+                        std::push_heap(heap.begin(), heap.end(), worse);
+                    } else if (k > 0 && score > heap.front().score) {
+                        std::pop_heap(heap.begin(), heap.end(), worse);
+                        heap.back() = ScoredId{ids[begin + j], score, versions[begin + j]};
+                        std::push_heap(heap.begin(), heap.end(), worse);
+                    }
+                }
+            }
+        }
+
+        for (auto& heap : heaps) {
+            std::sort_heap(heap.begin(), heap.end(), worse); //best first
+            for (auto& hit : heap) {
+                hit.score = std::round(hit.score * 10000.0f) / 10000.0f; //just round to 4 digits
+            }
+        }
+        return heaps;
+    }
+
+    //(re)create one empty arena per vector space, sized for the whole segment
+    //every per slot buffer is allocated to capacity up front: writers fill their own slot without
+    //a lock, so nothing may ever reallocate underneath a concurrent reader or writer
+    void initArenas() {
+        m_data.point_ids.assign(m_max_capacity, PointIdType{});
+        m_data.payloads.assign(m_max_capacity, Payload{});
+        m_data.versions.assign(m_max_capacity, 0);
+        m_deleted.assign(m_max_capacity, 0);
+        m_num_deleted = 0;
+        m_slot_ready = std::make_unique<std::atomic<uint8_t>[]>(m_max_capacity);
+        m_data.arenas.clear();
+        for (const auto& [name, spec] : m_info.vec_specs) {
+            m_data.arenas.emplace(name, VectorArena(spec.dim, m_max_capacity));
+        }
+    }
+
+    SegmentType seg_type{SegmentType::Appendable};
+    SegmentVectorData m_data;
+    CollectionInfo m_info;
+    IndexSpec m_index_spec;
+    size_t m_max_capacity;
+    SegmentIdType m_segment_id;
+    std::atomic<bool> m_sealed{false};
+    size_t m_sealed_rows{0}; //slots handed out before the seal, under m_mutex
+    std::atomic<size_t> m_next_slot{0}; //slot reservation cursor, pushed to m_max_capacity by seal()
+    std::atomic<size_t> m_committed{0}; //rows [0, m_committed) are fully written, what searches see
+    std::unique_ptr<std::atomic<uint8_t>[]> m_slot_ready; //per slot: written, possibly waiting on an earlier one
+    std::vector<uint8_t> m_deleted; //per slot tombstone
+    size_t m_num_deleted{0};
+    mutable std::shared_mutex m_mutex; //deletes, seal and the pre build trim; searches take it shared
+    std::shared_ptr<WAL> m_wal; //shared: requests waiting on it (WalBatch) may outlive the segment
 };
 
 } // namespace vectordb
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "BitmapIndex.h"
+
+#include <faiss/Index.h>
+
+/**
+ * @brief Adapts a BitmapIndex over FAISS offsets to faiss::IDSelector.
+ *
+ * FAISS asks is_member() for every candidate it is about to score (HNSW while walking the graph,
+ * IVF per list entry, Flat per row), so this is on the hot path: contains() instead of the
+ * throwing get(). The bitmap is borrowed, it has to outlive the search call.
+ */
+namespace vectordb {
+
+class BitmapIDSelector : public faiss::IDSelector {
+public:
+    explicit BitmapIDSelector(const BitmapIndex& bitmap) : m_bitmap{bitmap} {}
+
+    bool is_member(faiss::idx_t id) const override {
+        return id >= 0 && m_bitmap.contains(static_cast<size_t>(id));
+    }
+
+private:
+    const BitmapIndex& m_bitmap;
+};
+
+} // namespace vectordb
@@ -1,6 +1,6 @@
 /*
-BitmapIndex indexing for mark delete and pre-filtering, and 
-multi-tenancy (store multiple users’ data in the same collection and 
+BitmapIndex indexing for mark delete and pre-filtering, and
+multi-tenancy (store multiple users’ data in the same collection and
 filter queries by user_id (or tenant_id).)
 
 Multi-tenancy = multiple users (tenants) share the same collection and storage.
@@ -20,10 +20,36 @@ Bitmap:   0 1 1 0 0 0 1 0 0 0
 Intersection = bitwise AND:
 ID:       0 1 2 3 4 5 6 7 8 9
 result    0 1 0 0 0 0 1 0 0 0 = candidate IDs {1, 6}
+
+(update) This used to be one flat std::vector<uint64_t>, so a tenant with 50 points out of
+5 million still cost 610KB per bitmap and every AND walked all of it. Now it is roaring style:
+the id space is cut into chunks of 2^16 ids, keyed by the high 16 bits, and each chunk that has
+anything in it gets the smallest of three containers:
+
+    array  : sorted uint16 low bits, for <= 4096 ids (2 bytes per id)
+    bitset : 1024 x uint64, for dense chunks (always 8KB)
+    run    : (start, length) pairs, for long stretches of ones like "every point" (4 bytes per run)
+
+    ids 5, 9, 70000..70099:
+    key 0 -> array  [5, 9]
+    key 1 -> run    [(4464, 99)]          70000 = 1 << 16 | 4464
+
+Empty chunks cost nothing. AND/OR/ANDNOT go chunk by chunk, bitset-bitset pairs use the
+AVX2/AVX-512 kernels below (picked at runtime like Distance.h), cardinalities are kept per
+container with popcount, and iteration over a bitset jumps to the next set bit with ctz
+instead of testing all 65536 bits.
 */
 #pragma once
 
+#include "CpuFeatures.h"
+
+#ifdef VECTORDB_X86
+#include <immintrin.h>
+#endif
+#include <algorithm>
 #include <iostream>
+#include <istream>
+#include <ostream>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -33,74 +59,877 @@ result    0 1 0 0 0 0 1 0 0 0 = candidate IDs {1, 6}
 
 namespace vectordb {
 
+namespace bitmap_detail {
+
+inline constexpr uint32_t CHUNK_BITS = 65536;             //ids per container
+inline constexpr size_t BITSET_WORDS = CHUNK_BITS / 64;  //1024 words = 8KB
+inline constexpr uint32_t ARRAY_MAX_CARD = 4096;          //above this a bitset is smaller than an array
+inline constexpr uint64_t MAX_BITS = uint64_t{1} << 32;   //16 bit key + 16 bit low bits
+
+//------------------------------- bitset kernels -------------------------------
+//out = a op b over one 8KB bitset container, returns the popcount of out. out may be a (in place ops).
+enum BitsetOp { BitsetAnd, BitsetOr, BitsetAndNot };
+
+template <int OP>
+inline uint64_t scalar_word_op(uint64_t a, uint64_t b) noexcept {
+    if constexpr (OP == BitsetAnd) return a & b;
+    else if constexpr (OP == BitsetOr) return a | b;
+    else return a & ~b;
+}
+
+template <int OP>
+inline uint32_t scalar_bitset_op(const uint64_t* a, const uint64_t* b, uint64_t* out) noexcept {
+    uint32_t card = 0;
+    for (size_t i = 0; i < BITSET_WORDS; ++i) {
+        out[i] = scalar_word_op<OP>(a[i], b[i]);
+        card += static_cast<uint32_t>(__builtin_popcountll(out[i]));
+    }
+    return card;
+}
+
+#ifdef VECTORDB_X86
+template <int OP>
+VECTORDB_TARGET_AVX2
+inline uint32_t avx2_bitset_op(const uint64_t* a, const uint64_t* b, uint64_t* out) noexcept {
+    uint32_t card = 0;
+    for (size_t i = 0; i < BITSET_WORDS; i += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i r;
+        if constexpr (OP == BitsetAnd) r = _mm256_and_si256(va, vb);
+        else if constexpr (OP == BitsetOr) r = _mm256_or_si256(va, vb);
+        else r = _mm256_andnot_si256(vb, va); //~b & a
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), r);
+        card += static_cast<uint32_t>(__builtin_popcountll(out[i]) + __builtin_popcountll(out[i + 1]) +
+                                      __builtin_popcountll(out[i + 2]) + __builtin_popcountll(out[i + 3]));
+    }
+    return card;
+}
+
+template <int OP>
+VECTORDB_TARGET_AVX512
+inline uint32_t avx512_bitset_op(const uint64_t* a, const uint64_t* b, uint64_t* out) noexcept {
+    uint32_t card = 0;
+    for (size_t i = 0; i < BITSET_WORDS; i += 8) {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + i);
+        __m512i r;
+        if constexpr (OP == BitsetAnd) r = _mm512_and_si512(va, vb);
+        else if constexpr (OP == BitsetOr) r = _mm512_or_si512(va, vb);
+        else r = _mm512_andnot_si512(vb, va); //~b & a
+        _mm512_storeu_si512(out + i, r);
+        for (size_t j = 0; j < 8; ++j) {
+            card += static_cast<uint32_t>(__builtin_popcountll(out[i + j]));
+        }
+    }
+    return card;
+}
+#endif //VECTORDB_X86
+
+using BitsetKernelFn = uint32_t (*)(const uint64_t*, const uint64_t*, uint64_t*) noexcept;
+
+struct BitsetKernels {
+    BitsetKernelFn and_op;
+    BitsetKernelFn or_op;
+    BitsetKernelFn andnot_op;
+};
+
+inline BitsetKernels select_bitset_kernels(SimdLevel level) noexcept {
+    switch (level) {
+#ifdef VECTORDB_X86
+        case SimdLevel::AVX512:
+            return {avx512_bitset_op<BitsetAnd>, avx512_bitset_op<BitsetOr>, avx512_bitset_op<BitsetAndNot>};
+        case SimdLevel::AVX2:
+            return {avx2_bitset_op<BitsetAnd>, avx2_bitset_op<BitsetOr>, avx2_bitset_op<BitsetAndNot>};
+#endif
+        default:
+            return {scalar_bitset_op<BitsetAnd>, scalar_bitset_op<BitsetOr>, scalar_bitset_op<BitsetAndNot>};
+    }
+}
+
+inline const BitsetKernels& bitset_kernels() noexcept {
+    static const BitsetKernels kernels = select_bitset_kernels(detect_simd_level());
+    return kernels;
+}
+
+//------------------------------- containers -------------------------------
+struct Run {
+    uint16_t start;
+    uint16_t length; //covers start .. start + length (inclusive), so one run can hold all 65536
+};
+
+struct Container {
+    enum class Type : uint8_t { Array = 0, Bitset = 1, Run = 2 };
+
+    Type type{Type::Array};
+    uint32_t card{0};
+    std::vector<uint16_t> array; //Array: sorted
+    std::vector<uint64_t> bits;  //Bitset: BITSET_WORDS words
+    std::vector<Run> runs;       //Run: sorted, not overlapping
+
+    bool contains(uint16_t v) const noexcept {
+        switch (type) {
+            case Type::Array:
+                return std::binary_search(array.begin(), array.end(), v);
+            case Type::Bitset:
+                return (bits[v >> 6] >> (v & 63)) & 1ULL;
+            default: {
+                //last run starting at or before v
+                auto it = std::upper_bound(runs.begin(), runs.end(), v,
+                                           [](uint16_t x, const Run& r) { return x < r.start; });
+                if (it == runs.begin()) return false;
+                --it;
+                return static_cast<uint32_t>(v) <= static_cast<uint32_t>(it->start) + it->length;
+            }
+        }
+    }
+
+    size_t bytes() const noexcept {
+        return array.capacity() * sizeof(uint16_t) + bits.capacity() * sizeof(uint64_t) + runs.capacity() * sizeof(Run);
+    }
+};
+
+template <typename F>
+inline void forEachValue(const Container& c, F&& fn) {
+    switch (c.type) {
+        case Container::Type::Array:
+            for (uint16_t v : c.array) fn(v);
+            break;
+        case Container::Type::Bitset:
+            for (size_t w = 0; w < BITSET_WORDS; ++w) {
+                uint64_t word = c.bits[w];
+                while (word) {
+                    const uint32_t bit = static_cast<uint32_t>(__builtin_ctzll(word));
+                    fn(static_cast<uint16_t>(w * 64 + bit));
+                    word &= word - 1; //drop the lowest set bit
+                }
+            }
+            break;
+        default:
+            for (const Run& r : c.runs) {
+                const uint32_t end = static_cast<uint32_t>(r.start) + r.length;
+                for (uint32_t v = r.start; v <= end; ++v) fn(static_cast<uint16_t>(v));
+            }
+            break;
+    }
+}
+
+//set bits [begin, end) of a bitset container
+inline void setBitRange(uint64_t* bits, uint32_t begin, uint32_t end) noexcept {
+    while (begin < end) {
+        const uint32_t offset = begin & 63;
+        const uint32_t n = std::min<uint32_t>(64 - offset, end - begin);
+        const uint64_t mask = (n == 64) ? ~uint64_t{0} : (((uint64_t{1} << n) - 1) << offset);
+        bits[begin >> 6] |= mask;
+        begin += n;
+    }
+}
+
+inline uint32_t popcountBits(const std::vector<uint64_t>& bits) noexcept {
+    uint32_t card = 0;
+    for (uint64_t word : bits) card += static_cast<uint32_t>(__builtin_popcountll(word));
+    return card;
+}
+
+inline void toBitset(Container& c) {
+    if (c.type == Container::Type::Bitset) return;
+    std::vector<uint64_t> bits(BITSET_WORDS, 0);
+    if (c.type == Container::Type::Array) {
+        for (uint16_t v : c.array) bits[v >> 6] |= uint64_t{1} << (v & 63);
+    } else {
+        for (const Run& r : c.runs) {
+            setBitRange(bits.data(), r.start, static_cast<uint32_t>(r.start) + r.length + 1);
+        }
+    }
+    c.bits = std::move(bits);
+    std::vector<uint16_t>().swap(c.array);
+    std::vector<Run>().swap(c.runs);
+    c.type = Container::Type::Bitset;
+}
+
+inline void toArray(Container& c) {
+    if (c.type == Container::Type::Array) return;
+    std::vector<uint16_t> array;
+    array.reserve(c.card);
+    forEachValue(c, [&](uint16_t v) { array.push_back(v); });
+    c.array = std::move(array);
+    std::vector<uint64_t>().swap(c.bits);
+    std::vector<Run>().swap(c.runs);
+    c.type = Container::Type::Array;
+}
+
+inline void toRuns(Container& c) {
+    if (c.type == Container::Type::Run) return;
+    std::vector<Run> runs;
+    uint32_t start = 0, prev = 0;
+    bool open = false;
+    forEachValue(c, [&](uint16_t v) {
+        if (open && v == prev + 1) {
+            prev = v;
+            return;
+        }
+        if (open) runs.push_back({static_cast<uint16_t>(start), static_cast<uint16_t>(prev - start)});
+        start = prev = v;
+        open = true;
+    });
+    if (open) runs.push_back({static_cast<uint16_t>(start), static_cast<uint16_t>(prev - start)});
+    c.runs = std::move(runs);
+    std::vector<uint16_t>().swap(c.array);
+    std::vector<uint64_t>().swap(c.bits);
+    c.type = Container::Type::Run;
+}
+
+//array or bitset, whichever fits the cardinality (runs are only kept when runOptimize picks them)
+inline void materialize(Container& c) {
+    if (c.card <= ARRAY_MAX_CARD) toArray(c);
+    else toBitset(c);
+}
+
+//a bitset that got sparse goes back to an array
+inline void shrinkBitset(Container& c) {
+    if (c.type == Container::Type::Bitset && c.card <= ARRAY_MAX_CARD) toArray(c);
+}
+
+//pick the smallest of array / bitset / run for what is in there
+inline void runOptimize(Container& c) {
+    if (c.card == 0) return;
+    size_t num_runs = 0;
+    uint32_t prev = 0;
+    bool first = true;
+    forEachValue(c, [&](uint16_t v) {
+        if (first || v != prev + 1) ++num_runs;
+        prev = v;
+        first = false;
+    });
+
+    const size_t run_bytes = num_runs * sizeof(Run);
+    const size_t array_bytes = (c.card <= ARRAY_MAX_CARD) ? c.card * sizeof(uint16_t) : SIZE_MAX;
+    const size_t bitset_bytes = BITSET_WORDS * sizeof(uint64_t);
+    if (run_bytes < array_bytes && run_bytes < bitset_bytes) toRuns(c);
+    else if (array_bytes <= bitset_bytes) toArray(c);
+    else toBitset(c);
+}
+
+inline bool addValue(Container& c, uint16_t v) {
+    switch (c.type) {
+        case Container::Type::Array: {
+            if (c.array.empty() || c.array.back() < v) {
+                c.array.push_back(v); //ids mostly come in increasing order
+            } else {
+                auto it = std::lower_bound(c.array.begin(), c.array.end(), v);
+                if (it != c.array.end() && *it == v) return false;
+                c.array.insert(it, v);
+            }
+            ++c.card;
+            if (c.card > ARRAY_MAX_CARD) toBitset(c);
+            return true;
+        }
+        case Container::Type::Bitset: {
+            uint64_t& word = c.bits[v >> 6];
+            const uint64_t mask = uint64_t{1} << (v & 63);
+            if (word & mask) return false;
+            word |= mask;
+            ++c.card;
+            return true;
+        }
+        default:
+            if (c.contains(v)) return false;
+            materialize(c);
+            return addValue(c, v);
+    }
+}
+
+inline bool removeValue(Container& c, uint16_t v) {
+    switch (c.type) {
+        case Container::Type::Array: {
+            auto it = std::lower_bound(c.array.begin(), c.array.end(), v);
+            if (it == c.array.end() || *it != v) return false;
+            c.array.erase(it);
+            --c.card;
+            return true;
+        }
+        case Container::Type::Bitset: {
+            uint64_t& word = c.bits[v >> 6];
+            const uint64_t mask = uint64_t{1} << (v & 63);
+            if (!(word & mask)) return false;
+            word &= ~mask;
+            --c.card;
+            shrinkBitset(c);
+            return true;
+        }
+        default:
+            if (!c.contains(v)) return false;
+            materialize(c);
+            return removeValue(c, v);
+    }
+}
+
+//binary ops below work on arrays and bitsets, a run container gets a materialized copy first
+inline const Container& plain(const Container& c, Container& scratch) {
+    if (c.type != Container::Type::Run) return c;
+    scratch = c;
+    materialize(scratch);
+    return scratch;
+}
+
+inline void intersectArrays(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b, std::vector<uint16_t>& out) {
+    const auto& small = a.size() <= b.size() ? a : b;
+    const auto& large = a.size() <= b.size() ? b : a;
+    out.reserve(small.size());
+    if (small.size() * 32 < large.size()) {
+        //very lopsided (one tenant vs a big category): binary search the small side into the large one
+        auto from = large.begin();
+        for (uint16_t v : small) {
+            from = std::lower_bound(from, large.end(), v);
+            if (from == large.end()) break;
+            if (*from == v) out.push_back(v);
+        }
+        return;
+    }
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+}
+
+inline Container andContainers(const Container& a, const Container& b) {
+    if (a.card == CHUNK_BITS) return b; //a full chunk (fill()) changes nothing
+    if (b.card == CHUNK_BITS) return a;
+
+    Container sa, sb;
+    const Container& x = plain(a, sa);
+    const Container& y = plain(b, sb);
+    Container out;
+    if (x.type == Container::Type::Array && y.type == Container::Type::Array) {
+        intersectArrays(x.array, y.array, out.array);
+        out.card = static_cast<uint32_t>(out.array.size());
+    } else if (x.type == Container::Type::Array || y.type == Container::Type::Array) {
+        const Container& arr = (x.type == Container::Type::Array) ? x : y;
+        const Container& set = (x.type == Container::Type::Array) ? y : x;
+        out.array.reserve(arr.card);
+        for (uint16_t v : arr.array) {
+            if ((set.bits[v >> 6] >> (v & 63)) & 1ULL) out.array.push_back(v);
+        }
+        out.card = static_cast<uint32_t>(out.array.size());
+    } else {
+        out.type = Container::Type::Bitset;
+        out.bits.resize(BITSET_WORDS);
+        out.card = bitset_kernels().and_op(x.bits.data(), y.bits.data(), out.bits.data());
+        shrinkBitset(out);
+    }
+    return out;
+}
+
+inline Container orContainers(const Container& a, const Container& b) {
+    if (a.card == CHUNK_BITS) return a;
+    if (b.card == CHUNK_BITS) return b;
+
+    Container sa, sb;
+    const Container& x = plain(a, sa);
+    const Container& y = plain(b, sb);
+    Container out;
+    if (x.type == Container::Type::Array && y.type == Container::Type::Array &&
+        x.card + y.card <= ARRAY_MAX_CARD) {
+        out.array.reserve(x.card + y.card);
+        std::set_union(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), std::back_inserter(out.array));
+        out.card = static_cast<uint32_t>(out.array.size());
+    } else if (x.type == Container::Type::Bitset && y.type == Container::Type::Bitset) {
+        out.type = Container::Type::Bitset;
+        out.bits.resize(BITSET_WORDS);
+        out.card = bitset_kernels().or_op(x.bits.data(), y.bits.data(), out.bits.data());
+    } else {
+        //start from the bitset side (or a bitset copy of x) and add the other one in
+        const bool x_is_set = (x.type == Container::Type::Bitset);
+        out = x_is_set ? x : y;
+        toBitset(out);
+        for (uint16_t v : (x_is_set ? y : x).array) addValue(out, v);
+    }
+    return out;
+}
+
+//a \ b
+inline Container andNotContainers(const Container& a, const Container& b) {
+    if (b.card == CHUNK_BITS) return Container{};
+
+    Container sa, sb;
+    const Container& x = plain(a, sa);
+    const Container& y = plain(b, sb);
+    Container out;
+    if (x.type == Container::Type::Array && y.type == Container::Type::Array) {
+        out.array.reserve(x.card);
+        std::set_difference(x.array.begin(), x.array.end(), y.array.begin(), y.array.end(), std::back_inserter(out.array));
+        out.card = static_cast<uint32_t>(out.array.size());
+    } else if (x.type == Container::Type::Array) {
+        out.array.reserve(x.card);
+        for (uint16_t v : x.array) {
+            if (!((y.bits[v >> 6] >> (v & 63)) & 1ULL)) out.array.push_back(v);
+        }
+        out.card = static_cast<uint32_t>(out.array.size());
+    } else if (y.type == Container::Type::Array) {
+        out = x;
+        for (uint16_t v : y.array) {
+            uint64_t& word = out.bits[v >> 6];
+            const uint64_t mask = uint64_t{1} << (v & 63);
+            if (word & mask) {
+                word &= ~mask;
+                --out.card;
+            }
+        }
+        shrinkBitset(out);
+    } else {
+        out.type = Container::Type::Bitset;
+        out.bits.resize(BITSET_WORDS);
+        out.card = bitset_kernels().andnot_op(x.bits.data(), y.bits.data(), out.bits.data());
+        shrinkBitset(out);
+    }
+    return out;
+}
+
+//------------------------------- in place -------------------------------
+//The &=, -= paths used by the filter planner: the result is a subset of a, so it is written over
+//a's own array/bitset instead of building a new container per step.
+
+//keep the values of an array container that pass keep(v)
+template <typename Keep>
+inline void filterArray(Container& c, Keep&& keep) {
+    size_t w = 0;
+    for (uint16_t v : c.array) {
+        if (keep(v)) c.array[w++] = v;
+    }
+    c.array.resize(w);
+    c.card = static_cast<uint32_t>(w);
+}
+
+//clear bits [begin, end) of a bitset container
+inline void clearBitRange(uint64_t* bits, uint32_t begin, uint32_t end) noexcept {
+    while (begin < end) {
+        const uint32_t offset = begin & 63;
+        const uint32_t n = std::min<uint32_t>(64 - offset, end - begin);
+        const uint64_t mask = (n == 64) ? ~uint64_t{0} : (((uint64_t{1} << n) - 1) << offset);
+        bits[begin >> 6] &= ~mask;
+        begin += n;
+    }
+}
+
+//a &= b
+inline void andInPlace(Container& a, const Container& b) {
+    using Type = Container::Type;
+    if (b.card == CHUNK_BITS) return;
+    if (a.card == CHUNK_BITS) { a = b; return; }
+    if (a.type == Type::Run) materialize(a);
+
+    if (a.type == Type::Array) {
+        if (b.type == Type::Array) {
+            //the write position never passes the read position, so this is safe in place
+            const bool gallop = a.array.size() * 32 < b.array.size();
+            auto from = b.array.begin();
+            filterArray(a, [&](uint16_t v) {
+                if (gallop) from = std::lower_bound(from, b.array.end(), v);
+                else while (from != b.array.end() && *from < v) ++from;
+                return from != b.array.end() && *from == v;
+            });
+        } else {
+            filterArray(a, [&](uint16_t v) { return b.contains(v); });
+        }
+        return;
+    }
+
+    //a is a bitset
+    if (b.type == Type::Bitset) {
+        a.card = bitset_kernels().and_op(a.bits.data(), b.bits.data(), a.bits.data());
+    } else if (b.type == Type::Run) {
+        uint32_t from = 0; //clear the gaps between runs
+        for (const Run& r : b.runs) {
+            clearBitRange(a.bits.data(), from, r.start);
+            from = static_cast<uint32_t>(r.start) + r.length + 1;
+        }
+        clearBitRange(a.bits.data(), from, CHUNK_BITS);
+        a.card = popcountBits(a.bits);
+    } else {
+        //result is a subset of b's array, that is the only case that needs new storage
+        std::vector<uint16_t> out;
+        out.reserve(b.card);
+        for (uint16_t v : b.array) {
+            if ((a.bits[v >> 6] >> (v & 63)) & 1ULL) out.push_back(v);
+        }
+        a.array = std::move(out);
+        std::vector<uint64_t>().swap(a.bits);
+        a.type = Type::Array;
+        a.card = static_cast<uint32_t>(a.array.size());
+        return;
+    }
+    shrinkBitset(a);
+}
+
+//a -= b
+inline void andNotInPlace(Container& a, const Container& b) {
+    using Type = Container::Type;
+    if (a.card == 0) return;
+    if (b.card == CHUNK_BITS) { a = Container{}; return; }
+    if (a.type == Type::Run) materialize(a);
+
+    if (a.type == Type::Array) {
+        if (b.type == Type::Array) {
+            auto from = b.array.begin();
+            filterArray(a, [&](uint16_t v) {
+                while (from != b.array.end() && *from < v) ++from;
+                return from == b.array.end() || *from != v;
+            });
+        } else {
+            filterArray(a, [&](uint16_t v) { return !b.contains(v); });
+        }
+        return;
+    }
+
+    //a is a bitset
+    if (b.type == Type::Bitset) {
+        a.card = bitset_kernels().andnot_op(a.bits.data(), b.bits.data(), a.bits.data());
+    } else if (b.type == Type::Run) {
+        for (const Run& r : b.runs) {
+            clearBitRange(a.bits.data(), r.start, static_cast<uint32_t>(r.start) + r.length + 1);
+        }
+        a.card = popcountBits(a.bits);
+    } else {
+        for (uint16_t v : b.array) {
+            uint64_t& word = a.bits[v >> 6];
+            const uint64_t mask = uint64_t{1} << (v & 63);
+            if (word & mask) {
+                word &= ~mask;
+                --a.card;
+            }
+        }
+    }
+    shrinkBitset(a);
+}
+
+} // namespace bitmap_detail
+
 class BitmapIndex {
 public:
     BitmapIndex() = default;
     ~BitmapIndex() = default;
 
+    //Grows or shrinks the id space [0, new_size). Shrinking drops the ids past the end.
     void resize(size_t new_size) {
-        m_bits.resize((new_size + 63) / 64, 0);
+        if (new_size > bitmap_detail::MAX_BITS) throw std::length_error("BitmapIndex supports at most 2^32 ids");
+        if (new_size < m_size) truncate(new_size);
         m_size = new_size;
     }
 
     void set(size_t pos, bool value = true) {
         if (pos >= m_size) throw std::out_of_range("BitmapIndex::set out of range");
-        size_t idx = pos / 64;
-        size_t offset = pos % 64;
+        const uint16_t key = highBits(pos);
         if (value) {
-            m_bits[idx] |= (1ULL << offset);
-        } else {
-            m_bits[idx] &= ~(1ULL << offset);
+            bitmap_detail::addValue(getOrCreate(key), lowBits(pos));
+            return;
         }
+        const size_t idx = findIndex(key);
+        if (idx == NOT_FOUND) return;
+        bitmap_detail::removeValue(m_containers[idx], lowBits(pos));
+        if (m_containers[idx].card == 0) eraseAt(idx);
     }
 
     bool get(size_t pos) const {
         if (pos >= m_size) throw std::out_of_range("BitmapIndex::get out of range");
-        size_t idx = pos / 64;
-        size_t offset = pos % 64;
-        return (m_bits[idx] >> offset) & 1ULL;
+        return contains(pos);
+    }
+
+    //get() without the throw, out of range is just "not set". This is what the search hot path uses.
+    bool contains(size_t pos) const noexcept {
+        if (pos >= m_size) return false;
+        const size_t idx = findIndex(highBits(pos));
+        return idx != NOT_FOUND && m_containers[idx].contains(lowBits(pos));
+    }
+
+    //set [begin, end), whole chunks become a single run
+    void setRange(size_t begin, size_t end) {
+        if (end > m_size || begin > end) throw std::out_of_range("BitmapIndex::setRange out of range");
+        while (begin < end) {
+            const uint16_t key = highBits(begin);
+            const size_t chunk_end = std::min(end, (static_cast<size_t>(key) + 1) << 16);
+            const uint32_t lo = lowBits(begin);
+            const uint32_t hi = static_cast<uint32_t>((chunk_end - 1) & 0xFFFF); //inclusive
+
+            auto& c = getOrCreate(key);
+            if (c.card == 0) {
+                c = bitmap_detail::Container{};
+                c.type = bitmap_detail::Container::Type::Run;
+                c.runs.push_back({static_cast<uint16_t>(lo), static_cast<uint16_t>(hi - lo)});
+                c.card = hi - lo + 1;
+            } else {
+                bitmap_detail::toBitset(c);
+                bitmap_detail::setBitRange(c.bits.data(), lo, hi + 1);
+                c.card = bitmap_detail::popcountBits(c.bits);
+            }
+            begin = chunk_end;
+        }
+    }
+
+    //every id in [0, size())
+    void fill() {
+        setRange(0, m_size);
     }
 
     //set everything in the bitmap to zero
     void clear() {
-        std::fill(m_bits.begin(), m_bits.end(), 0);
+        m_keys.clear();
+        m_containers.clear();
     }
 
     size_t size() const { return m_size; }
 
+    //number of set bits, every container keeps its own popcount
+    size_t count() const {
+        size_t total = 0;
+        for (const auto& c : m_containers) total += c.card;
+        return total;
+    }
+
+    bool any() const {
+        return !m_containers.empty();
+    }
+
     // Bitwise AND (intersection)
     BitmapIndex operator&(const BitmapIndex& other) const {
-        if (m_size != other.m_size) throw std::invalid_argument("BitmapIndex sizes must match");
+        checkSameSize(other);
         BitmapIndex result;
         result.m_size = m_size;
-        result.m_bits.resize(m_bits.size(), 0);
-        for (size_t i = 0; i < m_bits.size(); i++) {
-            result.m_bits[i] = m_bits[i] & other.m_bits[i];
+        size_t i = 0, j = 0;
+        while (i < m_keys.size() && j < other.m_keys.size()) {
+            if (m_keys[i] < other.m_keys[j]) {
+                ++i;
+            } else if (m_keys[i] > other.m_keys[j]) {
+                ++j;
+            } else {
+                auto c = bitmap_detail::andContainers(m_containers[i], other.m_containers[j]);
+                if (c.card) result.append(m_keys[i], std::move(c));
+                ++i;
+                ++j;
+            }
         }
         return result;
     }
 
     // Bitwise OR (union)
     BitmapIndex operator|(const BitmapIndex& other) const {
-        if (m_size != other.m_size) throw std::invalid_argument("BitmapIndex sizes must match");
+        checkSameSize(other);
+        BitmapIndex result;
+        result.m_size = m_size;
+        size_t i = 0, j = 0;
+        while (i < m_keys.size() || j < other.m_keys.size()) {
+            if (j == other.m_keys.size() || (i < m_keys.size() && m_keys[i] < other.m_keys[j])) {
+                result.append(m_keys[i], m_containers[i]);
+                ++i;
+            } else if (i == m_keys.size() || m_keys[i] > other.m_keys[j]) {
+                result.append(other.m_keys[j], other.m_containers[j]);
+                ++j;
+            } else {
+                result.append(m_keys[i], bitmap_detail::orContainers(m_containers[i], other.m_containers[j]));
+                ++i;
+                ++j;
+            }
+        }
+        return result;
+    }
+
+    // Difference: set here and not in other (e.g. matches minus deleted)
+    BitmapIndex andNot(const BitmapIndex& other) const {
+        checkSameSize(other);
         BitmapIndex result;
         result.m_size = m_size;
-        result.m_bits.resize(m_bits.size(), 0);
-        for (size_t i = 0; i < m_bits.size(); i++) {
-            result.m_bits[i] = m_bits[i] | other.m_bits[i];
+        size_t j = 0;
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            while (j < other.m_keys.size() && other.m_keys[j] < m_keys[i]) ++j;
+            if (j < other.m_keys.size() && other.m_keys[j] == m_keys[i]) {
+                auto c = bitmap_detail::andNotContainers(m_containers[i], other.m_containers[j]);
+                if (c.card) result.append(m_keys[i], std::move(c));
+            } else {
+                result.append(m_keys[i], m_containers[i]);
+            }
         }
         return result;
     }
 
+    BitmapIndex operator-(const BitmapIndex& other) const {
+        return andNot(other);
+    }
+
+    //in place versions: containers are intersected over their own storage and empty ones dropped,
+    //no second bitmap gets built (this is what the filter planner chains)
+    BitmapIndex& operator&=(const BitmapIndex& other) {
+        checkSameSize(other);
+        size_t write = 0, j = 0;
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            while (j < other.m_keys.size() && other.m_keys[j] < m_keys[i]) ++j;
+            if (j == other.m_keys.size() || other.m_keys[j] != m_keys[i]) continue;
+            bitmap_detail::andInPlace(m_containers[i], other.m_containers[j]);
+            if (m_containers[i].card == 0) continue;
+            if (write != i) {
+                m_keys[write] = m_keys[i];
+                m_containers[write] = std::move(m_containers[i]);
+            }
+            ++write;
+        }
+        m_keys.resize(write);
+        m_containers.resize(write);
+        return *this;
+    }
+
+    BitmapIndex& operator-=(const BitmapIndex& other) {
+        checkSameSize(other);
+        size_t write = 0, j = 0;
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            while (j < other.m_keys.size() && other.m_keys[j] < m_keys[i]) ++j;
+            if (j < other.m_keys.size() && other.m_keys[j] == m_keys[i]) {
+                bitmap_detail::andNotInPlace(m_containers[i], other.m_containers[j]);
+                if (m_containers[i].card == 0) continue;
+            }
+            if (write != i) {
+                m_keys[write] = m_keys[i];
+                m_containers[write] = std::move(m_containers[i]);
+            }
+            ++write;
+        }
+        m_keys.resize(write);
+        m_containers.resize(write);
+        return *this;
+    }
+
+    BitmapIndex& operator|=(const BitmapIndex& other) {
+        *this = *this | other;
+        return *this;
+    }
+
+    //fn(id) for every set id, ascending
+    template <typename F>
+    void forEach(F&& fn) const {
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            const size_t base = static_cast<size_t>(m_keys[i]) << 16;
+            bitmap_detail::forEachValue(m_containers[i], [&](uint16_t low) { fn(base | low); });
+        }
+    }
+
     // Return list of active IDs
     std::vector<size_t> to_ids() const {
         std::vector<size_t> ids;
-        for (size_t i = 0; i < m_size; i++) {
-            if (get(i) == true) {
-                ids.push_back(i);
+        ids.reserve(count());
+        forEach([&](size_t id) { ids.push_back(id); });
+        return ids;
+    }
+
+    //re-pick the container type of every chunk, call after bulk building (FilterMatrix does)
+    void runOptimize() {
+        for (auto& c : m_containers) bitmap_detail::runOptimize(c);
+    }
+
+    //heap bytes held by the containers
+    size_t memoryBytes() const {
+        size_t bytes = m_keys.capacity() * sizeof(uint16_t) + m_containers.capacity() * sizeof(bitmap_detail::Container);
+        for (const auto& c : m_containers) bytes += c.bytes();
+        return bytes;
+    }
+
+    /*
+    binary form, native endian:
+        u32 magic, u64 size, u32 container count
+        per container: u16 key, u8 type, u32 cardinality, then
+            array  -> cardinality x u16
+            bitset -> 1024 x u64
+            run    -> u32 run count, runs x (u16 start, u16 length)
+    */
+    void serialize(std::ostream& out) const {
+        writePod(out, SERIAL_MAGIC);
+        writePod(out, static_cast<uint64_t>(m_size));
+        writePod(out, static_cast<uint32_t>(m_keys.size()));
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            const auto& c = m_containers[i];
+            writePod(out, m_keys[i]);
+            writePod(out, static_cast<uint8_t>(c.type));
+            writePod(out, c.card);
+            switch (c.type) {
+                case bitmap_detail::Container::Type::Array:
+                    writeArray(out, c.array);
+                    break;
+                case bitmap_detail::Container::Type::Bitset:
+                    writeArray(out, c.bits);
+                    break;
+                default:
+                    writePod(out, static_cast<uint32_t>(c.runs.size()));
+                    for (const auto& r : c.runs) {
+                        writePod(out, r.start);
+                        writePod(out, r.length);
+                    }
+                    break;
             }
         }
-        return ids;
+    }
+
+    static BitmapIndex deserialize(std::istream& in) {
+        using Type = bitmap_detail::Container::Type;
+        if (readPod<uint32_t>(in) != SERIAL_MAGIC) corrupt("bad magic");
+
+        BitmapIndex bitmap;
+        const uint64_t size = readPod<uint64_t>(in);
+        if (size > bitmap_detail::MAX_BITS) corrupt("size too large");
+        bitmap.m_size = static_cast<size_t>(size);
+
+        const uint32_t num_containers = readPod<uint32_t>(in);
+        if (num_containers > (size + bitmap_detail::CHUNK_BITS - 1) / bitmap_detail::CHUNK_BITS) corrupt("too many containers");
+        bitmap.m_keys.reserve(num_containers);
+        bitmap.m_containers.reserve(num_containers);
+
+        for (uint32_t n = 0; n < num_containers; ++n) {
+            const uint16_t key = readPod<uint16_t>(in);
+            if (!bitmap.m_keys.empty() && key <= bitmap.m_keys.back()) corrupt("keys out of order");
+
+            bitmap_detail::Container c;
+            const uint8_t type = readPod<uint8_t>(in);
+            c.card = readPod<uint32_t>(in);
+            if (c.card == 0 || c.card > bitmap_detail::CHUNK_BITS) corrupt("bad cardinality");
+
+            uint32_t max_low = 0;
+            if (type == static_cast<uint8_t>(Type::Array)) {
+                c.type = Type::Array;
+                c.array.resize(c.card);
+                readArray(in, c.array);
+                for (size_t i = 1; i < c.array.size(); ++i) {
+                    if (c.array[i] <= c.array[i - 1]) corrupt("array not sorted");
+                }
+                max_low = c.array.back();
+            } else if (type == static_cast<uint8_t>(Type::Bitset)) {
+                c.type = Type::Bitset;
+                c.bits.resize(bitmap_detail::BITSET_WORDS);
+                readArray(in, c.bits);
+                if (bitmap_detail::popcountBits(c.bits) != c.card) corrupt("bitset cardinality mismatch");
+                for (size_t w = bitmap_detail::BITSET_WORDS; w-- > 0;) {
+                    if (c.bits[w]) {
+                        max_low = static_cast<uint32_t>(w * 64 + 63 - __builtin_clzll(c.bits[w]));
+                        break;
+                    }
+                }
+            } else if (type == static_cast<uint8_t>(Type::Run)) {
+                c.type = Type::Run;
+                const uint32_t num_runs = readPod<uint32_t>(in);
+                if (num_runs == 0 || num_runs > bitmap_detail::CHUNK_BITS / 2) corrupt("bad run count");
+                c.runs.resize(num_runs);
+                uint64_t total = 0;
+                int64_t prev_end = -1;
+                for (auto& r : c.runs) {
+                    r.start = readPod<uint16_t>(in);
+                    r.length = readPod<uint16_t>(in);
+                    const int64_t end = static_cast<int64_t>(r.start) + r.length;
+                    if (static_cast<int64_t>(r.start) <= prev_end || end >= bitmap_detail::CHUNK_BITS) corrupt("bad run");
+                    prev_end = end;
+                    total += static_cast<uint64_t>(r.length) + 1;
+                }
+                if (total != c.card) corrupt("run cardinality mismatch");
+                max_low = static_cast<uint32_t>(prev_end);
+            } else {
+                corrupt("unknown container type");
+            }
+
+            if ((static_cast<uint64_t>(key) << 16 | max_low) >= size) corrupt("id past the end");
+            bitmap.m_keys.push_back(key);
+            bitmap.m_containers.push_back(std::move(c));
+        }
+        return bitmap;
     }
 
     std::string debugString(size_t limit = 64) const {
@@ -112,8 +941,109 @@ public:
     }
 
 private:
-    std::vector<uint64_t> m_bits;
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+    static constexpr uint32_t SERIAL_MAGIC = 0x314D4252; //"RBM1"
+
+    static uint16_t highBits(size_t pos) noexcept { return static_cast<uint16_t>(pos >> 16); }
+    static uint16_t lowBits(size_t pos) noexcept { return static_cast<uint16_t>(pos & 0xFFFF); }
+
+    size_t findIndex(uint16_t key) const noexcept {
+        //dense bitmaps (every chunk present) are the common case, key == index there
+        if (key < m_keys.size() && m_keys[key] == key) return key;
+        auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+        if (it == m_keys.end() || *it != key) return NOT_FOUND;
+        return static_cast<size_t>(it - m_keys.begin());
+    }
+
+    bitmap_detail::Container& getOrCreate(uint16_t key) {
+        if (m_keys.empty() || m_keys.back() < key) {
+            m_keys.push_back(key);
+            m_containers.emplace_back();
+            return m_containers.back();
+        }
+        auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+        const size_t idx = static_cast<size_t>(it - m_keys.begin());
+        if (*it != key) {
+            m_keys.insert(it, key);
+            m_containers.emplace(m_containers.begin() + static_cast<std::ptrdiff_t>(idx));
+        }
+        return m_containers[idx];
+    }
+
+    void append(uint16_t key, bitmap_detail::Container c) {
+        m_keys.push_back(key);
+        m_containers.push_back(std::move(c));
+    }
+
+    void eraseAt(size_t idx) {
+        m_keys.erase(m_keys.begin() + static_cast<std::ptrdiff_t>(idx));
+        m_containers.erase(m_containers.begin() + static_cast<std::ptrdiff_t>(idx));
+    }
+
+    //drop every id >= new_size
+    void truncate(size_t new_size) {
+        if (new_size == 0) {
+            clear();
+            return;
+        }
+        const uint16_t last_key = highBits(new_size - 1);
+        while (!m_keys.empty() && m_keys.back() > last_key) {
+            m_keys.pop_back();
+            m_containers.pop_back();
+        }
+        const uint32_t keep = static_cast<uint32_t>((new_size - 1) & 0xFFFF); //last low bit to keep
+        if (keep == 0xFFFF || m_keys.empty() || m_keys.back() != last_key) return;
+
+        auto& c = m_containers.back();
+        bitmap_detail::materialize(c);
+        if (c.type == bitmap_detail::Container::Type::Array) {
+            c.array.erase(std::upper_bound(c.array.begin(), c.array.end(), static_cast<uint16_t>(keep)), c.array.end());
+            c.card = static_cast<uint32_t>(c.array.size());
+        } else {
+            for (uint32_t v = keep + 1; v < bitmap_detail::CHUNK_BITS; ++v) {
+                c.bits[v >> 6] &= ~(uint64_t{1} << (v & 63));
+            }
+            c.card = bitmap_detail::popcountBits(c.bits);
+            bitmap_detail::shrinkBitset(c);
+        }
+        if (c.card == 0) eraseAt(m_keys.size() - 1);
+    }
+
+    void checkSameSize(const BitmapIndex& other) const {
+        if (m_size != other.m_size) throw std::invalid_argument("BitmapIndex sizes must match");
+    }
+
+    [[noreturn]] static void corrupt(const char* what) {
+        throw std::runtime_error(std::string("BitmapIndex::deserialize ") + what);
+    }
+
+    template <typename T>
+    static void writePod(std::ostream& out, const T& v) {
+        out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    template <typename T>
+    static T readPod(std::istream& in) {
+        T v{};
+        in.read(reinterpret_cast<char*>(&v), sizeof(T));
+        if (!in) corrupt("truncated");
+        return v;
+    }
+
+    template <typename T>
+    static void writeArray(std::ostream& out, const std::vector<T>& v) {
+        out.write(reinterpret_cast<const char*>(v.data()), static_cast<std::streamsize>(v.size() * sizeof(T)));
+    }
+
+    template <typename T>
+    static void readArray(std::istream& in, std::vector<T>& v) {
+        in.read(reinterpret_cast<char*>(v.data()), static_cast<std::streamsize>(v.size() * sizeof(T)));
+        if (!in) corrupt("truncated");
+    }
+
+    std::vector<uint16_t> m_keys;                          //high 16 bits, sorted
+    std::vector<bitmap_detail::Container> m_containers;    //m_containers[i] holds key m_keys[i]
     size_t m_size = 0;
 };
 
-} // namespace vectordb
\ No newline at end of file
+} // namespace vectordb
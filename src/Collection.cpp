@@ -1,38 +1,191 @@
 #include "Collection.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 namespace vectordb {
 
     Collection::Collection(const CollectionId& id, const CollectionInfo& info) 
         : m_collection_info {info}, 
           m_segment_holder(/*max_points*/MAX_MEMORYPOOL_POINTS, /*collectionInfo*/info),
-          m_point_payload("./vectordb/" + info.name + "/payload_" + id, CACHE_SIZE) //i might just add a base file path here instead of a hard coded one
+          m_point_payload("./vectordb/" + info.name + "/payload_" + id, CACHE_SIZE, info.payload_store) //i might just add a base file path here instead of a hard coded one
     {}
     
-    Status Collection::insertPoint(PointIdType point_id, const DenseVector& vector, const Payload& payload) 
+    Status Collection::insertPoint(PointIdType point_id, const DenseVector& vector, const Payload& payload,
+                                   WalBatch* wal_batch, uint64_t version) 
     {
-        auto status = m_segment_holder.insertPoint(point_id, vector);
-        if (status.ok && !payload.empty()) {
-            m_point_payload.putPayload(point_id, payload);//ignore payload now
-        }
-        return status;
+        return m_segment_holder.insertPoint(point_id, vector, payload, wal_batch, version);
     }
 
     Status Collection::insertPoint(PointIdType point_id, 
                                   const std::map<VectorName, DenseVector>& named_vectors,
-                                  const Payload& payload) 
+                                  const Payload& payload,
+                                  WalBatch* wal_batch,
+                                  uint64_t version) 
+    {
+        return m_segment_holder.insertPoint(point_id, named_vectors, payload, wal_batch, version);
+    }
+
+    StatusOr<size_t> Collection::deletePoints(const std::vector<PointIdType>& point_ids)
     {
-        auto status = m_segment_holder.insertPoint(point_id, named_vectors);
-        if (status.ok && !payload.empty()) {
-            m_point_payload.putPayload(point_id, payload);//ignore payload now
+        std::vector<std::pair<PointIdType, uint64_t>> removed_versions;
+        auto removed = m_segment_holder.deletePoints(point_ids, &removed_versions);
+        if (!removed.ok()) {
+            return removed.status();
+        }
+        //a payload goes only up to the version of the copy that was removed: an upsert that raced
+        //this delete and won in the segments keeps its payload too. Ids without a live copy (0)
+        //only lose a payload left over from an earlier run.
+        std::unordered_map<PointIdType, uint64_t> versions(removed_versions.begin(), removed_versions.end());
+        std::vector<std::pair<PointIdType, uint64_t>> payload_deletes;
+        payload_deletes.reserve(point_ids.size());
+        for (const auto& point_id : point_ids) {
+            auto it = versions.find(point_id);
+            payload_deletes.emplace_back(point_id, it != versions.end() ? it->second : 0);
+        }
+        auto status = m_point_payload.deletePayloads(payload_deletes);
+        if (!status.ok) {
+            return status;
+        }
+        return removed;
+    }
+
+    StatusOr<size_t> Collection::loadSegments()
+    {
+        return m_segment_holder.loadSegments();
+    }
+
+    //Only files without a SEGMENT_FLUSH marker get read, a flushed segment's file is recognized from
+    //its last entry header alone, so this costs what was never flushed, not the collection size.
+    //The entries of all files are put back in write order (version) and only the last one per id is
+    //applied, through the normal upsert path: they land in this run's active segment and its WAL,
+    //which gets synced before the old files are removed.
+    StatusOr<size_t> Collection::recoverFromWal()
+    {
+        namespace fs = std::filesystem;
+        const fs::path wal_dir = "./vectordb/" + m_collection_info.name + "/wal";
+        std::error_code ec;
+        if (!fs::is_directory(wal_dir, ec)) {
+            return size_t{0};
+        }
+
+        //this run's active segment already has its (empty) WAL file in there
+        const auto active_wal = m_segment_holder.getActiveWal();
+        const fs::path active_file = active_wal ? active_wal->getFilePath().filename() : fs::path{};
+
+        std::vector<fs::path> flushed_files, replayed_files;
+        std::vector<WalRecord> records;
+        for (const auto& file : fs::directory_iterator(wal_dir, ec)) {
+            const fs::path& path = file.path();
+            if (path.extension() != ".wal" || path.filename() == active_file) continue;
+
+            if (WAL::hasFlushMarker(path)) {
+                flushed_files.push_back(path);
+                continue;
+            }
+
+            auto contents = WAL::readFile(path);
+            if (!contents.ok()) {
+                std::cerr << "[RECOVERY] skipping " << path << ": " << contents.status().message << "\n";
+                continue;
+            }
+            auto& found = contents.value();
+            if (found.no_header) {
+                //created right before a crash, nothing in it ever got committed
+                std::cout << "[RECOVERY] " << path.filename() << ": no header, removed\n";
+                fs::remove(path, ec);
+                continue;
+            }
+            if (found.truncated_bytes > 0) {
+                std::cout << "[RECOVERY] " << path.filename() << ": cut off a torn tail of "
+                          << found.truncated_bytes << " bytes\n";
+            }
+            records.insert(records.end(), std::make_move_iterator(found.records.begin()),
+                           std::make_move_iterator(found.records.end()));
+            replayed_files.push_back(path);
+        }
+
+        std::stable_sort(records.begin(), records.end(),
+                         [](const WalRecord& a, const WalRecord& b) { return a.version < b.version; });
+        std::unordered_map<PointIdType, size_t> last_write;
+        for (size_t i = 0; i < records.size(); ++i) {
+            last_write[records[i].point_id] = i;
+        }
+        if (!records.empty()) {
+            m_segment_holder.advanceVersion(records.back().version);
         }
-        return status;
+
+        WalBatch wal_batch;
+        std::vector<PointIdType> deleted;
+        size_t applied = 0;
+        for (size_t i = 0; i < records.size(); ++i) {
+            auto& record = records[i];
+            if (last_write[record.point_id] != i) continue; //written again later
+            //a loaded segment already has this write or a later one (merged before its WAL got the marker)
+            auto loaded_version = m_segment_holder.getPointVersion(record.point_id);
+            if (loaded_version && *loaded_version >= record.version) continue;
+
+            if (record.type == WalEntryType::DELETE_POINT) {
+                deleted.push_back(record.point_id); //ids are unique here, so order doesn't matter
+            } else {
+                std::map<VectorName, DenseVector> named_vectors(std::make_move_iterator(record.vectors.begin()),
+                                                                std::make_move_iterator(record.vectors.end()));
+                //the payload went to rocksdb before the vectors were logged
+                auto payload = m_point_payload.getPayload(record.point_id);
+                auto status = m_segment_holder.insertPoint(record.point_id, named_vectors,
+                                                           payload.ok() ? payload.value() : Payload{}, &wal_batch);
+                if (!status.ok) {
+                    return status;
+                }
+            }
+            ++applied;
+        }
+
+        if (!deleted.empty()) {
+            auto removed = m_segment_holder.deletePoints(deleted);
+            if (!removed.ok()) {
+                return removed.status();
+            }
+        }
+
+        //replayed entries are in this run's WAL now, make that durable before the old copies go
+        auto status = wal_batch.sync();
+        if (status.ok) {
+            if (auto wal = m_segment_holder.getActiveWal()) status = wal->sync(); //the deletes
+        }
+        if (!status.ok) {
+            return status;
+        }
+
+        //a flushed file's segment was just reloaded by loadSegments() (only on_disk collections write
+        //segments, and with them the markers). Anything else: keep the file, it may be the only copy.
+        if (m_collection_info.on_disk) {
+            for (const auto& path : flushed_files) fs::remove(path, ec);
+        }
+        //without a WAL in this run (durability none) the old files are the only copy, keep them
+        if (active_wal || records.empty()) {
+            for (const auto& path : replayed_files) fs::remove(path, ec);
+        }
+        return applied;
     }
 
     QueryResult Collection::searchTopK(const std::string& vector_name,
                                        const std::vector<DenseVector>& query_vectors,
-                                       size_t k) const 
+                                       size_t k,
+                                       const SearchParams& params,
+                                       const PayloadFilter& filter) const 
     {
-        return m_segment_holder.searchTopK(vector_name, query_vectors, k);
+        //segments answer conditions on payload_index fields themselves, for the rest they get a
+        //lookup into the payload store (rocksdb)
+        SegmentFilter segment_filter;
+        if (!filter.empty()) {
+            segment_filter.filter = &filter;
+            segment_filter.fallback = [this, &filter](const PointIdType& point_id) {
+                auto payload = m_point_payload.getPayload(point_id);
+                return payload.ok() && filter.matches(payload.value());
+            };
+        }
+        return m_segment_holder.searchTopK(vector_name, query_vectors, k, params, segment_filter);
     }
 
     const CollectionId& Collection::getId() const { return m_collection_id; }
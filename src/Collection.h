@@ -3,6 +3,7 @@
 #include "DataTypes.h"
 #include "CollectionInfo.h"
 #include "PointPayloadStore.h"
+#include "PayloadFilter.h"
 #include "SegmentHolder.h"
 #include "VectorGraph.h"
 
@@ -17,15 +18,35 @@ public:
     Collection(const CollectionId& id, const CollectionInfo& info);
     ~Collection() = default;
 
-    Status insertPoint(PointIdType point_id, const DenseVector& vector, const Payload& payload);
+    //Vectors (and the payload_index fields) into the segments. The full payload goes to the payload
+    //store separately, one batch per request: getPayloadStore().putPayloads(...)
+    //Same for the WAL: pass a WalBatch and wait on it once after the last point (see SegmentHolder).
+    //`version`: the one the payload was stored with (SegmentHolder::reserveVersion()), 0 for a fresh one.
+    Status insertPoint(PointIdType point_id, const DenseVector& vector, const Payload& payload,
+                       WalBatch* wal_batch = nullptr, uint64_t version = 0);
 
     Status insertPoint(PointIdType point_id, 
                        const std::map<VectorName, DenseVector>& named_vectors,
-                       const Payload& payload);
+                       const Payload& payload,
+                       WalBatch* wal_batch = nullptr,
+                       uint64_t version = 0);
+
+    //Tombstone the points in every segment and drop their payloads, returns how many stored copies went away
+    StatusOr<size_t> deletePoints(const std::vector<PointIdType>& point_ids);
+
+    //Startup, first: reopen the segments an earlier run wrote to disk (on_disk collections, see
+    //SegmentHolder::loadSegments()), returns how many live points they hold
+    StatusOr<size_t> loadSegments();
+
+    //Startup: replay the WAL files an earlier run left in ./vectordb/<name>/wal (see WAL.h),
+    //returns how many entries were applied
+    StatusOr<size_t> recoverFromWal();
 
     QueryResult searchTopK(const std::string& vector_name,
                            const std::vector<DenseVector>& query_vectors, 
-                           size_t k) const;
+                           size_t k,
+                           const SearchParams& params = {},
+                           const PayloadFilter& filter = {}) const;
 
     const CollectionId& getId() const;
     const CollectionInfo& getInfo() const;
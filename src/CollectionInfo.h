@@ -4,11 +4,22 @@
 
 namespace vectordb {
 
+//Per vector space index choice. The HNSW graph params (m_edges, ef_*) stay in IndexSpec,
+//this only says which kind of index and the knobs that only IVF/PQ have.
+struct VectorIndexSpec {
+    IndexType type{IndexType::HNSWFlat};
+    size_t nlist{0};    //IVF: number of inverted lists, 0 = pick ~4*sqrt(n) per segment
+    size_t nprobe{8};   //IVF: lists visited per query
+    size_t pq_m{16};    //IVFPQ: sub-quantizers, dim must be divisible by it
+    size_t pq_nbits{8}; //IVFPQ: bits per sub-quantizer code
+};
+
 //since i allow namedvectors, then a collection can have multiple dims of the same data
 //i am not sure if this design is good or not, but limiting it is fine i guess. 
 struct VectorSpec {
     size_t dim;
     DistanceMetric metric;
+    VectorIndexSpec index{};
     //bool is_sharded = false;//Uhm, maybe use this after i got the first version of the db working
     //shard_key...
     //create_timestamp...
@@ -22,8 +33,41 @@ struct IndexSpec {
     size_t m_edges{32};//Maximum number of connections (or edges) each node can have in the graph at each level.
     size_t ef_construction{250}; //The number of candidates considered during index construction.
     size_t ef_search{16}; //The number of neighbors evaluated during a search. Should be at least as large as Top K.
+    size_t nprobe_segments{0}; //MetaIndex routing: only search the N immutable segments whose centroids are closest, 0 = search all of them.
+    //background compaction of immutable segments (size-tiered, see SegmentHolder::pickCompaction)
+    size_t compaction_fanout{4}; //merge this many segments of the same size tier into one, 0 = no compaction
+    size_t compaction_max_points{100000}; //a merge never builds a segment bigger than this
+    size_t compaction_deleted_pct{20}; //rewrite a segment once this % of its points are tombstoned, 0 = never
 };
 
+//How payload writes hit rocksdb. One WriteBatch per upsert request either way, these only pick
+//the durability of that one write.
+struct PayloadStoreSpec {
+    bool sync{false};        //fsync the rocksdb WAL before the request returns
+    bool disable_wal{false}; //skip the rocksdb WAL, payloads of a crash's last writes can be lost
+};
+
+//Vector WAL of the active segments (see WAL.h). Entries from concurrent upserts are group committed
+//by one writer thread, so a commit window costs one copy into the mapped file and at most one msync.
+struct WalSpec {
+    WalDurability durability{WalDurability::PerBatch};
+    size_t commit_window_ms{10}; //async: how often the writer flushes, per_batch: how often it syncs
+    size_t file_size_mb{32};     //each WAL file is preallocated to this, the WAL rotates when it is full
+};
+
+//How the immutable segments of an on_disk collection are served once they are written. Mapped
+//segments are opened with FAISS IO_FLAG_MMAP: the vectors stay in the file and get paged in from
+//the page cache on demand, so a collection can be much larger than RAM. What FAISS can map depends
+//on its version: IVF lists always, flat codes (flat, HNSW storage, SQ) only from faiss 1.11 on
+//(IO_FLAG_MMAP_IFC). HNSW graphs are always read in. See ImmutableSegment::canMap().
+struct StorageSpec {
+    bool mmap{true};             //serve persisted segments from their mapped files
+    size_t memory_budget_mb{0};  //segment indexes kept fully in process memory (smallest first), the rest is mapped
+};
+
+//payload field ("a.b" reaches into nested objects) -> how to index it, e.g. {"tenant": Keyword, "price": Numeric}
+using PayloadIndexSchema = std::map<std::string, PayloadFieldType>;
+
 //The name CollectionInfo is vague here for sure, like is it a schema or something metadata?
 //well i am still learning DB implementations and terminologies, so i will figure it out later.
 struct CollectionInfo {
@@ -32,6 +76,10 @@ struct CollectionInfo {
     // CollectionStatus status;  // e.g., Loaded, Unloaded, Building
     std::map<VectorName, VectorSpec> vec_specs; //vector specifications, lol not sure if this is a good name
     IndexSpec index_specs;
+    PayloadIndexSchema payload_index; //fields the immutable segments build in-memory filter indexes for
+    PayloadStoreSpec payload_store;
+    WalSpec wal;
+    StorageSpec storage; //on_disk only
 };
 
 }
\ No newline at end of file
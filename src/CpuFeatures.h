@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+/*
+Runtime cpu feature detection.
+
+Before this, the SIMD code was picked at compile time with #ifdef __AVX2__, so a portable
+build (no -march=native) always ended up with the scalar loops, and the AVX-512 machines
+never used the 512-bit lanes at all. Now the kernels are compiled for every ISA with the
+target attribute and we pick the best one at runtime with CPUID.
+
+__builtin_cpu_supports() also checks that the OS saved the ymm/zmm state (XGETBV), so
+there is no need to do that by hand here.
+
+For debugging or benchmarking you can cap the ISA with the env var:
+    VECTORDB_SIMD=scalar | avx2 | avx512
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VECTORDB_X86 1
+//kernels get compiled for each ISA with these (Distance.h, BitmapIndex.h). Every AVX2 cpu has
+//popcnt too, so __builtin_popcountll inside them is one instruction instead of a libgcc call.
+#define VECTORDB_TARGET_AVX2   __attribute__((target("avx2,fma,popcnt")))
+#define VECTORDB_TARGET_AVX512 __attribute__((target("avx512f,popcnt")))
+#endif
+
+namespace vectordb {
+
+enum class SimdLevel {
+    Scalar,
+    AVX2,   //AVX2 + FMA
+    AVX512, //AVX-512F
+};
+
+struct CpuFeatures {
+    bool sse42{false};
+    bool avx2{false};
+    bool fma{false};
+    bool avx512f{false};
+};
+
+inline const CpuFeatures& cpu_features() noexcept {
+    static const CpuFeatures features = [] {
+        CpuFeatures f;
+#ifdef VECTORDB_X86
+        __builtin_cpu_init();
+        f.sse42   = __builtin_cpu_supports("sse4.2");
+        f.avx2    = __builtin_cpu_supports("avx2");
+        f.fma     = __builtin_cpu_supports("fma");
+        f.avx512f = __builtin_cpu_supports("avx512f");
+#endif
+        return f;
+    }();
+    return features;
+}
+
+//best SIMD level this host can run, capped by VECTORDB_SIMD if it is set
+inline SimdLevel detect_simd_level() noexcept {
+    const auto& f = cpu_features();
+    SimdLevel level = SimdLevel::Scalar;
+    if (f.avx2 && f.fma) level = SimdLevel::AVX2;
+    if (f.avx512f) level = SimdLevel::AVX512;
+
+    if (const char* env = std::getenv("VECTORDB_SIMD")) {
+        if (std::strcmp(env, "scalar") == 0) {
+            level = SimdLevel::Scalar;
+        } else if (std::strcmp(env, "avx2") == 0 && level == SimdLevel::AVX512) {
+            level = SimdLevel::AVX2;
+        }
+    }
+    return level;
+}
+
+inline const char* to_string(SimdLevel level) noexcept {
+    switch (level) {
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::AVX2:   return "avx2";
+        default:                return "scalar";
+    }
+}
+
+} // namespace vectordb
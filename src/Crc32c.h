@@ -0,0 +1,83 @@
+#pragma once
+
+#include "CpuFeatures.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef VECTORDB_X86
+#include <nmmintrin.h>
+#endif
+
+/*
+CRC32C (Castagnoli), the checksum of the WAL entries.
+
+SSE4.2 has an instruction for exactly this polynomial, 8 bytes per crc32 instruction. Compiled
+with the target attribute and picked at runtime (same as the distance kernels), the table version
+is the fallback for other cpus.
+
+crc32c(b, crc32c(a)) == crc32c(a + b), so a checksum can be built over pieces.
+*/
+
+namespace vectordb {
+
+namespace detail {
+
+inline const std::array<uint32_t, 256>& crc32c_table() noexcept {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u))); //reflected 0x1EDC6F41
+            }
+            t[i] = crc;
+        }
+        return t;
+    }();
+    return table;
+}
+
+inline uint32_t crc32c_scalar(uint32_t crc, const uint8_t* bytes, size_t size) noexcept {
+    const auto& table = crc32c_table();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef VECTORDB_X86
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_sse42(uint32_t crc, const uint8_t* bytes, size_t size) noexcept {
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; --size, ++bytes) {
+        crc = _mm_crc32_u8(crc, *bytes);
+    }
+    return crc;
+}
+#endif
+
+} // namespace detail
+
+//`crc` is the result of the previous piece, 0 to start
+inline uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0) noexcept {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#ifdef VECTORDB_X86
+    static const bool hw = cpu_features().sse42;
+    crc = hw ? detail::crc32c_sse42(crc, bytes, size) : detail::crc32c_scalar(crc, bytes, size);
+#else
+    crc = detail::crc32c_scalar(crc, bytes, size);
+#endif
+    return ~crc;
+}
+
+} // namespace vectordb
@@ -1,6 +1,11 @@
 #include "DB.h"
 #include "Utils.h"
 #include "JsonConverters.h"
+#include "FileSync.h"
+#include "TaskExecutor.h"
+
+#include <fstream>
+#include <future>
 
 namespace vectordb {
 Status DB::addCollection(const CollectionId& collection_name, const json& config_json) {
@@ -8,6 +13,13 @@ Status DB::addCollection(const CollectionId& collection_name, const json& config
     if (container.contains(collection_name)) {
         return Status::Error("Collection already exists: " + collection_name);
     }
+    {
+        std::lock_guard<std::mutex> lock(m_failed_mutex);
+        if (m_failed_collections.count(collection_name)) {
+            return Status::Error("Collection " + collection_name + " failed to load at startup, its files are kept in " +
+                                 collectionDir(collection_name).string() + " (delete the collection to drop them)");
+        }
+    }
 
     if (!config_json.contains("vectors") || !config_json["vectors"].is_object()) {
         return Status::Error("Add Collection -- Invalid vector json format. [vectors] must be an object");
@@ -52,6 +64,50 @@ Status DB::addCollection(const CollectionId& collection_name, const json& config
         collection_info.vec_specs["default"] = std::move(spec);
     }
 
+    //optional, anything left out keeps the IndexSpec defaults
+    if (config_json.contains("index_specs")) {
+        auto [index_spec, status] = parseIndexSpec(config_json["index_specs"]);
+        if (!status.ok) return status;
+        collection_info.index_specs = index_spec;
+    }
+
+    //optional "payload_store": {"sync": false, "disable_wal": false}, durability of the payload writes
+    if (config_json.contains("payload_store")) {
+        auto [store_spec, status] = parsePayloadStore(config_json["payload_store"]);
+        if (!status.ok) return status;
+        collection_info.payload_store = store_spec;
+    }
+
+    //optional "wal": {"durability": "per_batch", "commit_window_ms": 10, "file_size_mb": 32}, durability of the vector writes
+    if (config_json.contains("wal")) {
+        auto [wal_spec, status] = parseWalSpec(config_json["wal"]);
+        if (!status.ok) return status;
+        collection_info.wal = wal_spec;
+    }
+
+    //optional "storage": {"mmap": true, "memory_budget_mb": 0}, how an on_disk collection's segments are served
+    if (config_json.contains("storage")) {
+        auto [storage_spec, status] = parseStorageSpec(config_json["storage"]);
+        if (!status.ok) return status;
+        collection_info.storage = storage_spec;
+    }
+
+    //optional "payload_index": {"tenant": "keyword", "price": "numeric", "active": "bool"}
+    if (config_json.contains("payload_index")) {
+        auto [schema, status] = parsePayloadIndex(config_json["payload_index"]);
+        if (!status.ok) return status;
+        collection_info.payload_index = std::move(schema);
+    }
+
+    //no collection.json: whatever WAL or segments are in there belong to a dropped collection of
+    //the same name, don't let a restart load them into this one
+    std::error_code ec;
+    if (!std::filesystem::exists(collectionDir(collection_name) / "collection.json", ec)) {
+        std::filesystem::remove_all(collectionDir(collection_name) / "wal", ec);
+        std::filesystem::remove_all(collectionDir(collection_name) / "segments", ec);
+        std::filesystem::remove(collectionDir(collection_name) / "manifest.json", ec);
+    }
+
     try {
         auto collection = std::make_unique<Collection>(collection_name, collection_info);
         CollectionEntry entry;
@@ -59,7 +115,15 @@ Status DB::addCollection(const CollectionId& collection_name, const json& config
         entry.config = config_json;
 
         // Thread-safe addition to container
-        return container.addCollection(collection_name, std::move(entry));
+        auto status = container.addCollection(collection_name, std::move(entry));
+        if (!status.ok) return status;
+
+        //the config is what recoverCollections() rebuilds it from
+        status = saveCollectionConfig(collection_name, config_json);
+        if (!status.ok) {
+            std::cerr << "[WRITE ERROR] " << status.message << " (the collection won't survive a restart)\n";
+        }
+        return Status::OK();
         
     } catch (const std::exception& e) {
         return Status::Error("Collection creation failed: " + std::string(e.what()));
@@ -80,7 +144,171 @@ std::pair<VectorSpec, Status> DB::parseVectorSpec(const std::string& name, const
         return {VectorSpec{}, Status::Error("Unknown distance metric for: " + name)};
     }
 
-    return {VectorSpec{dim, metric}, Status::OK()};
+    //optional "index": {"type": "ivf_pq", "nlist": 256, "nprobe": 16, "pq_m": 48, "pq_nbits": 8}
+    VectorIndexSpec index_spec;
+    if (config.contains("index")) {
+        const auto& index_json = config["index"];
+        if (!index_json.is_object()) {
+            return {VectorSpec{}, Status::Error("[index] must be an object for: " + name)};
+        }
+
+        index_spec.type = parse_index_type(index_json.value("type", "hnsw_flat"));
+        if (index_spec.type == IndexType::UNKNOWN) {
+            return {VectorSpec{}, Status::Error("Unknown index type for: " + name +
+                    " (flat, hnsw_flat, hnsw_sq8, hnsw_fp16, ivf_flat, ivf_pq)")};
+        }
+
+        for (const char* key : {"nlist", "nprobe", "pq_m", "pq_nbits"}) {
+            if (index_json.contains(key) && !index_json[key].is_number_unsigned()) {
+                return {VectorSpec{}, Status::Error(std::string("[index.") + key + "] must be a non-negative integer for: " + name)};
+            }
+        }
+        index_spec.nlist = index_json.value("nlist", index_spec.nlist);
+        index_spec.nprobe = std::max<size_t>(1, index_json.value("nprobe", index_spec.nprobe));
+        index_spec.pq_m = index_json.value("pq_m", index_spec.pq_m);
+        index_spec.pq_nbits = index_json.value("pq_nbits", index_spec.pq_nbits);
+
+        if (index_spec.type == IndexType::IVFPQ) {
+            if (index_spec.pq_m == 0 || dim % index_spec.pq_m != 0) {
+                return {VectorSpec{}, Status::Error("[index.pq_m] must divide the vector size for: " + name)};
+            }
+            if (index_spec.pq_nbits == 0 || index_spec.pq_nbits > 16) {
+                return {VectorSpec{}, Status::Error("[index.pq_nbits] must be in 1..16 for: " + name)};
+            }
+        }
+    }
+
+    return {VectorSpec{dim, metric, index_spec}, Status::OK()};
+}
+
+std::pair<IndexSpec, Status> DB::parseIndexSpec(const json& config) {
+    IndexSpec spec;
+    if (!config.is_object()) {
+        return {spec, Status::Error("[index_specs] must be an object")};
+    }
+
+    for (const auto& [key, value] : config.items()) {
+        if (!value.is_number_unsigned()) {
+            return {spec, Status::Error("[index_specs." + key + "] must be a non-negative integer")};
+        }
+    }
+
+    spec.index_threshold = config.value("index_threshold", spec.index_threshold);
+    spec.m_edges = config.value("m_edges", spec.m_edges);
+    spec.ef_construction = config.value("ef_construction", spec.ef_construction);
+    spec.ef_search = config.value("ef_search", spec.ef_search);
+    spec.nprobe_segments = config.value("nprobe_segments", spec.nprobe_segments);
+    spec.compaction_fanout = config.value("compaction_fanout", spec.compaction_fanout);
+    spec.compaction_max_points = config.value("compaction_max_points", spec.compaction_max_points);
+    spec.compaction_deleted_pct = config.value("compaction_deleted_pct", spec.compaction_deleted_pct);
+
+    if (spec.index_threshold == 0 || spec.index_threshold > MAX_MEMORYPOOL_POINTS) {
+        return {spec, Status::Error("[index_specs.index_threshold] must be in 1.." + std::to_string(MAX_MEMORYPOOL_POINTS))};
+    }
+    if (spec.m_edges == 0) {
+        return {spec, Status::Error("[index_specs.m_edges] must be > 0")};
+    }
+    if (spec.compaction_fanout == 1) {
+        return {spec, Status::Error("[index_specs.compaction_fanout] must be 0 (off) or >= 2")};
+    }
+    if (spec.compaction_max_points < spec.index_threshold) {
+        return {spec, Status::Error("[index_specs.compaction_max_points] must be >= index_threshold")};
+    }
+    if (spec.compaction_deleted_pct > 100) {
+        return {spec, Status::Error("[index_specs.compaction_deleted_pct] must be in 0..100")};
+    }
+    return {spec, Status::OK()};
+}
+
+std::pair<PayloadStoreSpec, Status> DB::parsePayloadStore(const json& config) {
+    PayloadStoreSpec spec;
+    if (!config.is_object()) {
+        return {spec, Status::Error("[payload_store] must be an object")};
+    }
+
+    for (const auto& [key, value] : config.items()) {
+        if (!value.is_boolean()) {
+            return {spec, Status::Error("[payload_store." + key + "] must be a boolean")};
+        }
+    }
+
+    spec.sync = config.value("sync", spec.sync);
+    spec.disable_wal = config.value("disable_wal", spec.disable_wal);
+    if (spec.sync && spec.disable_wal) {
+        return {spec, Status::Error("[payload_store] sync needs the WAL, can't have disable_wal too")};
+    }
+    return {spec, Status::OK()};
+}
+
+std::pair<WalSpec, Status> DB::parseWalSpec(const json& config) {
+    WalSpec spec;
+    if (!config.is_object()) {
+        return {spec, Status::Error("[wal] must be an object")};
+    }
+
+    if (config.contains("durability")) {
+        if (!config["durability"].is_string()) {
+            return {spec, Status::Error("[wal.durability] must be a string")};
+        }
+        spec.durability = parse_wal_durability(config["durability"].get<std::string>());
+        if (spec.durability == WalDurability::UNKNOWN) {
+            return {spec, Status::Error("Unknown [wal.durability] (none, async, per_batch, per_request)")};
+        }
+    }
+    if (config.contains("commit_window_ms")) {
+        if (!config["commit_window_ms"].is_number_unsigned() || config["commit_window_ms"].get<size_t>() == 0) {
+            return {spec, Status::Error("[wal.commit_window_ms] must be a positive integer")};
+        }
+        spec.commit_window_ms = config["commit_window_ms"].get<size_t>();
+    }
+    if (config.contains("file_size_mb")) {
+        if (!config["file_size_mb"].is_number_unsigned() || config["file_size_mb"].get<size_t>() == 0
+            || config["file_size_mb"].get<size_t>() > 4096) {
+            return {spec, Status::Error("[wal.file_size_mb] must be an integer between 1 and 4096")};
+        }
+        spec.file_size_mb = config["file_size_mb"].get<size_t>();
+    }
+    return {spec, Status::OK()};
+}
+
+std::pair<StorageSpec, Status> DB::parseStorageSpec(const json& config) {
+    StorageSpec spec;
+    if (!config.is_object()) {
+        return {spec, Status::Error("[storage] must be an object")};
+    }
+
+    if (config.contains("mmap")) {
+        if (!config["mmap"].is_boolean()) {
+            return {spec, Status::Error("[storage.mmap] must be a boolean")};
+        }
+        spec.mmap = config["mmap"].get<bool>();
+    }
+    if (config.contains("memory_budget_mb")) {
+        if (!config["memory_budget_mb"].is_number_unsigned()) {
+            return {spec, Status::Error("[storage.memory_budget_mb] must be a non-negative integer")};
+        }
+        spec.memory_budget_mb = config["memory_budget_mb"].get<size_t>();
+    }
+    return {spec, Status::OK()};
+}
+
+std::pair<PayloadIndexSchema, Status> DB::parsePayloadIndex(const json& config) {
+    PayloadIndexSchema schema;
+    if (!config.is_object()) {
+        return {schema, Status::Error("[payload_index] must be an object of field -> type")};
+    }
+
+    for (const auto& [field, type_json] : config.items()) {
+        if (field.empty() || !type_json.is_string()) {
+            return {schema, Status::Error("[payload_index." + field + "] must be a type string")};
+        }
+        auto type = parse_payload_field_type(type_json.get<std::string>());
+        if (type == PayloadFieldType::UNKNOWN) {
+            return {schema, Status::Error("Unknown payload index type for: " + field + " (keyword, numeric, bool)")};
+        }
+        schema[field] = type;
+    }
+    return {schema, Status::OK()};
 }
 
 //i actually am not expecting a lot of collections created on a single computer.
@@ -101,14 +329,50 @@ json DB::listCollections() {
                 vector_specs_json[vec_name] = {
                     {"size", vec_spec.dim},
                     {"distance", to_string(vec_spec.metric)}, // You'll need to implement this
+                    {"index", {
+                        {"type", to_string(vec_spec.index.type)},
+                        {"nlist", vec_spec.index.nlist},
+                        {"nprobe", vec_spec.index.nprobe},
+                        {"pq_m", vec_spec.index.pq_m},
+                        {"pq_nbits", vec_spec.index.pq_nbits}
+                    }},
                 };
             }
             
+            json payload_index_json = json::object();
+            for (const auto& [field, type] : collectionInfo.payload_index) {
+                payload_index_json[field] = to_string(type);
+            }
+
             json item = {
                 {"name", name},
                 {"config", {
                     {"vectors", vector_specs_json},
-                    {"on_disk", collectionInfo.on_disk ? "true" : "false"}
+                    {"on_disk", collectionInfo.on_disk ? "true" : "false"},
+                    {"index_specs", {
+                        {"index_threshold", collectionInfo.index_specs.index_threshold},
+                        {"m_edges", collectionInfo.index_specs.m_edges},
+                        {"ef_construction", collectionInfo.index_specs.ef_construction},
+                        {"ef_search", collectionInfo.index_specs.ef_search},
+                        {"nprobe_segments", collectionInfo.index_specs.nprobe_segments},
+                        {"compaction_fanout", collectionInfo.index_specs.compaction_fanout},
+                        {"compaction_max_points", collectionInfo.index_specs.compaction_max_points},
+                        {"compaction_deleted_pct", collectionInfo.index_specs.compaction_deleted_pct}
+                    }},
+                    {"payload_index", payload_index_json},
+                    {"payload_store", {
+                        {"sync", collectionInfo.payload_store.sync},
+                        {"disable_wal", collectionInfo.payload_store.disable_wal}
+                    }},
+                    {"wal", {
+                        {"durability", to_string(collectionInfo.wal.durability)},
+                        {"commit_window_ms", collectionInfo.wal.commit_window_ms},
+                        {"file_size_mb", collectionInfo.wal.file_size_mb}
+                    }},
+                    {"storage", {
+                        {"mmap", collectionInfo.storage.mmap},
+                        {"memory_budget_mb", collectionInfo.storage.memory_budget_mb}
+                    }}
                 }},
             };
             result.push_back(item);
@@ -122,87 +386,246 @@ json DB::listCollections() {
 }
 
 Status DB::deleteCollection(const CollectionId& collection_name) {
+    bool failed = false;
+    {
+        std::lock_guard<std::mutex> lock(m_failed_mutex);
+        failed = m_failed_collections.erase(collection_name) > 0;
+    }
     // Use thread-safe removal
-    if (container.removeCollection(collection_name)) {
+    if (container.removeCollection(collection_name) || failed) {
+        //without its config a restart doesn't bring it back, and its WAL and segments are of no use to anyone
+        std::error_code ec;
+        std::filesystem::remove(collectionDir(collection_name) / "collection.json", ec);
+        std::filesystem::remove_all(collectionDir(collection_name) / "wal", ec);
+        std::filesystem::remove_all(collectionDir(collection_name) / "segments", ec);
+        std::filesystem::remove(collectionDir(collection_name) / "manifest.json", ec);
         return Status::OK();
     }
     return Status::Error("Collection does not exist: " + collection_name);
 }
 
+//Collections are created one after the other (cheap, just the config). Loading them then runs in
+//parallel on the executor's IO lane (they share nothing but the disk): first the segments on disk
+//(those load in parallel too, on the query lane), then the WAL replay on top, which needs the loaded
+//point ids to apply deletes and to skip what the segments already have. Nothing in there waits on
+//other IO lane work, so a small lane only means fewer collections at a time.
+Status DB::recoverCollections() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (!fs::is_directory("./vectordb", ec)) {
+        return Status::OK();
+    }
+
+    std::vector<std::shared_ptr<Collection>> collections;
+    for (const auto& dir : fs::directory_iterator("./vectordb", ec)) {
+        const fs::path config_path = dir.path() / "collection.json";
+        if (!dir.is_directory() || !fs::exists(config_path, ec)) continue;
+
+        const CollectionId name = dir.path().filename().string();
+        std::ifstream in(config_path);
+        json config = json::parse(in, nullptr, /*allow_exceptions*/false);
+        if (config.is_discarded()) {
+            std::cerr << "[RECOVERY] " << name << ": unreadable collection.json, skipped\n";
+            continue;
+        }
+        auto status = addCollection(name, config);
+        if (!status.ok) {
+            std::cerr << "[RECOVERY] " << name << ": " << status.message << "\n";
+            continue;
+        }
+        collections.push_back(container.getCollectionPtr(name));
+    }
+
+    std::vector<std::future<StatusOr<size_t>>> replays;
+    replays.reserve(collections.size());
+    for (const auto& collection : collections) {
+        replays.push_back(TaskExecutor::getInstance().submit(TaskLane::IO, [collection]() -> StatusOr<size_t> {
+            auto loaded = collection->loadSegments();
+            if (!loaded.ok()) {
+                return loaded.status();
+            }
+            if (loaded.value() > 0) {
+                std::cout << "[RECOVERY] " << collection->getInfo().name << ": loaded " << loaded.value()
+                          << " points from disk\n";
+            }
+            return collection->recoverFromWal();
+        }));
+    }
+
+    Status result = Status::OK();
+    for (size_t i = 0; i < replays.size(); ++i) {
+        const auto& name = collections[i]->getInfo().name;
+        auto replayed = replays[i].get();
+        if (!replayed.ok()) {
+            //half loaded: serving it (or letting it write a new manifest) would lose what didn't load.
+            //Take it out and leave every file alone.
+            std::cerr << "[RECOVERY] " << name << ": " << replayed.status().message
+                      << ", not serving it, its files are kept\n";
+            {
+                std::lock_guard<std::mutex> lock(m_failed_mutex);
+                m_failed_collections.insert(name);
+            }
+            container.removeCollection(name);
+            result = Status::Error("Recovery of " + name + " failed: " + replayed.status().message);
+            continue;
+        }
+        std::cout << "[RECOVERY] " << name << ": replayed " << replayed.value() << " WAL entries\n";
+    }
+    return result;
+}
+
+std::filesystem::path DB::collectionDir(const CollectionId& collection_name) {
+    return std::filesystem::path("./vectordb") / collection_name;
+}
+
+//tmp file + rename, so a crash leaves either the old config or the new one, never half of it
+Status DB::saveCollectionConfig(const CollectionId& collection_name, const json& config_json) {
+    std::error_code ec;
+    const auto dir = collectionDir(collection_name);
+    std::filesystem::create_directories(dir, ec);
+    auto status = replaceFileSynced(dir / "collection.json", config_json.dump(4));
+    if (!status.ok) {
+        return Status::Error("Failed to save collection config: " + status.message);
+    }
+    return syncPath(dir.parent_path()); //the collection's directory itself is new too
+
+}
+
 
 Status DB::upsertPointsToCollection(const CollectionId& collection_name, const json& points_json) {
-    // Use the new optional approach
-    auto access_opt = container.getCollectionForWrite(collection_name);
+    if (!points_json.is_array()) {
+        return Status::Error("Points must be an array");
+    }
+
+    //shared access is enough: the segment holder and the payload store do their own locking, so
+    //concurrent upserts into one collection run side by side (and next to searches). This only
+    //keeps the collection from being dropped underneath us.
+    auto access_opt = container.getCollectionForRead(collection_name);
     if (!access_opt) {
         return Status::Error("Collection '" + collection_name + "' does not exist");
     }
     
     auto& access = access_opt.value();
-    auto& collection = access.first->collection;
-    auto collection_info = collection->getInfo();
+    const auto& collection = access.first->collection;
+    const auto& collection_info = collection->getInfo();
 
     std::cout << "Upsert into collection: " << collection_name << "\n";
 
-    if (!points_json.is_array()) {
-        return Status::Error("Points must be an array");
-    }
-
-    // Extract the points
+    //parse and validate the whole batch first, a bad point fails the request before anything is written
+    std::vector<PointUpsert> points;
+    points.reserve(points_json.size());
     for (const auto& p : points_json) {
-        if (!p.contains("id") || !p.contains("vector")) {
-            return Status::Error("Point missing id or vector field");
+        auto parsed = parsePoint(p, collection_info);
+        if (!parsed.ok()) {
+            return parsed.status();
         }
+        points.push_back(std::move(parsed.value()));
+    }
+
+    //all payloads in one rocksdb write, before the vectors: a filtered search that finds one of
+    //these points can then always read its payload. Each point's version is taken up front and the
+    //vectors get the same one, so when upserts of one id race, the payload store and the segments
+    //both keep the write with the higher version and can't end up with different ones.
+    auto& segment_holder = collection->getSegmentHolder();
+    std::vector<PayloadWrite> payloads;
+    payloads.reserve(points.size());
+    for (const auto& point : points) {
+        payloads.push_back(PayloadWrite{point.id, &point.payload, segment_holder.reserveVersion()});
+    }
+    auto payload_status = collection->getPayloadStore().putPayloads(payloads);
+    if (!payload_status.ok) {
+        return payload_status;
+    }
+
+    //the WAL entries of all points go to the group commit writer, the request waits for them once
+    //at the end (how long depends on the collection's wal.durability)
+    WalBatch wal_batch;
+    for (size_t i = 0; i < points.size(); ++i) {
+        const auto& point = points[i];
+        const uint64_t version = payloads[i].version;
+        auto status = point.named_vectors.empty()
+                    ? upsertPoints(collection, point.id, point.vector, point.payload, &wal_batch, version)
+                    : upsertPoints(collection, point.id, point.named_vectors, point.payload, &wal_batch, version);
+        if (!status.ok) { return status; }
+    } //end of point adding for-loop
+
+    return wal_batch.wait();
+}
+
+StatusOr<DB::PointUpsert> DB::parsePoint(const json& p, const CollectionInfo& collection_info) {
+    if (!p.contains("id") || !p.contains("vector")) {
+        return Status::Error("Point missing id or vector field");
+    }
 
-        std::string point_id = p["id"].get<PointIdType>();
-        auto payload = p.value("payload", vectordb::json::object());
+    PointUpsert point;
+    point.id = p["id"].get<PointIdType>();
+    point.payload = p.value("payload", vectordb::json::object());
+
+    // Schema 1: vector is array (single default vector)
+    if (p["vector"].is_array()) {
+        auto result = validateVector("default", p["vector"], collection_info);
+        if (!result.ok()) {
+            return result.status();
+        }
+        point.vector = std::move(result.value());
+    }
+    // Schema 2: vector is object (multiple named vectors)
+    else if (p["vector"].is_object()) {
+        if (p["vector"].size() > TINY_MAP_CAPACITY) {
+            return Status::Error("Point has too many named vectors (max " 
+                    + std::to_string(TINY_MAP_CAPACITY) + ")");
+        }
 
-        // Schema 1: vector is array (single default vector)
-        if (p["vector"].is_array()) {
-            auto result = validateVector("default", p["vector"], collection_info);
+        for (auto it = p["vector"].begin(); it != p["vector"].end(); ++it) {
+            const auto& vec_name = it.key();
+            const auto& jvec = it.value();
+            
+            auto result = validateVector(vec_name, jvec, collection_info);
             if (!result.ok()) {
                 return result.status();
             }
-            auto status = upsertPoints(collection, point_id, result.value(), payload);
-            if (!status.ok) { return status; }
+            point.named_vectors[vec_name] = std::move(result.value());
         }
-        // Schema 2: vector is object (multiple named vectors)
-        else if (p["vector"].is_object()) {
-            std::map<VectorName, DenseVector> named_vectors;
 
-            if (p["vector"].size() > TINY_MAP_CAPACITY) {
-                return Status::Error("Point has too many named vectors (max " 
-                        + std::to_string(TINY_MAP_CAPACITY) + ")");
-            }
+        // Must contain at least one valid vector
+        if (point.named_vectors.empty()) {
+            return Status::Error("No valid vectors found for point " + point.id);
+        }
+    } else {
+        return Status::Error("Invalid json vector format for point " + point.id);
+    }
+    return point;
+}
 
-            for (auto it = p["vector"].begin(); it != p["vector"].end(); ++it) {
-                const auto& vec_name = it.key();
-                const auto& jvec = it.value();
-                
-                auto result = validateVector(vec_name, jvec, collection_info);
-                if (!result.ok()) {
-                    return result.status();
-                }
-                named_vectors[vec_name] = result.value();
-            }
 
-            // Must contain at least one valid vector
-            if (named_vectors.empty()) {
-                return Status::Error("No valid vectors found for point " + point_id);
-            }
+//points_json is the list of ids to delete, e.g. ["p1", "p2"]. Unknown ids are not an error,
+//the returned count just doesn't include them.
+StatusOr<size_t> DB::deletePointsFromCollection(const CollectionId& collection_name, const json& point_ids_json) {
+    //shared access like the upserts: SegmentHolder::deletePoints() locks what it touches and the
+    //payload store does its own, so queries and upserts don't wait behind the WAL sync of a delete
+    auto access_opt = container.getCollectionForRead(collection_name);
+    if (!access_opt) {
+        return Status::Error("Collection '" + collection_name + "' does not exist");
+    }
 
-            auto status = upsertPoints(collection, point_id, named_vectors, payload);
-            if (!status.ok) { return status; }
-        } else {
-            return Status::Error("Invalid json vector format for point " + point_id);
-        }
+    auto& access = access_opt.value();
+    const auto& collection = access.first->collection;
 
-        //add payload here
-        auto& collection_point_payload = collection->getPayloadStore();
-        collection_point_payload.putPayload(point_id, payload);
+    if (!point_ids_json.is_array()) {
+        return Status::Error("Points must be an array of point ids");
+    }
 
-    } //end of point adding for-loop
+    std::vector<PointIdType> point_ids;
+    point_ids.reserve(point_ids_json.size());
+    for (const auto& id : point_ids_json) {
+        if (!id.is_string()) {
+            return Status::Error("Point ids must be strings");
+        }
+        point_ids.push_back(id.get<PointIdType>());
+    }
 
-    return Status::OK();
+    std::cout << "Delete " << point_ids.size() << " points from collection: " << collection_name << "\n";
+    return collection->deletePoints(point_ids);
 }
 
 
@@ -242,10 +665,12 @@ StatusOr<DenseVector> DB::validateVector(const VectorName& name,
 
 
 //for single vector inserts, so just the default named vector, no multiple named vectors
-Status DB::upsertPoints(std::shared_ptr<Collection>& collection, 
+Status DB::upsertPoints(const std::shared_ptr<Collection>& collection, 
                         const PointIdType& point_id, 
                         const DenseVector& vector,
-                        const json& payload) 
+                        const json& payload,
+                        WalBatch* wal_batch,
+                        uint64_t version) 
 {
     // std::cout << "Upsert into collection: " << collection_name << "\n";
     // std::cout << "Point ID: " << point_id << "\n";
@@ -256,14 +681,16 @@ Status DB::upsertPoints(std::shared_ptr<Collection>& collection,
     // }
     // std::cout << "]\n";
 
-    return collection->insertPoint(point_id, vector, payload);
+    return collection->insertPoint(point_id, vector, payload, wal_batch, version);
 }
 
 //overload for multiple named vector inserts
-Status DB::upsertPoints(std::shared_ptr<Collection>& collection, 
+Status DB::upsertPoints(const std::shared_ptr<Collection>& collection, 
                         const PointIdType& point_id, 
                         const std::map<VectorName, DenseVector>& named_vectors,
-                        const json& payload)
+                        const json& payload,
+                        WalBatch* wal_batch,
+                        uint64_t version)
 {
     // std::cout << "Point ID: " << point_id << "\n";
 
@@ -275,7 +702,7 @@ Status DB::upsertPoints(std::shared_ptr<Collection>& collection,
     //     std::cout << "]\n";
     // }
 
-    return collection->insertPoint(point_id, named_vectors, payload);
+    return collection->insertPoint(point_id, named_vectors, payload, wal_batch, version);
 
 }
 
@@ -283,7 +710,8 @@ Status DB::upsertPoints(std::shared_ptr<Collection>& collection,
 json DB::queryCollection(const std::string& collection_name, 
                          const json& query_body,
                          const std::string& using_index, 
-                         size_t top_k)
+                         size_t top_k,
+                         const SearchParams& search_params)
 {
     auto access_opt = container.getCollectionForRead(collection_name);
     if (!access_opt) {
@@ -298,6 +726,15 @@ json DB::queryCollection(const std::string& collection_name,
 
     // std::cout << query_body.dump(4) << std::endl;
 
+    PayloadFilter filter;
+    if (query_body.contains("filter") && !query_body["filter"].is_null()) {
+        auto parsed = PayloadFilter::parse(query_body["filter"]);
+        if (!parsed.ok()) {
+            return { {"status", "error"}, {"message", parsed.status().message} };
+        }
+        filter = std::move(parsed.value());
+    }
+
     if (query_body.contains("query_vectors")) 
     {
         const auto& query_vectors_json = query_body["query_vectors"];
@@ -319,7 +756,7 @@ json DB::queryCollection(const std::string& collection_name,
         if (query_vectors.empty()) {
             qr.status = Status::Error("No valid vectors found for given point IDs");
         } else {
-            qr = collection->searchTopK(vector_name, query_vectors, top_k);
+            qr = collection->searchTopK(vector_name, query_vectors, top_k, search_params, filter);
         }
     }
 
@@ -5,6 +5,9 @@
 #include "CollectionContainer.h"
 #include "Status.h"
 
+#include <mutex>
+#include <set>
+
 /*
 I will be using the Singleton Design Pattern for my DB class
 */
@@ -23,11 +26,15 @@ public:
 
     Status addCollection(const CollectionId& collection_name, const json& config_json);
     Status deleteCollection(const CollectionId& collection_name);
+    //Startup: re-create every collection saved under ./vectordb and replay its WAL (see WAL.h)
+    Status recoverCollections();
     Status upsertPointsToCollection(const CollectionId& collection_name, const json& points_json);
+    StatusOr<size_t> deletePointsFromCollection(const CollectionId& collection_name, const json& point_ids_json);
     
     json listCollections();
     json queryCollection(const std::string& collection_name, const json& query_body, 
-                         const std::string& using_index, std::size_t top_k);
+                         const std::string& using_index, std::size_t top_k,
+                         const SearchParams& search_params = {});
 
     // Graph operations, uhm the method names maybe bad for some people hehe, but i think is fine for now.
     Status addGraphRelationship(const std::string& collection_name, 
@@ -55,21 +62,48 @@ private:
     ~DB() = default;
     
     CollectionContainer container;
+    //collections whose segments or WAL couldn't be loaded at startup. Not served, and the name can't
+    //be re-created over their files (that would rewrite the manifest without them); deleting one
+    //drops its files like any other collection.
+    std::mutex m_failed_mutex;
+    std::set<CollectionId> m_failed_collections;
+
+    //./vectordb/<name>, holds collection.json (the create request as given), wal/, segments/, manifest.json...
+    static std::filesystem::path collectionDir(const CollectionId& collection_name);
+    Status saveCollectionConfig(const CollectionId& collection_name, const json& config_json);
     
     std::pair<VectorSpec, Status> parseVectorSpec(const std::string& name, const json& config);
+    std::pair<IndexSpec, Status> parseIndexSpec(const json& config);
+    std::pair<PayloadIndexSchema, Status> parsePayloadIndex(const json& config);
+    std::pair<PayloadStoreSpec, Status> parsePayloadStore(const json& config);
+    std::pair<WalSpec, Status> parseWalSpec(const json& config);
+    std::pair<StorageSpec, Status> parseStorageSpec(const json& config);
     StatusOr<DenseVector> validateVector(const VectorName& name, const json& jvec, 
                                          const CollectionInfo& collection_info);
     
+    //one point of an upsert request, parsed and validated before anything gets written
+    struct PointUpsert {
+        PointIdType id;
+        DenseVector vector; //schema 1, the "default" vector
+        std::map<VectorName, DenseVector> named_vectors; //schema 2, empty for schema 1
+        Payload payload;
+    };
+    StatusOr<PointUpsert> parsePoint(const json& p, const CollectionInfo& collection_info);
+
     // Upsert helpers
-    Status upsertPoints(std::shared_ptr<Collection>& collection, 
+    Status upsertPoints(const std::shared_ptr<Collection>& collection, 
                         const PointIdType& point_id, 
                         const DenseVector& vector,
-                        const Payload& payload);
+                        const Payload& payload,
+                        WalBatch* wal_batch,
+                        uint64_t version);
     
-    Status upsertPoints(std::shared_ptr<Collection>& collection, 
+    Status upsertPoints(const std::shared_ptr<Collection>& collection, 
                         const PointIdType& point_id, 
                         const std::map<VectorName, DenseVector>& named_vectors,
-                        const Payload& payload);
+                        const Payload& payload,
+                        WalBatch* wal_batch,
+                        uint64_t version);
 };
 
 } // namespace vectordb
\ No newline at end of file
@@ -47,6 +47,7 @@ namespace vectordb {
     //constexpr ensures compile-time evaluation (no runtime overhead).
     //inline prevents "multiple definition" errors when included in headers.
     //move these later in Config.h part...
+    inline constexpr double FILTER_BRUTE_FORCE_SELECTIVITY = 0.02; //filtered search: below 2% matching points, scan them instead of walking the graph
     inline constexpr size_t CACHE_SIZE = 128;// 128MB cache, can be specified by user...
 
     //could be adjusted, uhm, yeah i am thinking about just to have a config file here..but whatever, get the job done first.
@@ -80,6 +81,34 @@ namespace vectordb {
         UNKNOWN,
     };
 
+    //which FAISS index an immutableSegment builds for a vector space
+    enum class IndexType {
+        Flat,       // brute force, best for small segments
+        HNSWFlat,   // HNSW graph over raw floats (the default)
+        HNSWSQ8,    // HNSW over 8-bit scalar quantized vectors, ~4x less memory
+        HNSWFP16,   // HNSW over fp16 vectors, ~2x less memory
+        IVFFlat,    // inverted lists over raw floats
+        IVFPQ,      // inverted lists over product quantized codes, smallest footprint
+        UNKNOWN,
+    };
+
+    //how a payload field is indexed inside each immutable segment (see FilterMatrix.h)
+    enum class PayloadFieldType {
+        Keyword,    // equality on strings (one bitmap per distinct value)
+        Numeric,    // ranges on numbers (sorted value column)
+        Bool,       // true/false (two bitmaps)
+        UNKNOWN,
+    };
+
+    //what an upsert waits for before it is acknowledged (see WAL.h)
+    enum class WalDurability {
+        None,       // no WAL at all, a crash loses everything not in an immutable segment yet
+        Async,      // don't wait, the writer thread writes + fdatasyncs once per commit window
+        PerBatch,   // wait until the request's entries are written (survives a process crash)
+        PerRequest, // wait until they are fdatasync'd (survives losing the machine)
+        UNKNOWN,
+    };
+
     enum class CollectionStatus {
         //?
     };
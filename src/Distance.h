@@ -1,9 +1,14 @@
 #pragma once
 
 #include "DataTypes.h"
+#include "CpuFeatures.h"
 
+#ifdef VECTORDB_X86
 #include <immintrin.h>
+#endif
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
 /**
  * @brief Since it is possible that the points in the activeSegment is not added to the immutableSegment,
@@ -26,56 +31,313 @@
     _mm256_storeu_ps(): Store 8 results back
 
     Remainder handling: Process leftover elements (1-7) with regular loops
+
+    (update) The kernels are no longer picked with #ifdef __AVX2__. Every ISA version is
+    compiled with __attribute__((target(...))) and distance_kernels() picks the best one
+    for the host once (CPUID), so one portable binary gets AVX-512 / AVX2 / scalar.
+    AVX2 and AVX-512 use 4 independent accumulators (4x unroll), which is what
+    experiments/try_simd.cpp showed to be the fastest (~6x over scalar at 784-d).
 */
 namespace vectordb {
-//SIMD + Scalar Helpers
-#ifdef __AVX2__
-inline float avx_dot(const float* a, const float* b, size_t dim) noexcept {
+
+//result of the fused cosine kernel
+struct CosineParts {
+    float dot;
+    float norm_a_sq;
+    float norm_b_sq;
+};
+
+#ifdef VECTORDB_X86
+//------------------------------- AVX2 + FMA -------------------------------
+VECTORDB_TARGET_AVX2
+inline float avx2_hsum(__m256 v) noexcept {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    __m128 shuf = _mm_movehdup_ps(lo);
+    __m128 sums = _mm_add_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+VECTORDB_TARGET_AVX2
+inline float avx2_dot(const float* a, const float* b, size_t dim) noexcept {
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps();
+    __m256 s3 = _mm256_setzero_ps();
     size_t i = 0;
-    __m256 vsum = _mm256_setzero_ps();
-    // process 8 floating-point numbers in parallel using 256-bit registers
+    //32 floats per iteration, 4 independent FMA chains so we don't stall on FMA latency
+    for (; i + 32 <= dim; i += 32) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i),      s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8),  s1);
+        s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), s2);
+        s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), s3);
+    }
     for (; i + 8 <= dim; i += 8) {
-        __m256 va = _mm256_loadu_ps(a + i);
-        __m256 vb = _mm256_loadu_ps(b + i);
-        vsum = _mm256_fmadd_ps(va, vb, vsum); // vsum += va * vb
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
     }
+    float sum = avx2_hsum(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    for (; i < dim; ++i) sum += a[i] * b[i];
+    return sum;
+}
 
-    float tmp[8];
-    _mm256_storeu_ps(tmp, vsum);
-    float sum = tmp[0] + tmp[1] + tmp[2] + tmp[3] + tmp[4] + tmp[5] + tmp[6] + tmp[7];
-
-    // handle remainder
-    for (; i < dim; ++i)
-        sum += a[i] * b[i];
-
+VECTORDB_TARGET_AVX2
+inline float avx2_l2sq(const float* a, const float* b, size_t dim) noexcept {
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps();
+    __m256 s3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= dim; i += 32) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        s0 = _mm256_fmadd_ps(d0, d0, s0);
+        s1 = _mm256_fmadd_ps(d1, d1, s1);
+        s2 = _mm256_fmadd_ps(d2, d2, s2);
+        s3 = _mm256_fmadd_ps(d3, d3, s3);
+    }
+    for (; i + 8 <= dim; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        s0 = _mm256_fmadd_ps(d, d, s0);
+    }
+    float sum = avx2_hsum(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    for (; i < dim; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
     return sum;
 }
 
-inline float avx_l2sq(const float* a, const float* b, size_t dim) noexcept {
+//one pass over a and b for dot, |a|^2 and |b|^2 instead of three separate passes
+VECTORDB_TARGET_AVX2
+inline CosineParts avx2_cosine_parts(const float* a, const float* b, size_t dim) noexcept {
+    __m256 sd0 = _mm256_setzero_ps(), sd1 = _mm256_setzero_ps();
+    __m256 sa0 = _mm256_setzero_ps(), sa1 = _mm256_setzero_ps();
+    __m256 sb0 = _mm256_setzero_ps(), sb1 = _mm256_setzero_ps();
     size_t i = 0;
-    __m256 vsum = _mm256_setzero_ps();
+    for (; i + 16 <= dim; i += 16) {
+        __m256 a0 = _mm256_loadu_ps(a + i),     b0 = _mm256_loadu_ps(b + i);
+        __m256 a1 = _mm256_loadu_ps(a + i + 8), b1 = _mm256_loadu_ps(b + i + 8);
+        sd0 = _mm256_fmadd_ps(a0, b0, sd0);
+        sd1 = _mm256_fmadd_ps(a1, b1, sd1);
+        sa0 = _mm256_fmadd_ps(a0, a0, sa0);
+        sa1 = _mm256_fmadd_ps(a1, a1, sa1);
+        sb0 = _mm256_fmadd_ps(b0, b0, sb0);
+        sb1 = _mm256_fmadd_ps(b1, b1, sb1);
+    }
+    for (; i + 8 <= dim; i += 8) {
+        __m256 a0 = _mm256_loadu_ps(a + i), b0 = _mm256_loadu_ps(b + i);
+        sd0 = _mm256_fmadd_ps(a0, b0, sd0);
+        sa0 = _mm256_fmadd_ps(a0, a0, sa0);
+        sb0 = _mm256_fmadd_ps(b0, b0, sb0);
+    }
+    CosineParts parts{avx2_hsum(_mm256_add_ps(sd0, sd1)),
+                      avx2_hsum(_mm256_add_ps(sa0, sa1)),
+                      avx2_hsum(_mm256_add_ps(sb0, sb1))};
+    for (; i < dim; ++i) {
+        parts.dot += a[i] * b[i];
+        parts.norm_a_sq += a[i] * a[i];
+        parts.norm_b_sq += b[i] * b[i];
+    }
+    return parts;
+}
 
+//4 queries x 2 stored vectors per call, 8 accumulators live in registers. every load of a
+//stored vector chunk is reused by 4 queries and every query chunk by 2 stored vectors,
+//which is where the batch kernel wins over calling avx2_dot() nq*nb times.
+//q rows and b rows are contiguous with stride = dim, out is written as out[qi * ldo + bj].
+VECTORDB_TARGET_AVX2
+inline void avx2_dot_tile_4x2(const float* q, const float* b, size_t dim,
+                              float* out, size_t ldo) noexcept {
+    const float* q0 = q;
+    const float* q1 = q + dim;
+    const float* q2 = q + 2 * dim;
+    const float* q3 = q + 3 * dim;
+    const float* b0 = b;
+    const float* b1 = b + dim;
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    size_t i = 0;
     for (; i + 8 <= dim; i += 8) {
-        __m256 va = _mm256_loadu_ps(a + i);
-        __m256 vb = _mm256_loadu_ps(b + i);
-        __m256 diff = _mm256_sub_ps(va, vb);
-        vsum = _mm256_fmadd_ps(diff, diff, vsum);
+        __m256 vb0 = _mm256_loadu_ps(b0 + i);
+        __m256 vb1 = _mm256_loadu_ps(b1 + i);
+        __m256 vq = _mm256_loadu_ps(q0 + i);
+        c00 = _mm256_fmadd_ps(vq, vb0, c00);
+        c01 = _mm256_fmadd_ps(vq, vb1, c01);
+        vq = _mm256_loadu_ps(q1 + i);
+        c10 = _mm256_fmadd_ps(vq, vb0, c10);
+        c11 = _mm256_fmadd_ps(vq, vb1, c11);
+        vq = _mm256_loadu_ps(q2 + i);
+        c20 = _mm256_fmadd_ps(vq, vb0, c20);
+        c21 = _mm256_fmadd_ps(vq, vb1, c21);
+        vq = _mm256_loadu_ps(q3 + i);
+        c30 = _mm256_fmadd_ps(vq, vb0, c30);
+        c31 = _mm256_fmadd_ps(vq, vb1, c31);
+    }
+    float r[4][2] = {
+        {avx2_hsum(c00), avx2_hsum(c01)},
+        {avx2_hsum(c10), avx2_hsum(c11)},
+        {avx2_hsum(c20), avx2_hsum(c21)},
+        {avx2_hsum(c30), avx2_hsum(c31)},
+    };
+    for (; i < dim; ++i) {
+        r[0][0] += q0[i] * b0[i]; r[0][1] += q0[i] * b1[i];
+        r[1][0] += q1[i] * b0[i]; r[1][1] += q1[i] * b1[i];
+        r[2][0] += q2[i] * b0[i]; r[2][1] += q2[i] * b1[i];
+        r[3][0] += q3[i] * b0[i]; r[3][1] += q3[i] * b1[i];
+    }
+    for (size_t qi = 0; qi < 4; ++qi) {
+        out[qi * ldo]     = r[qi][0];
+        out[qi * ldo + 1] = r[qi][1];
     }
+}
 
-    float tmp[8];
-    _mm256_storeu_ps(tmp, vsum);
-    float sum = tmp[0] + tmp[1] + tmp[2] + tmp[3] + tmp[4] + tmp[5] + tmp[6] + tmp[7];
+//------------------------------- AVX-512F -------------------------------
+//sum of the 16 lanes, halved down to one by hand. _mm512_reduce_add_ps does the same, but with
+//GCC 12 it (and the plain extract/cast intrinsics) fill the unused result with _mm256_undefined_pd()
+//and -Wall warns '__Y' is used uninitialized. The zero-masked extract with an all-ones mask is the
+//same vextractf64x4 without that.
+VECTORDB_TARGET_AVX512
+inline float avx512_hsum(__m512 v) noexcept {
+    const __m512d vd = _mm512_castps_pd(v);
+    __m256 lo = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xFF, vd, 0));
+    __m256 hi = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xFF, vd, 1));
+    lo = _mm256_add_ps(lo, hi);
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1));
+    __m128 shuf = _mm_movehdup_ps(sums);
+    sums = _mm_add_ps(sums, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
 
-    for (; i < dim; ++i) {
-        float d = a[i] - b[i];
-        sum += d * d;
+//the tail is done with a masked load, so no scalar cleanup loop is needed.
+VECTORDB_TARGET_AVX512
+inline float avx512_dot(const float* a, const float* b, size_t dim) noexcept {
+    __m512 s0 = _mm512_setzero_ps();
+    __m512 s1 = _mm512_setzero_ps();
+    __m512 s2 = _mm512_setzero_ps();
+    __m512 s3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= dim; i += 64) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i),      s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+        s2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), s2);
+        s3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), s3);
     }
+    for (; i + 16 <= dim; i += 16) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+    }
+    if (i < dim) {
+        __mmask16 m = static_cast<__mmask16>((1u << (dim - i)) - 1);
+        s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), s1);
+    }
+    return avx512_hsum(_mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+}
 
-    return sum;
+VECTORDB_TARGET_AVX512
+inline float avx512_l2sq(const float* a, const float* b, size_t dim) noexcept {
+    __m512 s0 = _mm512_setzero_ps();
+    __m512 s1 = _mm512_setzero_ps();
+    __m512 s2 = _mm512_setzero_ps();
+    __m512 s3 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 64 <= dim; i += 64) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+        __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+        s0 = _mm512_fmadd_ps(d0, d0, s0);
+        s1 = _mm512_fmadd_ps(d1, d1, s1);
+        s2 = _mm512_fmadd_ps(d2, d2, s2);
+        s3 = _mm512_fmadd_ps(d3, d3, s3);
+    }
+    for (; i + 16 <= dim; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        s0 = _mm512_fmadd_ps(d, d, s0);
+    }
+    if (i < dim) {
+        __mmask16 m = static_cast<__mmask16>((1u << (dim - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+        s1 = _mm512_fmadd_ps(d, d, s1);
+    }
+    return avx512_hsum(_mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+}
+VECTORDB_TARGET_AVX512
+inline CosineParts avx512_cosine_parts(const float* a, const float* b, size_t dim) noexcept {
+    __m512 sd0 = _mm512_setzero_ps(), sd1 = _mm512_setzero_ps();
+    __m512 sa0 = _mm512_setzero_ps(), sa1 = _mm512_setzero_ps();
+    __m512 sb0 = _mm512_setzero_ps(), sb1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= dim; i += 32) {
+        __m512 a0 = _mm512_loadu_ps(a + i),      b0 = _mm512_loadu_ps(b + i);
+        __m512 a1 = _mm512_loadu_ps(a + i + 16), b1 = _mm512_loadu_ps(b + i + 16);
+        sd0 = _mm512_fmadd_ps(a0, b0, sd0);
+        sd1 = _mm512_fmadd_ps(a1, b1, sd1);
+        sa0 = _mm512_fmadd_ps(a0, a0, sa0);
+        sa1 = _mm512_fmadd_ps(a1, a1, sa1);
+        sb0 = _mm512_fmadd_ps(b0, b0, sb0);
+        sb1 = _mm512_fmadd_ps(b1, b1, sb1);
+    }
+    for (; i < dim; i += 16) {
+        //last chunk may be partial, the mask zeroes the lanes past dim
+        __mmask16 m = (dim - i >= 16) ? static_cast<__mmask16>(0xFFFF)
+                                      : static_cast<__mmask16>((1u << (dim - i)) - 1);
+        __m512 a0 = _mm512_maskz_loadu_ps(m, a + i), b0 = _mm512_maskz_loadu_ps(m, b + i);
+        sd0 = _mm512_fmadd_ps(a0, b0, sd0);
+        sa0 = _mm512_fmadd_ps(a0, a0, sa0);
+        sb0 = _mm512_fmadd_ps(b0, b0, sb0);
+    }
+    return {avx512_hsum(_mm512_add_ps(sd0, sd1)),
+            avx512_hsum(_mm512_add_ps(sa0, sa1)),
+            avx512_hsum(_mm512_add_ps(sb0, sb1))};
+}
+VECTORDB_TARGET_AVX512
+inline void avx512_dot_tile_4x2(const float* q, const float* b, size_t dim,
+                                float* out, size_t ldo) noexcept {
+    const float* q0 = q;
+    const float* q1 = q + dim;
+    const float* q2 = q + 2 * dim;
+    const float* q3 = q + 3 * dim;
+    const float* b0 = b;
+    const float* b1 = b + dim;
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    for (size_t i = 0; i < dim; i += 16) {
+        __mmask16 m = (dim - i >= 16) ? static_cast<__mmask16>(0xFFFF)
+                                      : static_cast<__mmask16>((1u << (dim - i)) - 1);
+        __m512 vb0 = _mm512_maskz_loadu_ps(m, b0 + i);
+        __m512 vb1 = _mm512_maskz_loadu_ps(m, b1 + i);
+        __m512 vq = _mm512_maskz_loadu_ps(m, q0 + i);
+        c00 = _mm512_fmadd_ps(vq, vb0, c00);
+        c01 = _mm512_fmadd_ps(vq, vb1, c01);
+        vq = _mm512_maskz_loadu_ps(m, q1 + i);
+        c10 = _mm512_fmadd_ps(vq, vb0, c10);
+        c11 = _mm512_fmadd_ps(vq, vb1, c11);
+        vq = _mm512_maskz_loadu_ps(m, q2 + i);
+        c20 = _mm512_fmadd_ps(vq, vb0, c20);
+        c21 = _mm512_fmadd_ps(vq, vb1, c21);
+        vq = _mm512_maskz_loadu_ps(m, q3 + i);
+        c30 = _mm512_fmadd_ps(vq, vb0, c30);
+        c31 = _mm512_fmadd_ps(vq, vb1, c31);
+    }
+    out[0]           = avx512_hsum(c00); out[1]           = avx512_hsum(c01);
+    out[ldo]         = avx512_hsum(c10); out[ldo + 1]     = avx512_hsum(c11);
+    out[2 * ldo]     = avx512_hsum(c20); out[2 * ldo + 1] = avx512_hsum(c21);
+    out[3 * ldo]     = avx512_hsum(c30); out[3 * ldo + 1] = avx512_hsum(c31);
 }
-#endif //__AVX2__
+#endif //VECTORDB_X86
 
 
+//------------------------------- Scalar -------------------------------
 inline float scalar_dot(const float* a, const float* b, size_t dim) noexcept {
     float s = 0.0f;
     for (size_t i = 0; i < dim; ++i) s += a[i] * b[i];
@@ -91,13 +353,67 @@ inline float scalar_l2sq(const float* a, const float* b, size_t dim) noexcept {
     return s;
 }
 
-inline float norm(const float* a, size_t dim) noexcept {
-#ifdef __AVX2__
-    float dot = avx_dot(a, a, dim);
-#else
-    float dot = scalar_dot(a, a, dim);
+
+inline CosineParts scalar_cosine_parts(const float* a, const float* b, size_t dim) noexcept {
+    CosineParts parts{0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < dim; ++i) {
+        parts.dot += a[i] * b[i];
+        parts.norm_a_sq += a[i] * a[i];
+        parts.norm_b_sq += b[i] * b[i];
+    }
+    return parts;
+}
+
+inline void scalar_dot_tile_4x2(const float* q, const float* b, size_t dim,
+                                float* out, size_t ldo) noexcept {
+    for (size_t qi = 0; qi < 4; ++qi) {
+        out[qi * ldo]     = scalar_dot(q + qi * dim, b, dim);
+        out[qi * ldo + 1] = scalar_dot(q + qi * dim, b + dim, dim);
+    }
+}
+
+
+//------------------------------- Dispatch -------------------------------
+using DistanceKernelFn = float (*)(const float*, const float*, size_t) noexcept;
+using CosineKernelFn = CosineParts (*)(const float*, const float*, size_t) noexcept;
+using DotTileKernelFn = void (*)(const float*, const float*, size_t, float*, size_t) noexcept;
+
+struct DistanceKernels {
+    SimdLevel level;
+    DistanceKernelFn dot;
+    DistanceKernelFn l2sq;
+    CosineKernelFn cosine_parts;
+    DotTileKernelFn dot_tile_4x2;
+};
+
+inline DistanceKernels select_distance_kernels(SimdLevel level) noexcept {
+    switch (level) {
+#ifdef VECTORDB_X86
+        case SimdLevel::AVX512:
+            return {SimdLevel::AVX512, avx512_dot, avx512_l2sq, avx512_cosine_parts, avx512_dot_tile_4x2};
+        case SimdLevel::AVX2:
+            return {SimdLevel::AVX2, avx2_dot, avx2_l2sq, avx2_cosine_parts, avx2_dot_tile_4x2};
 #endif
-    return std::sqrt(dot);
+        default:
+            return {SimdLevel::Scalar, scalar_dot, scalar_l2sq, scalar_cosine_parts, scalar_dot_tile_4x2};
+    }
+}
+
+//the table is built once (first call, main() touches it at startup) and never changes after.
+inline const DistanceKernels& distance_kernels() noexcept {
+    static const DistanceKernels kernels = select_distance_kernels(detect_simd_level());
+    return kernels;
+}
+
+inline float norm(const float* a, size_t dim) noexcept {
+    return std::sqrt(distance_kernels().dot(a, a, dim));
+}
+
+//cosine when both norms are already known (cached at insert time), so it only costs one dot
+inline float cosine_from_dot(float dot, float norm_a, float norm_b) noexcept {
+    if (norm_a < 1e-12f) norm_a = 1e-12f;
+    if (norm_b < 1e-12f) norm_b = 1e-12f;
+    return dot / (norm_a * norm_b);
 }
 
 
@@ -106,34 +422,18 @@ inline float compute_distance(DistanceMetric metric,
                               const float* a,
                               const float* b,
                               size_t dim) {
+    const auto& kernels = distance_kernels();
     switch (metric) {
-        case DistanceMetric::L2: {
-#ifdef __AVX2__
-            return avx_l2sq(a, b, dim);
-#else
-            return scalar_l2sq(a, b, dim);
-#endif
-        }
+        case DistanceMetric::L2:
+            return kernels.l2sq(a, b, dim);
 
-        case DistanceMetric::DOT: {
-#ifdef __AVX2__
-            return avx_dot(a, b, dim);
-#else
-            return scalar_dot(a, b, dim);
-#endif
-        }
+        case DistanceMetric::DOT:
+            return kernels.dot(a, b, dim);
 
         case DistanceMetric::COSINE: {
-#ifdef __AVX2__
-            float dot = avx_dot(a, b, dim);
-#else
-            float dot = scalar_dot(a, b, dim);
-#endif
-            float norm_a = norm(a, dim);
-            float norm_b = norm(b, dim);
-            if (norm_a < 1e-12f) norm_a = 1e-12f;
-            if (norm_b < 1e-12f) norm_b = 1e-12f;
-            return dot / (norm_a * norm_b);  // cosine similarity
+            //fused single pass, dot and both squared norms together
+            CosineParts parts = kernels.cosine_parts(a, b, dim);
+            return cosine_from_dot(parts.dot, std::sqrt(parts.norm_a_sq), std::sqrt(parts.norm_b_sq));
         }
 
         default:
@@ -143,6 +443,92 @@ inline float compute_distance(DistanceMetric metric,
     }
 }
 
+/**
+ * @brief Many queries x many stored vectors at once, GEMM style.
+ *        queries is nq x dim, base is nb x dim (both row major, contiguous), and
+ *        out[qi * nb + bj] gets the same value compute_distance() would return
+ *        (squared L2, dot, or cosine similarity).
+ *
+ *        Everything is done on top of one dot product matrix:
+ *          L2:     ||q-b||^2 = ||q||^2 + ||b||^2 - 2 q.b
+ *          COSINE: q.b / (|q| * |b|)
+ *        base_norms / query_norms are the plain (not squared) norms, pass them in if they
+ *        are already cached (the active segment caches them at insert), otherwise they get
+ *        computed here once per row instead of once per pair.
+ *
+ *        Tiling: the base is walked in blocks of DISTANCE_BLOCK_ROWS rows so a block stays in
+ *        L2 cache while every query runs over it, and inside a block the 4x2 micro kernel keeps
+ *        the partial sums in registers.
+ */
+inline constexpr size_t DISTANCE_BLOCK_ROWS = 256;
+
+inline void compute_distance_matrix(DistanceMetric metric,
+                                    const float* queries, size_t nq,
+                                    const float* base, size_t nb,
+                                    size_t dim, float* out,
+                                    const float* base_norms = nullptr,
+                                    const float* query_norms = nullptr) {
+    if (nq == 0 || nb == 0) return;
+    const auto& kernels = distance_kernels();
+
+    //1. dot products, blocked over the base rows
+    for (size_t b_begin = 0; b_begin < nb; b_begin += DISTANCE_BLOCK_ROWS) {
+        const size_t b_end = std::min(nb, b_begin + DISTANCE_BLOCK_ROWS);
+        size_t qi = 0;
+        for (; qi + 4 <= nq; qi += 4) {
+            size_t bj = b_begin;
+            for (; bj + 2 <= b_end; bj += 2) {
+                kernels.dot_tile_4x2(queries + qi * dim, base + bj * dim, dim, out + qi * nb + bj, nb);
+            }
+            for (; bj < b_end; ++bj) { //odd row at the end of the block
+                for (size_t t = 0; t < 4; ++t) {
+                    out[(qi + t) * nb + bj] = kernels.dot(queries + (qi + t) * dim, base + bj * dim, dim);
+                }
+            }
+        }
+        for (; qi < nq; ++qi) { //leftover queries (nq % 4)
+            for (size_t bj = b_begin; bj < b_end; ++bj) {
+                out[qi * nb + bj] = kernels.dot(queries + qi * dim, base + bj * dim, dim);
+            }
+        }
+    }
+
+    if (metric == DistanceMetric::DOT) return;
+    if (metric != DistanceMetric::L2 && metric != DistanceMetric::COSINE) {
+        throw std::runtime_error("Unknown DistanceMetric");
+    }
+
+    //2. norms, only what is not cached already
+    std::vector<float> computed_qn, computed_bn;
+    if (!query_norms) {
+        computed_qn.resize(nq);
+        for (size_t i = 0; i < nq; ++i) computed_qn[i] = norm(queries + i * dim, dim);
+        query_norms = computed_qn.data();
+    }
+    if (!base_norms) {
+        computed_bn.resize(nb);
+        for (size_t j = 0; j < nb; ++j) computed_bn[j] = norm(base + j * dim, dim);
+        base_norms = computed_bn.data();
+    }
+
+    //3. turn the dot matrix into the requested metric
+    for (size_t qi = 0; qi < nq; ++qi) {
+        float* row = out + qi * nb;
+        const float qn = query_norms[qi];
+        if (metric == DistanceMetric::L2) {
+            const float qn2 = qn * qn;
+            for (size_t bj = 0; bj < nb; ++bj) {
+                float d = qn2 + base_norms[bj] * base_norms[bj] - 2.0f * row[bj];
+                row[bj] = d > 0.0f ? d : 0.0f; //rounding can push identical vectors slightly below 0
+            }
+        } else {
+            for (size_t bj = 0; bj < nb; ++bj) {
+                row[bj] = cosine_from_dot(row[bj], qn, base_norms[bj]);
+            }
+        }
+    }
+}
+
 // Overloads for DenseVector or std::vector<float>
 template <typename VecType>
 inline float compute_distance(DistanceMetric metric,
@@ -155,4 +541,3 @@ inline float compute_distance(DistanceMetric metric,
 }
 
 } // namespace vectordb
-
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Status.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+/*
+fsync helpers for the files that have to survive losing the machine (segment files, manifest,
+tombstones). A rename is only durable once the directory holding it is synced too, so
+replaceFileSynced() does file, rename, directory in that order.
+*/
+
+namespace vectordb {
+
+//fsync a file or a directory
+inline Status syncPath(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return Status::Error("Failed to open " + path.string() + " for sync: " + std::string(strerror(errno)));
+    }
+    Status status = Status::OK();
+    if (::fsync(fd) == -1) {
+        status = Status::Error("Failed to sync " + path.string() + ": " + std::string(strerror(errno)));
+    }
+    ::close(fd);
+    return status;
+}
+
+//fsync every regular file directly in `dir`, then `dir` itself (its entries)
+inline Status syncDirectory(const std::filesystem::path& dir) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
+        auto status = syncPath(entry.path());
+        //gone since the listing: a tmp file renamed by its writer, which syncs it itself
+        std::error_code exists_ec;
+        if (!status.ok && std::filesystem::exists(entry.path(), exists_ec)) return status;
+    }
+    if (ec) {
+        return Status::Error("Failed to list " + dir.string() + ": " + ec.message());
+    }
+    return syncPath(dir);
+}
+
+//Replace `path` with `bytes`: a tmp file of its own (concurrent callers never share one), fsync,
+//rename over the old file, fsync the directory. A crash leaves the old file or the new one.
+inline Status replaceFileSynced(const std::filesystem::path& path, const std::string& bytes) {
+    static std::atomic<uint64_t> tmp_counter{0};
+    const std::filesystem::path tmp_path = path.string() + ".tmp." + std::to_string(::getpid()) + "." +
+                                           std::to_string(tmp_counter.fetch_add(1));
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return Status::Error("Failed to create " + tmp_path.string() + ": " + std::string(strerror(errno)));
+    }
+    size_t written = 0;
+    while (written < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) break;
+        written += static_cast<size_t>(n);
+    }
+    const bool ok = written == bytes.size() && ::fsync(fd) == 0;
+    const std::string reason = strerror(errno);
+    ::close(fd);
+
+    std::error_code ec;
+    if (!ok) {
+        std::filesystem::remove(tmp_path, ec);
+        return Status::Error("Failed writing " + tmp_path.string() + ": " + reason);
+    }
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        return Status::Error("Failed to replace " + path.string() + ": " + ec.message());
+    }
+    return syncPath(path.parent_path().empty() ? std::filesystem::path(".") : path.parent_path());
+}
+
+} // namespace vectordb
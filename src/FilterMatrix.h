@@ -17,15 +17,31 @@ tenant_123  [1 , 0 , 1 , 0 , 1 , 0 , 1 , 0 , 0 , 1]
 category_img[0 , 1 , 1 , 0 , 0 , 1 , 0 , 0 , 1 , 0]
 price_high  [1 , 0 , 0 , 1 , 1 , 0 , 0 , 1 , 0 , 1]
 
+Every ImmutableSegment builds one of these at seal time over its slots (slot = position in the
+segment's point id list), for the fields in the collection's payload_index:
+
+    keyword / bool : one row per distinct value, named "field=value"   e.g. "tenant=s:acme", "active=b:true"
+    numeric        : a column of (value, slot) pairs sorted by value, a range is two binary searches
+
+so resolving a filter condition never touches the payload store. It is written next to the
+index files as filters.bin. Whole must/should/must_not trees are evaluated over it by FilterPlanner.
 */
 
 #pragma once
 
 #include "DataTypes.h"
 #include "BitmapIndex.h"
+#include "CollectionInfo.h"
+#include "PayloadFilter.h"
+#include "Status.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <string>
 
@@ -59,15 +75,12 @@ public:
             // Return all ones bitmap if no filters
             BitmapIndex all_ones;
             all_ones.resize(total_points);
-            for (size_t i = 0; i < total_points; i++) {
-                all_ones.set(i, true);
-            }
+            all_ones.fill();
             return all_ones;
         }
-        
-        BitmapIndex result;
-        bool first = true;
-        
+
+        std::vector<const BitmapIndex*> rows;
+        rows.reserve(filter_names.size());
         for (const auto& name : filter_names) {
             auto it = filters.find(name);
             if (it == filters.end()) {
@@ -76,15 +89,17 @@ public:
                 empty.resize(total_points);
                 return empty;
             }
-            
-            if (first) {
-                result = it->second;
-                first = false;
-            } else {
-                result = result & it->second;
-            }
+            rows.push_back(&it->second);
+        }
+
+        //smallest row first: one copy, then every &= can only shrink it, stop once nothing is left
+        std::sort(rows.begin(), rows.end(), [](const BitmapIndex* a, const BitmapIndex* b) {
+            return a->count() < b->count();
+        });
+        BitmapIndex result = *rows.front();
+        for (size_t i = 1; i < rows.size() && result.any(); ++i) {
+            result &= *rows[i];
         }
-        
         return result;
     }
 
@@ -106,9 +121,278 @@ public:
     size_t get_total_points() const { return total_points; }
     size_t get_filter_count() const { return filters.size(); }
 
+    //Build the rows and columns from every slot's indexed fields (see projectIndexedFields).
+    //Array values index every element, like the filter matches them.
+    void build(const std::vector<Payload>& slot_payloads, const PayloadIndexSchema& payload_schema) {
+        filters.clear();
+        numeric_columns.clear();
+        schema = payload_schema;
+        total_points = slot_payloads.size();
+
+        std::unordered_map<std::string, std::vector<std::pair<double, uint32_t>>> numeric_pairs;
+        auto index_value = [&](const std::string& field, PayloadFieldType type, const json& value, size_t slot) {
+            if (type == PayloadFieldType::Numeric) {
+                if (value.is_number()) {
+                    numeric_pairs[field].emplace_back(value.get<double>(), static_cast<uint32_t>(slot));
+                }
+                return;
+            }
+            std::string name = row_key(field, value);
+            if (name.empty()) return;
+            auto& row = filters[name];
+            if (row.size() != total_points) row.resize(total_points);
+            row.set(slot, true);
+        };
+
+        for (size_t slot = 0; slot < slot_payloads.size(); ++slot) {
+            const Payload& payload = slot_payloads[slot];
+            if (!payload.is_object()) continue;
+            for (const auto& [field, type] : schema) {
+                auto it = payload.find(field);
+                if (it == payload.end()) continue;
+                if (it->is_array()) {
+                    for (const auto& element : *it) index_value(field, type, element, slot);
+                } else {
+                    index_value(field, type, *it, slot);
+                }
+            }
+        }
+
+        for (auto& [name, row] : filters) {
+            row.runOptimize();
+        }
+
+        for (auto& [field, pairs] : numeric_pairs) {
+            std::sort(pairs.begin(), pairs.end());
+            auto& column = numeric_columns[field];
+            column.values.reserve(pairs.size());
+            column.slots.reserve(pairs.size());
+            for (const auto& [value, slot] : pairs) {
+                column.values.push_back(value);
+                column.slots.push_back(slot);
+            }
+        }
+    }
+
+    bool is_indexed(const std::string& field) const {
+        return schema.find(field) != schema.end();
+    }
+
+    //Slots that pass one condition, or nullopt when this matrix can't answer it
+    //(field not indexed, or a condition the index type doesn't cover, like a range on a keyword).
+    std::optional<BitmapIndex> resolve(const FieldCondition& cond) const {
+        auto schema_it = schema.find(cond.key);
+        if (schema_it == schema.end()) return std::nullopt;
+
+        BitmapIndex result;
+        result.resize(total_points);
+
+        if (schema_it->second == PayloadFieldType::Numeric) {
+            if (cond.is_range) {
+                set_range(cond.key, cond.gt, cond.gte, cond.lt, cond.lte, result);
+                return result;
+            }
+            for (const auto& value : cond.match_any) {
+                if (!value.is_number()) return std::nullopt; //strings in a numeric field are not indexed
+                const double v = value.get<double>();
+                set_range(cond.key, std::nullopt, v, std::nullopt, v, result);
+            }
+            return result;
+        }
+
+        if (cond.is_range) return std::nullopt;
+        for (const auto& value : cond.match_any) {
+            auto it = filters.find(row_key(cond.key, value));
+            if (it != filters.end()) result |= it->second;
+        }
+        return result;
+    }
+
+    //How many slots resolve(cond) would return, without building the bitmap. Exact for numeric
+    //columns and single values, an upper bound for "any" over multi-valued fields.
+    //nullopt exactly when resolve() would return nullopt.
+    std::optional<size_t> estimate(const FieldCondition& cond) const {
+        auto schema_it = schema.find(cond.key);
+        if (schema_it == schema.end()) return std::nullopt;
+
+        if (schema_it->second == PayloadFieldType::Numeric) {
+            if (cond.is_range) {
+                auto [lo, hi] = range_span(cond.key, cond.gt, cond.gte, cond.lt, cond.lte);
+                return hi - lo;
+            }
+            size_t total = 0;
+            for (const auto& value : cond.match_any) {
+                if (!value.is_number()) return std::nullopt;
+                const double v = value.get<double>();
+                auto [lo, hi] = range_span(cond.key, std::nullopt, v, std::nullopt, v);
+                total += hi - lo;
+            }
+            return std::min(total, total_points);
+        }
+
+        if (cond.is_range) return std::nullopt;
+        size_t total = 0;
+        for (const auto& value : cond.match_any) {
+            auto it = filters.find(row_key(cond.key, value));
+            if (it != filters.end()) total += it->second.count();
+        }
+        return std::min(total, total_points);
+    }
+
+    //The stored row when cond is a single keyword/bool value, so callers can AND against it
+    //without resolve() copying it first. nullptr otherwise (including "value not present").
+    const BitmapIndex* find_row(const FieldCondition& cond) const {
+        if (cond.is_range || cond.match_any.size() != 1) return nullptr;
+        auto schema_it = schema.find(cond.key);
+        if (schema_it == schema.end() || schema_it->second == PayloadFieldType::Numeric) return nullptr;
+        auto it = filters.find(row_key(cond.key, cond.match_any.front()));
+        return it == filters.end() ? nullptr : &it->second;
+    }
+
+    Status save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return Status::Error("Cannot open " + path + " for writing");
+
+        write_u64(out, FILE_MAGIC);
+        write_u64(out, total_points);
+
+        write_u64(out, schema.size());
+        for (const auto& [field, type] : schema) {
+            write_string(out, field);
+            write_u64(out, static_cast<uint64_t>(type));
+        }
+
+        write_u64(out, filters.size());
+        for (const auto& [name, bitmap] : filters) {
+            write_string(out, name);
+            bitmap.serialize(out);
+        }
+
+        write_u64(out, numeric_columns.size());
+        for (const auto& [field, column] : numeric_columns) {
+            write_string(out, field);
+            write_u64(out, column.values.size());
+            out.write(reinterpret_cast<const char*>(column.values.data()),
+                      static_cast<std::streamsize>(column.values.size() * sizeof(double)));
+            out.write(reinterpret_cast<const char*>(column.slots.data()),
+                      static_cast<std::streamsize>(column.slots.size() * sizeof(uint32_t)));
+        }
+
+        if (!out) return Status::Error("Failed writing " + path);
+        return Status::OK();
+    }
+
+    Status load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return Status::Error("Cannot open " + path);
+
+        try {
+            if (read_u64(in) != FILE_MAGIC) return Status::Error("Not a filter matrix file: " + path);
+            FilterMatrix loaded;
+            loaded.total_points = read_u64(in);
+
+            for (uint64_t n = read_u64(in); n > 0; --n) {
+                std::string field = read_string(in);
+                loaded.schema[field] = static_cast<PayloadFieldType>(read_u64(in));
+            }
+            for (uint64_t n = read_u64(in); n > 0; --n) {
+                std::string name = read_string(in);
+                loaded.filters[name] = BitmapIndex::deserialize(in);
+            }
+            for (uint64_t n = read_u64(in); n > 0; --n) {
+                std::string field = read_string(in);
+                auto& column = loaded.numeric_columns[field];
+                const size_t count = read_u64(in);
+                column.values.resize(count);
+                column.slots.resize(count);
+                in.read(reinterpret_cast<char*>(column.values.data()), static_cast<std::streamsize>(count * sizeof(double)));
+                in.read(reinterpret_cast<char*>(column.slots.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+                if (!in) throw std::runtime_error("truncated numeric column");
+            }
+            *this = std::move(loaded);
+        } catch (const std::exception& e) {
+            return Status::Error("Corrupt filter matrix " + path + ": " + e.what());
+        }
+        return Status::OK();
+    }
+
 private:
+    struct NumericColumn {
+        std::vector<double> values;  //sorted ascending
+        std::vector<uint32_t> slots; //slots[i] holds values[i]
+    };
+
+    static constexpr uint64_t FILE_MAGIC = 0x32584D5446424456ULL; //"VDBFTMX2", v2 = roaring bitmaps
+
+    //"field=s:acme", numbers normalized through double so 5 and 5.0 land on the same row
+    static std::string row_key(const std::string& field, const json& value) {
+        if (value.is_string()) return field + "=s:" + value.get<std::string>();
+        if (value.is_boolean()) return field + (value.get<bool>() ? "=b:true" : "=b:false");
+        if (value.is_number()) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%.17g", value.get<double>());
+            return field + "=n:" + buf;
+        }
+        return {};
+    }
+
+    //[lo, hi) positions in the sorted column that fall inside the bounds
+    std::pair<size_t, size_t> range_span(const std::string& field,
+                                         std::optional<double> gt, std::optional<double> gte,
+                                         std::optional<double> lt, std::optional<double> lte) const {
+        auto it = numeric_columns.find(field);
+        if (it == numeric_columns.end()) return {0, 0};
+        const auto& values = it->second.values;
+
+        auto lo = values.begin();
+        auto hi = values.end();
+        if (gte) lo = std::max(lo, std::lower_bound(values.begin(), values.end(), *gte));
+        if (gt)  lo = std::max(lo, std::upper_bound(values.begin(), values.end(), *gt));
+        if (lte) hi = std::min(hi, std::upper_bound(values.begin(), values.end(), *lte));
+        if (lt)  hi = std::min(hi, std::lower_bound(values.begin(), values.end(), *lt));
+        if (hi < lo) hi = lo;
+        return {static_cast<size_t>(lo - values.begin()), static_cast<size_t>(hi - values.begin())};
+    }
+
+    void set_range(const std::string& field,
+                   std::optional<double> gt, std::optional<double> gte,
+                   std::optional<double> lt, std::optional<double> lte,
+                   BitmapIndex& out) const {
+        auto [lo, hi] = range_span(field, gt, gte, lt, lte);
+        if (lo == hi) return;
+        const auto& slots = numeric_columns.at(field).slots;
+        for (size_t i = lo; i < hi; ++i) {
+            out.set(slots[i], true);
+        }
+    }
+
+    static void write_u64(std::ostream& out, uint64_t v) {
+        out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static uint64_t read_u64(std::istream& in) {
+        uint64_t v = 0;
+        in.read(reinterpret_cast<char*>(&v), sizeof(v));
+        if (!in) throw std::runtime_error("unexpected end of file");
+        return v;
+    }
+
+    static void write_string(std::ostream& out, const std::string& s) {
+        write_u64(out, s.size());
+        out.write(s.data(), static_cast<std::streamsize>(s.size()));
+    }
+
+    static std::string read_string(std::istream& in) {
+        std::string s(read_u64(in), '\0');
+        in.read(s.data(), static_cast<std::streamsize>(s.size()));
+        if (!in) throw std::runtime_error("unexpected end of file");
+        return s;
+    }
+
     std::unordered_map<std::string, BitmapIndex> filters;
     size_t total_points;
+    std::unordered_map<std::string, NumericColumn> numeric_columns;
+    PayloadIndexSchema schema;
 };
 
 } // namespace vectordb
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "BitmapIndex.h"
+#include "FilterMatrix.h"
+#include "PayloadFilter.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/*
+Evaluates a whole must/should/must_not filter tree over one segment's FilterMatrix.
+
+    must     : AND, most selective clause first (estimate() is a binary search or a row
+               popcount, no bitmap gets built for it). The first result is the only copy, every
+               following clause is &= in place, and once it is empty the rest is skipped.
+    should   : OR group, biggest clause first, stops once every id is in.
+    must_not : -= in place, biggest first since it removes the most.
+
+Single keyword values AND / ANDNOT straight against the stored row, only ranges and "any" lists
+build a bitmap of their own.
+
+Conditions the matrix can't answer (field not in payload_index) are left out, which makes the
+result a superset: `exact` goes false and the segment re-checks the candidates with the payload
+store fallback. That is fine under AND and OR, but a superset can't be subtracted, so such a
+must_not clause is left entirely to the fallback.
+*/
+
+namespace vectordb {
+
+struct FilterPlan {
+    BitmapIndex bitmap;      //ids that pass (a superset of them when exact is false)
+    size_t matches{0};       //bitmap.count()
+    double selectivity{1.0}; //matches / universe, picks HNSW-with-selector vs brute force
+    bool exact{true};        //false: some conditions still need the payload store fallback
+    size_t conditions_evaluated{0}; //looked up in the matrix, the ones after an early exit are not
+};
+
+/**
+ * @brief Orders and evaluates a PayloadFilter over a FilterMatrix with in-place bitmap algebra.
+ *
+ * Borrows the matrix, cheap to construct per query (one per query and thread, plan() counts
+ * into a member). `universe` is the number of slots the result covers (the matrix may be empty
+ * when nothing is indexed).
+ */
+class FilterPlanner {
+public:
+    FilterPlanner(const FilterMatrix& matrix, size_t universe)
+        : m_matrix{matrix}, m_universe{universe} {}
+
+    FilterPlan plan(const PayloadFilter& filter) const {
+        m_evaluated = 0;
+        Operand result = evalFilter(filter);
+
+        FilterPlan out;
+        out.exact = result.exact;
+        out.conditions_evaluated = m_evaluated;
+        if (result.known) {
+            out.bitmap = std::move(result.owned);
+        } else {
+            out.bitmap.resize(m_universe);
+            out.bitmap.fill();
+        }
+        out.matches = out.bitmap.count();
+        if (out.matches == 0) out.exact = true; //a superset of nothing is nothing
+        out.selectivity = m_universe ? static_cast<double>(out.matches) / static_cast<double>(m_universe) : 0.0;
+        return out;
+    }
+
+    //Estimated number of ids passing the filter, from the matrix's per condition counts only.
+    //Clauses treated as independent; unindexed conditions count as "everything".
+    size_t estimate(const PayloadFilter& filter) const {
+        double est = static_cast<double>(m_universe);
+        for (const auto& clause : filter.getMust()) {
+            est = std::min(est, static_cast<double>(estimate(clause)));
+        }
+        if (!filter.getShould().empty()) {
+            double any = 0;
+            for (const auto& clause : filter.getShould()) any += static_cast<double>(estimate(clause));
+            est = std::min(est, any);
+        }
+        if (m_universe > 0) {
+            for (const auto& clause : filter.getMustNot()) {
+                est *= 1.0 - static_cast<double>(estimate(clause)) / static_cast<double>(m_universe);
+            }
+        }
+        return static_cast<size_t>(std::max(est, 0.0));
+    }
+
+private:
+    //Result of a clause or subtree: a superset of the ids passing it. known = false means
+    //"every id" (nothing was indexed, or an empty filter). row borrows a stored matrix row.
+    struct Operand {
+        bool known{false};
+        bool exact{true};
+        const BitmapIndex* row{nullptr};
+        BitmapIndex owned;
+
+        const BitmapIndex& bitmap() const { return row ? *row : owned; }
+        bool isEmpty() const { return known && !bitmap().any(); }
+    };
+
+    size_t estimate(const FilterClause& clause) const {
+        if (clause.nested) return estimate(*clause.nested);
+        return m_matrix.estimate(*clause.field).value_or(m_universe);
+    }
+
+    std::vector<const FilterClause*> byEstimate(const std::vector<FilterClause>& clauses, bool ascending) const {
+        std::vector<std::pair<size_t, const FilterClause*>> order;
+        order.reserve(clauses.size());
+        for (const auto& clause : clauses) order.emplace_back(estimate(clause), &clause);
+        std::stable_sort(order.begin(), order.end(), [ascending](const auto& a, const auto& b) {
+            return ascending ? a.first < b.first : a.first > b.first;
+        });
+
+        std::vector<const FilterClause*> sorted;
+        sorted.reserve(order.size());
+        for (const auto& [_, clause] : order) sorted.push_back(clause);
+        return sorted;
+    }
+
+    Operand evalFilter(const PayloadFilter& filter) const {
+        Operand acc;
+        for (const FilterClause* clause : byEstimate(filter.getMust(), true)) {
+            if (acc.isEmpty()) return acc;
+            intersect(acc, evalClause(*clause));
+        }
+        if (!filter.getShould().empty() && !acc.isEmpty()) {
+            intersect(acc, evalShould(filter.getShould()));
+        }
+        for (const FilterClause* clause : byEstimate(filter.getMustNot(), false)) {
+            if (acc.isEmpty()) return acc;
+            subtract(acc, evalClause(*clause));
+        }
+        return acc;
+    }
+
+    Operand evalShould(const std::vector<FilterClause>& clauses) const {
+        Operand acc;
+        acc.known = true;
+        acc.owned.resize(m_universe);
+        for (const FilterClause* clause : byEstimate(clauses, false)) {
+            if (acc.owned.count() == m_universe) break;
+            Operand op = evalClause(*clause);
+            if (!op.known) {
+                //one side is "everything", so is the OR (exactly, if that side was exact)
+                Operand all;
+                all.exact = op.exact;
+                return all;
+            }
+            if (!op.exact) acc.exact = false;
+            acc.owned |= op.bitmap();
+        }
+        return acc;
+    }
+
+    Operand evalClause(const FilterClause& clause) const {
+        if (clause.nested) return evalFilter(*clause.nested);
+
+        ++m_evaluated;
+        Operand op;
+        const FieldCondition& cond = *clause.field;
+        if ((op.row = m_matrix.find_row(cond))) {
+            op.known = true;
+            return op;
+        }
+        auto resolved = m_matrix.resolve(cond);
+        if (!resolved) {
+            op.exact = false;
+            return op;
+        }
+        op.known = true;
+        op.owned = std::move(*resolved);
+        return op;
+    }
+
+    //acc &= op
+    void intersect(Operand& acc, Operand&& op) const {
+        if (!op.exact) acc.exact = false;
+        if (!op.known) return;
+        if (!acc.known) {
+            acc.known = true;
+            acc.owned = op.row ? *op.row : std::move(op.owned);
+            return;
+        }
+        acc.owned &= op.bitmap();
+    }
+
+    //acc -= op
+    void subtract(Operand& acc, Operand&& op) const {
+        if (!op.exact) {
+            acc.exact = false; //can't take a superset away, the fallback handles this clause
+            return;
+        }
+        if (!acc.known) {
+            acc.known = true;
+            acc.owned.resize(m_universe);
+            if (!op.known) return; //everything minus everything
+            acc.owned.fill();
+        } else if (!op.known) {
+            acc.owned.clear();
+            return;
+        }
+        acc.owned -= op.bitmap();
+    }
+
+    const FilterMatrix& m_matrix;
+    size_t m_universe;
+    mutable size_t m_evaluated{0};
+};
+
+} // namespace vectordb
@@ -2,6 +2,7 @@
 
 #include "BitmapIndex.h"
 #include "DataTypes.h"
+#include <algorithm>
 #include <map>
 #include <optional>
 #include <unordered_map>
@@ -9,6 +10,9 @@
 #include <string>
 
 //this idtracker will be used to do mapping between faiss index and point ids.
+//Offsets mirror the FAISS index: every row gets its own, in insert order, and a removed one is never
+//handed out again. An id can own more than one offset (upserted twice before its segment was
+//sealed), so removal goes by offset, the stale row's tombstone must not take the live row with it.
 //maybe add reset(), integrityCheck(), thread safety, persistentSerialization() methods in future?
 namespace vectordb {
 
@@ -22,17 +26,19 @@ public:
         for (const auto& name : vector_names) {
             m_tables[name].offset_to_pointid.resize(expected_size);
             m_tables[name].bitmap.resize(expected_size);
-            m_tables[name].next_free_offset = 0;
+            m_tables[name].next_offset = 0;
+            m_tables[name].live = 0;
         }
     }
 
+    //the newest live offset of this id
     std::optional<PointOffSetType> getInternalId(const VectorName& name, PointIdType point_id) const {
         auto it_table = m_tables.find(name);
         if (it_table == m_tables.end()) return std::nullopt;
 
         const auto& tbl = it_table->second;
-        auto it = tbl.point_id_to_offset.find(point_id);
-        return (it != tbl.point_id_to_offset.end()) ? std::make_optional(it->second) : std::nullopt;
+        auto it = tbl.point_id_to_offsets.find(point_id);
+        return (it != tbl.point_id_to_offsets.end()) ? std::make_optional(it->second.back()) : std::nullopt;
     }
 
     std::optional<PointIdType> getExternalId(const VectorName& name, PointOffSetType offset) const {
@@ -46,42 +52,41 @@ public:
         return std::nullopt;
     }
 
+    //next offset for this row, also when the id already has one
     PointOffSetType insert(const VectorName& name, PointIdType point_id) {
         auto& tbl = m_tables[name]; // creates if not exists
 
-        if (auto existing = getInternalId(name, point_id))
-            return *existing;
-
-        PointOffSetType offset;
-        if (tbl.next_free_offset < tbl.offset_to_pointid.size()) {
-            offset = tbl.next_free_offset;
-            findNextFree(tbl);
+        PointOffSetType offset = tbl.next_offset++;
+        if (offset < tbl.offset_to_pointid.size()) {
             tbl.offset_to_pointid[offset] = point_id;
         } else {
-            offset = tbl.offset_to_pointid.size();
             tbl.offset_to_pointid.push_back(point_id);
             tbl.bitmap.resize(tbl.offset_to_pointid.size());
         }
 
         tbl.bitmap.set(offset, true);
-        tbl.point_id_to_offset[point_id] = offset;
+        tbl.point_id_to_offsets[point_id].push_back(offset); //ascending, offsets only grow
+        ++tbl.live;
         return offset;
     }
 
-    void remove(const VectorName& name, PointIdType point_id) {
+    //Drop one row. Returns false if the offset wasn't live.
+    bool remove(const VectorName& name, PointOffSetType offset) {
         auto it_table = m_tables.find(name);
-        if (it_table == m_tables.end()) return;
+        if (it_table == m_tables.end()) return false;
 
         auto& tbl = it_table->second;
-        auto it = tbl.point_id_to_offset.find(point_id);
-        if (it == tbl.point_id_to_offset.end()) return;
+        if (offset >= tbl.offset_to_pointid.size() || !tbl.bitmap.get(offset)) return false;
+
+        auto it = tbl.point_id_to_offsets.find(*tbl.offset_to_pointid[offset]);
+        auto& offsets = it->second;
+        offsets.erase(std::find(offsets.begin(), offsets.end(), offset));
+        if (offsets.empty()) tbl.point_id_to_offsets.erase(it);
 
-        PointOffSetType offset = it->second;
         tbl.bitmap.set(offset, false);
         tbl.offset_to_pointid[offset] = std::nullopt;
-        tbl.point_id_to_offset.erase(it);
-
-        if (offset < tbl.next_free_offset) tbl.next_free_offset = offset;
+        --tbl.live;
+        return true;
     }
 
     std::vector<PointOffSetType> iterInternalIds(const VectorName& name) const {
@@ -104,16 +109,17 @@ public:
         if (it_table == m_tables.end()) return ids;
 
         const auto& tbl = it_table->second;
-        ids.reserve(tbl.point_id_to_offset.size());
-        for (const auto& [pid, _] : tbl.point_id_to_offset) {
+        ids.reserve(tbl.point_id_to_offsets.size());
+        for (const auto& [pid, _] : tbl.point_id_to_offsets) {
             ids.push_back(pid);
         }
         return ids;
     }
 
+    //live offsets (rows), an id with two rows counts twice
     size_t size(const VectorName& name) const { 
         auto it_table = m_tables.find(name);
-        return (it_table != m_tables.end()) ? it_table->second.point_id_to_offset.size() : 0;
+        return (it_table != m_tables.end()) ? it_table->second.live : 0;
     }
 
     bool empty(const VectorName& name) const { 
@@ -126,20 +132,14 @@ public:
 
 private:
     struct Table {
-        std::map<PointIdType, PointOffSetType> point_id_to_offset;
+        std::map<PointIdType, std::vector<PointOffSetType>> point_id_to_offsets;
         std::vector<std::optional<PointIdType>> offset_to_pointid;
         BitmapIndex bitmap;
-        size_t next_free_offset = 0;
+        size_t next_offset = 0;
+        size_t live = 0;
     };
 
     std::unordered_map<VectorName, Table> m_tables;
-
-    static void findNextFree(Table& tbl) {
-        for (; tbl.next_free_offset < tbl.bitmap.size(); ++tbl.next_free_offset) {
-            if (!tbl.bitmap.get(tbl.next_free_offset))
-                return;
-        }
-    }
 };
 
 } // namespace vectordb
\ No newline at end of file
@@ -7,12 +7,23 @@
 #include "IdTracker.h"
 #include "Distance.h"
 #include "QueryResult.h"
+#include "VectorArena.h"
+#include "BitmapIndex.h"
+#include "BitmapIDSelector.h"
+#include "PayloadFilter.h"
+#include "FilterMatrix.h"
+#include "FilterPlanner.h"
+#include "FileSync.h"
 
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
 #include <faiss/index_io.h>
+#include <faiss/invlists/OnDiskInvertedLists.h>
 #include <faiss/Clustering.h>
 
+#include <atomic>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -22,22 +33,65 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+
+//IO_FLAG_MMAP only maps IVF inverted lists, anything else read_index() copies into the heap.
+//faiss 1.11 added IO_FLAG_MMAP_IFC, which leaves IndexFlatCodes codes in the file too: flat, SQ/PQ
+//flat codes and the storage under an HNSW graph (the graph itself is still read in).
+#if FAISS_VERSION_MAJOR > 1 || (FAISS_VERSION_MAJOR == 1 && FAISS_VERSION_MINOR >= 11)
+#define VECTORDB_MMAP_FLAT_CODES 1
+#else
+#define VECTORDB_MMAP_FLAT_CODES 0
+#endif
 #include <set>
+#include <shared_mutex>
 
 namespace vectordb {
 
 class ImmutableSegment {
 public:
-    // Constructor that takes copied data 
-    ImmutableSegment(const SegPointData& point_data, const CollectionInfo& info, const SegmentIdType seg_id)
+    //Row-major view of all vectors of one vector space. Points nearly always carry every named
+    //vector, so `data` just points into the arena; only when some rows are missing do we gather
+    //the present ones into `gathered` (FAISS offsets have to be dense).
+    struct FlatVectors {
+        const float* data{nullptr};
+        size_t n{0};
+        size_t dim{0};
+        std::vector<float> gathered;
+    };
+
+    // Constructor that builds straight from a sealed active segment's arenas, no copying of the vectors.
+    // The arenas are only read (cosine rows were already normalized at insert), so searches over the
+    // sealed segment can keep running during the build. FAISS keeps its own copy inside the index,
+    // we don't keep the raw buffers.
+    ImmutableSegment(const SegmentVectorData& data, const CollectionInfo& info, const SegmentIdType seg_id)
         : m_info{info}
         , m_index_spec{info.index_specs}
         , m_segment_id{seg_id}
     {
         std::cout << "Hello from ImmutableSegment, ID: " << m_segment_id << "\n";
-        buildHNSWIndexes(point_data);
-        computeKMeansClusters(point_data);//could use macro to represent maxiterations, now just use default.
-        //buildFilterMartix(point_data);??maybe 1 filtermatrix for 1 immutable_seg
+        auto flat = prepareFlatVectors(data);
+        buildIndexes(flat);
+        computeKMeansClusters(flat);//could use macro to represent maxiterations, now just use default.
+        //1 filtermatrix per immutable segment, over the payload_index fields
+        if (!m_info.payload_index.empty() && data.payloads.size() == data.size()) {
+            m_filter_matrix.build(data.payloads, m_info.payload_index);
+            m_payloads = data.payloads; //small (indexed fields only), a compaction rebuilds the matrix from them
+        }
+        m_deleted_slots.resize(m_point_ids.size());
+    }
+
+    //Reopen a segment writeIndex() put on disk (./vectordb/{collection}/segments/{segment_id}),
+    //nothing gets rebuilt: FAISS indexes, id map, centroids, filters and tombstones are read back.
+    //`mapped`: open the indexes with IO_FLAG_MMAP, see loadIndex()
+    static StatusOr<std::shared_ptr<ImmutableSegment>> load(const CollectionInfo& info, const SegmentIdType& seg_id,
+                                                            bool mapped = false,
+                                                            const std::string& base_path = "./vectordb") {
+        std::shared_ptr<ImmutableSegment> segment(new ImmutableSegment(info, seg_id));
+        auto status = segment->loadIndex(base_path, mapped);
+        if (!status.ok) {
+            return status;
+        }
+        return segment;
     }
 
     ~ImmutableSegment() = default;
@@ -46,8 +100,9 @@ public:
     ImmutableSegment(const ImmutableSegment&) = delete;
     ImmutableSegment& operator=(const ImmutableSegment&) = delete;
 
-    ImmutableSegment(ImmutableSegment&&) noexcept = default;
-    ImmutableSegment& operator=(ImmutableSegment&&) noexcept = default;
+    //no moves either, the tombstone mutex pins it (it lives behind a shared_ptr anyway)
+    ImmutableSegment(ImmutableSegment&&) = delete;
+    ImmutableSegment& operator=(ImmutableSegment&&) = delete;
 
     const std::string& getSegmentId() const { 
         return m_segment_id; 
@@ -62,6 +117,32 @@ public:
         return m_point_ids; 
     }
     
+    //part of the index data is served from the mapped files (page cache) rather than process memory
+    bool isMapped() const {
+        return m_mapped;
+    }
+
+    //index bytes held in process memory: the index files' size minus what stays mapped, 0 until the
+    //segment is written
+    size_t getIndexBytes() const {
+        return m_index_bytes.load();
+    }
+
+    //whether loading this segment mapped would leave any index data in the files with this faiss
+    //build. If not, a mapped load is just a second full copy in the heap.
+    bool canMap() const {
+        for (const auto& [_, type] : m_index_types) {
+            if (type == IndexType::IVFFlat || type == IndexType::IVFPQ) return true;
+            if (VECTORDB_MMAP_FLAT_CODES && type != IndexType::UNKNOWN) return true;
+        }
+        return false;
+    }
+
+    //write version of the point in this slot
+    uint64_t getVersion(size_t slot) const {
+        return slot < m_versions.size() ? m_versions[slot] : 0;
+    }
+
     const std::unordered_map<VectorName, size_t>& getVectorDimensions() const { 
         return m_vector_dims; 
     }
@@ -102,15 +183,48 @@ public:
             std::string segment_dir = segments_dir + "/" + m_segment_id;
             std::filesystem::create_directories(segment_dir);
             
+            //id map + centroids: without them the indexes can't be served again after a restart
+            auto points_status = writePoints(segment_dir + "/points.bin");
+            if (!points_status.ok) {
+                throw std::runtime_error(points_status.message);
+            }
+            auto centroids_status = writeCentroids(segment_dir + "/centroids.bin");
+            if (!centroids_status.ok) {
+                throw std::runtime_error(centroids_status.message);
+            }
+
             // Write each vector index
-            for (auto& [vec_name, index] : m_hnsw_indexes) {
+            size_t index_bytes = 0;
+            for (auto& [vec_name, index] : m_indexes) {
                 std::string path = segment_dir + "/" + vec_name + ".index";
                 faiss::write_index(index.get(), path.c_str());
+                index_bytes += std::filesystem::file_size(path);
                 std::cout << "[WRITE] Index written: " << path << "\n";
             }
+            m_index_bytes = index_bytes;
             
+            //payload indexes go next to the vector indexes
+            if (!m_info.payload_index.empty()) {
+                auto status = m_filter_matrix.save(segment_dir + "/filters.bin");
+                if (!status.ok) {
+                    std::cerr << "[WRITE ERROR] " << status.message << "\n";
+                }
+            }
+
+            //deleted.bin is not written here: the holder writes it right after (see
+            //SegmentHolder::writeTombstonesFor()), serialized with the other tombstone writes
+
             // Also write segment metadata
             writeSegmentMetadata(segment_dir);
+
+            //the manifest lists this segment next and the WAL gets its flush marker after that, so all of
+            //it has to be on disk first: the files, the segment's directory, and its entry in segments/
+            for (const auto& dir : {segment_dir, segments_dir, collection_dir}) {
+                auto sync_status = syncDirectory(dir);
+                if (!sync_status.ok) {
+                    throw std::runtime_error(sync_status.message);
+                }
+            }
             
         } catch (const std::exception& e) {
             std::cerr << "[WRITE ERROR] " << e.what() << "\n";
@@ -118,42 +232,261 @@ public:
         }
     }
 
-    // Synchronous load from disk
-    void loadIndex(const std::string& base_path = "./vectordb") {
-        //need try/catch here?
-        for (auto& [vec_name, _] : m_info.vec_specs) {
-            std::string path = base_path + "/" + vec_name + ".index";//fix this to match writeInedx(..)
-            if (!std::filesystem::exists(path)) continue;
+    // Synchronous load from disk, the files writeIndex() wrote. Ids, versions and offsets come from
+    // points.bin, the IdTracker is refilled from them the same way the build fills it.
+    // `mapped`: the indexes are opened read-only with IO_FLAG_MMAP (and IO_FLAG_MMAP_IFC where faiss
+    // has it), the vector data then stays in the file and is paged in as searches touch it. How much
+    // FAISS maps depends on the index type and version, see mappedBytes(); only what it actually
+    // left in the file is taken off getIndexBytes(). An index it refuses to map is read in whole.
+    Status loadIndex(const std::string& base_path = "./vectordb", bool mapped = false) {
+        const std::string segment_dir = base_path + "/" + m_info.name + "/segments/" + m_segment_id;
+        auto status = readPoints(segment_dir + "/points.bin");
+        if (!status.ok) return status;
+
+        for (const auto& [vec_name, _] : m_vector_dims) {
+            std::string path = segment_dir + "/" + vec_name + ".index";
+            if (!std::filesystem::exists(path)) {
+                return Status::Error("Missing index file " + path);
+            }
+            bool index_mapped = false;
+            try {
+                //read_index figures out the concrete type (HNSW, IVF, Flat...) from the file
+                if (mapped) {
+                    try {
+                        int io_flags = faiss::IO_FLAG_MMAP | faiss::IO_FLAG_READ_ONLY;
+#if VECTORDB_MMAP_FLAT_CODES
+                        io_flags |= faiss::IO_FLAG_MMAP_IFC;
+#endif
+                        m_indexes[vec_name] = std::unique_ptr<faiss::Index>(faiss::read_index(path.c_str(), io_flags));
+                        index_mapped = true;
+                    } catch (const std::exception& e) {
+                        std::cerr << "[LOAD] " << path << " can't be mapped (" << e.what() << "), reading it in\n";
+                    }
+                }
+                if (!index_mapped) {
+                    m_indexes[vec_name] = std::unique_ptr<faiss::Index>(faiss::read_index(path.c_str()));
+                }
+            } catch (const std::exception& e) {
+                return Status::Error("Failed to read " + path + ": " + e.what());
+            }
+            const size_t file_bytes = std::filesystem::file_size(path);
+            const size_t mapped_bytes = index_mapped ? std::min(mappedBytes(m_indexes[vec_name].get()), file_bytes) : 0;
+            m_mapped = m_mapped || mapped_bytes > 0;
+            m_index_bytes += file_bytes - mapped_bytes;
+            std::cout << "[LOAD] Index " << (mapped_bytes > 0 ? "mapped: " : "loaded: ") << path;
+            if (mapped_bytes > 0) std::cout << " (" << mapped_bytes << " of " << file_bytes << " bytes)";
+            std::cout << "\n";
+        }
 
-            auto loaded_index = std::unique_ptr<faiss::IndexHNSW>(
-                dynamic_cast<faiss::IndexHNSW*>(faiss::read_index(path.c_str()))
-            );
-            m_hnsw_indexes[vec_name] = std::move(loaded_index);
-            std::cout << "[LOAD] Index loaded: " << path << "\n";
+        //only used for routing, a segment without centroids just always gets searched
+        std::string centroids_path = segment_dir + "/centroids.bin";
+        if (std::filesystem::exists(centroids_path)) {
+            status = readCentroids(centroids_path);
+            if (!status.ok) {
+                std::cerr << "[LOAD ERROR] " << status.message << "\n";
+            }
         }
-        //after loaded need to write searchTopK for this? 
+
+        std::string filters_path = segment_dir + "/filters.bin";
+        if (!m_info.payload_index.empty() && std::filesystem::exists(filters_path)) {
+            status = m_filter_matrix.load(filters_path);
+            if (!status.ok) {
+                return status;
+            }
+        }
+
+        std::vector<std::string> all_vector_names;
+        for (const auto& [name, _] : m_info.vec_specs) all_vector_names.push_back(name);
+        m_id_tracker.init(all_vector_names, m_point_ids.size());
+        for (const auto& [name, _] : m_vector_dims) {
+            auto map_it = m_offset_to_slot.find(name);
+            if (map_it == m_offset_to_slot.end()) {
+                for (const auto& point_id : m_point_ids) m_id_tracker.insert(name, point_id);
+            } else {
+                for (uint32_t slot : map_it->second) m_id_tracker.insert(name, m_point_ids[slot]);
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(m_tombstone_mutex);
+        m_deleted_slots.resize(m_point_ids.size());
+        std::string tombstones_path = segment_dir + "/deleted.bin";
+        if (std::filesystem::exists(tombstones_path)) {
+            std::ifstream in(tombstones_path, std::ios::binary);
+            try {
+                //through tombstoneSlot, the IdTracker has to lose the offsets too
+                BitmapIndex deleted = BitmapIndex::deserialize(in);
+                deleted.forEach([&](size_t slot) { tombstoneSlot(slot); });
+            } catch (const std::exception& e) {
+                return Status::Error("Failed to read " + tombstones_path + ": " + e.what());
+            }
+        }
+        return Status::OK();
     }
 
-    // -------------------------------
-    //ideally, i think i will make K be sqrt(n), where n is the num of points.
-    //not sure if this is the best function design, but I can optimize this later.
-    //call this method after the HNSW index build. I expect k to be like around 70 or 50 depends. I will just hard code it.
-    void computeKMeansClusters(const SegPointData& points, size_t max_iters = 20) {
-        std::map<VectorName, std::vector<DenseVector>> per_name_vectors;
+    //Tombstone slots (deletes, and upserts replacing a point that lives here). FAISS HNSW can't
+    //remove vectors, so the points stay in the index and the live bitmap is handed to FAISS as an
+    //IDSelector on every search (see searchTopK), which keeps top-k at k live results.
+    //Returns how many slots were newly deleted.
+    size_t deleteSlots(const std::vector<size_t>& slots) {
+        std::unique_lock<std::shared_mutex> lock(m_tombstone_mutex);
+        size_t removed = 0;
+        for (size_t slot : slots) {
+            if (tombstoneSlot(slot)) ++removed;
+        }
+        return removed;
+    }
+
+    //tombstoned slots, to carry them over to a reopened copy of this segment
+    std::vector<size_t> getDeletedSlots() const {
+        std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+        return m_deleted_slots.to_ids();
+    }
+
+    size_t getDeletedCount() const {
+        std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+        return m_num_deleted;
+    }
+
+    size_t getLivePointCount() const {
+        std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+        return m_point_ids.size() - m_num_deleted;
+    }
+
+    bool isDeleted(size_t slot) const {
+        std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+        return m_num_deleted > 0 && m_deleted_slots.contains(slot);
+    }
+
+    //Append the live points to `out` for a compaction merge, `out`'s arenas must have room for them.
+    //FAISS keeps the only copy of the vectors, so they come back through reconstruct(): exact for
+    //Flat, HNSWFlat and IVFFlat, the decoded approximation for SQ8/FP16 and PQ.
+    //source_slots[i] is the slot of this segment that row i of what got appended came from.
+    void exportLivePoints(SegmentVectorData& out, std::vector<size_t>& source_slots) const {
+        std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+
+        //slot -> FAISS offset, only needed for vector spaces with missing rows (-1 = no vector)
+        std::unordered_map<VectorName, std::vector<faiss::idx_t>> slot_to_offset;
+        for (const auto& [name, offset_to_slot] : m_offset_to_slot) {
+            auto& offsets = slot_to_offset[name];
+            offsets.assign(m_point_ids.size(), -1);
+            for (size_t offset = 0; offset < offset_to_slot.size(); ++offset) {
+                offsets[offset_to_slot[offset]] = static_cast<faiss::idx_t>(offset);
+            }
+        }
+
+        std::vector<float> buffer;
+        for (size_t slot = 0; slot < m_point_ids.size(); ++slot) {
+            if (m_num_deleted > 0 && m_deleted_slots.contains(slot)) continue;
+
+            const size_t row = out.size();
+            for (auto& [name, arena] : out.arenas) {
+                auto it = m_indexes.find(name);
+                if (it == m_indexes.end()) continue;
+
+                faiss::idx_t offset = static_cast<faiss::idx_t>(slot);
+                auto map_it = slot_to_offset.find(name);
+                if (map_it != slot_to_offset.end()) offset = map_it->second[slot];
+                if (offset < 0 || offset >= it->second->ntotal) continue;
+
+                buffer.resize(arena.dim());
+                it->second->reconstruct(offset, buffer.data());
+                arena.write(row, buffer.data()); //cosine rows went in normalized already
+            }
+            out.point_ids.push_back(m_point_ids[slot]);
+            out.versions.push_back(m_versions[slot]);
+            out.payloads.push_back(slot < m_payloads.size() ? m_payloads[slot] : Payload{});
+            source_slots.push_back(slot);
+        }
+    }
+
+    //deleted.bin next to the index files, through a temp file of its own and fsync'd, so a crash
+    //never leaves half of it. The caller serializes the writes of one segment id (two IO threads, and
+    //a segment and its mapped copy share the file), see SegmentHolder::writeTombstonesFor().
+    Status writeTombstones(const std::string& base_path = "./vectordb") const {
+        const std::string segment_dir = base_path + "/" + m_info.name + "/segments/" + m_segment_id;
+        const std::string path = segment_dir + "/deleted.bin";
+        try {
+            //the holder only writes these after writeIndex(), a missing directory means the segment
+            //isn't (or no longer) on disk and the caller has to know
+            if (!std::filesystem::exists(segment_dir)) {
+                return Status::Error("No segment directory for " + path);
+            }
+            std::ostringstream out;
+            {
+                std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+                m_deleted_slots.serialize(out);
+            }
+            return replaceFileSynced(path, out.str());
+        } catch (const std::exception& e) {
+            return Status::Error("Failed writing " + path + ": " + e.what());
+        }
+    }
 
-        //collect all DenseVectors by VectorName
-        for (const auto& [id, vec_map] : points) {
-            for (const auto& [name, vec] : vec_map) {
-                per_name_vectors[name].push_back(vec);
+    //Resolve a filter into a FilterPlan over this segment's FAISS offsets for one vector space, ready to
+    //hand to searchTopK(). The FilterPlanner evaluates the must/should/must_not tree over the
+    //FilterMatrix; only if some condition is on an unindexed field do the surviving points go through
+    //the payload store fallback. Tombstoned slots are taken out. The returned plan is always exact.
+    FilterPlan resolveFilter(const VectorName& vector_name, const SegmentFilter& filter) const {
+        const size_t num_slots = m_point_ids.size();
+        FilterPlan slots = FilterPlanner(m_filter_matrix, num_slots).plan(*filter.filter);
+        const bool needs_fallback = !slots.exact;
+        {
+            std::shared_lock<std::shared_mutex> lock(m_tombstone_mutex);
+            if (m_num_deleted > 0 && m_deleted_slots.size() == slots.bitmap.size()) {
+                slots.bitmap -= m_deleted_slots;
+                slots.matches = slots.bitmap.count();
+                slots.selectivity = num_slots ? static_cast<double>(slots.matches) / static_cast<double>(num_slots) : 0.0;
             }
         }
 
-        //run KMeans per VectorName using FAISS
-        for (auto& [name, vectors] : per_name_vectors) {
-            if (vectors.empty()) continue;
+        auto it = m_indexes.find(vector_name);
+        const size_t n = (it == m_indexes.end()) ? 0 : static_cast<size_t>(it->second->ntotal);
+        auto map_it = m_offset_to_slot.find(vector_name);
+
+        //offset == slot and nothing left to check: the slot bitmap already is the answer
+        if (map_it == m_offset_to_slot.end() && !needs_fallback && n == num_slots) {
+            return slots;
+        }
+
+        FilterPlan result;
+        result.conditions_evaluated = slots.conditions_evaluated;
+        result.bitmap.resize(n);
+        if (map_it == m_offset_to_slot.end()) {
+            //only visit the candidates, so the payload store is hit once per surviving point
+            slots.bitmap.forEach([&](size_t slot) {
+                if (slot >= n) return;
+                if (needs_fallback && !(filter.fallback && filter.fallback(m_point_ids[slot]))) return;
+                result.bitmap.set(slot, true);
+            });
+        } else {
+            const auto& offset_to_slot = map_it->second;
+            for (size_t offset = 0; offset < n; ++offset) {
+                const size_t slot = offset_to_slot[offset];
+                if (!slots.bitmap.contains(slot)) continue;
+                if (needs_fallback && !(filter.fallback && filter.fallback(m_point_ids[slot]))) continue;
+                result.bitmap.set(offset, true);
+            }
+        }
+        result.matches = result.bitmap.count();
+        result.selectivity = n ? static_cast<double>(result.matches) / static_cast<double>(n) : 0.0;
+        return result;
+    }
 
-            size_t dim = vectors[0].size();
-            size_t n = vectors.size();
+    const FilterMatrix& getFilterMatrix() const {
+        return m_filter_matrix;
+    }
+
+    // -------------------------------
+    //ideally, i think i will make K be sqrt(n), where n is the num of points.
+    //not sure if this is the best function design, but I can optimize this later.
+    //call this method after the index build. I expect k to be like around 70 or 50 depends. I will just hard code it.
+    void computeKMeansClusters(const std::map<VectorName, FlatVectors>& per_name_vectors, size_t max_iters = 20) {
+        //run KMeans per VectorName using FAISS, on the same buffers the index build just used
+        for (const auto& [name, vectors] : per_name_vectors) {
+            if (vectors.n == 0) continue;
+
+            size_t dim = vectors.dim;
+            size_t n = vectors.n;
 
             size_t k = calculateOptimalK(n);
 
@@ -162,15 +495,14 @@ public:
 
             if (n <= k) {
                 std::cout << "Warning: Not enough vectors for proper clustering. Using all vectors as centroids.\n";
-                m_centroids[name] = vectors;
+                std::vector<DenseVector> all;
+                all.reserve(n);
+                for (size_t i = 0; i < n; ++i) {
+                    all.emplace_back(vectors.data + i * dim, vectors.data + (i + 1) * dim);
+                }
+                m_centroids[name] = std::move(all);
                 continue;
             }
-            //flatten to float*
-            std::vector<float> data_flat(n * dim);
-            for (size_t i = 0; i < n; ++i) {
-                std::copy(vectors[i].begin(), vectors[i].end(),
-                        data_flat.begin() + i * dim);
-            }
 
             //fAISS clustering
             faiss::ClusteringParameters cp;
@@ -179,7 +511,7 @@ public:
 
             faiss::Clustering clus(dim, k, cp);
             faiss::IndexFlatL2 index(dim);
-            clus.train(n, data_flat.data(), index);
+            clus.train(n, vectors.data, index);
 
             // Extract centroids
             const float* centroids_flat = clus.centroids.data();
@@ -216,12 +548,14 @@ public:
 
     QueryResult searchTopK(const std::string& vector_name,
                            const std::vector<DenseVector>& query_vectors,
-                           size_t k) const
+                           size_t k,
+                           const SearchParams& params = {},
+                           const FilterPlan* filter = nullptr) const
     {
         QueryResult query_result;
         std::cout << "In immutable searchTopK\n";
-        auto it = m_hnsw_indexes.find(vector_name);
-        if (it == m_hnsw_indexes.end()) {
+        auto it = m_indexes.find(vector_name);
+        if (it == m_indexes.end()) {
             query_result.status = Status::Error("Vector space not found: " + vector_name);
             return query_result;
         }
@@ -266,8 +600,69 @@ public:
             std::vector<faiss::idx_t> indices(nq * k);
             std::vector<float> dists(nq * k);
 
+            //filtered search: only offsets set in the plan's bitmap may come back. Without a filter but
+            //with tombstones, the IdTracker's live bitmap is the selector. When very few points
+            //match, a graph walk keeps hopping through filtered out nodes and comes back short, so scan instead.
+            std::shared_lock<std::shared_mutex> tombstone_lock(m_tombstone_mutex);
+            const BitmapIndex* allowed = nullptr;
+            size_t matches = 0;
+            double selectivity = 1.0;
+            if (filter) {
+                allowed = &filter->bitmap;
+                matches = filter->matches;
+                selectivity = filter->selectivity;
+            } else if (m_num_deleted > 0) {
+                allowed = &m_id_tracker.bitmap(vector_name);
+                matches = m_id_tracker.size(vector_name);
+                selectivity = static_cast<double>(matches) / static_cast<double>(std::max<faiss::idx_t>(1, it->second->ntotal));
+            }
+
+            bool exact = params.exact;
+            std::optional<BitmapIDSelector> selector;
+            if (allowed) {
+                if (matches == 0) {
+                    query_result.results.resize(nq);
+                    query_result.status = Status::OK();
+                    return query_result;
+                }
+                selector.emplace(*allowed);
+                if (selectivity < FILTER_BRUTE_FORCE_SELECTIVITY || matches <= k) {
+                    exact = true;
+                }
+            }
+            faiss::IDSelector* sel = selector ? &selector.value() : nullptr;
+
+            //per call FAISS SearchParameters, the shared index is never modified, so concurrent
+            //searches with different ef/nprobe can't race on hnsw.efSearch or ivf->nprobe
+            const faiss::Index* target = it->second.get();
+            faiss::SearchParameters plain_params;
+            faiss::SearchParametersHNSW hnsw_params;
+            faiss::SearchParametersIVF ivf_params;
+            plain_params.sel = sel;
+            hnsw_params.sel = sel;
+            ivf_params.sel = sel;
+            const faiss::SearchParameters* search_params = &plain_params;
+
+            if (auto* hnsw = dynamic_cast<const faiss::IndexHNSW*>(target)) {
+                if (exact && hnsw->storage) {
+                    target = hnsw->storage; //brute force over the vectors the graph was built on
+                } else {
+                    size_t ef = params.ef_search ? params.ef_search : static_cast<size_t>(hnsw->hnsw.efSearch);
+                    hnsw_params.efSearch = static_cast<int>(std::max(ef, k)); //ef below k just loses recall
+                    search_params = &hnsw_params;
+                }
+            } else if (auto* ivf = dynamic_cast<const faiss::IndexIVF*>(target)) {
+                //exact visits every list (for PQ that is as exact as the codes get)
+                if (exact) {
+                    ivf_params.nprobe = ivf->nlist;
+                } else {
+                    ivf_params.nprobe = params.nprobe ? std::min(params.nprobe, ivf->nlist) : ivf->nprobe;
+                }
+                search_params = &ivf_params;
+            }
+
             //perform FAISS search
-            it->second->search(nq, flat_queries.data(), k, dists.data(), indices.data());
+            target->search(nq, flat_queries.data(), k, dists.data(), indices.data(), search_params);
 
             //build QueryResult structure
             query_result.results.resize(nq);
@@ -283,7 +678,7 @@ public:
                         if (metric == DistanceMetric::L2)
                             score = -score;  // negate distance so higher = better
                         score = std::round(score * 10000.0f) / 10000.0f;
-                        batch.push_back({*point_id, score});
+                        batch.push_back({*point_id, score, slotVersion(vector_name, static_cast<size_t>(indices[idx]))});
                     }
                 }
             }
@@ -297,9 +692,53 @@ public:
 
 
 private:
-    void buildHNSWIndexes(const SegPointData& point_data) {
-        m_point_ids.reserve(point_data.size());
-        
+    //for load(), everything else gets filled in by loadIndex()
+    ImmutableSegment(const CollectionInfo& info, const SegmentIdType seg_id)
+        : m_segment_id{seg_id}
+        , m_info{info}
+        , m_index_spec{info.index_specs}
+    {}
+
+    //write version of the point at this FAISS offset
+    uint64_t slotVersion(const VectorName& vector_name, size_t offset) const {
+        auto map_it = m_offset_to_slot.find(vector_name);
+        const size_t slot = (map_it == m_offset_to_slot.end()) ? offset : map_it->second[offset];
+        return slot < m_versions.size() ? m_versions[slot] : 0;
+    }
+
+    //caller holds m_tombstone_mutex exclusively
+    bool tombstoneSlot(size_t slot) {
+        if (slot >= m_point_ids.size()) return false;
+        if (m_deleted_slots.size() != m_point_ids.size()) m_deleted_slots.resize(m_point_ids.size());
+        if (m_deleted_slots.contains(slot)) return false;
+        m_deleted_slots.set(slot, true);
+        ++m_num_deleted;
+        //this slot's own row per vector space, by offset: the same id can have a live row in
+        //another slot (upserted twice into one active segment)
+        for (const auto& [name, _] : m_vector_dims) {
+            auto offset = slotOffset(name, slot);
+            if (offset) m_id_tracker.remove(name, *offset);
+        }
+        return true;
+    }
+
+    //FAISS offset of a slot's row in one vector space, none if the point has no vector there
+    std::optional<size_t> slotOffset(const VectorName& vector_name, size_t slot) const {
+        auto map_it = m_offset_to_slot.find(vector_name);
+        if (map_it == m_offset_to_slot.end()) return slot;
+        const auto& offset_to_slot = map_it->second; //ascending, rows were added in slot order
+        auto it = std::lower_bound(offset_to_slot.begin(), offset_to_slot.end(), static_cast<uint32_t>(slot));
+        if (it == offset_to_slot.end() || *it != slot) return std::nullopt;
+        return static_cast<size_t>(it - offset_to_slot.begin());
+    }
+
+    //Fill the IdTracker (offset order == row order in the buffer) and hand back one view per vector space.
+    std::map<VectorName, FlatVectors> prepareFlatVectors(const SegmentVectorData& data) {
+        const size_t num_points = data.size();
+        m_point_ids = data.point_ids;
+        m_versions = data.versions;
+        m_versions.resize(num_points, 0);
+
         //get all possible vector names from collection info
         std::vector<VectorName> all_vector_names;
         all_vector_names.reserve(m_info.vec_specs.size());
@@ -308,95 +747,142 @@ private:
         }
         
         //init IdTracker with all possible vector names
-        m_id_tracker.init(all_vector_names, point_data.size());
+        m_id_tracker.init(all_vector_names, num_points);
 
-        //first pass: collect point IDs and track which vectors exist
-        std::unordered_map<VectorName, size_t> vector_counts;
-        std::set<VectorName> existing_vector_names;
-        
-        for (const auto& [point_id, vectors] : point_data) {
-            m_point_ids.push_back(point_id);
-            
-            // Track existing vectors for this point
-            for (const auto& [name, vec] : vectors) {
-                m_id_tracker.insert(name, point_id);
-                vector_counts[name]++;
-                existing_vector_names.insert(name);
-                
-                // Set dimension if not already set
-                if (m_vector_dims.find(name) == m_vector_dims.end()) {
-                    m_vector_dims[name] = vec.size();
-                } else if (m_vector_dims[name] != vec.size()) {
-                    throw std::runtime_error("Dimension mismatch for vector space: " + name);
+        std::map<VectorName, FlatVectors> flat;
+        for (const auto& [name, arena] : data.arenas) {
+            FlatVectors view;
+            view.dim = arena.dim();
+
+            size_t present = 0;
+            for (size_t slot = 0; slot < num_points; ++slot) {
+                if (arena.has(slot)) ++present;
+            }
+            if (present == 0) continue;
+
+            if (present == num_points) {
+                view.data = arena.data();
+            } else {
+                view.gathered.reserve(present * view.dim);
+                for (size_t slot = 0; slot < num_points; ++slot) {
+                    if (!arena.has(slot)) continue;
+                    view.gathered.insert(view.gathered.end(), arena.row(slot), arena.row(slot) + view.dim);
                 }
+                view.data = view.gathered.data();
             }
-        }
+            view.n = present;
 
-        //second pass: build batch buffers only for vectors that actually exist
-        std::unordered_map<VectorName, std::vector<float>> batch_buffers;
-        
-        for (const auto& name : existing_vector_names) {
-            size_t dim = m_vector_dims[name];
-            size_t count = vector_counts[name];
-            batch_buffers[name].reserve(count * dim);
-        }
-
-        //fill batch buffers in point order (important for ID mapping consistency)
-        for (const auto& [point_id, vectors] : point_data) {
-            for (const auto& name : existing_vector_names) {
-                auto it = vectors.find(name);
-                if (it != vectors.end()) {
-                    const auto& vec = it->second;
-                    auto& buf = batch_buffers[name];
-                    // buf.insert(buf.end(), vec.begin(), vec.end());
-                    //normalize vectors for cosine metric during build
-                    if (m_info.vec_specs.at(name).metric == DistanceMetric::COSINE) {
-                        DenseVector normalized_vec = vec;
-                        float vec_norm = vectordb::norm(normalized_vec.data(), normalized_vec.size());
-                        if (vec_norm > 1e-12f) {
-                            for (auto& val : normalized_vec) {
-                                val /= vec_norm;
-                            }
-                        }
-                        buf.insert(buf.end(), normalized_vec.begin(), normalized_vec.end());
-                    } else {
-                        //for L2 and DOT, store vectors as-is
-                        buf.insert(buf.end(), vec.begin(), vec.end());
-                    }//
+            for (size_t slot = 0; slot < num_points; ++slot) {
+                if (arena.has(slot)) m_id_tracker.insert(name, data.point_ids[slot]);
+            }
+            //faiss offset == slot unless some points lack this vector
+            if (present != num_points) {
+                auto& offset_to_slot = m_offset_to_slot[name];
+                offset_to_slot.reserve(present);
+                for (size_t slot = 0; slot < num_points; ++slot) {
+                    if (arena.has(slot)) offset_to_slot.push_back(static_cast<uint32_t>(slot));
                 }
             }
+
+            m_vector_dims[name] = view.dim;
+            flat.emplace(name, std::move(view));
         }
+        return flat;
+    }
 
+    void buildIndexes(const std::map<VectorName, FlatVectors>& flat) {
         // Build FAISS indexes only for vector spaces that have data
-        for (const auto& [name, buf] : batch_buffers) {
-            size_t dim = m_vector_dims[name];
-            size_t num_vectors = buf.size() / dim;
+        for (const auto& [name, vectors] : flat) {
+            size_t dim = vectors.dim;
+            size_t num_vectors = vectors.n;
 
             if (num_vectors == 0) {
                 continue; // Skip empty vector spaces
             }
 
-            std::cout << "Building HNSW index for vector space: " << name 
+            IndexType built_type;
+            auto index = makeIndex(m_info.vec_specs.at(name), dim, num_vectors, built_type);
+
+            std::cout << "Building " << to_string(built_type) << " index for vector space: " << name 
                       << " with " << num_vectors << " vectors of dimension " << dim << std::endl;
 
-            auto faiss_metric = to_faiss_metric(m_info.vec_specs.at(name).metric);
-            auto index = std::make_unique<faiss::IndexHNSWFlat>(dim, m_index_spec.m_edges, faiss_metric);
-            index->hnsw.efConstruction = m_index_spec.ef_construction;
-            index->hnsw.efSearch = m_index_spec.ef_search;
+            //SQ, IVF and PQ learn their codebooks/lists from the segment itself
+            if (!index->is_trained) {
+                index->train(num_vectors, vectors.data);
+            }
 
             // Add vectors to the index
-            index->add(num_vectors, buf.data());
-            m_hnsw_indexes[name] = std::move(index);
+            index->add(num_vectors, vectors.data);
+            m_indexes[name] = std::move(index);
+            m_index_types[name] = built_type;
         }
 
-        std::cout << "ImmutableSegment: built " << m_hnsw_indexes.size() 
-                  << " HNSW indexes for " << m_point_ids.size() << " points\n";
+        std::cout << "ImmutableSegment: built " << m_indexes.size() 
+                  << " indexes for " << m_point_ids.size() << " points\n";
         
         // Debug: print vector space statistics
-        for (const auto& [name, count] : vector_counts) {
-            std::cout << "  Vector space '" << name << "': " << count << " vectors" << std::endl;
+        for (const auto& [name, vectors] : flat) {
+            std::cout << "  Vector space '" << name << "': " << vectors.n << " vectors" << std::endl;
         }
     }
+
+    //Construct the FAISS index the vector spec asks for. When the segment is too small to train it
+    //(IVF wants ~MIN_POINTS_PER_LIST points per list, PQ needs 2^nbits points per codebook) we fall
+    //back to Flat, which for a segment that small is also the fastest anyway. `built` is what we made.
+    std::unique_ptr<faiss::Index> makeIndex(const VectorSpec& spec, size_t dim, size_t n, IndexType& built) const {
+        static constexpr size_t MIN_POINTS_PER_LIST = 39; //same rule of thumb FAISS warns with
+
+        const auto faiss_metric = to_faiss_metric(spec.metric);
+        const VectorIndexSpec& ix = spec.index;
+        built = ix.type;
+
+        switch (ix.type) {
+            case IndexType::HNSWFlat: {
+                auto index = std::make_unique<faiss::IndexHNSWFlat>(dim, m_index_spec.m_edges, faiss_metric);
+                index->hnsw.efConstruction = m_index_spec.ef_construction;
+                index->hnsw.efSearch = m_index_spec.ef_search;
+                return index;
+            }
+            case IndexType::HNSWSQ8:
+            case IndexType::HNSWFP16: {
+                auto qtype = (ix.type == IndexType::HNSWSQ8) ? faiss::ScalarQuantizer::QT_8bit
+                                                             : faiss::ScalarQuantizer::QT_fp16;
+                auto index = std::make_unique<faiss::IndexHNSWSQ>(dim, qtype, m_index_spec.m_edges, faiss_metric);
+                index->hnsw.efConstruction = m_index_spec.ef_construction;
+                index->hnsw.efSearch = m_index_spec.ef_search;
+                return index;
+            }
+            case IndexType::IVFFlat:
+            case IndexType::IVFPQ: {
+                size_t nlist = ix.nlist ? ix.nlist : static_cast<size_t>(4.0 * std::sqrt(static_cast<double>(n)));
+                nlist = std::min(nlist, n / MIN_POINTS_PER_LIST);
+                const bool pq_too_small = (ix.type == IndexType::IVFPQ) && n < (size_t{1} << ix.pq_nbits);
+                if (nlist == 0 || pq_too_small) {
+                    std::cout << "[INDEX] " << n << " vectors too few to train " << to_string(ix.type)
+                              << ", using flat for this segment\n";
+                    break;
+                }
+
+                auto quantizer = std::make_unique<faiss::IndexFlat>(dim, faiss_metric);
+                std::unique_ptr<faiss::IndexIVF> index;
+                if (ix.type == IndexType::IVFFlat) {
+                    index = std::make_unique<faiss::IndexIVFFlat>(quantizer.get(), dim, nlist, faiss_metric);
+                } else {
+                    index = std::make_unique<faiss::IndexIVFPQ>(quantizer.get(), dim, nlist, ix.pq_m, ix.pq_nbits, faiss_metric);
+                }
+                quantizer.release();
+                index->own_fields = true; //the ivf index deletes its quantizer
+                index->nprobe = std::min(ix.nprobe, nlist);
+                index->make_direct_map(true); //offset -> code lookup, so vectors can be reconstructed later
+                return index;
+            }
+            default:
+                break;
+        }
+
+        built = IndexType::Flat;
+        return std::make_unique<faiss::IndexFlat>(dim, faiss_metric);
+    }
     
     
     void writeSegmentMetadata(const std::string& segment_dir) {
@@ -411,9 +897,11 @@ private:
         metadata["vector_spaces"] = json::object();
         
         for (const auto& [vec_name, dim] : m_vector_dims) {
+            auto type_it = m_index_types.find(vec_name);
             metadata["vector_spaces"][vec_name] = {
                 {"dimension", dim},
-                {"metric", to_string(m_info.vec_specs.at(vec_name).metric)}
+                {"metric", to_string(m_info.vec_specs.at(vec_name).metric)},
+                {"index_type", to_string(type_it != m_index_types.end() ? type_it->second : IndexType::UNKNOWN)}
             };
         }
         
@@ -422,25 +910,209 @@ private:
         std::cout << "[METADATA] Segment metadata written: " << metadata_path << "\n";
     }
     
+    //points.bin: per slot the point id and version, per vector space its dim, the index type that
+    //was built and the offset -> slot map (empty when offset == slot), then the projected payloads
+    Status writePoints(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return Status::Error("Cannot open " + path + " for writing");
+
+        write_u64(out, POINTS_MAGIC);
+        write_u64(out, m_point_ids.size());
+        for (size_t slot = 0; slot < m_point_ids.size(); ++slot) {
+            write_string(out, m_point_ids[slot]);
+            write_u64(out, m_versions[slot]);
+        }
+
+        write_u64(out, m_vector_dims.size());
+        for (const auto& [name, dim] : m_vector_dims) {
+            auto type_it = m_index_types.find(name);
+            auto map_it = m_offset_to_slot.find(name);
+            write_string(out, name);
+            write_u64(out, dim);
+            write_u64(out, static_cast<uint64_t>(type_it != m_index_types.end() ? type_it->second : IndexType::UNKNOWN));
+            const std::vector<uint32_t> none;
+            const auto& offsets = (map_it == m_offset_to_slot.end()) ? none : map_it->second;
+            write_u64(out, offsets.size());
+            out.write(reinterpret_cast<const char*>(offsets.data()),
+                      static_cast<std::streamsize>(offsets.size() * sizeof(uint32_t)));
+        }
+
+        write_u64(out, m_payloads.size());
+        for (const auto& payload : m_payloads) {
+            write_string(out, payload.dump());
+        }
+
+        if (!out) return Status::Error("Failed writing " + path);
+        return Status::OK();
+    }
+
+    Status readPoints(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return Status::Error("Cannot open " + path);
+
+        try {
+            if (read_u64(in) != POINTS_MAGIC) return Status::Error("Not a segment points file: " + path);
+            const size_t num_points = read_u64(in);
+            m_point_ids.reserve(num_points);
+            m_versions.reserve(num_points);
+            for (size_t slot = 0; slot < num_points; ++slot) {
+                m_point_ids.push_back(read_string(in));
+                m_versions.push_back(read_u64(in));
+            }
+
+            for (uint64_t n = read_u64(in); n > 0; --n) {
+                std::string name = read_string(in);
+                if (!m_info.vec_specs.count(name)) throw std::runtime_error("unknown vector space " + name);
+                m_vector_dims[name] = read_u64(in);
+                m_index_types[name] = static_cast<IndexType>(read_u64(in));
+                const size_t count = read_u64(in);
+                if (count > num_points) throw std::runtime_error("offset map larger than the segment");
+                if (count == 0) continue;
+                auto& offsets = m_offset_to_slot[name];
+                offsets.resize(count);
+                in.read(reinterpret_cast<char*>(offsets.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+                if (!in) throw std::runtime_error("unexpected end of file");
+                for (uint32_t slot : offsets) {
+                    if (slot >= num_points) throw std::runtime_error("offset map points past the segment");
+                }
+            }
+
+            const size_t num_payloads = read_u64(in);
+            m_payloads.reserve(num_payloads);
+            for (size_t i = 0; i < num_payloads; ++i) {
+                m_payloads.push_back(json::parse(read_string(in)));
+            }
+        } catch (const std::exception& e) {
+            return Status::Error("Corrupt segment points file " + path + ": " + e.what());
+        }
+        return Status::OK();
+    }
+
+    //centroids.bin: per vector space k centroids of dim floats
+    Status writeCentroids(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) return Status::Error("Cannot open " + path + " for writing");
+
+        write_u64(out, CENTROIDS_MAGIC);
+        write_u64(out, m_centroids.size());
+        for (const auto& [name, centroids] : m_centroids) {
+            const size_t dim = centroids.empty() ? 0 : centroids.front().size();
+            write_string(out, name);
+            write_u64(out, centroids.size());
+            write_u64(out, dim);
+            for (const auto& c : centroids) {
+                out.write(reinterpret_cast<const char*>(c.data()), static_cast<std::streamsize>(dim * sizeof(float)));
+            }
+        }
+
+        if (!out) return Status::Error("Failed writing " + path);
+        return Status::OK();
+    }
+
+    Status readCentroids(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return Status::Error("Cannot open " + path);
+
+        try {
+            if (read_u64(in) != CENTROIDS_MAGIC) return Status::Error("Not a centroids file: " + path);
+            std::map<VectorName, std::vector<DenseVector>> loaded;
+            for (uint64_t n = read_u64(in); n > 0; --n) {
+                std::string name = read_string(in);
+                const size_t k = read_u64(in);
+                const size_t dim = read_u64(in);
+                auto dim_it = m_vector_dims.find(name);
+                if (dim_it == m_vector_dims.end() || dim_it->second != dim) throw std::runtime_error("centroids don't match " + name);
+                auto& centroids = loaded[name];
+                centroids.assign(k, DenseVector(dim));
+                for (auto& c : centroids) {
+                    in.read(reinterpret_cast<char*>(c.data()), static_cast<std::streamsize>(dim * sizeof(float)));
+                }
+                if (!in) throw std::runtime_error("unexpected end of file");
+            }
+            m_centroids = std::move(loaded);
+        } catch (const std::exception& e) {
+            return Status::Error("Corrupt centroids file " + path + ": " + e.what());
+        }
+        return Status::OK();
+    }
+
+    //bytes of `index` that read_index() left in the mapped file, 0 if it read everything in
+    static size_t mappedBytes(const faiss::Index* index) {
+        if (auto ivf = dynamic_cast<const faiss::IndexIVF*>(index)) {
+            auto lists = dynamic_cast<const faiss::OnDiskInvertedLists*>(ivf->invlists);
+            return lists ? lists->totsize : 0;
+        }
+#if VECTORDB_MMAP_FLAT_CODES
+        if (auto hnsw = dynamic_cast<const faiss::IndexHNSW*>(index)) {
+            return mappedBytes(hnsw->storage);
+        }
+        if (auto flat = dynamic_cast<const faiss::IndexFlatCodes*>(index)) {
+            return flat->codes.size();
+        }
+#endif
+        return 0;
+    }
+
+    static void write_u64(std::ostream& out, uint64_t v) {
+        out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static uint64_t read_u64(std::istream& in) {
+        uint64_t v = 0;
+        in.read(reinterpret_cast<char*>(&v), sizeof(v));
+        if (!in) throw std::runtime_error("unexpected end of file");
+        return v;
+    }
+
+    static void write_string(std::ostream& out, const std::string& s) {
+        write_u64(out, s.size());
+        out.write(s.data(), static_cast<std::streamsize>(s.size()));
+    }
+
+    static std::string read_string(std::istream& in) {
+        std::string s(read_u64(in), '\0');
+        in.read(s.data(), static_cast<std::streamsize>(s.size()));
+        if (!in) throw std::runtime_error("unexpected end of file");
+        return s;
+    }
+
+    static constexpr uint64_t POINTS_MAGIC = 0x31544E5042445654ULL;    //"TVDBPNT1"
+    static constexpr uint64_t CENTROIDS_MAGIC = 0x31544E4342445654ULL; //"TVDBCNT1"
+
     static std::string getCurrentTimestamp() {
         auto now = std::chrono::system_clock::now();
         auto time_t = std::chrono::system_clock::to_time_t(now);
+        std::tm local{};
+        localtime_r(&time_t, &local); //segments are written from several IO threads, localtime() isn't safe there
         std::stringstream ss;
-        ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
+        ss << std::put_time(&local, "%Y-%m-%d %H:%M:%S");
         return ss.str();
     }
 
 private:
     SegmentIdType m_segment_id;
     std::vector<PointIdType> m_point_ids;
-    std::unordered_map<VectorName, std::unique_ptr<faiss::IndexHNSW>> m_hnsw_indexes;
+    std::vector<uint64_t> m_versions; //per slot, from the active segment
+    std::unordered_map<VectorName, std::unique_ptr<faiss::Index>> m_indexes;
+    std::unordered_map<VectorName, IndexType> m_index_types; //what was actually built (small segments fall back to flat)
     std::unordered_map<VectorName, size_t> m_vector_dims;
     CollectionInfo m_info;
     IndexSpec m_index_spec;
     IdTracker m_id_tracker;
+    std::unordered_map<VectorName, std::vector<uint32_t>> m_offset_to_slot; //only for vector spaces with missing rows
+    FilterMatrix m_filter_matrix; //payload_index fields, over slots
+    std::vector<Payload> m_payloads; //projected payloads per slot (empty without payload_index), for compaction
+
+    //deleted points: slots here, offsets cleared in m_id_tracker. Searches hold it shared.
+    BitmapIndex m_deleted_slots;
+    size_t m_num_deleted{0};
+    mutable std::shared_mutex m_tombstone_mutex;
     
     //MetaIndex centroids
     std::map<VectorName, std::vector<DenseVector>> m_centroids;
+
+    bool m_mapped{false}; //set by loadIndex() before the segment is shared
+    std::atomic<size_t> m_index_bytes{0}; //set by writeIndex() on the IO lane, read by the holder
 };
 
 } // namespace vectordb
@@ -25,6 +25,8 @@ inline void to_json(json& j, const QueryResult& r) {
     j = json{
         {"status", r.status.ok ? "ok" : r.status.message},
         {"time", r.time_seconds},
+        {"segments_searched", r.segments_searched},
+        {"segments_skipped", r.segments_skipped},
         {"result", r.results} // let json lib expand using the converters above
     };
 }
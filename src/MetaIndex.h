@@ -18,6 +18,13 @@
 #pragma once
 
 #include "DataTypes.h"
+#include "Distance.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace vectordb {
 class MetaIndex {
@@ -28,23 +35,119 @@ public:
     ~MetaIndex() = default;
 
     //add
-    void insertToMetaIndex(const SegmentIdType seg_id, CentroidsType centroids, size_t immutableSeg_index) {
-        m_meta_index[seg_id] = centroids;//??
-        m_immutableSeg_tracker[seg_id] = immutableSeg_index;
+    void insertToMetaIndex(const SegmentIdType& seg_id, CentroidsType centroids) {
+        if (m_meta_index.count(seg_id)) {
+            removeFromMetaIndex(seg_id);
+        }
+        const size_t owner = m_segment_ids.size();
+        m_segment_ids.push_back(seg_id);
+        appendToTables(owner, centroids);
+        m_meta_index[seg_id] = std::move(centroids);
+    }
+
+    //remove a segment (e.g. after it got compacted away), rebuilds the flat tables which is fine, rare op
+    void removeFromMetaIndex(const SegmentIdType& seg_id) {
+        if (m_meta_index.erase(seg_id) == 0) return;
+        m_segment_ids.erase(std::remove(m_segment_ids.begin(), m_segment_ids.end(), seg_id), m_segment_ids.end());
+        m_tables.clear();
+        for (size_t owner = 0; owner < m_segment_ids.size(); ++owner) {
+            appendToTables(owner, m_meta_index.at(m_segment_ids[owner]));
+        }
+    }
+
+    bool contains(const SegmentIdType& seg_id) const {
+        return m_meta_index.count(seg_id) != 0;
+    }
+
+    size_t size() const {
+        return m_segment_ids.size();
     }
 
-    //search(important here, still thinking about making this class a shard layer?)
+    //search: score every centroid against every query in one batch, a segment scores as its best centroid,
+    //and each query gets the ids of its top `nprobe` segments (best first). Only segments that have
+    //centroids for `name` can show up here, the caller decides what to do with the others.
+    std::vector<std::vector<SegmentIdType>> routeQueries(const VectorName& name,
+                                                         DistanceMetric metric,
+                                                         const std::vector<DenseVector>& queries,
+                                                         size_t nprobe) const
+    {
+        std::vector<std::vector<SegmentIdType>> routes(queries.size());
+        auto it = m_tables.find(name);
+        if (it == m_tables.end() || it->second.owner.empty() || nprobe == 0) {
+            return routes;
+        }
+
+        const CentroidTable& table = it->second;
+        const size_t nq = queries.size();
+        const size_t nc = table.owner.size();
 
+        std::vector<float> flat_queries;
+        flat_queries.reserve(nq * table.dim);
+        for (const auto& q : queries) {
+            flat_queries.insert(flat_queries.end(), q.begin(), q.end());
+        }
+
+        std::vector<float> scores(nq * nc);
+        compute_distance_matrix(metric, flat_queries.data(), nq, table.data.data(), nc, table.dim,
+                                scores.data(), table.norms.data());
+
+        const size_t num_segments = m_segment_ids.size();
+        std::vector<float> seg_best(num_segments);
+        std::vector<size_t> order;
+        for (size_t qi = 0; qi < nq; ++qi) {
+            std::fill(seg_best.begin(), seg_best.end(), -std::numeric_limits<float>::infinity());
+            const float* row = scores.data() + qi * nc;
+            for (size_t c = 0; c < nc; ++c) {
+                //higher = better, same convention as the search results
+                float s = (metric == DistanceMetric::L2) ? -row[c] : row[c];
+                seg_best[table.owner[c]] = std::max(seg_best[table.owner[c]], s);
+            }
+
+            order.clear();
+            for (size_t sgi = 0; sgi < num_segments; ++sgi) {
+                if (seg_best[sgi] != -std::numeric_limits<float>::infinity()) order.push_back(sgi);
+            }
+            const size_t take = std::min(nprobe, order.size());
+            std::partial_sort(order.begin(), order.begin() + take, order.end(),
+                              [&](size_t a, size_t b) { return seg_best[a] > seg_best[b]; });
+
+            routes[qi].reserve(take);
+            for (size_t i = 0; i < take; ++i) {
+                routes[qi].push_back(m_segment_ids[order[i]]);
+            }
+        }
+        return routes;
+    }
 
     //perhaps write to disk to like preserve the MetaIndex state?
 
 
 private:
+    //all centroids of one vector space flattened into one matrix, so routing is one compute_distance_matrix call
+    struct CentroidTable {
+        size_t dim{0};
+        std::vector<float> data;
+        std::vector<float> norms;
+        std::vector<size_t> owner; //centroid row -> position in m_segment_ids
+    };
+
+    void appendToTables(size_t owner, const CentroidsType& centroids) {
+        for (const auto& [name, list] : centroids) {
+            if (list.empty()) continue;
+            auto& table = m_tables[name];
+            table.dim = list.front().size();
+            for (const auto& c : list) {
+                if (c.size() != table.dim) continue;
+                table.data.insert(table.data.end(), c.begin(), c.end());
+                table.norms.push_back(vectordb::norm(c.data(), c.size()));
+                table.owner.push_back(owner);
+            }
+        }
+    }
+
     std::unordered_map<SegmentIdType, CentroidsType> m_meta_index;
-    //for in memory use case, maybe need to store the location about 
-    //where the immutableSeg is located? 
-    //So we need mapping of segment id and m_immutableSegment[?] index integer?
-    std::unordered_map<SegmentIdType, size_t> m_immutableSeg_tracker;
+    std::vector<SegmentIdType> m_segment_ids;
+    std::unordered_map<VectorName, CentroidTable> m_tables;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,316 @@
+#pragma once
+
+#include "DataTypes.h"
+#include "CollectionInfo.h"
+#include "Status.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+Payload filters for the query API. The shape follows Qdrant's filter json:
+
+"filter": {
+    "must": [
+        {"key": "tenant",    "match": {"value": "acme"}},
+        {"key": "category",  "match": {"any": ["img", "video"]}},
+        {"key": "price",     "range": {"gte": 10, "lt": 100}},
+        {"key": "meta.lang", "match": {"value": "en"}}
+    ]
+}
+
+Every condition in "must" has to hold (AND), at least one in "should" has to hold when "should"
+is given (OR), and none in "must_not" may hold (NOT). Instead of a field condition an entry can be
+a whole filter again, so trees like (a AND (b OR c)) AND NOT d can be written:
+
+"filter": {
+    "must":     [{"key": "tenant", "match": {"value": "acme"}},
+                 {"should": [{"key": "tags", "match": {"value": "new"}},
+                             {"key": "price", "range": {"lt": 10}}]}],
+    "must_not": [{"key": "status", "match": {"value": "deleted"}}]
+}
+
+Keys can reach into nested objects with dots.
+When the payload value is an array, a match condition holds if any element matches
+(so {"tags": ["a", "b"]} matches {"key": "tags", "match": {"value": "a"}}).
+
+A point without a payload, or without the key, never matches.
+
+The filter gets resolved per segment into a BitmapIndex over the FAISS offsets and handed to
+the index as an IDSelector, so the ANN search only ever walks to points that pass the filter.
+Conditions on fields listed in the collection's payload_index are answered from the segment's
+own FilterMatrix (pure bitmap algebra, see FilterPlanner), anything else falls back to a payload
+store lookup.
+*/
+
+namespace vectordb {
+
+//true if the point passes the filter. Called from the query fan-out threads, so it has to be thread safe.
+using PointPredicate = std::function<bool(const PointIdType&)>;
+
+//"a.b.c" -> payload["a"]["b"]["c"], nullptr if any step is missing
+inline const json* lookupPayloadField(const Payload& payload, const std::string& key) {
+    const json* node = &payload;
+    size_t begin = 0;
+    while (begin <= key.size()) {
+        size_t end = key.find('.', begin);
+        if (end == std::string::npos) end = key.size();
+        if (!node->is_object()) return nullptr;
+        auto it = node->find(key.substr(begin, end - begin));
+        if (it == node->end()) return nullptr;
+        node = &(*it);
+        begin = end + 1;
+    }
+    return node;
+}
+
+struct FieldCondition {
+    std::string key;
+
+    //match: the payload value equals one of these
+    std::vector<json> match_any;
+
+    //range: numeric bounds, unset = unbounded
+    bool is_range{false};
+    std::optional<double> gt, gte, lt, lte;
+
+    bool inRange(double v) const {
+        if (gt && !(v > *gt)) return false;
+        if (gte && !(v >= *gte)) return false;
+        if (lt && !(v < *lt)) return false;
+        if (lte && !(v <= *lte)) return false;
+        return true;
+    }
+
+    bool matchesValue(const json& value) const {
+        if (is_range) {
+            return value.is_number() && inRange(value.get<double>());
+        }
+        for (const auto& candidate : match_any) {
+            if (value == candidate) return true;
+        }
+        return false;
+    }
+
+    bool matches(const Payload& payload) const {
+        return matchesField(lookupPayloadField(payload, key));
+    }
+
+    //same as matches() but with the field already looked up (nullptr = missing)
+    bool matchesField(const json* value) const {
+        if (!value) return false;
+        if (value->is_array()) {
+            for (const auto& element : *value) {
+                if (matchesValue(element)) return true;
+            }
+            return false;
+        }
+        return matchesValue(*value);
+    }
+};
+
+class PayloadFilter;
+
+//one entry of a must/should/must_not list: either a field condition or a whole nested filter
+struct FilterClause {
+    std::optional<FieldCondition> field;
+    std::shared_ptr<const PayloadFilter> nested;
+};
+
+class PayloadFilter {
+public:
+    //nested filters deeper than this are rejected, parse() and the evaluators recurse
+    static constexpr size_t MAX_DEPTH = 8;
+
+    PayloadFilter() = default;
+
+    static StatusOr<PayloadFilter> parse(const json& filter_json, size_t depth = 0) {
+        if (!filter_json.is_object()) {
+            return Status::Error("'filter' must be an object");
+        }
+        if (depth >= MAX_DEPTH) {
+            return Status::Error("Filter is nested too deeply (max " + std::to_string(MAX_DEPTH) + " levels)");
+        }
+
+        PayloadFilter filter;
+        for (const auto& [clause, value] : filter_json.items()) {
+            std::vector<FilterClause>* target = nullptr;
+            if (clause == "must") target = &filter.m_must;
+            else if (clause == "should") target = &filter.m_should;
+            else if (clause == "must_not") target = &filter.m_must_not;
+            else {
+                return Status::Error("Unsupported filter clause '" + clause + "', expected 'must', 'should' or 'must_not'");
+            }
+
+            if (!value.is_array()) {
+                return Status::Error("'filter." + clause + "' must be an array");
+            }
+            for (const auto& entry : value) {
+                auto parsed = parseClause(entry, depth);
+                if (!parsed.ok()) return parsed.status();
+                target->push_back(std::move(parsed.value()));
+            }
+        }
+        return filter;
+    }
+
+    bool empty() const {
+        return m_must.empty() && m_should.empty() && m_must_not.empty();
+    }
+
+    bool matches(const Payload& payload) const {
+        return evaluate([&](const FieldCondition& cond) {
+            return cond.matches(payload);
+        });
+    }
+
+    //matches() over a payload projected with projectIndexedFields(), keys are the flat "a.b" names
+    bool matchesProjected(const Payload& projected) const {
+        return evaluate([&](const FieldCondition& cond) {
+            auto it = projected.find(cond.key);
+            return cond.matchesField(it == projected.end() ? nullptr : &(*it));
+        });
+    }
+
+    //true if every condition (nested ones too) is on an indexed field, so no payload store lookup is needed
+    bool coveredBy(const PayloadIndexSchema& schema) const {
+        for (const auto* list : {&m_must, &m_should, &m_must_not}) {
+            for (const auto& clause : *list) {
+                if (clause.field && schema.find(clause.field->key) == schema.end()) return false;
+                if (clause.nested && !clause.nested->coveredBy(schema)) return false;
+            }
+        }
+        return true;
+    }
+
+    const std::vector<FilterClause>& getMust() const { return m_must; }
+    const std::vector<FilterClause>& getShould() const { return m_should; }
+    const std::vector<FilterClause>& getMustNot() const { return m_must_not; }
+
+private:
+    //must: all hold, should: at least one holds (when there are any), must_not: none holds
+    template <typename LeafFn>
+    bool evaluate(const LeafFn& leaf) const {
+        auto holds = [&](const FilterClause& clause) {
+            return clause.field ? leaf(*clause.field) : clause.nested->evaluate(leaf);
+        };
+
+        for (const auto& clause : m_must) {
+            if (!holds(clause)) return false;
+        }
+        if (!m_should.empty()) {
+            bool any = false;
+            for (const auto& clause : m_should) {
+                if (holds(clause)) { any = true; break; }
+            }
+            if (!any) return false;
+        }
+        for (const auto& clause : m_must_not) {
+            if (holds(clause)) return false;
+        }
+        return true;
+    }
+
+    static StatusOr<FilterClause> parseClause(const json& j, size_t depth) {
+        FilterClause clause;
+        const bool is_nested = j.is_object() && !j.contains("key") &&
+            (j.contains("must") || j.contains("should") || j.contains("must_not"));
+        if (is_nested) {
+            auto nested = parse(j, depth + 1);
+            if (!nested.ok()) return nested.status();
+            clause.nested = std::make_shared<const PayloadFilter>(std::move(nested.value()));
+            return clause;
+        }
+
+        auto cond = parseCondition(j);
+        if (!cond.ok()) return cond.status();
+        clause.field = std::move(cond.value());
+        return clause;
+    }
+
+    static StatusOr<FieldCondition> parseCondition(const json& j) {
+        if (!j.is_object() || !j.contains("key") || !j["key"].is_string()) {
+            return Status::Error("Each filter condition needs a string 'key'");
+        }
+
+        FieldCondition cond;
+        cond.key = j["key"].get<std::string>();
+        if (cond.key.empty()) {
+            return Status::Error("Filter condition 'key' cannot be empty");
+        }
+
+        const bool has_match = j.contains("match");
+        const bool has_range = j.contains("range");
+        if (has_match == has_range) {
+            return Status::Error("Filter condition on '" + cond.key + "' needs exactly one of 'match' or 'range'");
+        }
+
+        if (has_match) {
+            const auto& m = j["match"];
+            if (m.is_object() && m.contains("value")) {
+                cond.match_any.push_back(m["value"]);
+            } else if (m.is_object() && m.contains("any") && m["any"].is_array()) {
+                for (const auto& v : m["any"]) cond.match_any.push_back(v);
+            } else {
+                return Status::Error("'match' on '" + cond.key + "' needs 'value' or an 'any' array");
+            }
+            for (const auto& v : cond.match_any) {
+                if (!v.is_string() && !v.is_number() && !v.is_boolean()) {
+                    return Status::Error("'match' on '" + cond.key + "' only takes strings, numbers or booleans");
+                }
+            }
+            return cond;
+        }
+
+        const auto& r = j["range"];
+        if (!r.is_object() || r.empty()) {
+            return Status::Error("'range' on '" + cond.key + "' must be a non-empty object");
+        }
+        cond.is_range = true;
+        for (const auto& [bound, v] : r.items()) {
+            if (!v.is_number()) {
+                return Status::Error("'range." + bound + "' on '" + cond.key + "' must be a number");
+            }
+            const double d = v.get<double>();
+            if (bound == "gt") cond.gt = d;
+            else if (bound == "gte") cond.gte = d;
+            else if (bound == "lt") cond.lt = d;
+            else if (bound == "lte") cond.lte = d;
+            else return Status::Error("Unknown range bound '" + bound + "' (gt, gte, lt, lte)");
+        }
+        return cond;
+    }
+
+    std::vector<FilterClause> m_must;
+    std::vector<FilterClause> m_should;
+    std::vector<FilterClause> m_must_not;
+};
+
+//Keep only the indexed fields of a payload, flattened: {"meta": {"lang": "en"}, "x": 1} with
+//schema {"meta.lang"} -> {"meta.lang": "en"}. This is what segments hold on to per point.
+inline Payload projectIndexedFields(const Payload& payload, const PayloadIndexSchema& schema) {
+    Payload projected; //stays null (no allocation) when nothing is indexed
+    if (schema.empty() || !payload.is_object()) return projected;
+    for (const auto& [field, _] : schema) {
+        if (const json* value = lookupPayloadField(payload, field)) {
+            projected[field] = *value;
+        }
+    }
+    return projected;
+}
+
+//What a segment gets for a filtered search: the parsed filter, which it answers from its own
+//payload indexes where it can, and a payload store lookup for the conditions it can't.
+struct SegmentFilter {
+    const PayloadFilter* filter{nullptr};
+    PointPredicate fallback; //evaluates the whole filter against the stored payload
+
+    explicit operator bool() const {
+        return filter && !filter->empty();
+    }
+};
+
+} // namespace vectordb
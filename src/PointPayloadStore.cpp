@@ -4,12 +4,22 @@
 #include <rocksdb/table.h>
 #include <rocksdb/options.h>
 #include <rocksdb/filter_policy.h>
+#include <rocksdb/write_batch.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace vectordb {
 
+    //not a point id: starts with a NUL
+    static const std::string EPOCH_KEY("\0epoch", 6);
+
     PointPayloadStore::PointPayloadStore(const std::filesystem::path& db_path, 
-                                         size_t cache_size_mb) : m_rkdb_path{db_path} 
+                                         size_t cache_size_mb,
+                                         const PayloadStoreSpec& write_spec) 
+        : m_rkdb_path{db_path}, m_write_spec{write_spec} 
     {
         // Create the directory if it doesn't exist
         std::filesystem::create_directories(db_path.parent_path()); //uncomment this line after things work
@@ -32,24 +42,125 @@ namespace vectordb {
         if (!status.ok()) {
             throw std::runtime_error("Failed to open RocksDB: " + status.ToString());
         }
+
+        //new epoch per open, synced: a payload of this run must never compare as older than one of the last
+        std::string value;
+        status = m_rkdb->Get(rocksdb::ReadOptions(), EPOCH_KEY, &value);
+        if (!status.ok() && !status.IsNotFound()) {
+            delete m_rkdb;
+            throw std::runtime_error("Failed to read the payload store epoch: " + status.ToString());
+        }
+        if (status.ok() && value.size() == sizeof(uint64_t)) {
+            std::memcpy(&m_epoch, value.data(), sizeof(uint64_t));
+            ++m_epoch;
+        }
+        rocksdb::WriteOptions sync_options;
+        sync_options.sync = true;
+        status = m_rkdb->Put(sync_options, EPOCH_KEY,
+                             std::string(reinterpret_cast<const char*>(&m_epoch), sizeof(uint64_t)));
+        if (!status.ok()) {
+            delete m_rkdb;
+            throw std::runtime_error("Failed to write the payload store epoch: " + status.ToString());
+        }
     }
 
     PointPayloadStore::~PointPayloadStore() {
         delete m_rkdb;
     }
 
-    Status PointPayloadStore::putPayload(const PointIdType& id, const Payload& data) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        rocksdb::Status status = m_rkdb->Put(rocksdb::WriteOptions(), id, data.dump());
+    //rocksdb serializes writers itself (and groups concurrent ones into a single WAL write), the
+    //stripe locks only order the read-compare-write of one id, see writeBatch()
+    rocksdb::WriteOptions PointPayloadStore::writeOptions() const {
+        rocksdb::WriteOptions options;
+        options.sync = m_write_spec.sync;
+        options.disableWAL = m_write_spec.disable_wal;
+        return options;
+    }
+
+    std::string PointPayloadStore::encodeValue(const Payload& data, uint64_t version) const {
+        std::string value(VALUE_HEADER_SIZE, '\0');
+        value[0] = VALUE_TAG;
+        std::memcpy(&value[1], &m_epoch, sizeof(uint64_t));
+        std::memcpy(&value[1 + sizeof(uint64_t)], &version, sizeof(uint64_t));
+        value += data.dump();
+        return value;
+    }
+
+    PointPayloadStore::StoredVersion PointPayloadStore::storedVersion(const std::string& value) {
+        StoredVersion stored;
+        if (value.size() >= VALUE_HEADER_SIZE && value[0] == VALUE_TAG) {
+            std::memcpy(&stored.epoch, &value[1], sizeof(uint64_t));
+            std::memcpy(&stored.version, &value[1 + sizeof(uint64_t)], sizeof(uint64_t));
+        }
+        return stored;
+    }
+
+    StatusOr<std::vector<std::optional<PointPayloadStore::StoredVersion>>>
+    PointPayloadStore::readVersions(const std::vector<const PointIdType*>& ids) const {
+        std::vector<rocksdb::Slice> keys;
+        keys.reserve(ids.size());
+        for (const auto* id : ids) keys.emplace_back(*id);
+
+        std::vector<std::string> values;
+        std::vector<rocksdb::Status> statuses = m_rkdb->MultiGet(rocksdb::ReadOptions(), keys, &values);
+
+        std::vector<std::optional<StoredVersion>> versions(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (statuses[i].IsNotFound()) continue;
+            if (!statuses[i].ok()) {
+                return Status::Error("Get failed: " + statuses[i].ToString());
+            }
+            versions[i] = storedVersion(values[i]);
+        }
+        return versions;
+    }
+
+    std::vector<std::unique_lock<std::mutex>> PointPayloadStore::lockKeys(const std::vector<const PointIdType*>& ids) {
+        std::vector<size_t> stripes;
+        stripes.reserve(ids.size());
+        for (const auto* id : ids) {
+            stripes.push_back(std::hash<PointIdType>{}(*id) % KEY_LOCK_STRIPES);
+        }
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(stripes.size());
+        for (size_t stripe : stripes) {
+            locks.emplace_back(m_key_locks[stripe]);
+        }
+        return locks;
+    }
+
+    //A synced write would hold the stripes for a whole fsync, and with a batch of more than a few
+    //dozen ids that is every stripe: each other put and delete would queue behind it. So the batch
+    //goes in unsynced while the stripes are held (the next writer of an id reads this version), and
+    //the WAL sync runs after they are let go. The sync covers every write before it, also the ones
+    //of other requests this one compared against and skipped for, so nothing returns before what it
+    //relied on is durable. Readers may see a payload before its sync, like they see the vectors
+    //before the segment WAL's.
+    Status PointPayloadStore::writeBatch(rocksdb::WriteBatch& batch, std::vector<std::unique_lock<std::mutex>>& locks,
+                                         const std::string& what) {
+        rocksdb::WriteOptions options = writeOptions();
+        const bool sync = options.sync;
+        options.sync = false;
+        rocksdb::Status status = batch.Count() > 0 ? m_rkdb->Write(options, &batch) : rocksdb::Status();
+        locks.clear();
+        if (status.ok() && sync) {
+            status = m_rkdb->SyncWAL();
+        }
         if (!status.ok()) {
-            return Status::Error("Put failed: " + status.ToString());
+            return Status::Error(what + " failed: " + status.ToString());
         }
         return Status::OK();
     }
 
-    StatusOr<Payload> PointPayloadStore::getPayload(const PointIdType& id) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        
+    Status PointPayloadStore::putPayload(const PointIdType& id, const Payload& data, uint64_t version) {
+        return putPayloads({PayloadWrite{id, &data, version}});
+    }
+
+    //no lock here, rocksdb::DB::Get is thread safe and filtered searches call this from many query threads at once
+    StatusOr<Payload> PointPayloadStore::getPayload(const PointIdType& id) const {
         std::string value;
         rocksdb::Status status = m_rkdb->Get(rocksdb::ReadOptions(), id, &value);
         
@@ -60,20 +171,72 @@ namespace vectordb {
         }
 
         try {
+            if (!value.empty() && value[0] == VALUE_TAG) {
+                return Payload::parse(value.begin() + VALUE_HEADER_SIZE, value.end());
+            }
             return Payload::parse(value);
         } catch (const Payload::exception& e) {
             return Status::Error("Payload parse error: " + std::string(e.what()));
         }
     }
 
-    Status PointPayloadStore::deletePayload(const PointIdType& id) {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    Status PointPayloadStore::deletePayload(const PointIdType& id, uint64_t version) {
+        return deletePayloads({{id, version}});
+    }
 
-        rocksdb::Status status = m_rkdb->Delete(rocksdb::WriteOptions(), id);
-        if (!status.ok()) {
-            return Status::Error("Delete failed: " + status.ToString());
+    Status PointPayloadStore::putPayloads(const std::vector<PayloadWrite>& items) {
+        if (items.empty()) return Status::OK();
+
+        //an id twice in one request: the later entry has the higher version
+        std::unordered_map<PointIdType, const PayloadWrite*> latest;
+        for (const auto& item : items) {
+            auto [it, inserted] = latest.try_emplace(item.id, &item);
+            if (!inserted && it->second->version < item.version) it->second = &item;
         }
-        return Status::OK();
+        std::vector<const PointIdType*> ids;
+        std::vector<const PayloadWrite*> writes;
+        ids.reserve(latest.size());
+        writes.reserve(latest.size());
+        for (const auto& [id, item] : latest) {
+            ids.push_back(&id);
+            writes.push_back(item);
+        }
+
+        auto locks = lockKeys(ids);
+        auto stored = readVersions(ids);
+        if (!stored.ok()) return stored.status();
+
+        rocksdb::WriteBatch batch;
+        for (size_t i = 0; i < writes.size(); ++i) {
+            const auto& current = stored.value()[i];
+            if (current && !(*current < StoredVersion{m_epoch, writes[i]->version})) {
+                continue; //a newer write of this id got here first
+            }
+            batch.Put(*ids[i], encodeValue(*writes[i]->payload, writes[i]->version));
+        }
+        return writeBatch(batch, locks, "Batch put");
+    }
+
+    Status PointPayloadStore::deletePayloads(const std::vector<std::pair<PointIdType, uint64_t>>& ids) {
+        if (ids.empty()) return Status::OK();
+
+        std::vector<const PointIdType*> keys;
+        keys.reserve(ids.size());
+        for (const auto& [id, _] : ids) keys.push_back(&id);
+        auto locks = lockKeys(keys);
+        auto stored = readVersions(keys);
+        if (!stored.ok()) return stored.status();
+
+        rocksdb::WriteBatch batch;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const auto& current = stored.value()[i];
+            if (!current) continue;
+            if (StoredVersion{m_epoch, ids[i].second} < *current) {
+                continue; //written by an upsert newer than the copy this delete removed, it stays
+            }
+            batch.Delete(ids[i].first);
+        }
+        return writeBatch(batch, locks, "Batch delete");
     }
 
 }
\ No newline at end of file
@@ -2,42 +2,93 @@
 
 #include "DataTypes.h"
 #include "Status.h"
+#include "CollectionInfo.h"
 #include <rocksdb/db.h>
 // #include <rocksdb/options.h>
 
+#include <array>
+#include <mutex>
+
 /*
-Perhaps each Point has a version, so perhaps different payload versions. 
-Well this is too much work, so I might update the code for handling this
-if i ever have time.
+Each payload carries the version of the write that stored it (see PayloadWrite below), only the
+latest one is kept.
 
 Note:
 I am trying to make Payload per Point storage not per named vector here, so yeah.
 */
 
 namespace vectordb {
+    //one payload of an upsert, with the version the segments give the vectors of the same write
+    struct PayloadWrite {
+        PointIdType id;
+        const Payload* payload;
+        uint64_t version;
+    };
+
+    //Every payload is stored with the version of its write, so racing writes of one id end up the
+    //way the segments resolve them: the higher version wins, no matter which lands first. Versions
+    //come from the segment holder's counter, which restarts with the process, so they are compared
+    //within an epoch (bumped on every open); anything from an earlier run is older.
     class PointPayloadStore {
     public:
         // prevents copy-initialization such as PointPayloadStore payload = {} No No here
-        explicit PointPayloadStore(const std::filesystem::path& db_path, size_t cache_size_mb);
+        explicit PointPayloadStore(const std::filesystem::path& db_path, size_t cache_size_mb,
+                                   const PayloadStoreSpec& write_spec = {});
         ~PointPayloadStore();
 
         // Disable copying
         PointPayloadStore(const PointPayloadStore&) = delete;
         PointPayloadStore& operator=(const PointPayloadStore&) = delete;
 
-        Status putPayload(const PointIdType& id, const Payload& data);
-        StatusOr<Payload> getPayload(const PointIdType& id);
-        Status deletePayload(const std::string& id);
+        Status putPayload(const PointIdType& id, const Payload& data, uint64_t version);
+        StatusOr<Payload> getPayload(const PointIdType& id) const;
+        Status deletePayload(const PointIdType& id, uint64_t version);
+
+        //Whole request in one rocksdb::WriteBatch, so one write (and at most one WAL sync) no matter
+        //how many points. Atomic: either every payload lands or none does. A payload is skipped if
+        //the id already has one from a newer write.
+        Status putPayloads(const std::vector<PayloadWrite>& items);
+        //(id, version of the copy the delete removed, 0 if none): drops the payload unless a newer
+        //write of the id already stored one (an upsert that won against the delete)
+        Status deletePayloads(const std::vector<std::pair<PointIdType, uint64_t>>& ids);
 
         // Filter points by metadata field (simple equality)
         //could also be tricky, might need helper member functions for this one
         std::vector<Payload> filterWithPayload(const std::string& metadata_field, const Payload& condition); //?
 
     private:
+        rocksdb::WriteOptions writeOptions() const; //sync / disableWAL from the collection's PayloadStoreSpec
+
+        //stored value: VALUE_TAG, epoch (u64), version (u64), then the payload JSON. Values written
+        //before versions existed are plain JSON and count as epoch 0.
+        struct StoredVersion {
+            uint64_t epoch{0};
+            uint64_t version{0};
+            bool operator<(const StoredVersion& other) const {
+                return epoch != other.epoch ? epoch < other.epoch : version < other.version;
+            }
+        };
+        static constexpr char VALUE_TAG = '\x01';
+        static constexpr size_t VALUE_HEADER_SIZE = 1 + 2 * sizeof(uint64_t);
+        std::string encodeValue(const Payload& data, uint64_t version) const;
+        static StoredVersion storedVersion(const std::string& value);
+        //versions of what is stored for the ids now (one MultiGet), nullopt where nothing is
+        StatusOr<std::vector<std::optional<StoredVersion>>> readVersions(const std::vector<const PointIdType*>& ids) const;
+
+        //the read-compare-write of a put or delete holds the stripe of its id, so two writers of one
+        //id can't both read the old version. Locked in index order, a batch takes several.
+        static constexpr size_t KEY_LOCK_STRIPES = 64;
+        std::vector<std::unique_lock<std::mutex>> lockKeys(const std::vector<const PointIdType*>& ids);
+        //write the batch while the stripes are held, sync (payload_store.sync) after letting them go
+        Status writeBatch(rocksdb::WriteBatch& batch, std::vector<std::unique_lock<std::mutex>>& locks,
+                          const std::string& what);
+
         // Payload vec_metadata_;
         rocksdb::DB* m_rkdb;
         std::filesystem::path m_rkdb_path;
-        mutable std::mutex m_mutex;
+        PayloadStoreSpec m_write_spec;
+        uint64_t m_epoch{1}; //this run's, see the class comment
+        std::array<std::mutex, KEY_LOCK_STRIPES> m_key_locks;
     };
 
 }
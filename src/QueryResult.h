@@ -10,6 +10,15 @@ namespace vectordb {
 struct ScoredId {
     PointIdType id;
     float score;
+    uint64_t version{0}; //write version of the stored copy, merging keeps the newest per id
+};
+
+//Per request search knobs, 0/false = use what the segment was built with.
+//These go into per-call FAISS SearchParameters, the shared index is never touched.
+struct SearchParams {
+    size_t ef_search{0}; //HNSW: candidate list size, always raised to at least k
+    size_t nprobe{0};    //IVF: inverted lists to visit
+    bool exact{false};   //brute force every segment (no HNSW/IVF approximation, no MetaIndex routing)
 };
 
 struct QueryBatchResult {
@@ -20,6 +29,8 @@ struct QueryResult {
     std::vector<QueryBatchResult> results;  // multiple queries
     Status status;
     double time_seconds = 0.0;
+    size_t segments_searched = 0;
+    size_t segments_skipped = 0; //immutable segments pruned by MetaIndex routing
 };
 
 } // namespace vectordb
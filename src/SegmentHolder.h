@@ -3,8 +3,16 @@
 #include "DataTypes.h"
 #include "ActiveSegment.h"
 #include "ImmutableSegment.h"
+#include "TaskExecutor.h"
+#include "MetaIndex.h"
 
+#include <fstream>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <unordered_map>
 /**
  * @brief 
  * Low-level container: stores and manages access to segments
@@ -15,6 +23,32 @@
  * 
  * It will hold 1 ActiveSegment and multiple ImmutableSgment(s) per Collection obj.     
  * 
+ * Double buffering: when the active segment reaches the index threshold it gets sealed and a fresh
+ * active segment, built ahead on the IO lane (arenas and WAL file), is swapped in right away, so the
+ * upsert that crossed the threshold returns immediately. The sealed segment is turned into an ImmutableSegment on the executor's Index lane and stays
+ * searchable by brute force until that immutableSegment is published.
+ * 
+ *   insert -> [active] --seal--> [sealed...] --build on pool--> [immutable...] --compact--> [fewer, bigger]
+ *                                 (brute force)                  (HNSW)
+ *
+ * Compaction: every build adds one small immutable segment, and a search visits all of them, so
+ * left alone search cost grows linearly with the data. A background compactor (Index lane, one at
+ * a time) merges segments of the same size tier and rewrites tombstone-heavy ones, then swaps the
+ * result in under the same lock a publish uses. See pickCompaction() for the policy.
+ *
+ * Readers never take a holder lock: the lists and the MetaIndex live in an immutable SegmentSet
+ * behind a shared_ptr. A search atomic_loads the current set and keeps it for the whole query.
+ * Writers (seal, publish, compaction) serialize on m_write_mutex, copy the set,
+ * change the copy and atomic_store it, so a publish never makes a query wait and vice versa.
+ * (The active segment still guards its own rows with its own mutex.)
+ *
+ * on_disk: every immutable segment gets written to ./vectordb/<collection>/segments/<id>/ on the IO
+ * lane, and manifest.json lists the ones that are complete. A segment only goes in the manifest
+ * after all its files are written, and a compaction's inputs only leave it once the merged segment
+ * is in, so a crash at any point leaves a manifest that covers every point. loadSegments() reopens
+ * exactly those at startup, the WAL replay then only has to cover what never made it there.
+ * With storage.mmap, written segments are served from their mapped files (page cache) except for
+ * the smallest ones that fit in storage.memory_budget_mb, see enforceMemoryBudget().
  */
 namespace vectordb {
 
@@ -22,94 +56,271 @@ class SegmentHolder {
 public:
     SegmentHolder(size_t max_active_capacity, const CollectionInfo& info)
         : m_collection_info{info},
-          m_active_segment{max_active_capacity, info} {/*constructor body*/}
+          m_max_active_capacity{max_active_capacity}
+    {
+        SegmentSet initial;
+        initial.active = std::make_shared<ActiveSegment>(max_active_capacity, info);
+        initial.meta_index = std::make_shared<const MetaIndex>();
+        publishSegmentSet(std::move(initial));
+    }
     
-    ~SegmentHolder() = default;
+    //the background tasks capture `this`, so let them finish first
+    ~SegmentHolder() {
+        waitForBackgroundWork();
+    }
 
-    Status insertPoint(PointIdType point_id, const DenseVector& vector) {
-        auto status = m_active_segment.insertPoint(point_id, vector);
-        if (status.ok) {
-            // Try to convert if needed
-            auto convert_status = convertActiveToImmutable();
-            if (!convert_status.ok) {
-                return convert_status;
-            }
-        }
-        return status;
+    //Upserts are safe to call from many threads at once, see upsertPoint()
+    //With a wal_batch the WAL position goes in there and the caller waits for the whole request once
+    //(WalBatch::wait()), without one this returns only after the point is durable.
+    //`version`: from reserveVersion(), when something else (the payload store) was written with it
+    //first; 0 takes a fresh one.
+    Status insertPoint(PointIdType point_id, const DenseVector& vector, const Payload& payload = {},
+                       WalBatch* wal_batch = nullptr, uint64_t version = 0) {
+        return upsertPoint(point_id, {{"default", &vector}}, payload, wal_batch, version);
     }
     
     Status insertPoint(PointIdType point_id, 
-                      const std::map<VectorName, DenseVector>& named_vectors) {
-        auto status = m_active_segment.insertPoint(point_id, named_vectors);
-        if (status.ok) {
-            auto convert_status = convertActiveToImmutable();
-            if (!convert_status.ok) {
-                return convert_status;
+                      const std::map<VectorName, DenseVector>& named_vectors,
+                      const Payload& payload = {},
+                      WalBatch* wal_batch = nullptr,
+                      uint64_t version = 0) {
+        ActiveSegment::VectorRefs vectors;
+        vectors.reserve(named_vectors.size());
+        for (const auto& [name, vec] : named_vectors) {
+            vectors.emplace_back(name, &vec);
+        }
+        return upsertPoint(point_id, vectors, payload, wal_batch, version);
+    }
+
+    //write version for an upsert that is about to happen, see insertPoint()
+    uint64_t reserveVersion() {
+        return ++m_next_version;
+    }
+
+    //Tombstone these points wherever their current copy lives (active, sealed or immutable).
+    //Returns how many were removed, unknown ids are skipped. Immutable segments on disk get their
+    //deleted.bin rewritten on the IO lane. The deletes are logged to the active segment's WAL first
+    //and the call returns once they are durable (one wait for the whole list).
+    //`removed_versions` gets (id, version of the removed copy) for every id that had one.
+    StatusOr<size_t> deletePoints(const std::vector<PointIdType>& point_ids,
+                                  std::vector<std::pair<PointIdType, uint64_t>>* removed_versions = nullptr) {
+        std::shared_ptr<WAL> wal;
+        uint64_t lsn = 0;
+        size_t removed = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            //the active segment under the lock is never sealed, so its WAL is open
+            wal = snapshot()->active->getWal();
+            if (wal) {
+                for (const auto& point_id : point_ids) {
+                    if (!m_point_locations.count(point_id)) continue;
+                    auto logged = wal->logDelete(point_id, ++m_next_version);
+                    if (!logged.ok()) return logged.status();
+                    lsn = logged.value();
+                }
             }
+
+            const SegmentIdType logged_in = snapshot()->active->getSegmentId();
+            std::unordered_map<SegmentIdType, std::vector<size_t>> by_segment;
+            for (const auto& point_id : point_ids) {
+                auto it = m_point_locations.find(point_id);
+                if (it == m_point_locations.end()) continue;
+                by_segment[it->second.segment_id].push_back(it->second.slot);
+                if (removed_versions) removed_versions->emplace_back(point_id, it->second.version);
+                m_point_locations.erase(it);
+            }
+
+            for (const auto& [segment_id, slots] : by_segment) {
+                removed += tombstoneSlots(segment_id, slots, /*persist*/true, logged_in);
+            }
+            scheduleCompaction(); //a segment may have crossed compaction_deleted_pct
         }
-        return status;
+
+        if (wal) {
+            auto status = wal->waitDurable(lsn);
+            if (!status.ok) return status;
+        }
+        return removed;
     }
 
-    Status convertActiveToImmutable() {
-        size_t pending_writes = getPendingWriteCount();
-        if (pending_writes != 0) {
-            cleanupCompletedWrites();
+    //Startup, before the WAL replay: reopen the segments the manifest lists (on_disk collections
+    //only), in parallel, and register their live points. A point can have a copy in two segments
+    //when its tombstone in the older one was never written, the higher version wins like on upsert.
+    //Directories that aren't in the manifest are leftovers of a crash mid-write and get removed, but
+    //only when there is a manifest to go by. Returns how many live points were loaded; on an error
+    //the caller must not serve the collection (DB::recoverCollections() takes it out).
+    StatusOr<size_t> loadSegments() {
+        namespace fs = std::filesystem;
+        if (!m_collection_info.on_disk) {
+            return size_t{0};
         }
 
-        if (!m_active_segment.shouldIndex() && !m_active_segment.isFull()) {
-            return Status::OK();
+        std::vector<SegmentIdType> segment_ids;
+        bool have_manifest = false;
+        const fs::path manifest_path = collectionDir() / "manifest.json";
+        std::error_code ec;
+        if (fs::exists(manifest_path, ec)) {
+            std::ifstream in(manifest_path);
+            json manifest = json::parse(in, nullptr, /*allow_exceptions*/false);
+            if (manifest.is_discarded() || !manifest.contains("segments") || !manifest["segments"].is_array()) {
+                return Status::Error("Corrupt segment manifest " + manifest_path.string());
+            }
+            for (const auto& id : manifest["segments"]) {
+                if (!id.is_string()) {
+                    return Status::Error("Corrupt segment manifest " + manifest_path.string());
+                }
+                segment_ids.push_back(id.get<std::string>());
+            }
+            have_manifest = true;
+        }
+        {
+            //before anything can fail: whatever happens below, a later markPersisted() keeps these listed
+            std::lock_guard<std::mutex> manifest_lock(m_manifest_mutex);
+            m_persisted_segments.insert(segment_ids.begin(), segment_ids.end());
         }
 
-        auto immutable_segment = m_active_segment.convertToImmutable();
-        if (!immutable_segment.ok()) {
-            return immutable_segment.status();
+        //no manifest: the first segment never got listed, so unlisted directories can only be
+        //unfinished writes... unless the manifest itself went missing. Don't guess, keep them.
+        const fs::path segments_dir = collectionDir() / "segments";
+        if (have_manifest && fs::is_directory(segments_dir, ec)) {
+            const std::set<SegmentIdType> listed(segment_ids.begin(), segment_ids.end());
+            for (const auto& dir : fs::directory_iterator(segments_dir, ec)) {
+                if (listed.count(dir.path().filename().string())) continue;
+                std::cout << "[LOAD] removing unfinished segment " << dir.path().filename() << "\n";
+                fs::remove_all(dir.path(), ec);
+            }
         }
 
-        // Store in memory
-        m_immutable_segments.push_back(std::move(immutable_segment.value()));
-        auto& segment = m_immutable_segments.back();
-        
-        std::cout << "[CONVERT] Created segment: " << segment->getSegmentId() << "\n";
+        //smallest segments in memory while the budget lasts, everything else mapped
+        std::vector<bool> mapped(segment_ids.size(), m_collection_info.storage.mmap);
+        if (m_collection_info.storage.mmap) {
+            std::vector<std::pair<size_t, size_t>> by_size; //index bytes, position
+            for (size_t i = 0; i < segment_ids.size(); ++i) {
+                size_t bytes = 0;
+                for (const auto& file : fs::directory_iterator(segments_dir / segment_ids[i], ec)) {
+                    if (file.path().extension() == ".index") bytes += fs::file_size(file.path(), ec);
+                }
+                by_size.emplace_back(bytes, i);
+            }
+            std::sort(by_size.begin(), by_size.end());
+            size_t resident = 0;
+            for (const auto& [bytes, i] : by_size) {
+                if (resident + bytes > memoryBudget()) break;
+                resident += bytes;
+                mapped[i] = false;
+            }
+        }
 
-        if (m_collection_info.on_disk) {
-            //launch write in background
-            auto write_future = std::async(std::launch::async, [&segment]() {
-                segment->writeIndex();//may need a threadpool in the future if frequent writes are applied
-            });
-            
-            //store future to prevent immediate destruction
-            m_pending_writes.push_back(std::move(write_future));
+        //one segment per task, the query lane is idle this early
+        std::vector<StatusOr<std::shared_ptr<ImmutableSegment>>> loaded(segment_ids.size(), Status::Error("not loaded"));
+        parallelFor(segment_ids.size(), [&](size_t i) {
+            loaded[i] = ImmutableSegment::load(m_collection_info, segment_ids[i], mapped[i]);
+        });
+
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        SegmentSet next = *snapshot();
+        auto meta_index = std::make_shared<MetaIndex>(*next.meta_index);
+        uint64_t max_version = 0;
+        for (size_t i = 0; i < loaded.size(); ++i) {
+            if (!loaded[i].ok()) {
+                return Status::Error("Failed to load segment " + segment_ids[i] + ": " + loaded[i].status().message);
+            }
+            const auto& segment = loaded[i].value();
+            next.immutable.push_back(segment);
+            meta_index->insertToMetaIndex(segment->getSegmentId(), segment->getCentroids());
         }
+        next.meta_index = std::move(meta_index);
+        publishSegmentSet(std::move(next));
 
-        return Status::OK();
+        for (const auto& result : loaded) {
+            const auto& segment = result.value();
+            const auto& point_ids = segment->getPointIds();
+            for (size_t slot = 0; slot < point_ids.size(); ++slot) {
+                if (segment->isDeleted(slot)) continue;
+                const uint64_t version = segment->getVersion(slot);
+                max_version = std::max(max_version, version);
+                registerLocked(point_ids[slot], PointLocation{segment->getSegmentId(), slot, version});
+            }
+        }
+        advanceVersion(max_version);
+        scheduleCompaction();
+        return m_point_locations.size();
     }
 
-    void cleanupCompletedWrites() {
-        for (auto it = m_pending_writes.begin(); it != m_pending_writes.end(); ) {
-            // Check if future is ready (non-blocking check)
-            if (it->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-                it = m_pending_writes.erase(it);  // Remove completed write
-            } else {
-                ++it;
-            }
+    //version of the point's live copy, none if it has none
+    std::optional<uint64_t> getPointVersion(const PointIdType& point_id) const {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        auto it = m_point_locations.find(point_id);
+        if (it == m_point_locations.end()) return std::nullopt;
+        return it->second.version;
+    }
+
+    //WAL of the current active segment, null without one
+    std::shared_ptr<WAL> getActiveWal() const {
+        return snapshot()->active->getWal();
+    }
+
+    //Recovery: the next write gets a version above everything already in the WAL files, so entries of
+    //this run always sort after the ones of an earlier run (if those files are still around)
+    void advanceVersion(uint64_t version) {
+        uint64_t current = m_next_version.load();
+        while (current < version && !m_next_version.compare_exchange_weak(current, version)) {}
+    }
+
+    //points with a live copy, every id counted once
+    size_t getLivePointCount() const {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        return m_point_locations.size();
+    }
+
+    //caller holds m_write_mutex. This only seals and swaps, the build runs on the Index lane.
+    Status convertActiveToImmutable() {
+        auto current = snapshot();
+        if (!current->active->shouldIndex() && !current->active->isFull()) {
+            return Status::OK();
+        }
+
+        auto sealed = current->active;
+        sealed->seal();
+        SegmentSet next = *current;
+        next.sealed.push_back(sealed);
+        //the spare already has its arenas and its zero-filled WAL file, building one here would hold
+        //every upsert up for that long. None ready yet (seals in quick succession): build it inline.
+        if (m_spare_active) {
+            next.active = std::move(m_spare_active);
+        } else {
+            next.active = std::make_shared<ActiveSegment>(m_max_active_capacity, m_collection_info);
         }
+        publishSegmentSet(std::move(next));
+        prepareSpareActive();
+
+        std::cout << "[CONVERT] Sealed segment: " << sealed->getSegmentId() << ", building in background\n";
+
+        submitBackground(TaskLane::Index, [this, sealed]() { buildSealedSegment(sealed); });
+        return Status::OK();
     }
 
-    size_t getPendingWriteCount() const {
-        return m_pending_writes.size();
+    //block until every sealed segment has been indexed and every index write has finished
+    void waitForBackgroundWork() {
+        std::unique_lock<std::mutex> lock(m_background_mutex);
+        m_background_cv.wait(lock, [this] { return m_background_tasks == 0; });
     }
 
-    const ActiveSegment& getActiveSegment() const { 
-        return m_active_segment; 
+    size_t getSealedSegmentCount() const {
+        return snapshot()->sealed.size();
     }
 
-    const std::vector<std::unique_ptr<ImmutableSegment>>& getImmutableSegments() const {
-        return m_immutable_segments;
+    size_t getImmutableSegmentCount() const {
+        return snapshot()->immutable.size();
     }
 
     size_t getTotalPointCount() const {
-        size_t count = m_active_segment.getPointCount();
-        for (const auto& seg : m_immutable_segments) {
+        auto set = snapshot();
+        size_t count = set->active->getPointCount();
+        for (const auto& seg : set->sealed) {
+            count += seg->getPointCount();
+        }
+        for (const auto& seg : set->immutable) {
             count += seg->getPointCount();
         }
         return count;
@@ -118,54 +329,82 @@ public:
     QueryResult searchTopK(
         const std::string& vector_name,
         const std::vector<DenseVector>& query_vectors,
-        size_t k) const 
+        size_t k,
+        const SearchParams& params = {},
+        const SegmentFilter& filter = {}) const 
     {
+        //grab the current segment set, no lock: a publish or compaction in the middle of the search
+        //swaps in a new set and leaves this one alone (the shared_ptr keeps its segments alive)
+        auto set = snapshot();
+        std::vector<std::shared_ptr<const ActiveSegment>> brute_force_segments;
+        std::vector<std::shared_ptr<const ImmutableSegment>> immutable_segments;
+        brute_force_segments.push_back(set->active);
+        brute_force_segments.insert(brute_force_segments.end(), set->sealed.begin(), set->sealed.end());
+        immutable_segments.assign(set->immutable.begin(), set->immutable.end());
+        bool routed = false;
+        auto plan = planImmutableSearch(vector_name, query_vectors, immutable_segments, *set->meta_index, params, routed);
+
         // Collect all results
         std::vector<QueryResult> all_results;
 
-        // Search active segment first
-        all_results.push_back(
-            m_active_segment.searchTopK(vector_name, query_vectors, k)
-        );
-        std::cout << "[DEBUG] immutable_segments.size=" << m_immutable_segments.size() << "\n";
-        // Multi-threaded search for immutable segments
-        const size_t num_threads = std::max(1u, std::thread::hardware_concurrency() /2 );
-        std::cout << "[heheh] Number of threads: " << num_threads << std::endl;
-        std::atomic<size_t> next_index{0};
-        std::vector<std::future<std::vector<QueryResult>>> futures;
-
-        // Worker: searches one or more immutable segments
-        auto worker = [&]() -> std::vector<QueryResult> {
-            std::vector<QueryResult> local_results;
-            size_t idx;
-            while ((idx = next_index.fetch_add(1)) < m_immutable_segments.size()) {
-                auto& seg = *m_immutable_segments[idx];
-                local_results.push_back(
-                    seg.searchTopK(vector_name, query_vectors, k)
-                );
-            }
-            return local_results;
-        };
-
-        // Launch workers
-        for (size_t i = 0; i < num_threads; ++i)
-            futures.push_back(std::async(std::launch::async, worker));
+        // Search active segment first, then anything sealed but not indexed yet
+        for (const auto& seg : brute_force_segments) {
+            all_results.push_back(
+                seg->searchTopK(vector_name, query_vectors, k, filter)
+            );
+        }
+        std::cout << "[DEBUG] immutable_segments.size=" << immutable_segments.size() << "\n";
 
-        // Collect results
-        for (auto& f : futures) {
-            auto local = f.get();
-            for (auto& r : local)
-                all_results.push_back(std::move(r));
+        for (auto& r : searchImmutableSegments(immutable_segments, plan, vector_name, query_vectors, k, params, filter)) {
+            all_results.push_back(std::move(r));
         }
         std::cout <<"+++++ All results size " << all_results.size() << "\n"; 
         // Merge across all segments
         QueryResult merged = mergeBatchResults(all_results, k);
 
+        //exhaustive fallback: routing can cut a query off from segments it needed (few points near it,
+        //or a filter later on). Any query still short of k hits gets the segments it skipped.
+        if (routed) {
+            std::vector<std::vector<size_t>> extra(immutable_segments.size());
+            bool any_extra = false;
+            for (size_t qi = 0; qi < query_vectors.size(); ++qi) {
+                if (qi < merged.results.size() && merged.results[qi].hits.size() >= k) continue;
+                for (size_t si = 0; si < immutable_segments.size(); ++si) {
+                    if (!std::binary_search(plan[si].begin(), plan[si].end(), qi)) {
+                        extra[si].push_back(qi);
+                        any_extra = true;
+                    }
+                }
+            }
+
+            if (any_extra) {
+                std::cout << "[ROUTE] fallback to exhaustive search for short queries\n";
+                std::vector<QueryResult> second_round;
+                second_round.push_back(std::move(merged));
+                for (auto& r : searchImmutableSegments(immutable_segments, extra, vector_name, query_vectors, k, params, filter)) {
+                    second_round.push_back(std::move(r));
+                }
+                merged = mergeBatchResults(second_round, k);
+                for (size_t si = 0; si < plan.size(); ++si) {
+                    plan[si].insert(plan[si].end(), extra[si].begin(), extra[si].end());
+                }
+            }
+        }
+
+        size_t immutable_searched = 0;
+        for (const auto& queries : plan) {
+            if (!queries.empty()) ++immutable_searched;
+        }
+        merged.segments_searched = brute_force_segments.size() + immutable_searched;
+        merged.segments_skipped = immutable_segments.size() - immutable_searched;
+
         merged.status = Status::OK();
 
         return merged;
     }
 
+    //k best per query across segments. An id can come back from two segments when an upsert raced
+    //the search (the old copy got tombstoned after we looked), only its newest version is kept.
     QueryResult mergeBatchResults(
         const std::vector<QueryResult>& results,
         size_t k) const
@@ -173,7 +412,10 @@ public:
         QueryResult merged;
         if (results.empty()) return merged;
 
-        size_t num_queries = results.front().results.size();
+        size_t num_queries = 0;
+        for (const auto& r : results) {
+            num_queries = std::max(num_queries, r.results.size());
+        }
         merged.results.resize(num_queries);
 
         // For each query in the batch
@@ -184,16 +426,22 @@ public:
             };
             std::priority_queue<Item, std::vector<Item>, decltype(cmp)> max_heap(cmp);
 
-            // Gather all hits for this query index
+            // Gather all hits for this query index, newest version per id
+            std::unordered_map<PointIdType, ScoredId> newest;
             for (const auto& r : results) {
                 if (qi >= r.results.size()) continue;
                 for (const auto& hit : r.results[qi].hits) {
-                    if (max_heap.size() < k) {
-                        max_heap.push(hit);
-                    } else if (hit.score > max_heap.top().score) {
-                        max_heap.pop();
-                        max_heap.push(hit);
-                    }
+                    auto [it, inserted] = newest.try_emplace(hit.id, hit);
+                    if (!inserted && hit.version > it->second.version) it->second = hit;
+                }
+            }
+
+            for (const auto& [_, hit] : newest) {
+                if (max_heap.size() < k) {
+                    max_heap.push(hit);
+                } else if (hit.score > max_heap.top().score) {
+                    max_heap.pop();
+                    max_heap.push(hit);
                 }
             }
 
@@ -213,13 +461,780 @@ public:
 
 
 private:
-    const CollectionInfo& m_collection_info;
+    //where the current copy of a point id lives
+    struct PointLocation {
+        SegmentIdType segment_id;
+        size_t slot;
+        uint64_t version;
+    };
+
+    //One published version of the segment lists. Never modified once published: writers copy it,
+    //change the copy and publishSegmentSet() it. Copies are cheap, just shared_ptrs (and the
+    //MetaIndex is shared until a publish or compaction actually changes it).
+    struct SegmentSet {
+        std::shared_ptr<ActiveSegment> active;
+        std::vector<std::shared_ptr<ActiveSegment>> sealed;//sealed, waiting for their index
+        std::vector<std::shared_ptr<ImmutableSegment>> immutable;
+        std::shared_ptr<const MetaIndex> meta_index;//centroids of the immutable segments, for routing queries
+    };
+
+    std::shared_ptr<const SegmentSet> snapshot() const {
+        return std::atomic_load(&m_segment_set);
+    }
+
+    //caller holds m_write_mutex (or is the constructor)
+    void publishSegmentSet(SegmentSet next) {
+        std::atomic_store(&m_segment_set, std::shared_ptr<const SegmentSet>(std::make_shared<SegmentSet>(std::move(next))));
+    }
+
+    //Write into the active segment with a fresh version, then tombstone the copy this id had before
+    //(wherever it lives) and remember the new location, so an id is only ever live once and
+    //re-embedding doesn't grow the indexes.
+    //Concurrent writers: validation and the row copy run with no lock at all (the slot comes from the
+    //active segment's atomic cursor). m_write_mutex is only held for the location map update and the
+    //seal check. The slot is committed (made visible) after that, so a sealed segment's build, which
+    //waits for every slot to commit, never starts before its points are registered here.
+    //The insert is logged to the segment's WAL between the row copy and the commit, for the same
+    //reason: the build closes that WAL once every slot is in, so no entry can arrive after that.
+    Status upsertPoint(const PointIdType& point_id, const ActiveSegment::VectorRefs& vectors, const Payload& payload,
+                       WalBatch* wal_batch, uint64_t reserved_version) {
+        auto status = snapshot()->active->validatePoint(vectors);
+        if (!status.ok) {
+            return status;
+        }
+        const uint64_t version = reserved_version ? reserved_version : ++m_next_version;
+
+        while (true) {
+            std::shared_ptr<ActiveSegment> active = snapshot()->active;
+            auto slot = active->appendPoint(point_id, vectors, payload, version);
+            if (!slot) {
+                //full, or sealed by another writer in the meantime: make sure it is swapped out and go again
+                std::lock_guard<std::mutex> lock(m_write_mutex);
+                status = convertActiveToImmutable();
+                if (!status.ok) return status;
+                continue;
+            }
+
+            //only buffered here, the WAL's writer thread does the write() for many upserts at once
+            const std::shared_ptr<WAL>& wal = active->getWal();
+            uint64_t lsn = 0;
+            if (wal) {
+                auto logged = wal->logInsert(point_id, vectors, version);
+                if (!logged.ok()) {
+                    //never acknowledged, so it must not show up either
+                    active->deleteSlots({*slot});
+                    active->commitSlot(*slot);
+                    return logged.status();
+                }
+                lsn = logged.value();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_write_mutex);
+                registerLocked(point_id, PointLocation{active->getSegmentId(), *slot, version});
+                prepareSpareActive(); //first upsert: have the next active segment ready for the seal
+                // Try to convert if needed
+                status = convertActiveToImmutable();
+            }
+            active->commitSlot(*slot);
+            if (!status.ok || !wal) return status;
+
+            if (wal_batch) {
+                wal_batch->add(wal, lsn);
+                return Status::OK();
+            }
+            return wal->waitDurable(lsn);
+        }
+    }
+
+    //caller holds m_write_mutex. Two upserts of one id can race, the newer version wins no matter
+    //which of them gets here first; the loser's copy is tombstoned right away.
+    void registerLocked(const PointIdType& point_id, const PointLocation& location) {
+        auto [it, inserted] = m_point_locations.try_emplace(point_id, location);
+        if (inserted) return;
+
+        //persisted: once the new copy's WAL is flushed nothing replays the delete of the old one,
+        //that WAL only gets its marker after the old copy's deleted.bin is on disk (flushReadyWals())
+        if (it->second.version > location.version) {
+            tombstoneSlots(location.segment_id, {location.slot}, /*persist*/true, location.segment_id);
+            return;
+        }
+        tombstoneSlots(it->second.segment_id, {it->second.slot}, /*persist*/true, location.segment_id);
+        it->second = location;
+    }
+
+    //caller holds m_write_mutex. Returns how many slots were newly tombstoned.
+    //`logged_in`: the segment whose WAL has the entry behind this (the delete, or the upsert that
+    //replaced the point). That WAL must outlive the tombstone until it is on disk, see flushReadyWals().
+    size_t tombstoneSlots(const SegmentIdType& segment_id, const std::vector<size_t>& slots, bool persist,
+                          const SegmentIdType& logged_in) {
+        auto set = snapshot();
+        size_t removed = 0;
+        if (set->active->getSegmentId() == segment_id) {
+            return set->active->deleteSlots(slots); //same WAL, replay sees both
+        }
+        for (const auto& seg : set->sealed) {
+            if (seg->getSegmentId() == segment_id) removed = seg->deleteSlots(slots);
+        }
+        for (const auto& seg : set->immutable) {
+            if (seg->getSegmentId() != segment_id) continue;
+            removed = seg->deleteSlots(slots);
+            if (removed > 0 && persist && m_collection_info.on_disk) {
+                scheduleTombstoneWrite(segment_id);
+            }
+        }
+
+        if (removed > 0 && persist && m_collection_info.on_disk && logged_in != segment_id) {
+            //only segments that still have a WAL (active or sealed), a loaded one's is long gone
+            bool has_wal = set->active->getSegmentId() == logged_in;
+            for (const auto& seg : set->sealed) {
+                if (seg->getSegmentId() == logged_in) has_wal = true;
+            }
+            if (has_wal) m_tombstoned_by[logged_in].insert(segment_id);
+        }
+        return removed;
+    }
+
+    //runs on the Index lane
+    void buildSealedSegment(std::shared_ptr<ActiveSegment> sealed) {
+        auto immutable_segment = sealed->convertToImmutable();
+        if (!immutable_segment.ok()) {
+            //keep the sealed segment around, it is still searchable by brute force so nothing is lost
+            std::cerr << "[CONVERT ERROR] " << sealed->getSegmentId() << ": "
+                      << immutable_segment.status().message << "\n";
+            return;
+        }
+
+        std::shared_ptr<ImmutableSegment> segment = std::move(immutable_segment.value());
+        {
+            //publish: the immutable segment replaces the sealed one in one step. Deletes that came in
+            //during the build only tombstoned the sealed segment, carry them over (by slot, same layout).
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            segment->deleteSlots(sealed->deletedSlots());
+            SegmentSet next = *snapshot();
+            next.immutable.push_back(segment);
+            auto meta_index = std::make_shared<MetaIndex>(*next.meta_index);
+            meta_index->insertToMetaIndex(segment->getSegmentId(), segment->getCentroids());
+            next.meta_index = std::move(meta_index);
+            next.sealed.erase(std::remove(next.sealed.begin(), next.sealed.end(), sealed), next.sealed.end());
+            publishSegmentSet(std::move(next));
+            scheduleCompaction();
+        }
+        std::cout << "[CONVERT] Created segment: " << segment->getSegmentId() << "\n";
+
+        if (m_collection_info.on_disk) {
+            //write in the background too, on the IO lane so a slow disk never holds up a build
+            //once it is on disk the segment's WAL entries are no longer needed, say so for the replay
+            std::shared_ptr<WAL> wal = sealed->getWal();
+            submitBackground(TaskLane::IO, [this, segment, wal]() {
+                try {
+                    segment->writeIndex();
+                } catch (const std::exception&) {
+                    //writeIndex() already logged it, the segment is still served from memory
+                    return;
+                }
+                auto tombstone_status = writeTombstonesFor(segment->getSegmentId());
+                if (!tombstone_status.ok) {
+                    std::cerr << "[WRITE ERROR] " << tombstone_status.message << "\n";
+                    return;
+                }
+                if (!markPersisted({segment->getSegmentId()}, {})) {
+                    return;
+                }
+                //the WAL gets its marker once the segments its entries tombstoned are on disk with
+                //those tombstones, this one's listing may be what another WAL was waiting for
+                queueWalFlush(segment->getSegmentId(), wal);
+                flushReadyWals();
+                {
+                    std::lock_guard<std::mutex> lock(m_write_mutex);
+                    scheduleCompaction(); //it can be merged now
+                }
+                enforceMemoryBudget();
+            });
+        }
+    }
+
+    //caller holds m_write_mutex. Build the next active segment on the IO lane unless there is one
+    //(or one on the way). Only from the first upsert on: a spare's WAL file must not exist yet when
+    //the WAL replay lists the files of earlier runs (Collection::recoverFromWal() would take it for one).
+    void prepareSpareActive() {
+        if (m_spare_active || m_spare_pending) return;
+        m_spare_pending = true;
+        submitBackground(TaskLane::IO, [this]() {
+            auto spare = std::make_shared<ActiveSegment>(m_max_active_capacity, m_collection_info);
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            m_spare_pending = false;
+            m_spare_active = std::move(spare);
+        });
+    }
+
+    //caller holds m_write_mutex. Kick off the compactor if it isn't running and
+    //the policy has something for it.
+    void scheduleCompaction() {
+        if (m_compaction_running || pickCompaction().empty()) return;
+        m_compaction_running = true;
+        submitBackground(TaskLane::Index, [this]() { runCompaction(); });
+    }
+
+    //Size-tiered policy, caller holds m_write_mutex. Segments are bucketed by live points, tier t
+    //holds [index_threshold * fanout^t, index_threshold * fanout^(t+1)). Once a tier has `fanout`
+    //segments they are merged into one segment of the next tier, so N points end up in about
+    //fanout * log_fanout(N / index_threshold) segments and a search that visits all of them grows
+    //with log N instead of N. Each point gets rewritten about once per tier.
+    //A segment with compaction_deleted_pct of its points tombstoned is rewritten on its own first,
+    //that gives the space back and gets the dead points out of the HNSW graph walk.
+    //on_disk: only segments already in the manifest are merged, so a merge never overtakes the
+    //write of one of its inputs (the manifest would lose or duplicate it)
+    std::vector<std::shared_ptr<ImmutableSegment>> pickCompaction() const {
+        const IndexSpec& spec = m_collection_info.index_specs;
+        if (spec.compaction_fanout < 2) return {};
+
+        std::map<size_t, std::vector<std::pair<size_t, std::shared_ptr<ImmutableSegment>>>> tiers;
+        for (const auto& seg : snapshot()->immutable) {
+            if (m_collection_info.on_disk && !isPersisted(seg->getSegmentId())) continue;
+            const size_t total = seg->getPointCount();
+            const size_t deleted = seg->getDeletedCount();
+            const size_t live = total - deleted;
+            if (spec.compaction_deleted_pct > 0 && deleted > 0 && deleted * 100 >= total * spec.compaction_deleted_pct) {
+                return {seg};
+            }
+            if (live >= spec.compaction_max_points) continue; //done growing, only tombstones rewrite it
+
+            size_t tier = 0;
+            for (size_t bound = spec.index_threshold * spec.compaction_fanout; live >= bound; bound *= spec.compaction_fanout) {
+                ++tier;
+            }
+            tiers[tier].emplace_back(live, seg);
+        }
+
+        for (auto& [_, segments] : tiers) {
+            if (segments.size() < spec.compaction_fanout) continue;
+
+            //smallest first, as many as fit under compaction_max_points
+            std::stable_sort(segments.begin(), segments.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            std::vector<std::shared_ptr<ImmutableSegment>> picked;
+            size_t points = 0;
+            for (const auto& [live, seg] : segments) {
+                if (picked.size() == spec.compaction_fanout) break;
+                if (!picked.empty() && points + live > spec.compaction_max_points) break;
+                picked.push_back(seg);
+                points += live;
+            }
+            if (picked.size() >= 2) return picked;
+        }
+        return {};
+    }
+
+    //runs on the Index lane, keeps merging until the policy is satisfied
+    void runCompaction() {
+        while (true) {
+            std::vector<std::shared_ptr<ImmutableSegment>> inputs;
+            {
+                std::lock_guard<std::mutex> lock(m_write_mutex);
+                inputs = pickCompaction();
+                if (inputs.empty()) {
+                    m_compaction_running = false;
+                    return;
+                }
+            }
+
+            auto status = compactSegments(inputs);
+            if (!status.ok) {
+                //the inputs stay as they are and keep serving, the next publish or delete retries
+                std::cerr << "[COMPACT ERROR] " << status.message << "\n";
+                std::lock_guard<std::mutex> lock(m_write_mutex);
+                m_compaction_running = false;
+                return;
+            }
+        }
+    }
+
+    //Merge the live points of `inputs` into one new ImmutableSegment. The copy-out and the index
+    //build run without m_write_mutex, searches and upserts carry on against the inputs meanwhile.
+    //The swap takes the lock once: deletes that hit the inputs during the build are carried over to
+    //the merged segment by slot, point locations move over, and one new segment set (list and
+    //MetaIndex) is published, so a search sees either the inputs or the merged segment, never both or neither.
+    Status compactSegments(const std::vector<std::shared_ptr<ImmutableSegment>>& inputs) {
+        //live counts only go down, so this is enough room for whatever the export finds
+        size_t capacity = 0;
+        for (const auto& seg : inputs) capacity += seg->getLivePointCount();
+
+        SegmentVectorData data;
+        for (const auto& [name, spec] : m_collection_info.vec_specs) {
+            data.arenas.emplace(name, VectorArena(spec.dim, std::max<size_t>(capacity, 1)));
+        }
+        std::vector<std::vector<size_t>> source_slots(inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            inputs[i]->exportLivePoints(data, source_slots[i]);
+        }
+
+        std::shared_ptr<ImmutableSegment> merged;
+        if (data.size() > 0) {
+            try {
+                merged = std::make_shared<ImmutableSegment>(data, m_collection_info, ActiveSegment::generateSegmentId());
+            } catch (const std::exception& e) {
+                return Status::Error(std::string("Merge build failed: ") + e.what());
+            }
+        }
+
+        std::vector<SegmentIdType> retired;
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            //an input may have been swapped for its mapped copy meanwhile (enforceMemoryBudget), the
+            //deletes since then are on that copy. Same id and slots, so look inputs up by id.
+            SegmentSet next = *snapshot();
+            std::vector<std::shared_ptr<ImmutableSegment>> current(inputs.begin(), inputs.end());
+            for (auto& seg : current) {
+                for (const auto& live : next.immutable) {
+                    if (live->getSegmentId() == seg->getSegmentId()) seg = live;
+                }
+            }
+
+            std::vector<size_t> replay;
+            size_t row = 0;
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                const SegmentIdType& source_id = inputs[i]->getSegmentId();
+                for (size_t slot : source_slots[i]) {
+                    if (current[i]->isDeleted(slot)) {
+                        replay.push_back(row);
+                    } else {
+                        //only move ids whose current copy is still the one we exported
+                        auto it = m_point_locations.find(data.point_ids[row]);
+                        if (it != m_point_locations.end() && it->second.segment_id == source_id && it->second.slot == slot) {
+                            it->second = PointLocation{merged->getSegmentId(), row, it->second.version};
+                        }
+                    }
+                    ++row;
+                }
+            }
+            if (merged) merged->deleteSlots(replay);
+
+            auto meta_index = std::make_shared<MetaIndex>(*next.meta_index);
+            for (const auto& seg : current) {
+                retired.push_back(seg->getSegmentId());
+                meta_index->removeFromMetaIndex(seg->getSegmentId());
+                next.immutable.erase(std::remove(next.immutable.begin(), next.immutable.end(), seg), next.immutable.end());
+            }
+            if (merged) {
+                next.immutable.push_back(merged);
+                meta_index->insertToMetaIndex(merged->getSegmentId(), merged->getCentroids());
+            }
+            next.meta_index = std::move(meta_index);
+            publishSegmentSet(std::move(next));
+        }
+        std::cout << "[COMPACT] Merged " << inputs.size() << " segments ("
+                  << data.size() << " live points) into "
+                  << (merged ? merged->getSegmentId() : std::string("nothing")) << "\n";
+
+        if (m_collection_info.on_disk) {
+            //the old directories only go once the merged segment is safely written
+            const std::string segments_dir = "./vectordb/" + m_collection_info.name + "/segments/";
+            submitBackground(TaskLane::IO, [this, merged, retired, segments_dir]() {
+                try {
+                    std::vector<SegmentIdType> added;
+                    if (merged) {
+                        merged->writeIndex();
+                        auto tombstone_status = writeTombstonesFor(merged->getSegmentId());
+                        if (!tombstone_status.ok) {
+                            std::cerr << "[WRITE ERROR] " << tombstone_status.message << "\n";
+                            return;
+                        }
+                        added.push_back(merged->getSegmentId());
+                    }
+                    if (!markPersisted(added, retired)) return; //keep the inputs' files, the manifest still lists them
+                    for (const auto& seg_id : retired) {
+                        std::filesystem::remove_all(segments_dir + seg_id);
+                    }
+                    flushReadyWals(); //deletes that hit the merged segment or its inputs are on disk now
+                    enforceMemoryBudget();
+                } catch (const std::exception&) {
+                    //writeIndex() already logged it, keep the old files and serve from memory
+                }
+            });
+        }
+        return Status::OK();
+    }
+
+    //caller holds m_write_mutex. At most one pending deleted.bin write per segment: a burst of deletes
+    //on one segment turns into one write, and that write reads the bitmap when it runs.
+    void scheduleTombstoneWrite(const SegmentIdType& segment_id) {
+        {
+            std::lock_guard<std::mutex> lock(m_tombstone_pending_mutex);
+            if (!m_tombstone_pending.insert(segment_id).second) return; //the queued write will pick this up
+        }
+        submitBackground(TaskLane::IO, [this, segment_id]() {
+            auto status = writeTombstonesFor(segment_id, /*queued*/true);
+            if (!status.ok) std::cerr << "[WRITE ERROR] " << status.message << "\n";
+        });
+    }
+
+    //IO lane. Writes deleted.bin of whichever copy of the segment is current (in memory or mapped,
+    //they share the file). One writer at a time, so an older bitmap can never land after a newer one.
+    //`queued`: a write from the queue, see writeTombstonesLocked().
+    Status writeTombstonesFor(const SegmentIdType& segment_id, bool queued = false) {
+        std::lock_guard<std::mutex> io_lock(m_tombstone_io_mutex);
+        return writeTombstonesLocked(segment_id, queued);
+    }
+
+    //IO lane. Writes every queued deleted.bin now. Taking m_tombstone_io_mutex also waits out a
+    //write that already left the queue, so on return everything tombstoned before the call is on disk.
+    Status flushTombstoneWrites() {
+        std::lock_guard<std::mutex> io_lock(m_tombstone_io_mutex);
+        std::set<SegmentIdType> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_tombstone_pending_mutex);
+            pending = m_tombstone_pending;
+        }
+        for (const auto& segment_id : pending) {
+            auto status = writeTombstonesLocked(segment_id, /*queued*/true);
+            if (!status.ok) return status;
+        }
+        return Status::OK();
+    }
+
+    //caller holds m_tombstone_io_mutex. A queued write leaves a segment that isn't in the manifest
+    //yet queued: its directory may not even exist, and its own write task writes the whole bitmap
+    //before listing it and flushes the queue right after (the deletes since then are still queued).
+    Status writeTombstonesLocked(const SegmentIdType& segment_id, bool queued) {
+        if (queued && !isPersisted(segment_id) && findImmutable(*snapshot(), segment_id)) {
+            return Status::OK();
+        }
+        {
+            //cleared before reading the bitmap: deletes from here on queue a new write
+            std::lock_guard<std::mutex> lock(m_tombstone_pending_mutex);
+            m_tombstone_pending.erase(segment_id);
+        }
+        auto seg = findImmutable(*snapshot(), segment_id);
+        if (!seg) {
+            return Status::OK(); //compacted away, its directory goes with it
+        }
+        auto status = seg->writeTombstones();
+        if (!status.ok && !findImmutable(*snapshot(), segment_id)) {
+            return Status::OK(); //compacted away while we wrote, the directory went first
+        }
+        return status;
+    }
+
+    static std::shared_ptr<ImmutableSegment> findImmutable(const SegmentSet& set, const SegmentIdType& segment_id) {
+        for (const auto& seg : set.immutable) {
+            if (seg->getSegmentId() == segment_id) return seg;
+        }
+        return nullptr;
+    }
+
+    //IO lane, once `segment_id` is listed in the manifest: its WAL waits in the queue for
+    //flushReadyWals(), together with the segments its entries tombstoned
+    void queueWalFlush(const SegmentIdType& segment_id, std::shared_ptr<WAL> wal) {
+        std::set<SegmentIdType> tombstoned;
+        {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            auto it = m_tombstoned_by.find(segment_id);
+            if (it != m_tombstoned_by.end()) {
+                tombstoned = std::move(it->second);
+                m_tombstoned_by.erase(it);
+            }
+        }
+        if (!wal) return; //durability none, nothing to mark
+        std::lock_guard<std::mutex> lock(m_wal_flush_mutex);
+        m_wal_flushes.push_back(WalFlush{std::move(wal), std::move(tombstoned)});
+    }
+
+    //IO lane. A WAL may only get its flush marker (and be removed) once every segment its deletes
+    //and upserts tombstoned is on disk with those tombstones. Until then the replay of that WAL is
+    //the only thing that would undo a point the older segment's WAL (or its files) still has: a
+    //delete that hit a sealed or not yet written segment, whose own WAL then outlives this one.
+    //A tombstoned segment is done when it is in the manifest (its queued deleted.bin gets written
+    //below), or when it was compacted away and the manifest no longer lists it (the merged segment
+    //that replaced it was written with the carried over tombstones).
+    void flushReadyWals() {
+        std::lock_guard<std::mutex> lock(m_wal_flush_mutex);
+        //decided before the tombstone flush: whatever is listed by now gets its queued write done below
+        auto set = snapshot();
+        auto inSet = [&set](const SegmentIdType& segment_id) {
+            if (findImmutable(*set, segment_id)) return true;
+            for (const auto& seg : set->sealed) {
+                if (seg->getSegmentId() == segment_id) return true;
+            }
+            return false;
+        };
+        std::vector<bool> ready(m_wal_flushes.size(), true);
+        for (size_t i = 0; i < m_wal_flushes.size(); ++i) {
+            for (const auto& segment_id : m_wal_flushes[i].tombstoned) {
+                if (inSet(segment_id) != isPersisted(segment_id)) ready[i] = false;
+            }
+        }
+
+        auto status = flushTombstoneWrites();
+        if (!status.ok) {
+            std::cerr << "[WRITE ERROR] " << status.message << ", keeping the WAL\n";
+            return;
+        }
+
+        std::vector<WalFlush> waiting;
+        for (size_t i = 0; i < m_wal_flushes.size(); ++i) {
+            if (!ready[i]) {
+                waiting.push_back(std::move(m_wal_flushes[i]));
+                continue;
+            }
+            status = m_wal_flushes[i].wal->logSegmentFlush();
+            if (status.ok) status = m_wal_flushes[i].wal->removeFiles();
+            if (!status.ok) std::cerr << "[WAL ERROR] " << status.message << "\n";
+        }
+        m_wal_flushes = std::move(waiting);
+    }
+
+    //./vectordb/<collection>
+    std::filesystem::path collectionDir() const {
+        return std::filesystem::path("./vectordb") / m_collection_info.name;
+    }
+
+    //IO lane, after the segments' files are written: add them to the manifest and drop `removed`.
+    //Returns false if the manifest couldn't be written.
+    bool markPersisted(const std::vector<SegmentIdType>& added, const std::vector<SegmentIdType>& removed) {
+        std::lock_guard<std::mutex> lock(m_manifest_mutex);
+        m_persisted_segments.insert(added.begin(), added.end());
+        for (const auto& seg_id : removed) {
+            m_persisted_segments.erase(seg_id);
+        }
+
+        //tmp file + rename, a crash leaves the old manifest or the new one. Synced with its directory
+        //before returning: the caller writes the WAL flush marker next.
+        json manifest;
+        manifest["segments"] = std::vector<SegmentIdType>(m_persisted_segments.begin(), m_persisted_segments.end());
+        auto status = replaceFileSynced(collectionDir() / "manifest.json", manifest.dump(4));
+        if (!status.ok) {
+            std::cerr << "[WRITE ERROR] " << status.message << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    size_t memoryBudget() const {
+        return m_collection_info.storage.memory_budget_mb << 20;
+    }
+
+    //IO lane, after a segment got written: while the written segments held in process memory add
+    //up to more than storage.memory_budget_mb, reopen the largest of them from their files with
+    //mmap and swap that copy in. Tombstones move over by slot under m_write_mutex, the point
+    //locations stay valid (same id, same slots). Searches that still hold the old copy finish on it.
+    void enforceMemoryBudget() {
+        if (!m_collection_info.on_disk || !m_collection_info.storage.mmap) return;
+        std::lock_guard<std::mutex> budget_lock(m_budget_mutex); //one pass at a time
+
+        auto set = snapshot(); //no lock held, keep the set alive while we walk it
+        std::vector<std::shared_ptr<ImmutableSegment>> candidates;
+        size_t resident_bytes = 0;
+        for (const auto& seg : set->immutable) {
+            resident_bytes += seg->getIndexBytes(); //mapped copies too, whatever faiss still read in
+            //a reload only helps if faiss leaves some of it in the file, otherwise it is a second heap copy
+            if (seg->isMapped() || !seg->canMap() || seg->getIndexBytes() == 0 ||
+                m_unmappable_segments.count(seg->getSegmentId()) || !isPersisted(seg->getSegmentId())) continue;
+            candidates.push_back(seg);
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const auto& a, const auto& b) { return a->getIndexBytes() > b->getIndexBytes(); });
+
+        for (const auto& seg : candidates) {
+            if (resident_bytes <= memoryBudget()) break;
+
+            auto loaded = ImmutableSegment::load(m_collection_info, seg->getSegmentId(), /*mapped*/true);
+            if (!loaded.ok()) {
+                std::cerr << "[LOAD ERROR] " << loaded.status().message << ", " << seg->getSegmentId()
+                          << " stays in memory\n";
+                continue;
+            }
+            const auto& mapped = loaded.value();
+            if (!mapped->isMapped()) {
+                //faiss read it all in after all, drop the copy and don't try again
+                m_unmappable_segments.insert(seg->getSegmentId());
+                std::cout << "[LOAD] " << seg->getSegmentId() << " can't be mapped, stays in memory\n";
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            SegmentSet next = *snapshot();
+            auto it = std::find(next.immutable.begin(), next.immutable.end(), seg);
+            if (it == next.immutable.end()) continue; //compacted away in the meantime
+            mapped->deleteSlots(seg->getDeletedSlots());
+            *it = mapped;
+            publishSegmentSet(std::move(next));
+            resident_bytes -= seg->getIndexBytes() - std::min(mapped->getIndexBytes(), seg->getIndexBytes());
+            std::cout << "[LOAD] " << seg->getSegmentId() << " now served from its mapped files\n";
+        }
+    }
+
+    bool isPersisted(const SegmentIdType& segment_id) const {
+        std::lock_guard<std::mutex> lock(m_manifest_mutex);
+        return m_persisted_segments.count(segment_id) > 0;
+    }
+
+    //plan[i] = sorted list of the queries that go to immutable segment i, routed with the MetaIndex of the same segment set.
+    //Without routing (nprobe_segments == 0, not fewer than the segment count, or an exact search)
+    //every query goes everywhere.
+    std::vector<std::vector<size_t>> planImmutableSearch(const VectorName& vector_name,
+                                                         const std::vector<DenseVector>& query_vectors,
+                                                         const std::vector<std::shared_ptr<const ImmutableSegment>>& segments,
+                                                         const MetaIndex& meta_index,
+                                                         const SearchParams& params,
+                                                         bool& routed) const
+    {
+        const size_t nq = query_vectors.size();
+        std::vector<size_t> all_queries(nq);
+        for (size_t qi = 0; qi < nq; ++qi) all_queries[qi] = qi;
+
+        std::vector<std::vector<size_t>> plan(segments.size());
+        const size_t nprobe = m_collection_info.index_specs.nprobe_segments;
+        auto spec_it = m_collection_info.vec_specs.find(vector_name);
+
+        routed = !params.exact && nprobe > 0 && nprobe < segments.size() && spec_it != m_collection_info.vec_specs.end();
+        if (!routed) {
+            for (auto& queries : plan) queries = all_queries;
+            return plan;
+        }
+
+        std::unordered_map<SegmentIdType, size_t> position;
+        for (size_t si = 0; si < segments.size(); ++si) {
+            position[segments[si]->getSegmentId()] = si;
+        }
+
+        auto routes = meta_index.routeQueries(vector_name, spec_it->second.metric, query_vectors, nprobe);
+        for (size_t qi = 0; qi < routes.size(); ++qi) {
+            for (const auto& seg_id : routes[qi]) {
+                auto it = position.find(seg_id);
+                if (it != position.end()) plan[it->second].push_back(qi);
+            }
+        }
+
+        //segments the MetaIndex has no centroids for can't be ranked, so they always get searched
+        for (size_t si = 0; si < segments.size(); ++si) {
+            if (!meta_index.contains(segments[si]->getSegmentId())) plan[si] = all_queries;
+        }
+        return plan;
+    }
+
+    //Run plan[i] against immutable segment i, fanned out on the Query lane. Every returned QueryResult
+    //has one slot per query (empty where that segment was not asked), so mergeBatchResults can line them up.
+    //A filter is resolved once per segment into a bitmap over its FAISS offsets, inside the fan-out.
+    std::vector<QueryResult> searchImmutableSegments(const std::vector<std::shared_ptr<const ImmutableSegment>>& segments,
+                                                     const std::vector<std::vector<size_t>>& plan,
+                                                     const VectorName& vector_name,
+                                                     const std::vector<DenseVector>& query_vectors,
+                                                     size_t k,
+                                                     const SearchParams& params,
+                                                     const SegmentFilter& filter) const
+    {
+        const size_t nq = query_vectors.size();
+        std::vector<size_t> work;
+        for (size_t si = 0; si < segments.size(); ++si) {
+            if (!plan[si].empty()) work.push_back(si);
+        }
+
+        std::vector<QueryResult> results(work.size());
+        parallelFor(work.size(), [&](size_t i) {
+            const size_t si = work[i];
+            const auto& queries = plan[si];
+            FilterPlan filter_plan;
+            if (filter) {
+                filter_plan = segments[si]->resolveFilter(vector_name, filter);
+            }
+            const FilterPlan* filter_ptr = filter ? &filter_plan : nullptr;
+
+            if (queries.size() == nq) {
+                results[i] = segments[si]->searchTopK(vector_name, query_vectors, k, params, filter_ptr);
+                return;
+            }
+
+            std::vector<DenseVector> subset;
+            subset.reserve(queries.size());
+            for (size_t qi : queries) subset.push_back(query_vectors[qi]);
+
+            QueryResult partial = segments[si]->searchTopK(vector_name, subset, k, params, filter_ptr);
+            results[i].status = partial.status;
+            results[i].results.resize(nq);
+            for (size_t j = 0; j < queries.size() && j < partial.results.size(); ++j) {
+                results[i].results[queries[j]] = std::move(partial.results[j]);
+            }
+        });
+        return results;
+    }
+
+    //fn(0..n-1) on the Query lane. The calling thread works through the items too, so a busy
+    //pool only means fewer helpers, never a stalled query.
+    static void parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+        std::atomic<size_t> next_index{0};
+        auto worker = [&]() {
+            size_t idx;
+            while ((idx = next_index.fetch_add(1)) < n) {
+                fn(idx);
+            }
+        };
+
+        auto& query_pool = TaskExecutor::getInstance().lane(TaskLane::Query);
+        const size_t num_helpers = query_pool.isWorkerThread() || n < 2
+                                 ? 0
+                                 : std::min(query_pool.size(), n - 1);
+        std::vector<std::future<void>> helpers;
+        helpers.reserve(num_helpers);
+        for (size_t i = 0; i < num_helpers; ++i) {
+            helpers.push_back(query_pool.submit(worker));
+        }
+        worker();
+        for (auto& f : helpers) {
+            f.get();
+        }
+    }
+
+    //queue work on an executor lane, counted from submit until it finishes for waitForBackgroundWork()
+    template <typename F>
+    void submitBackground(TaskLane lane, F&& fn) {
+        {
+            std::lock_guard<std::mutex> lock(m_background_mutex);
+            ++m_background_tasks;
+        }
+        TaskExecutor::getInstance().post(lane, [this, fn = std::forward<F>(fn)]() mutable {
+            fn();
+            std::lock_guard<std::mutex> lock(m_background_mutex);
+            --m_background_tasks;
+            m_background_cv.notify_all();
+        });
+    }
+
+    CollectionInfo m_collection_info;//own copy, the background builds outlive the caller's info
+    size_t m_max_active_capacity;
     std::filesystem::path m_wal_base_path;
-    ActiveSegment m_active_segment;
+
     //might implement my own AI driven std::vector for capacity prediction expansion later. Cool stuff
-    std::vector<std::unique_ptr<ImmutableSegment>> m_immutable_segments;
+    std::shared_ptr<const SegmentSet> m_segment_set;//only ever touched through snapshot() / publishSegmentSet()
+    mutable std::mutex m_write_mutex;//serializes location updates, deletes, seal, publish and compaction; readers never take it
+    std::unordered_map<PointIdType, PointLocation> m_point_locations;//id -> current copy, under m_write_mutex
+    std::atomic<uint64_t> m_next_version{0};//bumped per upsert, outside the lock
+    bool m_compaction_running{false};//at most one compactor per collection, under m_write_mutex
+    std::shared_ptr<ActiveSegment> m_spare_active;//next active segment, ready for the seal, under m_write_mutex
+    bool m_spare_pending{false};//a spare is being built on the IO lane, under m_write_mutex
     // std::atomic<uint64_t> next_id_{0};//mayeb uuid is better for segment id?
-    std::vector<std::future<void>> m_pending_writes;
+
+    mutable std::mutex m_manifest_mutex;//IO lane tasks update the manifest one at a time
+    std::set<SegmentIdType> m_persisted_segments;//what manifest.json lists, under m_manifest_mutex
+    std::mutex m_budget_mutex;//serializes enforceMemoryBudget() passes
+    std::set<SegmentIdType> m_unmappable_segments;//faiss read them in whole when asked to map, under m_budget_mutex
+    std::mutex m_tombstone_io_mutex;//one deleted.bin write at a time, see writeTombstonesFor()
+    std::mutex m_tombstone_pending_mutex;
+    std::set<SegmentIdType> m_tombstone_pending;//segments with a deleted.bin write queued, under m_tombstone_pending_mutex
+    //segment -> the other segments its WAL's entries tombstoned, under m_write_mutex (see queueWalFlush())
+    std::unordered_map<SegmentIdType, std::set<SegmentIdType>> m_tombstoned_by;
+
+    //a written segment's WAL waiting for its flush marker, see flushReadyWals()
+    struct WalFlush {
+        std::shared_ptr<WAL> wal;
+        std::set<SegmentIdType> tombstoned;
+    };
+    std::mutex m_wal_flush_mutex;//one flushReadyWals() pass at a time
+    std::vector<WalFlush> m_wal_flushes;//under m_wal_flush_mutex
+
+    std::mutex m_background_mutex;
+    std::condition_variable m_background_cv;
+    size_t m_background_tasks{0};
 };
 
 } // namespace vectordb
\ No newline at end of file
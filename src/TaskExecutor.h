@@ -0,0 +1,152 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+One process-wide executor so nobody spawns threads per call anymore.
+
+It has separate lanes, each its own work-stealing ThreadPool, so the different kinds of
+work can't starve each other:
+
+    Query : fan-out of a search over the immutable segments (latency sensitive, many small tasks)
+    Index : building ImmutableSegments (HNSW + k-means), long and cpu heavy
+    IO    : writing indexes / segment files to disk, mostly waiting on the disk
+
+A multi-second index build only ever occupies Index threads, so queries keep their own
+threads no matter what the background is doing.
+
+Sizes come from ExecutorConfig. The defaults can be overridden with env vars
+    VECTORDB_QUERY_THREADS, VECTORDB_INDEX_THREADS, VECTORDB_IO_THREADS
+or by calling TaskExecutor::configure(...) before the first getInstance().
+*/
+
+namespace vectordb {
+
+enum class TaskLane {
+    Query,
+    Index,
+    IO,
+};
+
+struct ExecutorConfig {
+    size_t query_threads{0};
+    size_t index_threads{0};
+    size_t io_threads{0};
+
+    static ExecutorConfig defaults() {
+        const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+        ExecutorConfig cfg;
+        cfg.query_threads = hw;
+        cfg.index_threads = std::max<size_t>(1, hw / 4);
+        cfg.io_threads = 2;
+        return cfg;
+    }
+
+    static ExecutorConfig fromEnv() {
+        ExecutorConfig cfg = defaults();
+        readEnv("VECTORDB_QUERY_THREADS", cfg.query_threads);
+        readEnv("VECTORDB_INDEX_THREADS", cfg.index_threads);
+        readEnv("VECTORDB_IO_THREADS", cfg.io_threads);
+        return cfg;
+    }
+
+private:
+    static void readEnv(const char* name, size_t& value) {
+        if (const char* env = std::getenv(name)) {
+            long v = std::strtol(env, nullptr, 10);
+            if (v > 0) value = static_cast<size_t>(v);
+        }
+    }
+};
+
+class TaskExecutor {
+public:
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+    //Has to be called before the first getInstance(), returns false (and changes nothing) after that.
+    static bool configure(const ExecutorConfig& config) {
+        std::lock_guard<std::mutex> lock(configMutex());
+        if (started()) return false;
+        pendingConfig() = config;
+        return true;
+    }
+
+    static TaskExecutor& getInstance() {
+        static TaskExecutor instance{takeConfig()}; //Created only once (thread-safe since C++11)
+        return instance;
+    }
+
+    ThreadPool& lane(TaskLane lane) {
+        switch (lane) {
+            case TaskLane::Query: return m_query_pool;
+            case TaskLane::Index: return m_index_pool;
+            default:              return m_io_pool;
+        }
+    }
+
+    template <typename F>
+    auto submit(TaskLane lane_id, F&& fn) {
+        return lane(lane_id).submit(std::forward<F>(fn));
+    }
+
+    void post(TaskLane lane_id, std::function<void()> fn) {
+        lane(lane_id).post(std::move(fn));
+    }
+
+    const ExecutorConfig& getConfig() const {
+        return m_config;
+    }
+
+    void printInfo() const {
+        std::cout << "[EXECUTOR] query=" << m_query_pool.size()
+                  << " index=" << m_index_pool.size()
+                  << " io=" << m_io_pool.size() << " threads\n";
+    }
+
+private:
+    explicit TaskExecutor(const ExecutorConfig& config)
+        : m_config{config}
+        , m_io_pool{config.io_threads, "io"}
+        , m_index_pool{config.index_threads, "index"}
+        , m_query_pool{config.query_threads, "query"}
+    {}
+
+    //freeze the config, configure() is a no-op from here on
+    static ExecutorConfig takeConfig() {
+        std::lock_guard<std::mutex> lock(configMutex());
+        started() = true;
+        return pendingConfig();
+    }
+
+    static std::mutex& configMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static ExecutorConfig& pendingConfig() {
+        static ExecutorConfig config = ExecutorConfig::fromEnv();
+        return config;
+    }
+
+    static bool& started() {
+        static bool flag = false;
+        return flag;
+    }
+
+    ExecutorConfig m_config;
+    //destroyed bottom up: index builds still draining at shutdown may queue writes on the io lane
+    ThreadPool m_io_pool;
+    ThreadPool m_index_pool;
+    ThreadPool m_query_pool;
+};
+
+} // namespace vectordb
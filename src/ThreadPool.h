@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed size work-stealing thread pool.
+ *
+ * Every worker has its own deque. Tasks submitted from outside are spread round robin over
+ * the deques, tasks submitted from inside a worker go to that worker's own deque. A worker
+ * pops its own deque from the back (LIFO, the data it just touched is still in cache) and
+ * when it runs dry it steals from the front of the other deques, so one long task (an index
+ * build) never leaves queued work stuck behind it while other workers sit idle.
+ *
+ *   worker 0: [t1 t2 t3] <- pop back        submit() from outside -> round robin
+ *   worker 1: [] -> steal front of worker 0
+ *
+ * The destructor finishes whatever is already queued and then joins the workers.
+ */
+namespace vectordb {
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t num_threads, std::string name = "pool")
+        : m_name{std::move(name)}
+    {
+        if (num_threads == 0) num_threads = 1;
+        m_queues.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            m_queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        m_workers.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            m_workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        for (auto& t : m_workers) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    //queue a task, the returned future carries its result (or exception)
+    template <typename F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        //std::function needs a copyable callable, packaged_task is move only, so wrap it in a shared_ptr
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        std::future<R> fut = task->get_future();
+        post([task] { (*task)(); });
+        return fut;
+    }
+
+    //fire and forget
+    void post(std::function<void()> task) {
+        const auto& self = currentWorker();
+        const size_t q = (self.pool == this)
+                       ? self.index
+                       : m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        //counted before it is visible: a worker that takes it right away must never decrement first
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            ++m_pending;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+            m_queues[q]->tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+    }
+
+    //true when called from one of this pool's workers (waiting on our own futures there can deadlock)
+    bool isWorkerThread() const noexcept {
+        return currentWorker().pool == this;
+    }
+
+    size_t size() const noexcept {
+        return m_workers.size();
+    }
+
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        return m_pending;
+    }
+
+    const std::string& name() const noexcept {
+        return m_name;
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct WorkerIdentity {
+        const ThreadPool* pool{nullptr};
+        size_t index{0};
+    };
+
+    static WorkerIdentity& currentWorker() noexcept {
+        static thread_local WorkerIdentity identity;
+        return identity;
+    }
+
+    //own deque from the back first, then steal from the front of the others
+    bool tryTake(size_t self, std::function<void()>& out) {
+        {
+            auto& own = *m_queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                out = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < m_queues.size(); ++i) {
+            auto& victim = *m_queues[(self + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                out = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index) {
+        currentWorker() = WorkerIdentity{this, index};
+
+        for (;;) {
+            std::function<void()> task;
+            if (tryTake(index, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(m_sleep_mutex);
+                    --m_pending;
+                }
+                task();
+                continue;
+            }
+
+            //nothing anywhere: sleep until something is posted. m_pending is bumped right before
+            //the push, so a worker woken in between rescans until the task shows up (a few
+            //instructions) and the count never drops below the tasks actually queued.
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            if (m_stopping && m_pending == 0) return;
+            m_cv.wait(lock, [this] { return m_stopping || m_pending > 0; });
+            if (m_stopping && m_pending == 0) return;
+        }
+    }
+
+    std::string m_name;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_next_queue{0};
+
+    mutable std::mutex m_sleep_mutex;
+    std::condition_variable m_cv;
+    size_t m_pending{0}; //queued but not yet taken, guarded by m_sleep_mutex
+    bool m_stopping{false};
+};
+
+} // namespace vectordb
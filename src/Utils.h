@@ -45,6 +45,74 @@ inline std::string to_string(DistanceMetric m) {
     }
 }
 
+inline auto parse_index_type(const std::string& s) -> IndexType {
+    std::string s_lower = s;
+    std::transform(s_lower.begin(), s_lower.end(), s_lower.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+
+    if (s_lower == "flat") return IndexType::Flat;
+    if (s_lower == "hnsw" || s_lower == "hnsw_flat") return IndexType::HNSWFlat;
+    if (s_lower == "hnsw_sq8") return IndexType::HNSWSQ8;
+    if (s_lower == "hnsw_fp16") return IndexType::HNSWFP16;
+    if (s_lower == "ivf_flat") return IndexType::IVFFlat;
+    if (s_lower == "ivf_pq") return IndexType::IVFPQ;
+    return IndexType::UNKNOWN;
+}
+
+inline auto parse_payload_field_type(const std::string& s) -> PayloadFieldType {
+    std::string s_lower = s;
+    std::transform(s_lower.begin(), s_lower.end(), s_lower.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+
+    if (s_lower == "keyword") return PayloadFieldType::Keyword;
+    if (s_lower == "numeric" || s_lower == "integer" || s_lower == "float") return PayloadFieldType::Numeric;
+    if (s_lower == "bool" || s_lower == "boolean") return PayloadFieldType::Bool;
+    return PayloadFieldType::UNKNOWN;
+}
+
+inline std::string to_string(PayloadFieldType t) {
+    switch (t) {
+        case PayloadFieldType::Keyword: return "keyword";
+        case PayloadFieldType::Numeric: return "numeric";
+        case PayloadFieldType::Bool: return "bool";
+        default: return "UNKNOWN";
+    }
+}
+
+inline auto parse_wal_durability(const std::string& s) -> WalDurability {
+    std::string s_lower = s;
+    std::transform(s_lower.begin(), s_lower.end(), s_lower.begin(),
+                   [](unsigned char c){ return c == '-' ? '_' : std::tolower(c); });
+
+    if (s_lower == "none") return WalDurability::None;
+    if (s_lower == "async") return WalDurability::Async;
+    if (s_lower == "per_batch") return WalDurability::PerBatch;
+    if (s_lower == "per_request") return WalDurability::PerRequest;
+    return WalDurability::UNKNOWN;
+}
+
+inline std::string to_string(WalDurability d) {
+    switch (d) {
+        case WalDurability::None: return "none";
+        case WalDurability::Async: return "async";
+        case WalDurability::PerBatch: return "per_batch";
+        case WalDurability::PerRequest: return "per_request";
+        default: return "UNKNOWN";
+    }
+}
+
+inline std::string to_string(IndexType t) {
+    switch (t) {
+        case IndexType::Flat: return "flat";
+        case IndexType::HNSWFlat: return "hnsw_flat";
+        case IndexType::HNSWSQ8: return "hnsw_sq8";
+        case IndexType::HNSWFP16: return "hnsw_fp16";
+        case IndexType::IVFFlat: return "ivf_flat";
+        case IndexType::IVFPQ: return "ivf_pq";
+        default: return "UNKNOWN";
+    }
+}
+
 //APIErrorType defined in DataTypes,
 //the purpose of having it is for type safety? perhaps.
 //not sure how people in the industry like to handle this kind of stuff.
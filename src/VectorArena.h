@@ -0,0 +1,125 @@
+#pragma once
+
+#include "DataTypes.h"
+#include "Distance.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <map>
+#include <vector>
+
+/*
+Columnar storage for the vectors in the ActiveSegment.
+
+Before, every Point in the PointMemoryPool owned a TinyMap of heap allocated std::vector<float>,
+so a brute force scan was chasing pointers all over the heap and getVector() copied every
+vector under a shared_mutex. Now each named vector space gets one contiguous float arena:
+
+    arena "image" (dim 3, 64-byte aligned):
+    row 0: [0.1, 0.2, 0.3]   <- slot 0 ("img_1")
+    row 1: [0.4, 0.1, 0.2]   <- slot 1 ("img_q")
+    row 2: [ ?,   ?,   ? ]   <- slot 2 has no "image" vector, present[2] = 0
+    ...
+
+    point_ids: ["img_1", "img_q", "doc_3", ...]   (slot/offset -> point id)
+
+Rows are packed with stride = dim (no padding), so the whole arena is exactly what FAISS
+wants for index->add(n, data). The norm of every row is cached when it is written.
+
+The buffer is allocated once for the whole segment capacity. For big buffers glibc hands out
+fresh mmap'd pages, so untouched rows don't cost physical memory.
+*/
+
+namespace vectordb {
+
+inline constexpr size_t ARENA_ALIGNMENT = 64; //one cache line, also the AVX-512 register width
+
+struct AlignedFree {
+    void operator()(float* ptr) const noexcept { std::free(ptr); }
+};
+
+using AlignedFloatBuffer = std::unique_ptr<float[], AlignedFree>;
+
+inline AlignedFloatBuffer allocateAlignedFloats(size_t count) {
+    //aligned_alloc wants the size to be a multiple of the alignment
+    size_t bytes = count * sizeof(float);
+    bytes = ((bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT;
+    if (bytes == 0) bytes = ARENA_ALIGNMENT;
+
+    void* ptr = std::aligned_alloc(ARENA_ALIGNMENT, bytes);
+    if (!ptr) throw std::bad_alloc();
+    return AlignedFloatBuffer(static_cast<float*>(ptr));
+}
+
+class VectorArena {
+public:
+    VectorArena(size_t dim, size_t capacity)
+        : m_dim{dim}
+        , m_capacity{capacity}
+        , m_data{allocateAlignedFloats(dim * capacity)}
+        , m_norms(capacity, 0.0f)
+        , m_present(capacity, 0)
+    {}
+
+    ~VectorArena() = default;
+
+    VectorArena(const VectorArena&) = delete;
+    VectorArena& operator=(const VectorArena&) = delete;
+
+    VectorArena(VectorArena&&) noexcept = default;
+    VectorArena& operator=(VectorArena&&) noexcept = default;
+
+    //copy one vector into its row and cache the norm, caller checks vec has dim() floats.
+    //with normalize=true the row is stored unit length (cosine spaces), its norm is then 1.
+    void write(size_t row, const float* vec, bool normalize = false) noexcept {
+        float* dst = m_data.get() + row * m_dim;
+        std::memcpy(dst, vec, m_dim * sizeof(float));
+        float n = vectordb::norm(dst, m_dim);
+        if (normalize && n > 1e-12f) {
+            const float inv = 1.0f / n;
+            for (size_t i = 0; i < m_dim; ++i) dst[i] *= inv;
+            n = 1.0f;
+        }
+        m_norms[row] = n;
+        m_present[row] = 1;
+    }
+
+    void erase(size_t row) noexcept {
+        m_present[row] = 0;
+    }
+
+    bool has(size_t row) const noexcept {
+        return row < m_capacity && m_present[row] != 0;
+    }
+
+    const float* row(size_t r) const noexcept { return m_data.get() + r * m_dim; }
+    const float* data() const noexcept { return m_data.get(); }
+    float* data() noexcept { return m_data.get(); }
+    const float* norms() const noexcept { return m_norms.data(); }
+    const uint8_t* present() const noexcept { return m_present.data(); }
+
+    size_t dim() const noexcept { return m_dim; }
+    size_t capacity() const noexcept { return m_capacity; }
+
+private:
+    size_t m_dim;
+    size_t m_capacity;
+    AlignedFloatBuffer m_data;
+    std::vector<float> m_norms;
+    std::vector<uint8_t> m_present; //a point does not have to carry every named vector
+};
+
+//All vector data of one active segment: slot -> point id, plus one arena per named vector.
+//payloads[slot] only keeps the payload_index fields (flat "a.b" keys), the full payload is in rocksdb.
+struct SegmentVectorData {
+    std::vector<PointIdType> point_ids;
+    std::map<VectorName, VectorArena> arenas;
+    std::vector<Payload> payloads;
+    std::vector<uint64_t> versions; //per slot write version, the newest one wins when an id shows up twice
+
+    size_t size() const noexcept { return point_ids.size(); }
+};
+
+} // namespace vectordb
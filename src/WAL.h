@@ -1,50 +1,71 @@
 #pragma once
 
-#include "Point.h"
+#include "Crc32c.h"
+#include "DataTypes.h"
+#include "Status.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 /*
 Write ahead log for the vectors. The payloads are handled by rocksdb, so don't worry about them
 WAL idea is about persist before it’s acknowledged.
-I probably will not implement the full recovery of data, we will see.
 
-WAL in my understanding is before i add vectors to memory pool, need to append them to the WAL file.
+One WAL file per active segment: ./vectordb/<collection>/wal/segment_<id>.wal
 Insert flow:
-User calls insertPoint() etc
-You serialize the insert operation to the WAL (append to file).
-Then you apply the insert operation to the memory pool / active segment.
-If crash happens after WAL but before memory, replay restores it.
-If crash happens after memory but before WAL, replay re-applies it (idempotent, you overwrite same ID).
-
-Replay:
-On startup, you open the WAL.
-For each entry, reconstruct Point and put it back into the active segment (or memory pool).
-Then resume as if nothing happened.
-
-
-| checksum | entry_type | collection_name | point_id | named_vec_count | [[vec_name, dim, data], [vec_name, dim, data], ...] |
-
-entry type meaning insert, delete, update, etc.
-
-Not sure if this is correct or not. 
+The SegmentHolder reserves a slot in the active segment and copies the row in (still invisible),
+then logs the insert here, then commits the slot. The request is acknowledged after
+WAL::waitDurable() says its entries are as durable as the collection's WalDurability asks for.
+Deletes are logged into the current active segment's WAL the same way.
+Every entry carries the SegmentHolder's version, so a replay can put the entries of all the WAL
+files of a collection back in order.
+
+Group commit: logInsert()/logDelete() only serialize the entry and append it to an in-memory buffer
+(they return its lsn, a per WAL sequence number). One writer thread per open WAL swaps that buffer
+out, copies it into the file in one go and syncs. Everything that came in while it was busy goes
+out with the next round, so N concurrent upserts cost one copy and one sync, not N of each.
+
+    async       : nobody waits, the writer wakes once per commit window, writes + syncs
+    per_batch   : wait until the entries are written (page cache), sync once per commit window
+    per_request : wait until the sync that covers the entries is done
+
+Files: each one is preallocated to wal.file_size_mb with fallocate, zero-filled once and mmap'd
+(MAP_SHARED). The writer memcpy's into the mapping and a commit is an msync of the pages written
+since the last one. Size and blocks are set once when the file is created, so a commit never has to
+journal a new file size the way appending write()s do. The zero fill matters on ext4/xfs: fallocate
+alone leaves unwritten extents, and the first msync of every page would still journal converting
+it. Creating a file costs that fill plus an fsync, so the SegmentHolder builds the next active
+segment (and with it this WAL's first file) on the IO lane ahead of the seal. When a file is full
+the WAL rotates to segment_<id>.<n>.wal (an entry never spans two files). A finished file is
+msync'd and truncated to what it holds, so a closed file ends with its last entry. A crashed one
+still has its zeroed preallocated tail, which readFile() stops at like at any other invalid entry.
+
+When the sealed segment is converted its WAL is closed (the writer drains and stops, no thread per
+sealed segment). Once its immutable segment is on disk a SEGMENT_FLUSH marker is appended to each of
+its files: replay can skip them.
+
+Recovery (readFile, see Collection::recoverFromWal): every entry carries a CRC32C over its header and
+data. A crash can leave the last write half done, so the file is read up to the first entry that is
+cut short or doesn't check out and truncated there, everything before it was written completely.
+
+| header | entry | entry | ...
+entry = | type | timestamp | data_size | checksum | data |   checksum = crc32c(type..data_size, data)
+insert data = | point_id_len | point_id | version | named_vec_count | [[name_len, name, bytes, floats], ...] |
+delete data = | point_id_len | point_id | version |
 */
-#pragma once
-
-#include "Point.h"
-#include "DataTypes.h"
-#include "Status.h"
-
-#include <filesystem>
-#include <mutex>
-#include <shared_mutex>
-#include <sys/mman.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <cstring>
-#include <chrono>
-#include <vector>
-#include <string>
 
 namespace vectordb {
 
@@ -58,8 +79,7 @@ enum class WalEntryType : uint8_t {
 struct WalHeader {
     uint32_t magic;
     uint32_t version;
-    uint64_t entry_count;
-    SegmentIdType segment_id;
+    char segment_id[64]; //"Segment_<uuid>", zero padded (the file is written raw, no std::string in here)
     uint32_t checksum;
 };
 
@@ -71,376 +91,743 @@ struct WalEntryHeader {
 };
 #pragma pack(pop)
 
+//One INSERT_VECTOR / DELETE_POINT entry read back from a WAL file
+struct WalRecord {
+    WalEntryType type;
+    uint64_t version{0};
+    PointIdType point_id;
+    std::vector<std::pair<VectorName, DenseVector>> vectors; //inserts only
+};
+
+//What WAL::readFile() found in one file
+struct WalFileContents {
+    SegmentIdType segment_id;
+    bool flushed{false};            //has a SEGMENT_FLUSH marker, the segment is on disk
+    std::vector<WalRecord> records; //valid entries in file order
+    size_t truncated_bytes{0};      //torn or corrupt tail that got cut off the file
+    bool no_header{false};          //created but its header never reached the disk, holds nothing
+};
+
 class WAL {
 public:
-    WAL() = default;
-    
-    WAL(const std::filesystem::path& base_path, SegmentIdType segment_id) 
+    WAL(const std::filesystem::path& base_path, SegmentIdType segment_id,
+        WalDurability durability = WalDurability::PerBatch,
+        std::chrono::milliseconds commit_window = std::chrono::milliseconds{10},
+        size_t file_size = size_t{32} << 20)
         : m_base_path{base_path}
-        , m_segment_id{segment_id}
+        , m_segment_id{std::move(segment_id)}
+        , m_durability{durability}
+        , m_commit_window{std::max(commit_window, std::chrono::milliseconds{1})}
+        , m_file_size{std::max(file_size, MIN_FILE_SIZE)}
     {
         std::filesystem::create_directories(m_base_path);
-        m_current_wal_path = getWalPath(segment_id);
+        m_current_wal_path = getWalPath(m_segment_id);
     }
-    
+
     ~WAL() {
         close();
     }
 
-    // Open new WAL file for this segment
+    WAL(const WAL&) = delete;
+    WAL& operator=(const WAL&) = delete;
+
+    //Create this segment's first WAL file and start the group commit writer. Segment ids are fresh
+    //uuids, an existing file is never reopened (replay reads those, see readFile()).
     Status open() {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
-        
+        std::lock_guard<std::mutex> lock(m_mutex);
+
         if (m_is_open) {
             return Status::OK();
         }
 
-        m_fd = ::open(m_current_wal_path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);//0644 permission code
-        if (m_fd == -1) {
-            return Status::Error("Failed to open WAL file: " + std::string(strerror(errno)));
-        }
-
-        // Check if file is new or existing
-        off_t file_size = ::lseek(m_fd, 0, SEEK_END);
-        if (file_size == 0) {
-            // New file, write header
-            if (!writeHeader()) {
-                ::close(m_fd);
-                m_fd = -1;
-                return Status::Error("Failed to write WAL header");
-            }
-        } else {
-            // Existing file, read header to get entry count
-            if (!readHeader()) {
-                ::close(m_fd);
-                m_fd = -1;
-                return Status::Error("Failed to read WAL header from existing file");
-            }
+        auto status = startFile(m_current_wal_path, m_file_size);
+        if (!status.ok) {
+            return status;
         }
+        m_files.push_back(m_current_wal_path);
 
         m_is_open = true;
+        m_stop = false;
+        m_writer = std::thread([this]() { writerLoop(); });
         return Status::OK();
     }
 
+    //Drain: whatever is buffered gets written and synced, then the writer stops and the file is
+    //trimmed to what it holds. Nobody waiting on this WAL is left hanging.
     void close() {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
-        if (m_fd != -1) {
-            // Don't fsync here to avoid performance hit on every close
-            ::close(m_fd);
-            m_fd = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_is_open) return;
+            m_is_open = false;
+            m_stop = true;
+        }
+        m_work_cv.notify_one();
+        if (m_writer.joinable()) m_writer.join();
+
+        //the writer is gone, the mapping is ours now
+        auto status = finishFile();
+        if (!status.ok) {
+            std::cerr << "[WAL ERROR] " << m_segment_id << ": " << status.message << "\n";
         }
-        m_is_open = false;
     }
 
-    // Log insertion of a point with named vectors
-    Status logInsert(const std::string& collection_name, 
-                     PointIdType point_id,
-                     const std::map<VectorName, DenseVector>& vectors) {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
-        
-        if (!m_is_open) {
-            return Status::Error("WAL not open");
+    // Log insertion of a point with named vectors, returns the entry's lsn for waitDurable()
+    StatusOr<uint64_t> logInsert(const PointIdType& point_id,
+                                 const std::vector<std::pair<VectorName, const DenseVector*>>& vectors,
+                                 uint64_t version) {
+        std::vector<uint8_t> buffer;
+        appendString(buffer, point_id);
+        appendToBuffer(buffer, version);
+
+        // Number of vectors
+        uint32_t num_vectors = vectors.size();
+        appendToBuffer(buffer, num_vectors);
+
+        // Each vector: name + vector data (as raw bytes)
+        for (const auto& [vec_name, vec_data] : vectors) {
+            appendString(buffer, vec_name);
+            uint32_t vec_data_bytes = vec_data->size() * sizeof(float);
+            appendToBuffer(buffer, vec_data_bytes);
+            const uint8_t* float_data = reinterpret_cast<const uint8_t*>(vec_data->data());
+            buffer.insert(buffer.end(), float_data, float_data + vec_data_bytes);
         }
 
-        try {
-            // Serialize data to binary buffer
-            std::vector<uint8_t> buffer;
-            
-            // Collection name (length-prefixed)
-            uint32_t coll_name_len = collection_name.size();
-            appendToBuffer(buffer, coll_name_len);
-            buffer.insert(buffer.end(), collection_name.begin(), collection_name.end());
-            
-            // Point ID
-            uint32_t point_id_len = point_id.size();
-            appendToBuffer(buffer, point_id_len);
-            buffer.insert(buffer.end(), point_id.begin(), point_id.end());
-            
-            // Number of vectors
-            uint32_t num_vectors = vectors.size();
-            appendToBuffer(buffer, num_vectors);
-            
-            // Each vector: name + vector data
-            for (const auto& [vec_name, vec_data] : vectors) {
-                // Vector name
-                uint32_t vec_name_len = vec_name.size();
-                appendToBuffer(buffer, vec_name_len);
-                buffer.insert(buffer.end(), vec_name.begin(), vec_name.end());
-                
-                // Vector data (as raw bytes)
-                uint32_t vec_data_bytes = vec_data.size() * sizeof(float);
-                appendToBuffer(buffer, vec_data_bytes);
-                const uint8_t* float_data = reinterpret_cast<const uint8_t*>(vec_data.data());
-                buffer.insert(buffer.end(), float_data, float_data + vec_data_bytes);
-            }
+        return appendEntry(WalEntryType::INSERT_VECTOR, buffer);
+    }
 
-            return writeEntry(WalEntryType::INSERT_VECTOR, buffer);
-            
-        } catch (const std::exception& e) {
-            return Status::Error(std::string("Failed to serialize insert entry: ") + e.what());
-        }
+    // Log deletion of a point, returns the entry's lsn for waitDurable()
+    StatusOr<uint64_t> logDelete(const PointIdType& point_id, uint64_t version) {
+        std::vector<uint8_t> buffer;
+        appendString(buffer, point_id);
+        appendToBuffer(buffer, version);
+        return appendEntry(WalEntryType::DELETE_POINT, buffer);
     }
 
-    // Log deletion of a point
-    Status logDelete(const std::string& collection_name, PointIdType point_id) {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
-        
-        if (!m_is_open) {
-            return Status::Error("WAL not open");
+    //Block until the entries up to `lsn` are as durable as the durability mode promises
+    Status waitDurable(uint64_t lsn) {
+        if (m_durability == WalDurability::Async || lsn == 0) {
+            return Status::OK();
         }
+        return waitFor(lsn, /*synced*/m_durability == WalDurability::PerRequest);
+    }
 
-        try {
-            std::vector<uint8_t> buffer;
-            
-            // Collection name
-            uint32_t coll_name_len = collection_name.size();
-            appendToBuffer(buffer, coll_name_len);
-            buffer.insert(buffer.end(), collection_name.begin(), collection_name.end());
-            
-            // Point ID
-            uint32_t point_id_len = point_id.size();
-            appendToBuffer(buffer, point_id_len);
-            buffer.insert(buffer.end(), point_id.begin(), point_id.end());
-            
-            return writeEntry(WalEntryType::DELETE_POINT, buffer);
-            
-        } catch (const std::exception& e) {
-            return Status::Error(std::string("Failed to serialize delete entry: ") + e.what());
+    //Write and sync everything logged so far, whatever the mode
+    Status sync() {
+        uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            lsn = m_next_lsn;
         }
+        return waitFor(lsn, /*synced*/true);
     }
 
-    // Mark that segment is being converted to immutable
+    //Mark the segment's data as persisted (its immutable segment is on disk). By then the segment
+    //has long been converted and its WAL closed (files trimmed), so the marker is appended to every
+    //file of the segment with a plain write and synced. Each file can then be dropped on its own.
     Status logSegmentFlush() {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
-        
-        if (!m_is_open) {
-            return Status::Error("WAL not open");
-        }
-
-        WalEntryHeader entry_header;
-        entry_header.type = WalEntryType::SEGMENT_FLUSH;
-        entry_header.timestamp = getCurrentTimestamp();
-        entry_header.data_size = 0;
-        entry_header.checksum = computeChecksum(&entry_header, sizeof(entry_header) - sizeof(uint32_t));
-
-        ssize_t written = ::write(m_fd, &entry_header, sizeof(entry_header));
-        if (written != sizeof(entry_header)) {
-            return Status::Error("Failed to write segment flush marker");
-        }
+        close();
 
-        m_entry_count++;
-        updateHeaderEntryCount();
-        
-        // Force sync to disk for durability
-        if (fsync(m_fd) == -1) {
-            return Status::Error("Failed to sync WAL after flush marker: " + std::string(strerror(errno)));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = encodeEntry(WalEntryType::SEGMENT_FLUSH, {});
+        for (const auto& path : m_files) {
+            int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+            if (fd == -1) {
+                return Status::Error("Failed to open WAL for flush marker: " + std::string(strerror(errno)));
+            }
+            Status status = writeAll(fd, entry.data(), entry.size());
+            if (status.ok && ::fdatasync(fd) == -1) {
+                status = Status::Error("Failed to sync WAL after flush marker: " + std::string(strerror(errno)));
+            }
+            ::close(fd);
+            if (!status.ok) return status;
         }
-        
-        ::close(m_fd);
-        m_fd = -1;
-        m_is_open = false;
-
         return Status::OK();
     }
 
-    // Sync WAL to disk (for durability)
-    Status sync() {
-        std::unique_lock<std::shared_mutex> lock(m_mutex);
-        
-        if (!m_is_open) {
-            return Status::Error("WAL not open");
+    //After logSegmentFlush(): the files are of no use any more, delete them. A crash before this
+    //leaves them with the marker and recovery deletes them instead.
+    Status removeFiles() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_is_open) {
+            return Status::Error("WAL still open, not removing " + m_current_wal_path.string());
         }
-
-        if (fsync(m_fd) == -1) {
-            return Status::Error("Failed to sync WAL: " + std::string(strerror(errno)));
+        Status result = Status::OK();
+        for (const auto& path : m_files) {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            if (ec) result = Status::Error("Failed to remove " + path.string() + ": " + ec.message());
         }
-        
-        return Status::OK();
+        return result;
     }
 
-    // Get the path to this WAL file
+    // Get the path to the WAL file being written (the last one after rotations)
     std::filesystem::path getFilePath() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
         return m_current_wal_path;
     }
 
+    // Every file of this segment's WAL, in order
+    std::vector<std::filesystem::path> getFilePaths() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_files;
+    }
+
     // Check if WAL can be safely deleted (contains flush marker)
     bool isSegmentFlushed() const {
-        std::shared_lock<std::shared_mutex> lock(m_mutex);
-        
-        // If file is still open, it hasn't been flushed yet
-        if (m_is_open) {
-            return false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // If file is still open, it hasn't been flushed yet
+            if (m_is_open) {
+                return false;
+            }
         }
+        return hasFlushMarker(getFilePath());
+    }
 
-        // Read the file to check for flush marker
-        int fd = ::open(m_current_wal_path.c_str(), O_RDONLY);
+    //The marker is the last thing ever written to a file, so this only reads the last entry header,
+    //no matter how big the file is. Recovery skips these files without reading them.
+    static bool hasFlushMarker(const std::filesystem::path& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
         if (fd == -1) {
             return false;
         }
 
         bool has_flush_marker = false;
-        
-        // Get file size
         off_t file_size = ::lseek(fd, 0, SEEK_END);
         if (file_size >= static_cast<off_t>(sizeof(WalHeader) + sizeof(WalEntryHeader))) {
-            // Read last entry header
             WalEntryHeader last_entry;
-            if (::pread(fd, &last_entry, sizeof(last_entry), 
+            if (::pread(fd, &last_entry, sizeof(last_entry),
                        file_size - sizeof(WalEntryHeader)) == sizeof(WalEntryHeader)) {
-                has_flush_marker = (last_entry.type == WalEntryType::SEGMENT_FLUSH);
+                has_flush_marker = last_entry.type == WalEntryType::SEGMENT_FLUSH &&
+                                   last_entry.data_size == 0 &&
+                                   last_entry.checksum == entryChecksum(last_entry, nullptr);
             }
         }
-        
+
         ::close(fd);
         return has_flush_marker;
     }
 
-    // Get current entry count
+    //Read every valid entry of a WAL file back. The file is truncated after the last valid entry (a
+    //torn write from a crash, or garbage), so the next run sees a clean file. Zeros after the last
+    //entry are the unused preallocated part, not a torn write. A file too short to even have its
+    //header, or with a header that is still all zeros, was created right before a crash and holds
+    //nothing (no_header): the header is only synced with the first commit.
+    static StatusOr<WalFileContents> readFile(const std::filesystem::path& path) {
+        int fd = ::open(path.c_str(), O_RDWR);
+        if (fd == -1) {
+            return Status::Error("Failed to open WAL file " + path.string() + ": " + std::string(strerror(errno)));
+        }
+
+        std::vector<uint8_t> bytes;
+        auto status = readAll(fd, bytes);
+        if (!status.ok) {
+            ::close(fd);
+            return Status::Error(status.message + " (" + path.string() + ")");
+        }
+
+        WalFileContents contents;
+        if (bytes.size() < sizeof(WalHeader) ||
+            std::all_of(bytes.begin(), bytes.begin() + sizeof(WalHeader), [](uint8_t b) { return b == 0; })) {
+            ::close(fd);
+            contents.no_header = true;
+            return contents;
+        }
+
+        WalHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (header.magic != WAL_MAGIC || header.version != WAL_VERSION ||
+            header.checksum != crc32c(&header, sizeof(header) - sizeof(uint32_t))) {
+            ::close(fd);
+            return Status::Error("Not a WAL file of this version: " + path.string());
+        }
+        contents.segment_id.assign(header.segment_id, strnlen(header.segment_id, sizeof(header.segment_id)));
+
+        size_t offset = sizeof(WalHeader);
+        while (offset < bytes.size() && decodeEntry(bytes, offset, contents)) {}
+
+        if (offset < bytes.size()) {
+            const bool preallocated = std::all_of(bytes.begin() + offset, bytes.end(), [](uint8_t b) { return b == 0; });
+            if (!preallocated) contents.truncated_bytes = bytes.size() - offset;
+            if (::ftruncate(fd, static_cast<off_t>(offset)) == -1 || ::fdatasync(fd) == -1) {
+                status = Status::Error("Failed to truncate torn WAL tail: " + std::string(strerror(errno)));
+            }
+        }
+        ::close(fd);
+        if (!status.ok) return status;
+        return contents;
+    }
+
+    // Entries logged through this object (not counting what an existing file already had)
     uint64_t getEntryCount() const {
-        std::shared_lock<std::shared_mutex> lock(m_mutex);
-        return m_entry_count;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_next_lsn;
     }
 
-    // Get current WAL file size
+    // Disk space of all this segment's WAL files (the open one counts with its preallocation)
     size_t getSize() const {
-        std::shared_lock<std::shared_mutex> lock(m_mutex);
-        if (!m_is_open) {
-            // File is closed, get size from filesystem
+        size_t total = 0;
+        for (const auto& path : getFilePaths()) {
             std::error_code ec;
-            auto size = std::filesystem::file_size(m_current_wal_path, ec);
-            return ec ? 0 : size;
+            auto size = std::filesystem::file_size(path, ec);
+            if (!ec) total += size;
         }
-        
-        off_t size = ::lseek(m_fd, 0, SEEK_END);
-        return size >= 0 ? static_cast<size_t>(size) : 0;
+        return total;
     }
 
-    // Check if WAL is empty (only has header)
+    // Check if WAL is empty (nothing logged through it)
     bool isEmpty() const {
-        return getSize() <= sizeof(WalHeader);
+        return getEntryCount() == 0;
+    }
+
+    WalDurability getDurability() const {
+        return m_durability;
     }
 
 private:
     static constexpr uint32_t WAL_MAGIC = 0x57414C31;  // "WAL1"
-    static constexpr uint32_t WAL_VERSION = 1;
-    
+    static constexpr uint32_t WAL_VERSION = 2; //2: crc32c checksums
+    static constexpr size_t MIN_FILE_SIZE = size_t{1} << 16;
+
     std::filesystem::path m_base_path;
     std::filesystem::path m_current_wal_path;
     SegmentIdType m_segment_id;
-    int m_fd = -1;
+    WalDurability m_durability;
+    std::chrono::milliseconds m_commit_window;
+    size_t m_file_size; //preallocated size of each file
+    std::vector<std::filesystem::path> m_files; //every file so far, the last one is being written
     bool m_is_open = false;
-    uint64_t m_entry_count = 0;
-    mutable std::shared_mutex m_mutex;
 
-    std::filesystem::path getWalPath(SegmentIdType segment_id) const {
+    //the current file, only the writer thread touches these while the WAL is open
+    int m_fd = -1;
+    uint8_t* m_map{nullptr};
+    size_t m_map_size{0};
+    size_t m_write_offset{0};  //end of the last entry copied in
+    size_t m_synced_offset{0}; //msync'd up to here
+
+    //group commit state, all under m_mutex
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work_cv; //wakes the writer
+    std::condition_variable m_done_cv; //wakes whoever waits in waitFor()
+    std::vector<uint8_t> m_pending;    //encoded entries not handed to write() yet
+    uint64_t m_next_lsn{0};            //lsn of the last entry appended
+    uint64_t m_written_lsn{0};         //entries up to here are written
+    uint64_t m_synced_lsn{0};          //entries up to here are synced
+    uint64_t m_write_wanted{0};        //someone waits for a write up to here (per_batch)
+    uint64_t m_sync_wanted{0};         //someone waits for a sync up to here (per_request, sync())
+    Status m_error{Status::OK()};      //first write/sync failure, sticks: every later wait returns it
+    bool m_stop{false};
+    std::thread m_writer;
+
+    std::filesystem::path getWalPath(const SegmentIdType& segment_id) const {
         return m_base_path / ("segment_" + segment_id + ".wal");
     }
 
-    bool writeHeader() {
-        WalHeader header;
+    //Create a WAL file, preallocate and map it, header first. Blocks and size are set here once,
+    //commits only ever msync pages inside the file.
+    Status startFile(const std::filesystem::path& path, size_t size) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);//0644 permission code
+        if (fd == -1) {
+            return Status::Error("Failed to create WAL file " + path.string() + ": " + std::string(strerror(errno)));
+        }
+
+        auto fail = [&](const std::string& what) {
+            const std::string reason = strerror(errno);
+            ::close(fd);
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            return Status::Error(what + " " + path.string() + ": " + reason);
+        };
+
+        //posix_fallocate only for filesystems without fallocate (it writes the zeros itself)
+        if (::fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) {
+            //fallocate'd blocks are unwritten extents: write real zeros once so the commits later
+            //only ever write data, the extent conversion is journaled here by the fsync below
+            static const std::vector<uint8_t> zeros(size_t{1} << 20, 0);
+            size_t done = 0;
+            while (done < size) {
+                const size_t n = std::min(zeros.size(), size - done);
+                const ssize_t written = ::pwrite(fd, zeros.data(), n, static_cast<off_t>(done));
+                if (written == -1 && errno == EINTR) continue;
+                if (written <= 0) return fail("Failed to zero-fill WAL file");
+                done += static_cast<size_t>(written);
+            }
+        } else {
+            const int err = ::posix_fallocate(fd, 0, static_cast<off_t>(size));
+            if (err != 0) {
+                errno = err;
+                return fail("Failed to preallocate WAL file");
+            }
+        }
+        //the new directory entry, file size and the zeros have to survive a crash too, once per file
+        if (::fsync(fd) == -1) {
+            return fail("Failed to sync new WAL file");
+        }
+
+        void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            return fail("Failed to mmap WAL file");
+        }
+
+        m_fd = fd;
+        m_map = static_cast<uint8_t*>(map);
+        m_map_size = size;
+        m_synced_offset = 0;
+
+        WalHeader header{};
         header.magic = WAL_MAGIC;
         header.version = WAL_VERSION;
-        header.entry_count = 0;
-        header.segment_id = m_segment_id;
-        header.checksum = computeChecksum(&header, sizeof(header) - sizeof(uint32_t));
-        
-        ssize_t written = ::write(m_fd, &header, sizeof(header));
-        return written == sizeof(header);
+        std::strncpy(header.segment_id, m_segment_id.c_str(), sizeof(header.segment_id) - 1);
+        header.checksum = crc32c(&header, sizeof(header) - sizeof(uint32_t));
+        std::memcpy(m_map, &header, sizeof(header));
+        m_write_offset = sizeof(header);
+        return Status::OK();
     }
 
-    bool readHeader() {
-        WalHeader header;
-        if (::pread(m_fd, &header, sizeof(header), 0) != sizeof(header)) {
-            return false;
+    //msync the pages written since the last commit (msync wants a page aligned start)
+    Status syncMapped() {
+        if (m_synced_offset >= m_write_offset) {
+            return Status::OK();
         }
-        
-        if (header.magic != WAL_MAGIC) {
-            return false;
+        static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t begin = m_synced_offset / page_size * page_size;
+        if (::msync(m_map + begin, m_write_offset - begin, MS_SYNC) == -1) {
+            return Status::Error("Failed to msync WAL: " + std::string(strerror(errno)));
         }
-        
-        if (header.version != WAL_VERSION) {
-            // In production, you might want version migration logic
-            return false;
+        m_synced_offset = m_write_offset;
+        return Status::OK();
+    }
+
+    //Copy a round's entries into the mapping, whole entries only. Rotates when the next entry
+    //doesn't fit any more.
+    Status appendMapped(const std::vector<uint8_t>& batch) {
+        size_t pos = 0;
+        while (pos < batch.size()) {
+            size_t end = pos;
+            while (end < batch.size() && m_write_offset + (end - pos) + entrySizeAt(batch, end) <= m_map_size) {
+                end += entrySizeAt(batch, end);
+            }
+            if (end == pos) {
+                auto status = rotate(entrySizeAt(batch, pos));
+                if (!status.ok) return status;
+                continue;
+            }
+            std::memcpy(m_map + m_write_offset, batch.data() + pos, end - pos);
+            m_write_offset += end - pos;
+            pos = end;
         }
-        
-        // Verify checksum
-        uint32_t saved_checksum = header.checksum;
-        header.checksum = 0;
-        if (computeChecksum(&header, sizeof(header)) != saved_checksum) {
-            return false;
+        return Status::OK();
+    }
+
+    //The current file is full: finish it and go on in the next one. An entry bigger than a whole
+    //file gets a file of its own size.
+    Status rotate(size_t entry_size) {
+        auto status = finishFile();
+        if (!status.ok) return status;
+
+        std::filesystem::path next;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            next = m_base_path / ("segment_" + m_segment_id + "." + std::to_string(m_files.size()) + ".wal");
         }
-        
-        m_entry_count = header.entry_count;
-        return true;
+        status = startFile(next, std::max(m_file_size, sizeof(WalHeader) + entry_size));
+        if (!status.ok) return status;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_files.push_back(next);
+        m_current_wal_path = next;
+        return Status::OK();
     }
 
-    void updateHeaderEntryCount() {
-        WalHeader header;
-        if (::pread(m_fd, &header, sizeof(header), 0) != sizeof(header)) {
-            return;
+    //Sync the rest, unmap, and cut the unused preallocated space off, so the file ends with its
+    //last entry (hasFlushMarker() and the flush marker append rely on that)
+    Status finishFile() {
+        if (m_fd == -1) {
+            return Status::OK();
         }
-        
-        header.entry_count = m_entry_count;
-        header.checksum = computeChecksum(&header, sizeof(header) - sizeof(uint32_t));
-        
-        ::pwrite(m_fd, &header, sizeof(header), 0);
+        Status status = syncMapped();
+        ::munmap(m_map, m_map_size);
+        m_map = nullptr;
+        if (status.ok && (::ftruncate(m_fd, static_cast<off_t>(m_write_offset)) == -1 || ::fdatasync(m_fd) == -1)) {
+            status = Status::Error("Failed to trim WAL file: " + std::string(strerror(errno)));
+        }
+        ::close(m_fd);
+        m_fd = -1;
+        return status;
     }
 
-    Status writeEntry(WalEntryType type, const std::vector<uint8_t>& data) {
+    static size_t entrySizeAt(const std::vector<uint8_t>& buffer, size_t offset) {
+        WalEntryHeader entry_header;
+        std::memcpy(&entry_header, buffer.data() + offset, sizeof(entry_header));
+        return sizeof(entry_header) + entry_header.data_size;
+    }
+
+    //header + data of one entry, ready to go into the file as is
+    std::vector<uint8_t> encodeEntry(WalEntryType type, const std::vector<uint8_t>& data) const {
         WalEntryHeader entry_header;
         entry_header.type = type;
         entry_header.timestamp = getCurrentTimestamp();
         entry_header.data_size = data.size();
-        entry_header.checksum = 0;  // Will compute after setting data
-        
-        // Compute entry checksum (header + data)
-        uint32_t header_checksum = computeChecksum(&entry_header, sizeof(entry_header) - sizeof(uint32_t));
-        uint32_t data_checksum = computeChecksum(data.data(), data.size());
-        entry_header.checksum = header_checksum ^ data_checksum;
-        
-        // Write entry header
-        ssize_t written = ::write(m_fd, &entry_header, sizeof(entry_header));
-        if (written != sizeof(entry_header)) {
-            return Status::Error("Failed to write WAL entry header");
-        }
-        
-        // Write entry data
-        if (!data.empty()) {
-            written = ::write(m_fd, data.data(), data.size());
-            if (written != static_cast<ssize_t>(data.size())) {
-                return Status::Error("Failed to write WAL entry data");
+        entry_header.checksum = entryChecksum(entry_header, data.data());
+
+        std::vector<uint8_t> entry(sizeof(entry_header) + data.size());
+        std::memcpy(entry.data(), &entry_header, sizeof(entry_header));
+        if (!data.empty()) std::memcpy(entry.data() + sizeof(entry_header), data.data(), data.size());
+        return entry;
+    }
+
+    //encoding and checksum happen in the caller's thread, the lock only covers the append
+    StatusOr<uint64_t> appendEntry(WalEntryType type, const std::vector<uint8_t>& data) {
+        auto entry = encodeEntry(type, data);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_is_open) {
+            return Status::Error("WAL not open");
+        }
+        if (!m_error.ok) {
+            return m_error;
+        }
+        if (m_pending.empty()) m_work_cv.notify_one(); //an idle writer starts the commit window
+        m_pending.insert(m_pending.end(), entry.begin(), entry.end());
+        return ++m_next_lsn;
+    }
+
+    Status waitFor(uint64_t lsn, bool synced) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        uint64_t& wanted = synced ? m_sync_wanted : m_write_wanted;
+        const uint64_t& reached = synced ? m_synced_lsn : m_written_lsn;
+        if (reached < lsn && m_error.ok) {
+            wanted = std::max(wanted, lsn);
+            m_work_cv.notify_one();
+            m_done_cv.wait(lock, [&] { return reached >= lsn || !m_error.ok; });
+        }
+        return reached >= lsn ? Status::OK() : m_error;
+    }
+
+    //The group commit writer. Each round takes everything pending and copies it in, plus one msync
+    //when someone asked for it or the commit window since the last one ran out (so at most one per
+    //window unless per_request waiters ask). What arrives during a round goes in the next one.
+    void writerLoop() {
+        using clock = std::chrono::steady_clock;
+        std::vector<uint8_t> batch;
+        clock::time_point last_sync{};
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            if (!m_error.ok) {
+                //the file is in an unknown state, everything after the failure is refused (appendEntry)
+                m_pending.clear();
+                m_work_cv.wait(lock, [this] { return m_stop; });
+                return;
+            }
+            auto asked = [this] {
+                return m_stop || m_sync_wanted > m_synced_lsn || m_write_wanted > m_written_lsn;
+            };
+            m_work_cv.wait(lock, [&] {
+                return asked() || !m_pending.empty() || m_written_lsn > m_synced_lsn;
+            });
+            //nobody waits for it: let the window fill up
+            if (!asked()) m_work_cv.wait_until(lock, last_sync + m_commit_window, asked);
+
+            const bool stopping = m_stop;
+            const bool sync = stopping || m_sync_wanted > m_synced_lsn || clock::now() >= last_sync + m_commit_window;
+            const uint64_t batch_lsn = m_next_lsn;
+            batch.swap(m_pending);
+            lock.unlock();
+
+            Status status = Status::OK();
+            if (!batch.empty()) {
+                status = appendMapped(batch);
+            }
+            if (status.ok && sync) {
+                status = syncMapped();
+                last_sync = clock::now();
+            }
+            batch.clear();
+
+            lock.lock();
+            if (status.ok) {
+                m_written_lsn = batch_lsn;
+                if (sync) m_synced_lsn = batch_lsn;
+            } else if (m_error.ok) {
+                std::cerr << "[WAL ERROR] " << m_segment_id << ": " << status.message << "\n";
+                m_error = status;
+            }
+            m_done_cv.notify_all();
+            if (stopping) return;
+        }
+    }
+
+    static Status writeAll(int fd, const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(fd, bytes, size);
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                return Status::Error("Failed to write WAL: " + std::string(strerror(errno)));
             }
+            bytes += written;
+            size -= static_cast<size_t>(written);
         }
-        
-        // Update header with new entry count
-        m_entry_count++;
-        updateHeaderEntryCount();
-        
         return Status::OK();
     }
 
     template<typename T>
-    void appendToBuffer(std::vector<uint8_t>& buffer, const T& value) {
+    static void appendToBuffer(std::vector<uint8_t>& buffer, const T& value) {
         const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
         buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
     }
 
-    uint64_t getCurrentTimestamp() const {
+    //length prefixed
+    static void appendString(std::vector<uint8_t>& buffer, const std::string& s) {
+        uint32_t len = s.size();
+        appendToBuffer(buffer, len);
+        buffer.insert(buffer.end(), s.begin(), s.end());
+    }
+
+    static uint64_t getCurrentTimestamp() {
         auto now = std::chrono::system_clock::now();
         return std::chrono::duration_cast<std::chrono::microseconds>(
             now.time_since_epoch()).count();
     }
 
-    uint32_t computeChecksum(const void* data, size_t size) const {
-        // Simple XOR-based checksum for prototyping
-        // In production, consider CRC32 or a proper hash
-        const uint8_t* bytes = static_cast<const uint8_t*>(data);
-        uint32_t checksum = 0;
-        for (size_t i = 0; i < size; ++i) {
-            checksum ^= (static_cast<uint32_t>(bytes[i]) << ((i % 4) * 8));
+    //crc32c over the entry header (without the checksum field) followed by its data
+    static uint32_t entryChecksum(const WalEntryHeader& entry_header, const uint8_t* data) {
+        uint32_t crc = crc32c(&entry_header, sizeof(entry_header) - sizeof(uint32_t));
+        return entry_header.data_size ? crc32c(data, entry_header.data_size, crc) : crc;
+    }
+
+    static Status readAll(int fd, std::vector<uint8_t>& bytes) {
+        off_t file_size = ::lseek(fd, 0, SEEK_END);
+        if (file_size < 0) {
+            return Status::Error("Failed to stat WAL file: " + std::string(strerror(errno)));
+        }
+        bytes.resize(static_cast<size_t>(file_size));
+        size_t done = 0;
+        while (done < bytes.size()) {
+            ssize_t got = ::pread(fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(done));
+            if (got == -1 && errno == EINTR) continue;
+            if (got <= 0) {
+                return Status::Error("Failed to read WAL file: " + std::string(strerror(errno)));
+            }
+            done += static_cast<size_t>(got);
+        }
+        return Status::OK();
+    }
+
+    //bounds checked reads out of one entry's data
+    struct EntryReader {
+        const uint8_t* data;
+        size_t size;
+        size_t pos{0};
+
+        template<typename T>
+        bool read(T& value) {
+            if (size - pos < sizeof(T)) return false;
+            std::memcpy(&value, data + pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
         }
-        return checksum;
+
+        bool readString(std::string& s) {
+            uint32_t len = 0;
+            if (!read(len) || size - pos < len) return false;
+            s.assign(reinterpret_cast<const char*>(data + pos), len);
+            pos += len;
+            return true;
+        }
+
+        bool readFloats(DenseVector& vec) {
+            uint32_t num_bytes = 0;
+            if (!read(num_bytes) || num_bytes % sizeof(float) != 0 || size - pos < num_bytes) return false;
+            vec.resize(num_bytes / sizeof(float));
+            std::memcpy(vec.data(), data + pos, num_bytes);
+            pos += num_bytes;
+            return true;
+        }
+    };
+
+    //The entry at `offset`: false when it is cut short or doesn't check out, otherwise it goes into
+    //`out` and offset moves past it.
+    static bool decodeEntry(const std::vector<uint8_t>& bytes, size_t& offset, WalFileContents& out) {
+        WalEntryHeader entry_header;
+        if (bytes.size() - offset < sizeof(entry_header)) return false;
+        std::memcpy(&entry_header, bytes.data() + offset, sizeof(entry_header));
+
+        const size_t data_offset = offset + sizeof(entry_header);
+        if (entry_header.data_size > bytes.size() - data_offset) return false;
+        const uint8_t* data = bytes.data() + data_offset;
+        if (entryChecksum(entry_header, data) != entry_header.checksum) return false;
+
+        EntryReader reader{data, entry_header.data_size};
+        WalRecord record;
+        record.type = entry_header.type;
+        switch (entry_header.type) {
+            case WalEntryType::SEGMENT_FLUSH:
+                out.flushed = true;
+                break;
+            case WalEntryType::INSERT_VECTOR: {
+                uint32_t num_vectors = 0;
+                if (!reader.readString(record.point_id) || !reader.read(record.version) || !reader.read(num_vectors)) {
+                    return false;
+                }
+                for (uint32_t i = 0; i < num_vectors; ++i) {
+                    std::pair<VectorName, DenseVector> vec;
+                    if (!reader.readString(vec.first) || !reader.readFloats(vec.second)) return false;
+                    record.vectors.push_back(std::move(vec));
+                }
+                out.records.push_back(std::move(record));
+                break;
+            }
+            case WalEntryType::DELETE_POINT:
+                if (!reader.readString(record.point_id) || !reader.read(record.version)) return false;
+                out.records.push_back(std::move(record));
+                break;
+            default:
+                return false;
+        }
+
+        offset = data_offset + entry_header.data_size;
+        return true;
+    }
+};
+
+/**
+ * @brief The WAL positions one request logged to, so it waits once at the end instead of per point.
+ *
+ * Usually one WAL, two when the active segment got sealed halfway through the request. Holds the
+ * WALs by shared_ptr, a segment that gets converted meanwhile closes its WAL, which drains it first.
+ */
+class WalBatch {
+public:
+    void add(const std::shared_ptr<WAL>& wal, uint64_t lsn) {
+        for (auto& [w, last] : m_entries) {
+            if (w == wal) {
+                last = std::max(last, lsn);
+                return;
+            }
+        }
+        m_entries.emplace_back(wal, lsn);
+    }
+
+    Status wait() const {
+        for (const auto& [wal, lsn] : m_entries) {
+            auto status = wal->waitDurable(lsn);
+            if (!status.ok) return status;
+        }
+        return Status::OK();
     }
+
+    //fdatasync no matter the durability mode (recovery, before it drops the files it replayed)
+    Status sync() const {
+        for (const auto& [wal, lsn] : m_entries) {
+            auto status = wal->sync();
+            if (!status.ok) return status;
+        }
+        return Status::OK();
+    }
+
+private:
+    std::vector<std::pair<std::shared_ptr<WAL>, uint64_t>> m_entries;
 };
 
 } // namespace vectordb
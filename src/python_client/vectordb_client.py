@@ -1,7 +1,7 @@
 import requests
 import json
 from vectordb_models import *
-from typing import List, Union, Optional
+from typing import Dict, List, Union, Optional
 
 # from vectordb_models import CreateCollectionRequest, PointStruct, UpsertBatch, QueryRequest
 
@@ -28,6 +28,12 @@ class VectorDBClient:
         url = f"{self.host}/collections/{name}"
         return self._delete(url)
     
+    def delete_points(self, collection_name: str, point_ids: List[str]) -> Optional[dict]:
+        for pid in point_ids:
+            self._validate_point_id(pid)
+        url = f"{self.host}/collections/{collection_name}/points"
+        return self._delete(url, {"points": list(point_ids)})
+
     def upsert(self, collection_name: str, points: Union[PointStruct, List[PointStruct], UpsertBatch]) -> Optional[dict]:
         payload_base = {"collection_name": collection_name}
 
@@ -86,6 +92,10 @@ class VectorDBClient:
             query_pointids: Optional[List[str]] = None,
             using: str = "default",
             top_k: Optional[int] = 10,
+            ef_search: Optional[int] = None,
+            nprobe: Optional[int] = None,
+            exact: bool = False,
+            filter: Optional[Dict] = None,
         ) -> Optional[QueryResponse]:
             """
             Query the collection using either query vectors or existing point IDs.
@@ -112,7 +122,11 @@ class VectorDBClient:
                     query_vectors=query_vectors,
                     query_pointids=query_pointids,
                     using=using,
-                    top_k=top_k if top_k is not None else 0
+                    top_k=top_k if top_k is not None else 0,
+                    ef_search=ef_search,
+                    nprobe=nprobe,
+                    exact=exact,
+                    filter=filter
                 )
             except ValueError as e:
                 print(f"[ERROR] Invalid query request: {e}")
@@ -356,9 +370,9 @@ class VectorDBClient:
             print(f"[ERROR] {e}")
             return None
 
-    def _delete(self, url: str) -> Optional[dict]:
+    def _delete(self, url: str, data: Optional[dict] = None) -> Optional[dict]:
         try:
-            response = requests.delete(url)
+            response = requests.delete(url, json=data) if data is not None else requests.delete(url)
             response.raise_for_status()
             return response.json()
         except requests.HTTPError:
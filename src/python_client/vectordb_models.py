@@ -7,16 +7,48 @@ OK, so for now I only supoprt point ids of string type, no integer type.
 I can always add it later.
 """
 
+@dataclass
+class IndexParams:
+    type: Literal["flat", "hnsw_flat", "hnsw_sq8", "hnsw_fp16", "ivf_flat", "ivf_pq"] = "hnsw_flat"
+    nlist: Optional[int] = None     # ivf: inverted lists, default ~4*sqrt(points per segment)
+    nprobe: Optional[int] = None    # ivf: lists visited per query
+    pq_m: Optional[int] = None      # ivf_pq: sub-quantizers, must divide size
+    pq_nbits: Optional[int] = None  # ivf_pq: bits per code
+
+    def to_dict(self):
+        return {k: v for k, v in self.__dict__.items() if v is not None}
+
 @dataclass
 class VectorParams:
     size: int
     distance: Literal["Cosine", "L2", "Dot"]
+    index: Optional[IndexParams] = None
 
     def to_dict(self):
-        return {
+        d = {
             "size": self.size,
             "distance": self.distance,
         }
+        if self.index is not None:
+            d["index"] = self.index.to_dict()
+        return d
+
+#----------------
+
+@dataclass
+class IndexSpecs:
+    # all optional, the server keeps its defaults for anything left as None
+    index_threshold: Optional[int] = None
+    m_edges: Optional[int] = None
+    ef_construction: Optional[int] = None
+    ef_search: Optional[int] = None
+    nprobe_segments: Optional[int] = None  # 0 = search every segment
+    compaction_fanout: Optional[int] = None  # merge this many same-size segments, 0 = no compaction
+    compaction_max_points: Optional[int] = None  # merged segments stay below this
+    compaction_deleted_pct: Optional[int] = None  # rewrite a segment once this % of it is deleted
+
+    def to_dict(self):
+        return {k: v for k, v in self.__dict__.items() if v is not None}
 
 #----------------
 
@@ -24,11 +56,25 @@ class VectorParams:
 class CreateCollectionRequest:
     vectors: Union[VectorParams, Dict[str, VectorParams]]
     on_disk: Literal["true", "false"] # Type hint for valid values
+    index_specs: Optional[IndexSpecs] = None
+    # payload field -> "keyword" | "numeric" | "bool", filters on these are answered from in-memory bitmaps
+    payload_index: Optional[Dict[str, Literal["keyword", "numeric", "bool"]]] = None
+    # rocksdb durability of payload writes, e.g. {"sync": True} or {"disable_wal": True}
+    payload_store: Optional[Dict[str, bool]] = None
+    # vector WAL, e.g. {"durability": "per_request", "commit_window_ms": 10, "file_size_mb": 32}
+    # durability: "none" | "async" | "per_batch" | "per_request"
+    wal: Optional[Dict[str, Union[str, int]]] = None
+    # on_disk segments, e.g. {"mmap": True, "memory_budget_mb": 1024}
+    storage: Optional[Dict[str, Union[bool, int]]] = None
 
     def __post_init__(self):
         # Validation still good for runtime safety
         if self.on_disk not in ["true", "false"]:
             raise ValueError(f'on_disk must be "true" or "false", got "{self.on_disk}"')
+        if self.payload_index is not None:
+            for field, kind in self.payload_index.items():
+                if kind not in ("keyword", "numeric", "bool"):
+                    raise ValueError(f'payload_index["{field}"] must be "keyword", "numeric" or "bool", got "{kind}"')
         
     def to_dict(self):
         result = {}
@@ -39,6 +85,16 @@ class CreateCollectionRequest:
             result["vectors"] = self.vectors.to_dict()
         
         result["on_disk"] = self.on_disk
+        if self.index_specs is not None:
+            result["index_specs"] = self.index_specs.to_dict()
+        if self.payload_index:
+            result["payload_index"] = dict(self.payload_index)
+        if self.payload_store:
+            result["payload_store"] = dict(self.payload_store)
+        if self.wal:
+            result["wal"] = dict(self.wal)
+        if self.storage:
+            result["storage"] = dict(self.storage)
         return result
 
 #----------------
@@ -78,6 +134,10 @@ class QueryRequest:
     query_pointids: Optional[List[str]] = None
     using: str = "default"
     top_k: Optional[int] = 10
+    ef_search: Optional[int] = None  # hnsw candidate list for this query (raised to top_k if smaller)
+    nprobe: Optional[int] = None     # ivf lists to visit for this query
+    exact: bool = False              # brute force, skip the ann indexes and segment routing
+    filter: Optional[Dict] = None    # payload filter, e.g. {"must": [{"key": "tenant", "match": {"value": "acme"}}]}
 
     def __post_init__(self):
         # Validate collection name
@@ -127,6 +187,19 @@ class QueryRequest:
             # For ID-based queries, ignore top_k entirely
             self.top_k = None
 
+        for name in ("ef_search", "nprobe"):
+            value = getattr(self, name)
+            if value is not None and (not isinstance(value, int) or value <= 0):
+                raise ValueError(f"`{name}` must be a positive integer.")
+        if not isinstance(self.exact, bool):
+            raise TypeError("`exact` must be a boolean.")
+        if self.filter is not None:
+            if not isinstance(self.filter, dict):
+                raise TypeError("`filter` must be a dict.")
+            for clause in ("must", "should", "must_not"):
+                if clause in self.filter and not isinstance(self.filter[clause], list):
+                    raise TypeError(f"`filter['{clause}']` must be a list of conditions.")
+
     def to_dict(self):
         data = OrderedDict()
         data["collection_name"] = self.collection_name
@@ -142,6 +215,15 @@ class QueryRequest:
         if self.top_k is not None:
             data["top_k"] = self.top_k
 
+        if self.ef_search is not None:
+            data["ef_search"] = self.ef_search
+        if self.nprobe is not None:
+            data["nprobe"] = self.nprobe
+        if self.exact:
+            data["exact"] = True
+        if self.filter:
+            data["filter"] = self.filter
+
         return data
 
 #-------------------
@@ -157,6 +239,8 @@ class QueryResponse:
     result: Union[List[ScoredPoint], List[List[ScoredPoint]]]
     status: str
     time: float
+    segments_searched: int = 0
+    segments_skipped: int = 0
 
     @classmethod
     def from_dict(cls, data: dict) -> "QueryResponse":
@@ -177,7 +261,9 @@ class QueryResponse:
         return cls(
             result=parsed_result,
             status=data.get("status", ""),
-            time=data.get("time", 0.0)
+            time=data.get("time", 0.0),
+            segments_searched=data.get("segments_searched", 0),
+            segments_skipped=data.get("segments_skipped", 0)
         )
 
 #--------------------------------------
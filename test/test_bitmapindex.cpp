@@ -314,4 +314,149 @@ TEST_CASE("Edge Cases", "[bitmap][edge]") {
         REQUIRE(bm.get(64) == true);
         REQUIRE(bm.get(1) == false);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("BitmapIndex count", "[bitmap]") {
+    vectordb::BitmapIndex bm;
+    REQUIRE(bm.count() == 0);
+
+    bm.resize(130);
+    bm.set(0);
+    bm.set(63);
+    bm.set(64);
+    bm.set(129);
+    REQUIRE(bm.count() == 4);
+
+    bm.set(63, false);
+    REQUIRE(bm.count() == 3);
+
+    bm.clear();
+    REQUIRE(bm.count() == 0);
+}
+
+TEST_CASE("BitmapIndex serialize round trip", "[bitmap]") {
+    vectordb::BitmapIndex bm;
+    bm.resize(130);
+    bm.set(1);
+    bm.set(64);
+    bm.set(129);
+
+    std::stringstream buffer;
+    bm.serialize(buffer);
+    auto loaded = vectordb::BitmapIndex::deserialize(buffer);
+
+    REQUIRE(loaded.size() == 130);
+    REQUIRE(loaded.count() == 3);
+    REQUIRE(loaded.get(1));
+    REQUIRE(loaded.get(64));
+    REQUIRE(loaded.get(129));
+    REQUIRE_FALSE(loaded.get(0));
+
+    std::stringstream truncated(buffer.str().substr(0, 10));
+    REQUIRE_THROWS(vectordb::BitmapIndex::deserialize(truncated));
+}
+
+TEST_CASE("BitmapIndex andNot and contains", "[bitmap]") {
+    vectordb::BitmapIndex matches, deleted;
+    matches.resize(200000);
+    deleted.resize(200000);
+    for (size_t i = 0; i < 200000; i += 3) matches.set(i);
+    deleted.set(3);
+    deleted.set(70002);
+    deleted.set(70001); // not in matches
+
+    auto live = matches - deleted;
+    REQUIRE(live.count() == matches.count() - 2);
+    REQUIRE_FALSE(live.contains(3));
+    REQUIRE_FALSE(live.contains(70002));
+    REQUIRE(live.contains(6));
+
+    // contains() never throws, out of range is just not set
+    REQUIRE_FALSE(live.contains(200000));
+    REQUIRE_FALSE(live.contains(size_t(-1)));
+}
+
+TEST_CASE("BitmapIndex fill, ranges and compression", "[bitmap]") {
+    const size_t n = 5000000;
+
+    vectordb::BitmapIndex all;
+    all.resize(n);
+    all.fill();
+    REQUIRE(all.count() == n);
+    REQUIRE(all.contains(n - 1));
+    REQUIRE(all.memoryBytes() < 16 * 1024); // one run per chunk, not 610KB of words
+
+    vectordb::BitmapIndex tenant;
+    tenant.resize(n);
+    for (size_t i = 0; i < n; i += 100000) tenant.set(i);
+    REQUIRE(tenant.memoryBytes() < 16 * 1024);
+
+    auto both = tenant & all;
+    REQUIRE(both.to_ids() == tenant.to_ids());
+
+    vectordb::BitmapIndex range;
+    range.resize(300000);
+    range.setRange(65530, 131080);
+    REQUIRE(range.count() == 131080 - 65530);
+    REQUIRE_FALSE(range.contains(65529));
+    REQUIRE(range.contains(65530));
+    REQUIRE(range.contains(131079));
+    REQUIRE_FALSE(range.contains(131080));
+
+    range.resize(70000); // shrinking drops what is past the end
+    REQUIRE(range.count() == 70000 - 65530);
+    range.resize(300000);
+    REQUIRE_FALSE(range.contains(131079));
+}
+
+TEST_CASE("BitmapIndex serialize all container types", "[bitmap]") {
+    vectordb::BitmapIndex bm;
+    bm.resize(300000);
+    bm.set(5);                                          // array chunk
+    for (size_t i = 65536; i < 65536 + 20000; i += 2) bm.set(i); // bitset chunk
+    bm.setRange(140000, 190000);                        // run chunks
+    bm.runOptimize();
+
+    std::stringstream buffer;
+    bm.serialize(buffer);
+    auto loaded = vectordb::BitmapIndex::deserialize(buffer);
+    REQUIRE(loaded.size() == bm.size());
+    REQUIRE(loaded.count() == bm.count());
+    REQUIRE(loaded.to_ids() == bm.to_ids());
+}
+
+TEST_CASE("BitmapIndex in place and / andNot", "[bitmap]") {
+    const size_t n = 300000;
+    vectordb::BitmapIndex mixed, evens, range;
+    mixed.resize(n);
+    evens.resize(n);
+    range.resize(n);
+    mixed.set(3);                                                // array chunk
+    for (size_t i = 65536; i < 65536 + 20000; ++i) mixed.set(i); // bitset chunk
+    mixed.setRange(200000, 260000);                              // run chunks
+    mixed.runOptimize();
+    for (size_t i = 0; i < n; i += 2) evens.set(i);
+    range.setRange(70000, 210000);
+    range.runOptimize();
+
+    for (const auto* other : {&evens, &range}) {
+        auto a = mixed;
+        a &= *other;
+        REQUIRE(a.to_ids() == (mixed & *other).to_ids());
+        REQUIRE(a.count() == (mixed & *other).count());
+
+        auto b = mixed;
+        b -= *other;
+        REQUIRE(b.to_ids() == (mixed - *other).to_ids());
+        REQUIRE(b.count() == (mixed - *other).count());
+    }
+
+    vectordb::BitmapIndex none;
+    none.resize(n);
+    auto c = mixed;
+    c &= none;
+    REQUIRE_FALSE(c.any());
+
+    vectordb::BitmapIndex other_size;
+    other_size.resize(n + 1);
+    REQUIRE_THROWS_AS(c &= other_size, std::invalid_argument);
+}
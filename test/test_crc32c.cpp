@@ -0,0 +1,33 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/Crc32c.h"
+
+#include <string>
+#include <vector>
+
+TEST_CASE("CRC32C check value", "[crc32c]") {
+    const std::string check = "123456789";
+    REQUIRE(vectordb::crc32c(check.data(), check.size()) == 0xE3069283u);
+    REQUIRE(vectordb::crc32c(check.data(), 0) == 0u);
+}
+
+TEST_CASE("CRC32C table fallback matches", "[crc32c]") {
+    std::vector<uint8_t> bytes(1000);
+    for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<uint8_t>(i * 31 + 7);
+
+    //every length, so the 8 byte loop and the byte tail of the SSE4.2 version both get covered
+    for (size_t size = 0; size <= 64; ++size) {
+        const uint32_t scalar = ~vectordb::detail::crc32c_scalar(~0u, bytes.data(), size);
+        REQUIRE(vectordb::crc32c(bytes.data(), size) == scalar);
+    }
+    const std::string check = "123456789";
+    REQUIRE(~vectordb::detail::crc32c_scalar(~0u, reinterpret_cast<const uint8_t*>(check.data()), check.size()) == 0xE3069283u);
+}
+
+TEST_CASE("CRC32C over pieces", "[crc32c]") {
+    const std::string a = "write ahead ";
+    const std::string b = "log entry";
+    const std::string ab = a + b;
+    REQUIRE(vectordb::crc32c(b.data(), b.size(), vectordb::crc32c(a.data(), a.size())) ==
+            vectordb::crc32c(ab.data(), ab.size()));
+}
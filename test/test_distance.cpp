@@ -0,0 +1,159 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/Distance.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace vectordb;
+
+//dims around every SIMD width and unroll step (8, 16, 32, 64), none of the odd ones divide evenly
+static const std::vector<size_t> DIMS = {1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 47, 63, 64, 65, 100, 127, 129, 784};
+
+static std::vector<float> randomVector(std::mt19937& rng, size_t dim) {
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> vec(dim);
+    for (auto& x : vec) x = dist(rng);
+    return vec;
+}
+
+//every level this host can run, scalar first
+static std::vector<SimdLevel> availableLevels() {
+    std::vector<SimdLevel> levels{SimdLevel::Scalar};
+    const auto& f = cpu_features();
+    if (f.avx2 && f.fma) levels.push_back(SimdLevel::AVX2);
+    if (f.avx512f) levels.push_back(SimdLevel::AVX512);
+    return levels;
+}
+
+//plain double precision reference
+static double refDot(const float* a, const float* b, size_t dim) {
+    double s = 0.0;
+    for (size_t i = 0; i < dim; ++i) s += static_cast<double>(a[i]) * b[i];
+    return s;
+}
+
+static double refL2sq(const float* a, const float* b, size_t dim) {
+    double s = 0.0;
+    for (size_t i = 0; i < dim; ++i) {
+        double d = static_cast<double>(a[i]) - b[i];
+        s += d * d;
+    }
+    return s;
+}
+
+//float sums of dim terms in [-1, 1]: the error grows with dim
+static double tolerance(size_t dim) {
+    return 1e-5 * static_cast<double>(dim) + 1e-6;
+}
+
+TEST_CASE("Every SIMD level matches the scalar reference", "[distance]") {
+    std::mt19937 rng(42);
+    for (SimdLevel level : availableLevels()) {
+        const DistanceKernels kernels = select_distance_kernels(level);
+        REQUIRE(kernels.level == level);
+        for (size_t dim : DIMS) {
+            INFO("level " << to_string(level) << ", dim " << dim);
+            const auto a = randomVector(rng, dim);
+            const auto b = randomVector(rng, dim);
+
+            REQUIRE(std::abs(kernels.dot(a.data(), b.data(), dim) - refDot(a.data(), b.data(), dim)) <= tolerance(dim));
+            REQUIRE(std::abs(kernels.l2sq(a.data(), b.data(), dim) - refL2sq(a.data(), b.data(), dim)) <= tolerance(dim));
+
+            const CosineParts parts = kernels.cosine_parts(a.data(), b.data(), dim);
+            REQUIRE(std::abs(parts.dot - refDot(a.data(), b.data(), dim)) <= tolerance(dim));
+            REQUIRE(std::abs(parts.norm_a_sq - refDot(a.data(), a.data(), dim)) <= tolerance(dim));
+            REQUIRE(std::abs(parts.norm_b_sq - refDot(b.data(), b.data(), dim)) <= tolerance(dim));
+        }
+    }
+}
+
+TEST_CASE("Every SIMD level computes the 4x2 dot tile", "[distance]") {
+    std::mt19937 rng(7);
+    for (SimdLevel level : availableLevels()) {
+        const DistanceKernels kernels = select_distance_kernels(level);
+        for (size_t dim : DIMS) {
+            INFO("level " << to_string(level) << ", dim " << dim);
+            const auto q = randomVector(rng, 4 * dim);
+            const auto b = randomVector(rng, 2 * dim);
+            //written into a wider matrix, ldo = 5, the cells around the tile stay as they were
+            std::vector<float> out(4 * 5, -100.0f);
+            kernels.dot_tile_4x2(q.data(), b.data(), dim, out.data(), 5);
+            for (size_t qi = 0; qi < 4; ++qi) {
+                for (size_t bj = 0; bj < 2; ++bj) {
+                    const double expected = refDot(q.data() + qi * dim, b.data() + bj * dim, dim);
+                    REQUIRE(std::abs(out[qi * 5 + bj] - expected) <= tolerance(dim));
+                }
+                for (size_t bj = 2; bj < 5; ++bj) REQUIRE(out[qi * 5 + bj] == -100.0f);
+            }
+        }
+    }
+}
+
+TEST_CASE("Every SIMD level gives zero distance for identical vectors", "[distance]") {
+    std::mt19937 rng(3);
+    for (SimdLevel level : availableLevels()) {
+        const DistanceKernels kernels = select_distance_kernels(level);
+        for (size_t dim : DIMS) {
+            const auto a = randomVector(rng, dim);
+            REQUIRE(kernels.l2sq(a.data(), a.data(), dim) == 0.0f);
+        }
+    }
+}
+
+TEST_CASE("compute_distance_matrix matches compute_distance", "[distance]") {
+    std::mt19937 rng(11);
+    //nq not a multiple of 4, nb odd and past one DISTANCE_BLOCK_ROWS block
+    const size_t nq = 7;
+    const size_t nb = DISTANCE_BLOCK_ROWS + 45;
+    const bool cached = GENERATE(false, true);
+
+    for (DistanceMetric metric : {DistanceMetric::L2, DistanceMetric::DOT, DistanceMetric::COSINE}) {
+        for (size_t dim : {size_t{3}, size_t{17}, size_t{100}, size_t{129}}) {
+            INFO("metric " << static_cast<int>(metric) << ", dim " << dim << ", cached norms " << cached);
+            const auto queries = randomVector(rng, nq * dim);
+            const auto base = randomVector(rng, nb * dim);
+
+            std::vector<float> query_norms(nq), base_norms(nb);
+            for (size_t i = 0; i < nq; ++i) query_norms[i] = norm(queries.data() + i * dim, dim);
+            for (size_t j = 0; j < nb; ++j) base_norms[j] = norm(base.data() + j * dim, dim);
+
+            std::vector<float> out(nq * nb);
+            compute_distance_matrix(metric, queries.data(), nq, base.data(), nb, dim, out.data(),
+                                    cached ? base_norms.data() : nullptr,
+                                    cached ? query_norms.data() : nullptr);
+
+            for (size_t qi = 0; qi < nq; ++qi) {
+                for (size_t bj = 0; bj < nb; ++bj) {
+                    const float* q = queries.data() + qi * dim;
+                    const float* b = base.data() + bj * dim;
+                    const float expected = compute_distance(metric, q, b, dim);
+                    //L2 goes through ||q||^2 + ||b||^2 - 2 q.b, which loses precision to cancellation
+                    const double scale = metric == DistanceMetric::L2
+                        ? query_norms[qi] * query_norms[qi] + base_norms[bj] * base_norms[bj]
+                        : 1.0;
+                    REQUIRE(std::abs(out[qi * nb + bj] - expected) <= tolerance(dim) * scale + 1e-5);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("compute_distance_matrix of a vector with itself", "[distance]") {
+    std::mt19937 rng(5);
+    const size_t dim = 33;
+    const auto vectors = randomVector(rng, 5 * dim);
+    std::vector<float> out(25);
+
+    compute_distance_matrix(DistanceMetric::L2, vectors.data(), 5, vectors.data(), 5, dim, out.data());
+    for (size_t i = 0; i < 5; ++i) {
+        REQUIRE(out[i * 5 + i] >= 0.0f); //clamped, never slightly negative
+        REQUIRE(out[i * 5 + i] < 1e-4f);
+    }
+
+    compute_distance_matrix(DistanceMetric::COSINE, vectors.data(), 5, vectors.data(), 5, dim, out.data());
+    for (size_t i = 0; i < 5; ++i) {
+        REQUIRE(std::abs(out[i * 5 + i] - 1.0f) < 1e-5f);
+    }
+}
@@ -0,0 +1,63 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/IdTracker.h"
+
+using vectordb::IdTracker;
+
+TEST_CASE("IdTracker gives every row its own offset", "[idtracker]") {
+    IdTracker tracker;
+    tracker.init({"default"}, 4);
+
+    //an id upserted twice into one segment has two rows, the offsets have to stay in step with FAISS
+    REQUIRE(tracker.insert("default", "a") == 0);
+    REQUIRE(tracker.insert("default", "b") == 1);
+    REQUIRE(tracker.insert("default", "a") == 2);
+    REQUIRE(tracker.insert("default", "c") == 3);
+    REQUIRE(tracker.size("default") == 4);
+
+    REQUIRE(tracker.getExternalId("default", 2) == "a");
+    REQUIRE(tracker.getExternalId("default", 3) == "c");
+    REQUIRE(tracker.getInternalId("default", "a") == 2u); //the newest row
+}
+
+TEST_CASE("IdTracker removes by offset", "[idtracker]") {
+    IdTracker tracker;
+    tracker.init({"default"}, 3);
+    tracker.insert("default", "a");
+    tracker.insert("default", "b");
+    tracker.insert("default", "a");
+
+    SECTION("The stale row goes, the live copy stays") {
+        REQUIRE(tracker.remove("default", 0));
+        REQUIRE_FALSE(tracker.getExternalId("default", 0));
+        REQUIRE(tracker.getExternalId("default", 2) == "a");
+        REQUIRE(tracker.getInternalId("default", "a") == 2u);
+        REQUIRE(tracker.size("default") == 2);
+        REQUIRE_FALSE(tracker.bitmap("default").get(0));
+        REQUIRE(tracker.bitmap("default").get(2));
+    }
+
+    SECTION("Removing twice or out of range is a no-op") {
+        REQUIRE(tracker.remove("default", 1));
+        REQUIRE_FALSE(tracker.remove("default", 1));
+        REQUIRE_FALSE(tracker.remove("default", 7));
+        REQUIRE_FALSE(tracker.remove("other", 0));
+        REQUIRE(tracker.size("default") == 2);
+        REQUIRE_FALSE(tracker.getInternalId("default", "b"));
+    }
+
+    SECTION("A removed offset is never handed out again") {
+        REQUIRE(tracker.remove("default", 1));
+        REQUIRE(tracker.insert("default", "d") == 3);
+        REQUIRE(tracker.getExternalId("default", 3) == "d");
+        REQUIRE_FALSE(tracker.getExternalId("default", 1));
+    }
+
+    SECTION("Both rows gone, the id is gone") {
+        REQUIRE(tracker.remove("default", 0));
+        REQUIRE(tracker.remove("default", 2));
+        REQUIRE_FALSE(tracker.getInternalId("default", "a"));
+        REQUIRE(tracker.iterExternalIds("default") == std::vector<vectordb::PointIdType>{"b"});
+        REQUIRE(tracker.iterInternalIds("default") == std::vector<vectordb::PointOffSetType>{1});
+    }
+}
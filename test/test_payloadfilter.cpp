@@ -0,0 +1,428 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/FilterPlanner.h"
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace vectordb;
+
+//------------------------------- brute force reference -------------------------------
+//Straight off the filter json, nothing shared with PayloadFilter.
+
+static const json* bruteLookup(const json& payload, const std::string& key) {
+    const json* node = &payload;
+    size_t begin = 0;
+    for (;;) {
+        const size_t dot = key.find('.', begin);
+        const std::string part = key.substr(begin, dot == std::string::npos ? std::string::npos : dot - begin);
+        if (!node->is_object() || !node->contains(part)) return nullptr;
+        node = &(*node)[part];
+        if (dot == std::string::npos) return node;
+        begin = dot + 1;
+    }
+}
+
+static bool bruteValue(const json& cond, const json& value) {
+    if (cond.contains("range")) {
+        if (!value.is_number()) return false;
+        const double v = value.get<double>();
+        const auto& r = cond["range"];
+        if (r.contains("gt") && !(v > r["gt"].get<double>())) return false;
+        if (r.contains("gte") && !(v >= r["gte"].get<double>())) return false;
+        if (r.contains("lt") && !(v < r["lt"].get<double>())) return false;
+        if (r.contains("lte") && !(v <= r["lte"].get<double>())) return false;
+        return true;
+    }
+    const auto& m = cond["match"];
+    if (m.contains("value")) return value == m["value"];
+    for (const auto& candidate : m["any"]) {
+        if (value == candidate) return true;
+    }
+    return false;
+}
+
+static bool bruteCondition(const json& cond, const json& payload) {
+    const json* value = bruteLookup(payload, cond["key"].get<std::string>());
+    if (!value) return false;
+    if (!value->is_array()) return bruteValue(cond, *value);
+    for (const auto& element : *value) {
+        if (bruteValue(cond, element)) return true;
+    }
+    return false;
+}
+
+static bool bruteFilter(const json& filter, const json& payload) {
+    auto holds = [&](const json& entry) {
+        return entry.contains("key") ? bruteCondition(entry, payload) : bruteFilter(entry, payload);
+    };
+    if (filter.contains("must")) {
+        for (const auto& entry : filter["must"]) {
+            if (!holds(entry)) return false;
+        }
+    }
+    if (filter.contains("should") && !filter["should"].empty()) {
+        bool any = false;
+        for (const auto& entry : filter["should"]) any = any || holds(entry);
+        if (!any) return false;
+    }
+    if (filter.contains("must_not")) {
+        for (const auto& entry : filter["must_not"]) {
+            if (holds(entry)) return false;
+        }
+    }
+    return true;
+}
+
+//------------------------------- random payloads and filters -------------------------------
+
+static const std::vector<std::string> TENANTS = {"acme", "globex", "initech", "umbrella"};
+static const std::vector<std::string> TAGS = {"new", "sale", "hot", "old"};
+static const std::vector<std::string> LANGS = {"en", "de", "fr"};
+
+static PayloadIndexSchema testSchema() {
+    return {
+        {"tenant", PayloadFieldType::Keyword},
+        {"tags", PayloadFieldType::Keyword},
+        {"price", PayloadFieldType::Numeric},
+        {"meta.lang", PayloadFieldType::Keyword},
+        {"meta.score", PayloadFieldType::Numeric},
+        {"active", PayloadFieldType::Bool},
+    }; //"note" stays unindexed
+}
+
+template <typename T>
+static const T& pick(std::mt19937& rng, const std::vector<T>& from) {
+    return from[std::uniform_int_distribution<size_t>(0, from.size() - 1)(rng)];
+}
+
+static bool chance(std::mt19937& rng, double p) {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng) < p;
+}
+
+static int randomInt(std::mt19937& rng, int lo, int hi) {
+    return std::uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+static Payload randomPayload(std::mt19937& rng) {
+    Payload p = json::object();
+    if (!chance(rng, 0.1)) p["tenant"] = pick(rng, TENANTS);
+    if (chance(rng, 0.1)) {
+        p["tags"] = pick(rng, TAGS); //a plain value, not an array
+    } else if (!chance(rng, 0.1)) {
+        p["tags"] = json::array();
+        for (int n = randomInt(rng, 0, 3); n > 0; --n) p["tags"].push_back(pick(rng, TAGS));
+    }
+    if (chance(rng, 0.05)) {
+        p["price"] = "n/a";
+    } else if (!chance(rng, 0.1)) {
+        //whole numbers mostly, so range bounds land exactly on stored values
+        p["price"] = chance(rng, 0.8) ? json(randomInt(rng, 0, 50)) : json(randomInt(rng, 0, 50) + 0.5);
+    }
+    if (chance(rng, 0.05)) {
+        p["meta"] = "not an object";
+    } else if (!chance(rng, 0.1)) {
+        p["meta"] = {{"lang", pick(rng, LANGS)}, {"score", randomInt(rng, 0, 10)}};
+    }
+    p["active"] = chance(rng, 0.5);
+    p["note"] = chance(rng, 0.5) ? "a" : "b";
+    return p;
+}
+
+static json randomCondition(std::mt19937& rng) {
+    auto keywordMatch = [&](const std::string& key, std::vector<std::string> pool) {
+        pool.push_back("missing"); //a value no point has
+        if (chance(rng, 0.5)) return json{{"key", key}, {"match", {{"value", pick(rng, pool)}}}};
+        json any = json::array();
+        for (int n = randomInt(rng, 1, 3); n > 0; --n) any.push_back(pick(rng, pool));
+        return json{{"key", key}, {"match", {{"any", any}}}};
+    };
+    auto numeric = [&](const std::string& key, int max) {
+        if (chance(rng, 0.2)) return json{{"key", key}, {"match", {{"value", randomInt(rng, 0, max)}}}};
+        json range = json::object();
+        while (range.empty()) {
+            for (const char* bound : {"gt", "gte", "lt", "lte"}) {
+                if (chance(rng, 0.35)) range[bound] = randomInt(rng, -1, max + 1);
+            }
+        }
+        return json{{"key", key}, {"range", range}};
+    };
+
+    switch (randomInt(rng, 0, 7)) {
+        case 0: return keywordMatch("tenant", TENANTS);
+        case 1: return keywordMatch("tags", TAGS);
+        case 2: return numeric("price", 50);
+        case 3: return keywordMatch("meta.lang", LANGS);
+        case 4: return numeric("meta.score", 10);
+        case 5: return json{{"key", "active"}, {"match", {{"value", chance(rng, 0.5)}}}};
+        case 6: return json{{"key", "note"}, {"match", {{"value", chance(rng, 0.5) ? "a" : "b"}}}};
+        default: return json{{"key", "nope.nothing"}, {"match", {{"value", "x"}}}};
+    }
+}
+
+static json randomFilter(std::mt19937& rng, int depth) {
+    json filter = json::object();
+    //a nested {} reads as a condition without a key, so nested filters get at least one clause
+    const int forced = depth > 0 ? randomInt(rng, 0, 2) : -1;
+    int index = 0;
+    for (const char* clause : {"must", "should", "must_not"}) {
+        if (index++ != forced && !chance(rng, 0.6)) continue;
+        filter[clause] = json::array();
+        for (int n = randomInt(rng, 1, 3); n > 0; --n) {
+            filter[clause].push_back(depth < 3 && chance(rng, 0.25) ? randomFilter(rng, depth + 1) : randomCondition(rng));
+        }
+    }
+    return filter;
+}
+
+static PayloadFilter parseOk(const json& filter) {
+    auto parsed = PayloadFilter::parse(filter);
+    INFO(filter.dump());
+    REQUIRE(parsed.ok());
+    return parsed.value();
+}
+
+static FilterMatrix buildMatrix(const std::vector<Payload>& payloads, const PayloadIndexSchema& schema) {
+    std::vector<Payload> projected;
+    projected.reserve(payloads.size());
+    for (const auto& p : payloads) projected.push_back(projectIndexedFields(p, schema));
+    FilterMatrix matrix;
+    matrix.build(projected, schema);
+    return matrix;
+}
+
+//------------------------------- PayloadFilter -------------------------------
+
+TEST_CASE("Filter dotted keys reach into nested objects", "[payload_filter]") {
+    const Payload p = {{"meta", {{"lang", "en"}, {"source", {{"kind", "web"}}}}}, {"flat", "x"}};
+
+    REQUIRE(parseOk({{"must", {{{"key", "meta.lang"}, {"match", {{"value", "en"}}}}}}}).matches(p));
+    REQUIRE(parseOk({{"must", {{{"key", "meta.source.kind"}, {"match", {{"value", "web"}}}}}}}).matches(p));
+    REQUIRE_FALSE(parseOk({{"must", {{{"key", "meta.lang"}, {"match", {{"value", "de"}}}}}}}).matches(p));
+    //missing step, or a step that is not an object
+    REQUIRE_FALSE(parseOk({{"must", {{{"key", "meta.missing"}, {"match", {{"value", "en"}}}}}}}).matches(p));
+    REQUIRE_FALSE(parseOk({{"must", {{{"key", "flat.deeper"}, {"match", {{"value", "x"}}}}}}}).matches(p));
+    //a missing key doesn't match under must_not either, so must_not of it passes
+    REQUIRE(parseOk({{"must_not", {{{"key", "meta.missing"}, {"match", {{"value", "en"}}}}}}}).matches(p));
+}
+
+TEST_CASE("Filter match on an array holds if any element matches", "[payload_filter]") {
+    const Payload p = {{"tags", {"a", "b"}}, {"scores", {1, 7, 20}}};
+
+    REQUIRE(parseOk({{"must", {{{"key", "tags"}, {"match", {{"value", "a"}}}}}}}).matches(p));
+    REQUIRE(parseOk({{"must", {{{"key", "tags"}, {"match", {{"any", {"z", "b"}}}}}}}}).matches(p));
+    REQUIRE_FALSE(parseOk({{"must", {{{"key", "tags"}, {"match", {{"any", {"y", "z"}}}}}}}}).matches(p));
+    REQUIRE(parseOk({{"must", {{{"key", "scores"}, {"range", {{"gt", 5}, {"lt", 10}}}}}}}).matches(p));
+    REQUIRE_FALSE(parseOk({{"must", {{{"key", "scores"}, {"range", {{"gt", 7}, {"lt", 20}}}}}}}).matches(p));
+}
+
+TEST_CASE("Filter range bounds", "[payload_filter]") {
+    auto priceIn = [](const json& range, const json& price) {
+        return parseOk({{"must", {{{"key", "price"}, {"range", range}}}}}).matches(Payload{{"price", price}});
+    };
+
+    REQUIRE(priceIn({{"gte", 10}}, 10));
+    REQUIRE_FALSE(priceIn({{"gt", 10}}, 10));
+    REQUIRE(priceIn({{"gt", 10}}, 10.5));
+    REQUIRE(priceIn({{"lte", 20}}, 20));
+    REQUIRE_FALSE(priceIn({{"lt", 20}}, 20));
+    REQUIRE(priceIn({{"gte", 10}, {"lt", 20}}, 19.99));
+    REQUIRE_FALSE(priceIn({{"gt", 20}, {"lt", 10}}, 15)); //empty range
+    REQUIRE(priceIn({{"gte", -1.5}}, -1));
+    REQUIRE_FALSE(priceIn({{"gte", 0}}, "10")); //strings never fall in a range
+}
+
+TEST_CASE("Filter must, should and must_not nest", "[payload_filter]") {
+    //tenant = acme AND (tags has new OR price < 10) AND NOT status = deleted
+    const json tree = {
+        {"must", {{{"key", "tenant"}, {"match", {{"value", "acme"}}}},
+                  {{"should", {{{"key", "tags"}, {"match", {{"value", "new"}}}},
+                               {{"key", "price"}, {"range", {{"lt", 10}}}}}}}}},
+        {"must_not", {{{"key", "status"}, {"match", {{"value", "deleted"}}}}}},
+    };
+    const PayloadFilter filter = parseOk(tree);
+
+    REQUIRE(filter.matches({{"tenant", "acme"}, {"tags", {"new"}}, {"price", 50}}));
+    REQUIRE(filter.matches({{"tenant", "acme"}, {"price", 5}}));
+    REQUIRE_FALSE(filter.matches({{"tenant", "acme"}, {"price", 50}}));
+    REQUIRE_FALSE(filter.matches({{"tenant", "globex"}, {"price", 5}}));
+    REQUIRE_FALSE(filter.matches({{"tenant", "acme"}, {"price", 5}, {"status", "deleted"}}));
+
+    //an empty should doesn't restrict, an empty filter passes everything
+    REQUIRE(parseOk({{"should", json::array()}}).matches({{"x", 1}}));
+    REQUIRE(parseOk(json::object()).empty());
+}
+
+TEST_CASE("Filter parse errors", "[payload_filter]") {
+    REQUIRE_FALSE(PayloadFilter::parse(json::array()).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"filter", json::array()}}).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{"key", "a"}}}}).ok()); //not an array of conditions
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{{"key", ""}, {"match", {{"value", 1}}}}}}}).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{{"key", "a"}}}}}).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{{"key", "a"}, {"match", {{"value", 1}}}, {"range", {{"gt", 1}}}}}}}).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{{"key", "a"}, {"range", {{"gt", "1"}}}}}}}).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{{"key", "a"}, {"range", {{"between", 1}}}}}}}).ok());
+    REQUIRE_FALSE(PayloadFilter::parse({{"must", {{{"key", "a"}, {"match", {{"value", {1, 2}}}}}}}}).ok());
+
+    json deep = {{"must", {{{"key", "a"}, {"match", {{"value", 1}}}}}}};
+    for (size_t i = 0; i < PayloadFilter::MAX_DEPTH; ++i) deep = {{"must", {deep}}};
+    REQUIRE_FALSE(PayloadFilter::parse(deep).ok());
+}
+
+TEST_CASE("Filter matches the brute force evaluation", "[payload_filter]") {
+    std::mt19937 rng(1234);
+    const PayloadIndexSchema schema = testSchema();
+    std::vector<Payload> payloads;
+    for (int i = 0; i < 300; ++i) payloads.push_back(randomPayload(rng));
+    const FilterMatrix matrix = buildMatrix(payloads, schema);
+
+    size_t covered = 0, inexact = 0;
+    for (int round = 0; round < 400; ++round) {
+        const json tree = randomFilter(rng, 0);
+        INFO(tree.dump());
+        const PayloadFilter filter = parseOk(tree);
+        const bool is_covered = filter.coveredBy(schema);
+        covered += is_covered;
+
+        std::set<size_t> expected;
+        for (size_t slot = 0; slot < payloads.size(); ++slot) {
+            const bool truth = bruteFilter(tree, payloads[slot]);
+            if (truth) expected.insert(slot);
+            REQUIRE(filter.matches(payloads[slot]) == truth);
+            if (is_covered) {
+                REQUIRE(filter.matchesProjected(projectIndexedFields(payloads[slot], schema)) == truth);
+            }
+        }
+
+        //exact: the same ids, otherwise a superset the fallback narrows down
+        const FilterPlan plan = FilterPlanner(matrix, payloads.size()).plan(filter);
+        REQUIRE(plan.bitmap.size() == payloads.size());
+        REQUIRE(plan.matches == plan.bitmap.count());
+        REQUIRE(plan.selectivity == Catch::Approx(static_cast<double>(plan.matches) / payloads.size()));
+        const auto ids = plan.bitmap.to_ids();
+        const std::set<size_t> planned(ids.begin(), ids.end());
+        if (plan.exact) {
+            REQUIRE(planned == expected);
+        } else {
+            ++inexact;
+            for (size_t slot : expected) REQUIRE(planned.count(slot) == 1);
+        }
+        if (is_covered) REQUIRE(plan.exact);
+    }
+    //the generator hit both sides
+    REQUIRE(covered > 50);
+    REQUIRE(inexact > 20);
+}
+
+//------------------------------- FilterPlanner -------------------------------
+
+//100 slots: tenant acme on 0..89, globex on 90..99, price = slot
+struct PlannerFixture {
+    std::vector<Payload> payloads;
+    FilterMatrix matrix;
+    PlannerFixture() {
+        for (int slot = 0; slot < 100; ++slot) {
+            payloads.push_back({{"tenant", slot < 90 ? "acme" : "globex"}, {"price", slot}, {"note", "x"}});
+        }
+        matrix = buildMatrix(payloads, {{"tenant", PayloadFieldType::Keyword}, {"price", PayloadFieldType::Numeric}});
+    }
+    FilterPlan plan(const json& tree) const {
+        return FilterPlanner(matrix, payloads.size()).plan(parseOk(tree));
+    }
+    size_t estimate(const json& tree) const {
+        return FilterPlanner(matrix, payloads.size()).estimate(parseOk(tree));
+    }
+};
+
+static json tenantIs(const std::string& tenant) {
+    return {{"key", "tenant"}, {"match", {{"value", tenant}}}};
+}
+
+static json tenantAny(const std::vector<std::string>& tenants) {
+    return {{"key", "tenant"}, {"match", {{"any", tenants}}}};
+}
+
+TEST_CASE("FilterPlanner estimates from the matrix counts", "[filter_planner]") {
+    PlannerFixture f;
+    REQUIRE(f.estimate({{"must", {tenantIs("acme")}}}) == 90);
+    REQUIRE(f.estimate({{"must", {tenantIs("acme"), tenantIs("globex")}}}) == 10);
+    REQUIRE(f.estimate({{"should", {tenantIs("acme"), tenantIs("globex")}}}) == 100);
+    REQUIRE(f.estimate({{"must_not", {tenantIs("globex")}}}) == 90);
+    REQUIRE(f.estimate({{"must", {{{"key", "price"}, {"range", {{"gte", 10}, {"lt", 30}}}}}}}) == 20);
+    REQUIRE(f.estimate({{"must", {tenantIs("nobody")}}}) == 0);
+    //unindexed counts as everything
+    REQUIRE(f.estimate({{"must", {{{"key", "note"}, {"match", {{"value", "x"}}}}}}}) == 100);
+}
+
+TEST_CASE("FilterPlanner runs the most selective must clause first and stops once empty", "[filter_planner]") {
+    PlannerFixture f;
+    //written biggest first, the empty one is evaluated first and the rest is skipped
+    FilterPlan plan = f.plan({{"must", {tenantIs("acme"), tenantAny({"acme", "globex"}), tenantIs("nobody")}}});
+    REQUIRE(plan.matches == 0);
+    REQUIRE(plan.conditions_evaluated == 1);
+
+    //disjoint: the second clause empties it, the third is never looked at
+    plan = f.plan({{"must", {tenantAny({"acme", "globex"}), tenantIs("acme"), tenantIs("globex")}}});
+    REQUIRE(plan.matches == 0);
+    REQUIRE(plan.conditions_evaluated == 2);
+
+    //an empty must skips should and must_not too
+    plan = f.plan({{"must", {tenantIs("nobody")}},
+                   {"should", {tenantIs("acme")}},
+                   {"must_not", {tenantIs("globex")}}});
+    REQUIRE(plan.conditions_evaluated == 1);
+
+    plan = f.plan({{"must", {tenantIs("acme"), {{"key", "price"}, {"range", {{"gte", 85}}}}}}});
+    REQUIRE(plan.matches == 5);
+    REQUIRE(plan.exact);
+    REQUIRE(plan.conditions_evaluated == 2);
+}
+
+TEST_CASE("FilterPlanner should takes the biggest clause first and stops once full", "[filter_planner]") {
+    PlannerFixture f;
+    FilterPlan plan = f.plan({{"should", {tenantIs("globex"), tenantIs("nobody"), tenantAny({"acme", "globex"})}}});
+    REQUIRE(plan.matches == 100);
+    REQUIRE(plan.conditions_evaluated == 1);
+
+    plan = f.plan({{"should", {tenantIs("globex"), {{"key", "price"}, {"range", {{"lt", 5}}}}}}});
+    REQUIRE(plan.matches == 15);
+    REQUIRE(plan.conditions_evaluated == 2);
+}
+
+TEST_CASE("FilterPlanner must_not takes the biggest clause first", "[filter_planner]") {
+    PlannerFixture f;
+    FilterPlan plan = f.plan({{"must_not", {tenantIs("globex"), tenantAny({"acme", "globex"})}}});
+    REQUIRE(plan.matches == 0);
+    REQUIRE(plan.conditions_evaluated == 1);
+
+    plan = f.plan({{"must_not", {tenantIs("globex"), {{"key", "price"}, {"range", {{"lt", 50}}}}}}});
+    REQUIRE(plan.matches == 40);
+    REQUIRE(plan.exact);
+}
+
+TEST_CASE("FilterPlanner leaves unindexed conditions to the fallback", "[filter_planner]") {
+    PlannerFixture f;
+    const json unindexed = {{"key", "note"}, {"match", {{"value", "y"}}}};
+
+    //under must: a superset, the indexed part still narrows it
+    FilterPlan plan = f.plan({{"must", {tenantIs("globex"), unindexed}}});
+    REQUIRE_FALSE(plan.exact);
+    REQUIRE(plan.matches == 10);
+
+    //under must_not it can't be subtracted, nothing is taken away
+    plan = f.plan({{"must", {tenantIs("globex")}}, {"must_not", {unindexed}}});
+    REQUIRE_FALSE(plan.exact);
+    REQUIRE(plan.matches == 10);
+
+    //a superset of nothing is nothing
+    plan = f.plan({{"must", {tenantIs("nobody"), unindexed}}});
+    REQUIRE(plan.exact);
+    REQUIRE(plan.matches == 0);
+
+    //nothing indexed at all: everything, inexact
+    plan = f.plan({{"must", {unindexed}}});
+    REQUIRE_FALSE(plan.exact);
+    REQUIRE(plan.matches == 100);
+}
@@ -0,0 +1,176 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/SegmentHolder.h"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using namespace vectordb;
+
+//fresh working directory per test case (the holder writes to ./vectordb), gone afterwards
+struct TempCwd {
+    fs::path path;
+    fs::path previous;
+    TempCwd() {
+        static int counter = 0;
+        previous = fs::current_path();
+        path = fs::temp_directory_path() / ("vectordb_segment_test_" + std::to_string(::getpid()) + "_" + std::to_string(counter++));
+        fs::remove_all(path);
+        fs::create_directories(path);
+        fs::current_path(path);
+    }
+    ~TempCwd() {
+        fs::current_path(previous);
+        std::error_code ec;
+        fs::remove_all(path, ec);
+    }
+};
+
+static CollectionInfo diskCollection() {
+    CollectionInfo info;
+    info.name = "c";
+    info.on_disk = true;
+    info.vec_specs["default"] = VectorSpec{4, DistanceMetric::L2};
+    info.index_specs.index_threshold = 10;
+    info.index_specs.compaction_fanout = 0;
+    info.wal.durability = WalDurability::PerRequest;
+    info.wal.file_size_mb = 1;
+    info.storage.mmap = false;
+    return info;
+}
+
+static void insertPoints(SegmentHolder& holder, const std::string& prefix, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        DenseVector vec{1.0f, 2.0f, 3.0f, static_cast<float>(i)};
+        REQUIRE(holder.insertPoint(prefix + std::to_string(i), vec).ok);
+    }
+}
+
+//segment id of the active segment, from its WAL file name (segment_<id>.wal)
+static SegmentIdType activeSegmentId(const SegmentHolder& holder) {
+    return holder.getActiveWal()->getFilePath().stem().string().substr(std::string("segment_").size());
+}
+
+//what a replay of the WAL directory would apply: the last entry per id, files with a flush marker skipped
+static std::map<PointIdType, WalEntryType> replayWalDir() {
+    std::vector<WalRecord> records;
+    for (const auto& file : fs::directory_iterator("./vectordb/c/wal")) {
+        if (WAL::hasFlushMarker(file.path())) continue;
+        auto contents = WAL::readFile(file.path());
+        REQUIRE(contents.ok());
+        for (auto& record : contents.value().records) records.push_back(std::move(record));
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const WalRecord& a, const WalRecord& b) { return a.version < b.version; });
+    std::map<PointIdType, WalEntryType> last;
+    for (const auto& record : records) last[record.point_id] = record.type;
+    return last;
+}
+
+TEST_CASE("A point upserted twice before the seal stays searchable", "[segment_holder]") {
+    TempCwd cwd;
+    CollectionInfo info = diskCollection();
+    info.on_disk = false;
+    SegmentHolder holder(100, info);
+
+    //both copies land in the same active segment, the first one gets tombstoned by slot
+    DenseVector old_vec{0.0f, 0.0f, 0.0f, 100.0f};
+    DenseVector new_vec{0.0f, 0.0f, 0.0f, 200.0f};
+    REQUIRE(holder.insertPoint("p1", old_vec).ok);
+    REQUIRE(holder.insertPoint("p1", new_vec).ok);
+    std::vector<DenseVector> vectors;
+    for (size_t i = 2; i < 10; ++i) {
+        vectors.push_back(DenseVector{0.0f, 0.0f, 0.0f, static_cast<float>(i)});
+        REQUIRE(holder.insertPoint("p" + std::to_string(i), vectors.back()).ok);
+    }
+    holder.waitForBackgroundWork();
+    REQUIRE(holder.getImmutableSegmentCount() == 1);
+    REQUIRE(holder.getSealedSegmentCount() == 0);
+    REQUIRE(holder.getLivePointCount() == 9);
+
+    SearchParams exact;
+    exact.exact = true;
+    auto result = holder.searchTopK("default", {new_vec}, 1, exact);
+    REQUIRE(result.status.ok);
+    REQUIRE(result.results[0].hits.size() == 1);
+    REQUIRE(result.results[0].hits[0].id == "p1");
+    REQUIRE(result.results[0].hits[0].score == 0.0f);
+
+    //the stale copy is gone, and every row after the duplicate still maps to its own id
+    result = holder.searchTopK("default", {old_vec}, 1, exact);
+    REQUIRE(result.results[0].hits[0].id == "p9"); //91 away, the new copy of p1 is 100 away
+    for (size_t i = 2; i < 10; ++i) {
+        result = holder.searchTopK("default", {vectors[i - 2]}, 1, exact);
+        REQUIRE(result.results[0].hits[0].id == "p" + std::to_string(i));
+    }
+
+    result = holder.searchTopK("default", {new_vec}, 20, exact);
+    REQUIRE(result.results[0].hits.size() == 9);
+}
+
+TEST_CASE("A WAL with deletes waits for the segment they tombstoned", "[segment_holder]") {
+    TempCwd cwd;
+    const CollectionInfo info = diskCollection();
+    SegmentHolder holder(100, info);
+
+    //the first segment can't be written: a plain file sits where its directory goes
+    const SegmentIdType first = activeSegmentId(holder);
+    fs::create_directories("./vectordb/c/segments");
+    std::ofstream("./vectordb/c/segments/" + first) << "in the way";
+
+    insertPoints(holder, "p", 10); //seals and builds it, served from memory only
+    holder.waitForBackgroundWork();
+    REQUIRE(holder.getImmutableSegmentCount() == 1);
+
+    //the delete is logged to the second segment's WAL, the second segment gets written fine
+    const SegmentIdType second = activeSegmentId(holder);
+    auto removed = holder.deletePoints({"p3"});
+    REQUIRE(removed.ok());
+    REQUIRE(removed.value() == 1);
+    insertPoints(holder, "q", 10);
+    holder.waitForBackgroundWork();
+    REQUIRE(fs::is_directory("./vectordb/c/segments/" + second));
+
+    //a crash now replays the first segment's WAL: without the delete the point would be back
+    const fs::path second_wal = "./vectordb/c/wal/segment_" + second + ".wal";
+    REQUIRE(fs::exists(second_wal));
+    REQUIRE_FALSE(WAL::hasFlushMarker(second_wal));
+    auto replay = replayWalDir();
+    REQUIRE(replay.at("p3") == WalEntryType::DELETE_POINT);
+    REQUIRE(replay.at("p4") == WalEntryType::INSERT_VECTOR);
+}
+
+TEST_CASE("Deletes and upserts on written segments survive a reload", "[segment_holder]") {
+    TempCwd cwd;
+    const CollectionInfo info = diskCollection();
+    {
+        SegmentHolder holder(100, info);
+        const SegmentIdType first = activeSegmentId(holder);
+        insertPoints(holder, "p", 10);
+        holder.waitForBackgroundWork();
+
+        const SegmentIdType second = activeSegmentId(holder);
+        REQUIRE(holder.deletePoints({"p3"}).value() == 1);
+        DenseVector moved{9.0f, 9.0f, 9.0f, 9.0f};
+        REQUIRE(holder.insertPoint("p5", moved).ok); //tombstones the first copy
+        insertPoints(holder, "q", 9);
+        holder.waitForBackgroundWork();
+
+        //both segments are on disk with their tombstones, their WALs went away
+        REQUIRE_FALSE(fs::exists("./vectordb/c/wal/segment_" + first + ".wal"));
+        REQUIRE_FALSE(fs::exists("./vectordb/c/wal/segment_" + second + ".wal"));
+        REQUIRE(fs::exists(holder.getActiveWal()->getFilePath()));
+    }
+
+    SegmentHolder reloaded(100, info);
+    auto loaded = reloaded.loadSegments();
+    REQUIRE(loaded.ok());
+    REQUIRE(loaded.value() == 18);
+    REQUIRE_FALSE(reloaded.getPointVersion("p3"));
+    REQUIRE(reloaded.getPointVersion("p4"));
+    REQUIRE(reloaded.getPointVersion("p5"));
+    REQUIRE(reloaded.getLivePointCount() == 18);
+}
@@ -0,0 +1,199 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/TaskExecutor.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace vectordb;
+using namespace std::chrono_literals;
+
+TEST_CASE("ThreadPool submit returns results", "[threadpool]") {
+    ThreadPool pool(4, "test");
+    REQUIRE(pool.size() == 4);
+    REQUIRE(pool.name() == "test");
+    REQUIRE_FALSE(pool.isWorkerThread());
+
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 100; ++i) {
+        futures.push_back(pool.submit([i] { return i * i; }));
+    }
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(futures[i].get() == i * i);
+    }
+
+    //move only callables and results
+    auto owned = std::make_unique<int>(7);
+    auto fut = pool.submit([p = std::move(owned)]() mutable { return std::move(p); });
+    REQUIRE(*fut.get() == 7);
+
+    REQUIRE(pool.submit([&pool] { return pool.isWorkerThread(); }).get());
+}
+
+TEST_CASE("ThreadPool submit carries exceptions", "[threadpool]") {
+    ThreadPool pool(2);
+    auto fut = pool.submit([]() -> int { throw std::runtime_error("boom"); });
+    REQUIRE_THROWS_AS(fut.get(), std::runtime_error);
+
+    //the worker survived it
+    REQUIRE(pool.submit([] { return 1; }).get() == 1);
+}
+
+TEST_CASE("ThreadPool zero threads still gets one worker", "[threadpool]") {
+    ThreadPool pool(0);
+    REQUIRE(pool.size() == 1);
+    REQUIRE(pool.submit([] { return 3; }).get() == 3);
+}
+
+TEST_CASE("ThreadPool idle workers steal from a busy one", "[threadpool]") {
+    ThreadPool pool(4);
+    constexpr int TASKS = 64;
+    std::atomic<int> done{0};
+    std::mutex ids_mutex;
+    std::set<std::thread::id> ids;
+
+    //posted from inside a worker, all of them go to that worker's own deque. It then blocks until
+    //they are done, so they only ever finish if the other workers steal them.
+    auto owner = pool.submit([&] {
+        for (int i = 0; i < TASKS; ++i) {
+            pool.post([&] {
+                {
+                    std::lock_guard<std::mutex> lock(ids_mutex);
+                    ids.insert(std::this_thread::get_id());
+                }
+                std::this_thread::sleep_for(1ms);
+                ++done;
+            });
+        }
+        const auto deadline = std::chrono::steady_clock::now() + 10s;
+        while (done.load() < TASKS && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(1ms);
+        }
+        return std::this_thread::get_id();
+    });
+
+    const std::thread::id owner_id = owner.get();
+    REQUIRE(done.load() == TASKS);
+    REQUIRE(ids.count(owner_id) == 0);
+    REQUIRE(ids.size() >= 2); //spread over more than one thief
+}
+
+TEST_CASE("ThreadPool pending counts queued tasks", "[threadpool]") {
+    ThreadPool pool(1);
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::promise<void> started;
+
+    pool.post([&] {
+        started.set_value();
+        opened.wait();
+    });
+    started.get_future().wait(); //the worker holds it, nothing else can run
+    std::vector<std::future<void>> queued;
+    for (int i = 0; i < 5; ++i) queued.push_back(pool.submit([] {}));
+    REQUIRE(pool.pending() == 5);
+
+    //(not one more submit() to wait on: the worker pops its deque from the back, that would run first)
+    gate.set_value();
+    for (auto& f : queued) f.get();
+    REQUIRE(pool.pending() == 0);
+}
+
+TEST_CASE("ThreadPool destructor drains pending tasks", "[threadpool]") {
+    std::atomic<int> ran{0};
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 2; ++i) {
+            pool.post([] { std::this_thread::sleep_for(20ms); });
+        }
+        for (int i = 0; i < 200; ++i) {
+            pool.post([&ran] { ++ran; });
+        }
+        //posted by a task while the pool is already shutting down, still runs
+        pool.post([&pool, &ran] {
+            std::this_thread::sleep_for(20ms);
+            pool.post([&ran] { ++ran; });
+        });
+    }
+    REQUIRE(ran.load() == 201);
+}
+
+//TaskExecutor is a process-wide singleton, configured once for every test case below
+static TaskExecutor& executor() {
+    static TaskExecutor& instance = [] () -> TaskExecutor& {
+        ExecutorConfig config;
+        config.query_threads = 2;
+        config.index_threads = 1;
+        config.io_threads = 1;
+        REQUIRE(TaskExecutor::configure(config));
+        return TaskExecutor::getInstance();
+    }();
+    return instance;
+}
+
+TEST_CASE("TaskExecutor uses the configured lane sizes", "[executor]") {
+    auto& exec = executor();
+    REQUIRE(exec.lane(TaskLane::Query).size() == 2);
+    REQUIRE(exec.lane(TaskLane::Index).size() == 1);
+    REQUIRE(exec.lane(TaskLane::IO).size() == 1);
+
+    //frozen after the first getInstance()
+    ExecutorConfig other;
+    other.query_threads = 8;
+    REQUIRE_FALSE(TaskExecutor::configure(other));
+    REQUIRE(exec.getConfig().query_threads == 2);
+
+    REQUIRE(exec.submit(TaskLane::IO, [] { return 5; }).get() == 5);
+}
+
+TEST_CASE("TaskExecutor lanes don't share threads", "[executor]") {
+    auto& exec = executor();
+    auto on_query = exec.submit(TaskLane::Query, [&exec] {
+        return std::vector<bool>{exec.lane(TaskLane::Query).isWorkerThread(),
+                                 exec.lane(TaskLane::Index).isWorkerThread(),
+                                 exec.lane(TaskLane::IO).isWorkerThread()};
+    });
+    REQUIRE(on_query.get() == std::vector<bool>{true, false, false});
+}
+
+TEST_CASE("TaskExecutor a busy lane doesn't hold up the others", "[executor]") {
+    auto& exec = executor();
+
+    //the one index thread is stuck in a "build", with more builds queued behind it
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::promise<void> started;
+    auto build = exec.submit(TaskLane::Index, [&] {
+        started.set_value();
+        opened.wait();
+        return 1;
+    });
+    started.get_future().wait();
+    std::vector<std::future<int>> queued_builds;
+    for (int i = 0; i < 10; ++i) {
+        queued_builds.push_back(exec.submit(TaskLane::Index, [] { return 1; }));
+    }
+
+    //queries and writes still go through
+    std::vector<std::future<int>> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(exec.submit(TaskLane::Query, [i] { return i; }));
+    }
+    for (int i = 0; i < 50; ++i) {
+        REQUIRE(queries[i].wait_for(5s) == std::future_status::ready);
+        REQUIRE(queries[i].get() == i);
+    }
+    auto write = exec.submit(TaskLane::IO, [] { return 2; });
+    REQUIRE(write.wait_for(5s) == std::future_status::ready);
+    REQUIRE(build.wait_for(0ms) == std::future_status::timeout);
+
+    gate.set_value();
+    REQUIRE(build.get() == 1);
+    for (auto& f : queued_builds) REQUIRE(f.get() == 1);
+}
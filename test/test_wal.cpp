@@ -0,0 +1,244 @@
+#define CATCH_CONFIG_MAIN
+#include "catch_amalgamated.hpp"
+#include "../src/WAL.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+using vectordb::WAL;
+using vectordb::WalEntryType;
+
+//fresh directory per test case, gone afterwards
+struct TempDir {
+    fs::path path;
+    TempDir() {
+        static int counter = 0;
+        path = fs::temp_directory_path() / ("vectordb_wal_test_" + std::to_string(::getpid()) + "_" + std::to_string(counter++));
+        fs::remove_all(path);
+        fs::create_directories(path);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+    }
+};
+
+static vectordb::StatusOr<uint64_t> logPoint(WAL& wal, const std::string& id, const vectordb::DenseVector& vec, uint64_t version) {
+    return wal.logInsert(id, {{"default", &vec}}, version);
+}
+
+static std::vector<vectordb::WalRecord> readAllFiles(const std::vector<fs::path>& files) {
+    std::vector<vectordb::WalRecord> records;
+    for (const auto& path : files) {
+        auto contents = WAL::readFile(path);
+        REQUIRE(contents.ok());
+        for (auto& record : contents.value().records) records.push_back(std::move(record));
+    }
+    return records;
+}
+
+TEST_CASE("WAL round trip", "[wal]") {
+    TempDir dir;
+    fs::path file;
+    {
+        WAL wal(dir.path, "seg1", vectordb::WalDurability::PerRequest);
+        REQUIRE(wal.open().ok);
+        vectordb::DenseVector a{1.0f, 2.0f, 3.0f};
+        vectordb::DenseVector b{4.0f, 5.0f, 6.0f};
+        vectordb::DenseVector c{7.0f, 8.0f};
+        REQUIRE(logPoint(wal, "p1", a, 1).ok());
+        REQUIRE(wal.logInsert("p2", {{"text", &b}, {"image", &c}}, 2).ok());
+        auto lsn = wal.logDelete("p1", 3);
+        REQUIRE(lsn.ok());
+        REQUIRE(wal.waitDurable(lsn.value()).ok);
+        file = wal.getFilePath();
+    }
+
+    auto contents = WAL::readFile(file);
+    REQUIRE(contents.ok());
+    const auto& found = contents.value();
+    REQUIRE(found.segment_id == "seg1");
+    REQUIRE_FALSE(found.flushed);
+    REQUIRE(found.truncated_bytes == 0);
+    REQUIRE(found.records.size() == 3);
+
+    REQUIRE(found.records[0].type == WalEntryType::INSERT_VECTOR);
+    REQUIRE(found.records[0].point_id == "p1");
+    REQUIRE(found.records[0].version == 1);
+    REQUIRE(found.records[0].vectors.size() == 1);
+    REQUIRE(found.records[0].vectors[0].first == "default");
+    REQUIRE(found.records[0].vectors[0].second == vectordb::DenseVector{1.0f, 2.0f, 3.0f});
+
+    REQUIRE(found.records[1].point_id == "p2");
+    REQUIRE(found.records[1].vectors.size() == 2);
+
+    REQUIRE(found.records[2].type == WalEntryType::DELETE_POINT);
+    REQUIRE(found.records[2].point_id == "p1");
+    REQUIRE(found.records[2].version == 3);
+}
+
+TEST_CASE("WAL recovery of a crashed file", "[wal]") {
+    TempDir dir;
+    const fs::path crashed = dir.path / "crashed.wal";
+    {
+        WAL wal(dir.path, "seg1", vectordb::WalDurability::PerRequest);
+        REQUIRE(wal.open().ok);
+        vectordb::DenseVector vec{1.0f, 2.0f, 3.0f, 4.0f};
+        for (uint64_t i = 1; i <= 5; ++i) {
+            REQUIRE(logPoint(wal, "p" + std::to_string(i), vec, i).ok());
+        }
+        REQUIRE(wal.sync().ok);
+        //a copy taken while it is still open is what a crash leaves: the entries, then the zeroed
+        //preallocated rest of the file
+        fs::copy_file(wal.getFilePath(), crashed);
+    }
+    const auto preallocated_size = fs::file_size(crashed);
+
+    SECTION("Zero-filled tail is preallocated space, not a torn write") {
+        auto contents = WAL::readFile(crashed);
+        REQUIRE(contents.ok());
+        REQUIRE(contents.value().records.size() == 5);
+        REQUIRE(contents.value().truncated_bytes == 0);
+        REQUIRE(fs::file_size(crashed) < preallocated_size); //the zeros are cut off
+    }
+
+    SECTION("Torn last entry is cut off") {
+        REQUIRE(WAL::readFile(crashed).ok()); //trims the zeros
+        const auto full_size = fs::file_size(crashed);
+        fs::resize_file(crashed, full_size - 3);
+
+        auto contents = WAL::readFile(crashed);
+        REQUIRE(contents.ok());
+        REQUIRE(contents.value().records.size() == 4);
+        REQUIRE(contents.value().truncated_bytes > 0);
+        REQUIRE(fs::file_size(crashed) == full_size - 3 - contents.value().truncated_bytes);
+
+        //clean now, a second read finds the same entries and nothing to cut
+        auto again = WAL::readFile(crashed);
+        REQUIRE(again.ok());
+        REQUIRE(again.value().records.size() == 4);
+        REQUIRE(again.value().truncated_bytes == 0);
+    }
+
+    SECTION("Garbage after the last entry is cut off") {
+        REQUIRE(WAL::readFile(crashed).ok());
+        {
+            std::ofstream out(crashed, std::ios::binary | std::ios::app);
+            out << "not a wal entry";
+        }
+        auto contents = WAL::readFile(crashed);
+        REQUIRE(contents.ok());
+        REQUIRE(contents.value().records.size() == 5);
+        REQUIRE(contents.value().truncated_bytes == std::string("not a wal entry").size());
+    }
+}
+
+TEST_CASE("WAL rotation", "[wal]") {
+    TempDir dir;
+    std::vector<fs::path> files;
+    const size_t file_size = size_t{1} << 16; //the smallest the WAL allows
+    {
+        WAL wal(dir.path, "seg1", vectordb::WalDurability::PerRequest, std::chrono::milliseconds{1}, file_size);
+        REQUIRE(wal.open().ok);
+
+        vectordb::DenseVector small(16, 0.5f);
+        vectordb::DenseVector big(3 * file_size / sizeof(float), 1.5f); //bigger than a whole file
+        REQUIRE(logPoint(wal, "a", small, 1).ok());
+        REQUIRE(logPoint(wal, "big", big, 2).ok());
+        auto lsn = logPoint(wal, "b", small, 3);
+        REQUIRE(lsn.ok());
+        REQUIRE(wal.waitDurable(lsn.value()).ok);
+        wal.close();
+        files = wal.getFilePaths();
+    }
+
+    REQUIRE(files.size() >= 2);
+    for (const auto& path : files) {
+        REQUIRE(fs::exists(path));
+    }
+
+    //an entry never spans two files, the big one got a file of its own size
+    auto records = readAllFiles(files);
+    REQUIRE(records.size() == 3);
+    REQUIRE(records[0].point_id == "a");
+    REQUIRE(records[1].point_id == "big");
+    REQUIRE(records[1].vectors[0].second.size() == 3 * file_size / sizeof(float));
+    REQUIRE(records[1].vectors[0].second.back() == 1.5f);
+    REQUIRE(records[2].point_id == "b");
+}
+
+TEST_CASE("WAL flush marker", "[wal]") {
+    TempDir dir;
+    WAL wal(dir.path, "seg1", vectordb::WalDurability::PerRequest, std::chrono::milliseconds{1}, size_t{1} << 16);
+    REQUIRE(wal.open().ok);
+    vectordb::DenseVector vec(4096, 0.25f); //16 KB a point, a few files' worth
+    for (uint64_t i = 1; i <= 10; ++i) {
+        REQUIRE(logPoint(wal, "p" + std::to_string(i), vec, i).ok());
+    }
+    REQUIRE(wal.sync().ok);
+    wal.close();
+
+    const auto files = wal.getFilePaths();
+    REQUIRE(files.size() >= 2);
+    for (const auto& path : files) {
+        REQUIRE_FALSE(WAL::hasFlushMarker(path));
+    }
+
+    REQUIRE(wal.logSegmentFlush().ok);
+    for (const auto& path : files) {
+        REQUIRE(WAL::hasFlushMarker(path));
+        auto contents = WAL::readFile(path);
+        REQUIRE(contents.ok());
+        REQUIRE(contents.value().flushed);
+    }
+    REQUIRE(readAllFiles(files).size() == 10);
+
+    SECTION("A torn marker doesn't count") {
+        fs::resize_file(files.back(), fs::file_size(files.back()) - 1);
+        REQUIRE_FALSE(WAL::hasFlushMarker(files.back()));
+    }
+
+    SECTION("Files go away once the marker is written") {
+        REQUIRE(wal.removeFiles().ok);
+        for (const auto& path : files) {
+            REQUIRE_FALSE(fs::exists(path));
+        }
+    }
+}
+
+TEST_CASE("WAL file without a header", "[wal]") {
+    TempDir dir;
+    const fs::path file = dir.path / "segment_never_committed.wal";
+
+    SECTION("Preallocated zeros only") {
+        {
+            std::ofstream out(file, std::ios::binary);
+            const std::string zeros(size_t{1} << 16, '\0');
+            out << zeros;
+        }
+        auto contents = WAL::readFile(file);
+        REQUIRE(contents.ok());
+        REQUIRE(contents.value().no_header);
+        REQUIRE(contents.value().records.empty());
+    }
+
+    SECTION("Shorter than a header") {
+        {
+            std::ofstream out(file, std::ios::binary);
+            out << "WAL";
+        }
+        auto contents = WAL::readFile(file);
+        REQUIRE(contents.ok());
+        REQUIRE(contents.value().no_header);
+    }
+
+    SECTION("A header that is not ours is still an error") {
+        {
+            std::ofstream out(file, std::ios::binary);
+            const std::string junk(size_t{1} << 10, 'x');
+            out << junk;
+        }
+        REQUIRE_FALSE(WAL::readFile(file).ok());
+    }
+}